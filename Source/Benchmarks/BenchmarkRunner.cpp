@@ -0,0 +1,106 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ BenchmarkRunner.cpp: This file contains the result collection & JSON output for Imogen's benchmarks.
+ 
+======================================================================================================================================================*/
+
+
+#include <iostream>
+
+#include "BenchmarkRunner.h"
+
+
+#ifndef IMOGEN_VERSION
+  #define IMOGEN_VERSION "unknown"
+#endif
+
+
+BenchmarkRunner::BenchmarkRunner (double minSecondsPerMeasurementToUse)
+    : minSecondsPerMeasurement (minSecondsPerMeasurementToUse)
+{
+    jassert (minSecondsPerMeasurement > 0.0);
+}
+
+
+bool BenchmarkRunner::shouldRun (const juce::String& benchmarkName) const
+{
+    return filter.isEmpty() || benchmarkName.containsIgnoreCase (filter);
+}
+
+
+void BenchmarkRunner::addDerivedResult (const juce::String& benchmarkName, const BenchmarkConfig& config, double nanosecondsPerBlock)
+{
+    addResult (benchmarkName, config, nanosecondsPerBlock, nanosecondsPerBlock, 0);
+}
+
+
+void BenchmarkRunner::addResult (const juce::String& benchmarkName, const BenchmarkConfig& config,
+                                 double nanosecondsPerBlock, double meanNanosecondsPerBlock, juce::int64 numBlocks)
+{
+    auto* result = new juce::DynamicObject();
+    
+    result->setProperty ("benchmark", benchmarkName);
+    
+    if (config.precision.isNotEmpty()) result->setProperty ("precision", config.precision);
+    if (config.input.isNotEmpty())     result->setProperty ("input", config.input);
+    if (config.numVoices > 0)          result->setProperty ("numVoices", config.numVoices);
+    if (config.blocksize > 0)          result->setProperty ("blocksize", config.blocksize);
+    if (config.samplerate > 0.0)       result->setProperty ("samplerate", config.samplerate);
+    
+    result->setProperty ("nanosecondsPerBlock", nanosecondsPerBlock);
+    result->setProperty ("meanNanosecondsPerBlock", meanNanosecondsPerBlock);
+    
+    if (numBlocks > 0)
+        result->setProperty ("numBlocksTimed", numBlocks);
+    
+    // how many times faster than real time one block is processed
+    if (config.blocksize > 0 && config.samplerate > 0.0 && nanosecondsPerBlock > 0.0)
+        result->setProperty ("realtimeFactor", (config.blocksize / config.samplerate) * 1.0e9 / nanosecondsPerBlock);
+    
+    results.add (juce::var (result));
+    
+    std::cerr << benchmarkName << " [" << config.precision << ", " << config.input
+              << ", voices " << config.numVoices << ", block " << config.blocksize << ", " << config.samplerate << " Hz]: "
+              << juce::String (nanosecondsPerBlock / 1000.0, 2) << " us/block" << std::endl;
+}
+
+
+juce::String BenchmarkRunner::toJSON() const
+{
+    auto* system = new juce::DynamicObject();
+    system->setProperty ("cpu", juce::SystemStats::getCpuModel());
+    system->setProperty ("numCpus", juce::SystemStats::getNumCpus());
+    system->setProperty ("cpuSpeedMHz", juce::SystemStats::getCpuSpeedInMegahertz());
+    system->setProperty ("operatingSystem", juce::SystemStats::getOperatingSystemName());
+    
+    auto* root = new juce::DynamicObject();
+    root->setProperty ("formatVersion", 1);
+    root->setProperty ("imogenVersion", IMOGEN_VERSION);
+   #if JUCE_DEBUG
+    root->setProperty ("buildType", "debug");
+   #else
+    root->setProperty ("buildType", "release");
+   #endif
+    root->setProperty ("date", juce::Time::getCurrentTime().toISO8601 (true));
+    root->setProperty ("system", juce::var (system));
+    root->setProperty ("results", results);
+    
+    return juce::JSON::toString (juce::var (root));
+}
@@ -0,0 +1,120 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ BenchmarkRunner.h: This file defines the BenchmarkRunner class, which times Imogen's hot paths and collects the results as JSON.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+#include "bv_ImogenEngine/bv_ImogenEngine.h"
+
+
+// the settings one measurement was taken with. Settings that don't apply to a benchmark are left at 0, and aren't written to its result.
+struct BenchmarkConfig
+{
+    juce::String precision;  // "float", "double" or "mixed"
+    juce::String input;      // "pitched" or "unpitched"
+    int numVoices = 0;
+    int blocksize = 0;
+    double samplerate = 0.0;
+};
+
+
+/*
+    BenchmarkRunner : times repeated calls to a function that renders one block, and collects a result for every measurement.
+    Each measurement runs batches of blocks, doubling the batch size until a batch is long enough for the timer's resolution not to matter, for at least the minimum measuring time. The fastest batch gives the time per block, which is the figure least disturbed by the rest of the system, and the mean is recorded alongside it.
+*/
+
+class BenchmarkRunner
+{
+public:
+    explicit BenchmarkRunner (double minSecondsPerMeasurementToUse);
+    
+    // only benchmarks whose names contain this text are run. An empty filter runs everything.
+    void setFilter (const juce::String& newFilter) { filter = newFilter; }
+    bool shouldRun (const juce::String& benchmarkName) const;
+    
+    // calls renderBlock repeatedly, records the result, and returns the fastest time per block in nanoseconds
+    template<typename BlockRenderer>
+    double measure (const juce::String& benchmarkName, const BenchmarkConfig& config, BlockRenderer&& renderBlock);
+    
+    // records a result that was worked out from other measurements, rather than timed directly
+    void addDerivedResult (const juce::String& benchmarkName, const BenchmarkConfig& config, double nanosecondsPerBlock);
+    
+    int getNumResults() const noexcept { return results.size(); }
+    
+    // every result so far, along with the build & the machine they were measured on
+    juce::String toJSON() const;
+    
+    
+private:
+    void addResult (const juce::String& benchmarkName, const BenchmarkConfig& config,
+                    double nanosecondsPerBlock, double meanNanosecondsPerBlock, juce::int64 numBlocks);
+    
+    const double minSecondsPerMeasurement;
+    
+    juce::String filter;
+    
+    juce::Array<juce::var> results;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BenchmarkRunner)
+};
+
+
+// enough blocks for the caches, the window tables & the voices' grain queues to settle before timing starts
+#define bvi_WARMUP_BLOCKS 16
+
+template<typename BlockRenderer>
+double BenchmarkRunner::measure (const juce::String& benchmarkName, const BenchmarkConfig& config, BlockRenderer&& renderBlock)
+{
+    for (int i = 0; i < bvi_WARMUP_BLOCKS; ++i)
+        renderBlock();
+    
+    const auto minTicks = juce::Time::secondsToHighResolutionTicks (minSecondsPerMeasurement);
+    
+    juce::int64 totalTicks = 0, numBlocks = 0;
+    double fastest = std::numeric_limits<double>::max();
+    int batchSize = 1;
+    
+    while (totalTicks < minTicks)
+    {
+        const auto start = juce::Time::getHighResolutionTicks();
+        
+        for (int i = 0; i < batchSize; ++i)
+            renderBlock();
+        
+        const auto elapsed = juce::Time::getHighResolutionTicks() - start;
+        
+        totalTicks += elapsed;
+        numBlocks  += batchSize;
+        
+        fastest = std::min (fastest, juce::Time::highResolutionTicksToSeconds (elapsed) * 1.0e9 / batchSize);
+        
+        if (elapsed < minTicks / 20)
+            batchSize *= 2;
+    }
+    
+    addResult (benchmarkName, config, fastest, juce::Time::highResolutionTicksToSeconds (totalTicks) * 1.0e9 / double (numBlocks), numBlocks);
+    
+    return fastest;
+}
+
+#undef bvi_WARMUP_BLOCKS
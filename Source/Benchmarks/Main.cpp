@@ -0,0 +1,822 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ Main.cpp: This file contains the entry point for ImogenBenchmarks, which sweeps the harmonizer's & the engine's hot paths over their settings, compares optimised code paths with the ones they replaced, and writes the timings as JSON.
+ 
+======================================================================================================================================================*/
+
+
+#include <iostream>
+
+#include "BenchmarkRunner.h"
+
+
+// the settings held while another one is swept
+#define bvi_DEFAULT_NUM_VOICES 12
+#define bvi_DEFAULT_BLOCKSIZE 512
+#define bvi_DEFAULT_SAMPLERATE 44100.0
+
+// the pitch of the pitched input, and the detection range around it -- the same range as the harmonizer's unit tests
+#define bvi_PITCHED_INPUT_HZ 330.0
+#define bvi_MIN_DETECTION_HZ 200
+#define bvi_MAX_DETECTION_HZ 2400
+
+// stands in for the arbitrary period that the harmonizer imposes on unpitched input
+#define bvi_UNPITCHED_PERIOD 128
+
+
+static const int    voiceCounts[] = { 1, 2, 4, 8, 12, 16, 20 };
+static const int    blocksizes[]  = { 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+static const double samplerates[] = { 44100.0, 48000.0, 88200.0, 96000.0, 192000.0 };
+
+
+// sweeps each of the requested settings in turn, holding the others at their defaults
+static juce::Array<BenchmarkConfig> makeSweep (bool sweepVoices, bool sweepBlocksizes, bool sweepSamplerates)
+{
+    BenchmarkConfig defaults;
+    defaults.numVoices  = sweepVoices ? bvi_DEFAULT_NUM_VOICES : 0;
+    defaults.blocksize  = bvi_DEFAULT_BLOCKSIZE;
+    defaults.samplerate = bvi_DEFAULT_SAMPLERATE;
+    
+    juce::Array<BenchmarkConfig> sweep;
+    sweep.add (defaults);
+    
+    auto addVariation = [&sweep, &defaults] (auto&& change)
+    {
+        auto config = defaults;
+        change (config);
+        
+        if (config.numVoices != defaults.numVoices || config.blocksize != defaults.blocksize || config.samplerate != defaults.samplerate)
+            sweep.add (config);
+    };
+    
+    if (sweepVoices)
+        for (auto numVoices : voiceCounts)
+            addVariation ([numVoices] (BenchmarkConfig& config) { config.numVoices = numVoices; });
+    
+    if (sweepBlocksizes)
+        for (auto blocksize : blocksizes)
+            addVariation ([blocksize] (BenchmarkConfig& config) { config.blocksize = blocksize; });
+    
+    if (sweepSamplerates)
+        for (auto samplerate : samplerates)
+            addVariation ([samplerate] (BenchmarkConfig& config) { config.samplerate = samplerate; });
+    
+    return sweep;
+}
+
+
+/*===========================================================================================================================
+ ============================================================================================================================*/
+
+/*
+    Synthetic input: a harmonically rich waveform roughly like a sung vowel, at bvi_PITCHED_INPUT_HZ unless another pitch is given, or white noise.
+    The benchmarks loop through a couple of seconds of it block by block, so that the pitch detection & grain analysis see a continuous signal.
+*/
+
+template<typename SampleType>
+class InputLoop
+{
+public:
+    InputLoop (bool pitched, double samplerate, int numChannels, double frequency = bvi_PITCHED_INPUT_HZ)
+        : source (numChannels, juce::roundToInt (samplerate * 2.0))
+    {
+        juce::Random rand (pitched ? 1 : 2);
+        
+        const auto phaseIncrement = juce::MathConstants<double>::twoPi * frequency / samplerate;
+        
+        for (int s = 0; s < source.getNumSamples(); ++s)
+        {
+            const auto phase = phaseIncrement * s;
+            
+            const auto sample = pitched ? 0.6 * std::sin (phase) + 0.3 * std::sin (2.0 * phase + 0.4) + 0.15 * std::sin (3.0 * phase + 1.1)
+                                        + 0.05 * (rand.nextDouble() - 0.5)
+                                        : 0.5 * (rand.nextDouble() * 2.0 - 1.0);
+            
+            for (int chan = 0; chan < numChannels; ++chan)
+                source.setSample (chan, s, SampleType (sample));
+        }
+    }
+    
+    // the start of the next numSamples contiguous samples of the input
+    int advance (int numSamples)
+    {
+        jassert (numSamples <= source.getNumSamples());
+        
+        if (position + numSamples > source.getNumSamples())
+            position = 0;
+        
+        const auto start = position;
+        position += numSamples;
+        return start;
+    }
+    
+    juce::AudioBuffer<SampleType> source;
+    
+private:
+    int position = 0;
+};
+
+
+static juce::Array<int> makeChord (int numVoices)
+{
+    juce::Array<int> chord;
+    
+    for (int v = 0; v < numVoices; ++v)
+        chord.add (48 + v * 2);
+    
+    return chord;
+}
+
+
+template<typename SampleType>
+static const char* precisionName() { return std::is_same<SampleType, float>::value ? "float" : "double"; }
+
+
+/*===========================================================================================================================
+ ============================================================================================================================*/
+
+/*
+    Harmonizer::render, first with no notes sounding -- which leaves the pitch detection & the storage of each block's analysis grains -- and then with a chord on every voice.
+    HarmonizerVoice::renderPlease is private, so each voice's share is worked out from the difference between the two.
+*/
+template<typename SampleType>
+static void benchmarkHarmonizer (BenchmarkRunner& runner, BenchmarkConfig config, bool pitchedInput)
+{
+    config.precision = precisionName<SampleType>();
+    config.input = pitchedInput ? "pitched" : "unpitched";
+    
+    bav::Harmonizer<SampleType> harmonizer;
+    harmonizer.initialize (config.numVoices, config.samplerate, config.blocksize);
+    harmonizer.updatePitchDetectionHzRange (bvi_MIN_DETECTION_HZ, bvi_MAX_DETECTION_HZ);
+    
+    // the pitch detector's analysis frame doesn't fit into the smallest blocks, so those are tracked incrementally, the way the engine runs at short latencies
+    if (harmonizer.getLatencySamples() > config.blocksize)
+        harmonizer.setUseIncrementalPitchTracking (true, config.blocksize, std::min (64, config.blocksize));
+    
+    harmonizer.prepare (config.blocksize);
+    
+    InputLoop<SampleType> input (pitchedInput, config.samplerate, 1);
+    juce::AudioBuffer<SampleType> output (2, config.blocksize);
+    juce::MidiBuffer midi;
+    
+    auto renderBlock = [&]
+    {
+        juce::AudioBuffer<SampleType> block (input.source.getArrayOfWritePointers(), 1, input.advance (config.blocksize), config.blocksize);
+        midi.clear();
+        harmonizer.render (block, output, midi);
+    };
+    
+    const auto analysisOnly = runner.measure ("Harmonizer::render, no voices sounding", config, renderBlock);
+    
+    harmonizer.playChord (makeChord (config.numVoices), 1.0f, false);
+    
+    const auto withVoices = runner.measure ("Harmonizer::render", config, renderBlock);
+    
+    runner.addDerivedResult ("HarmonizerVoice::renderPlease, per voice", config, std::max (0.0, withVoices - analysisOnly) / config.numVoices);
+}
+
+
+static int getInputPeriod (bool pitchedInput, double samplerate)
+{
+    return pitchedInput ? juce::roundToInt (samplerate / bvi_PITCHED_INPUT_HZ) : bvi_UNPITCHED_PERIOD;
+}
+
+
+template<typename SampleType>
+static void benchmarkGrainExtractor (BenchmarkRunner& runner, BenchmarkConfig config, bool pitchedInput)
+{
+    config.precision = precisionName<SampleType>();
+    config.input = pitchedInput ? "pitched" : "unpitched";
+    
+    const auto period = getInputPeriod (pitchedInput, config.samplerate);
+    
+    if (config.blocksize < period * 2)
+        return;  // a block has to hold at least one whole grain
+    
+    bav::GrainExtractor<SampleType> extractor;
+    extractor.prepare (config.blocksize);
+    
+    InputLoop<SampleType> input (pitchedInput, config.samplerate, 1);
+    juce::Array<int> onsets;
+    onsets.ensureStorageAllocated (config.blocksize);
+    
+    runner.measure ("GrainExtractor::getGrainOnsetIndices", config, [&]
+                    {
+                        juce::AudioBuffer<SampleType> block (input.source.getArrayOfWritePointers(), 1, input.advance (config.blocksize), config.blocksize);
+                        extractor.getGrainOnsetIndices (onsets, block, period);
+                    });
+}
+
+
+// stores a block's worth of grains over the input, one per period like the harmonizer's analysis -- windowing each one once into a store -- and reads each one back the way a voice does
+template<typename SampleType>
+static void benchmarkAnalysisGrains (BenchmarkRunner& runner, BenchmarkConfig config, bool pitchedInput)
+{
+    config.precision = precisionName<SampleType>();
+    config.input = pitchedInput ? "pitched" : "unpitched";
+    
+    const auto period = getInputPeriod (pitchedInput, config.samplerate);
+    const auto grainSize = period * 2;
+    const auto numGrains = std::max (1, config.blocksize / period);
+    
+    juce::HeapBlock<SampleType> window (grainSize);
+    
+    for (int s = 0; s < grainSize; ++s)
+        window[s] = SampleType (0.5 - 0.5 * std::cos (juce::MathConstants<double>::twoPi * s / (grainSize - 1)));
+    
+    juce::OwnedArray<bav::AnalysisGrain<SampleType>> grains;
+    
+    for (int g = 0; g < numGrains; ++g)
+        grains.add (new bav::AnalysisGrain<SampleType>());
+    
+    InputLoop<SampleType> input (pitchedInput, config.samplerate, 1);
+    juce::HeapBlock<SampleType> store (numGrains * grainSize);
+    juce::HeapBlock<SampleType> output (numGrains * period + grainSize, true);
+    juce::int64 position = 0;
+    
+    runner.measure ("AnalysisGrain::storeNewGrain", config, [&]
+                    {
+                        const auto* samples = input.source.getReadPointer (0, input.advance (numGrains * period + grainSize));
+                        
+                        for (int g = 0; g < numGrains; ++g)
+                        {
+                            auto* grain = grains.getUnchecked (g);
+                            auto* windowed = store.get() + g * grainSize;
+                            
+                            juce::FloatVectorOperations::multiply (windowed, samples + g * period, window.get(), grainSize);
+                            grain->storeNewGrain (windowed, position + g * period, g * grainSize, grainSize);
+                            grain->addSamplesTo (output.get() + g * period, 0, grainSize);
+                        }
+                        
+                        position += numGrains * period;
+                    });
+}
+
+
+// sets the engine up the way the plugin runs it, with a chord on every voice. With effectsOn false, every optional effect is switched off, leaving the gain & mix stages around the harmonizer
+template<typename SampleType, typename HarmonySampleType>
+static void prepareEngine (bav::ImogenEngine<SampleType, HarmonySampleType>& engine, const BenchmarkConfig& config, bool effectsOn)
+{
+    engine.initialize (config.samplerate, config.blocksize);
+    engine.updatePitchDetectionHzRange (bvi_MIN_DETECTION_HZ, bvi_MAX_DETECTION_HZ);
+    engine.prepare (config.samplerate);
+    
+    engine.updateNumVoices (config.numVoices);
+    engine.updateBypassStates (false, false);
+    engine.updateInputGain (1.0f);
+    engine.updateOutputGain (1.0f);
+    engine.updateDryVoxPan (64);
+    engine.updateDryWet (50);
+    engine.updateNoiseGate (-40.0f, effectsOn);
+    engine.updateDeEsser (0.5f, -20.0f, effectsOn);
+    engine.updateCompressor (-20.0f, 2.0f, effectsOn);
+    engine.updateReverb (35, 0.6f, 0.3f, 80.0f, 5500.0f, effectsOn);
+    engine.updateLimiter (effectsOn);
+    engine.playChord (makeChord (config.numVoices), 1.0f, false);
+}
+
+
+// the full engine, in whichever precision. The host blocksize is swept; the engine's internal blocksize follows from the pitch detection range, as it does in the plugin
+template<typename SampleType, typename HarmonySampleType>
+static void benchmarkEngine (BenchmarkRunner& runner, BenchmarkConfig config, bool pitchedInput)
+{
+    constexpr bool isMixed = ! std::is_same<SampleType, HarmonySampleType>::value;
+    
+    config.precision = isMixed ? "mixed" : precisionName<SampleType>();
+    config.input = pitchedInput ? "pitched" : "unpitched";
+    
+    bav::ImogenEngine<SampleType, HarmonySampleType> engine;
+    prepareEngine (engine, config, true);
+    
+    InputLoop<SampleType> input (pitchedInput, config.samplerate, 2);
+    juce::AudioBuffer<SampleType> output (2, config.blocksize);
+    juce::MidiBuffer midi;
+    
+    runner.measure ("ImogenEngine::process", config, [&]
+                    {
+                        juce::AudioBuffer<SampleType> block (input.source.getArrayOfWritePointers(), 2, input.advance (config.blocksize), config.blocksize);
+                        midi.clear();
+                        engine.process (block, output, midi, false);
+                    });
+}
+
+
+/*===========================================================================================================================
+ ============================================================================================================================*/
+
+/*
+    Comparisons: each of these times two or more ways of doing the same job, at the default settings, so that an optimisation can be checked against what it replaced.
+    They run once, in float, with the pitched input.
+*/
+
+static BenchmarkConfig makeComparisonConfig (int numVoices = 0, int blocksize = bvi_DEFAULT_BLOCKSIZE, double samplerate = bvi_DEFAULT_SAMPLERATE)
+{
+    BenchmarkConfig config;
+    config.precision  = "float";
+    config.input      = "pitched";
+    config.numVoices  = numVoices;
+    config.blocksize  = blocksize;
+    config.samplerate = samplerate;
+    return config;
+}
+
+
+// the single-pass PSOLA peak search against the iterative one it replaced, over a range of input periods
+static void comparePeakSearches (BenchmarkRunner& runner)
+{
+    const auto config = makeComparisonConfig (0, 4096);
+    
+    bav::GrainExtractor<float> singlePass, iterative;
+    singlePass.prepare (config.blocksize);
+    iterative.prepare (config.blocksize);
+    iterative.setUseSinglePassPeakSearch (false);
+    
+    juce::Array<int> onsets;
+    onsets.ensureStorageAllocated (config.blocksize);
+    
+    for (int period : { 100, 300, 600, 1000 })
+    {
+        InputLoop<float> input (true, config.samplerate, 1, config.samplerate / period);
+        
+        for (auto* extractor : { &iterative, &singlePass })
+        {
+            const juce::String name (extractor == &singlePass ? "GrainExtractor peak search, single pass, period " : "GrainExtractor peak search, iterative, period ");
+            
+            runner.measure (name + juce::String (period), config, [&]
+                            {
+                                juce::AudioBuffer<float> block (input.source.getArrayOfWritePointers(), 1, input.advance (config.blocksize), config.blocksize);
+                                extractor->getGrainOnsetIndices (onsets, block, period);
+                            });
+        }
+    }
+}
+
+
+// the harmonizer's voices rendered in parallel on the shared render pool, for each voice count
+static void compareMultithreadedHarmonizer (BenchmarkRunner& runner)
+{
+    for (auto config : makeSweep (true, false, false))
+    {
+        config.precision = "float";
+        config.input = "pitched";
+        
+        bav::Harmonizer<float> harmonizer;
+        harmonizer.setUseMultithreadedRendering (true);
+        harmonizer.initialize (config.numVoices, config.samplerate, config.blocksize);
+        harmonizer.updatePitchDetectionHzRange (bvi_MIN_DETECTION_HZ, bvi_MAX_DETECTION_HZ);
+        harmonizer.prepare (config.blocksize);
+        harmonizer.playChord (makeChord (config.numVoices), 1.0f, false);
+        
+        InputLoop<float> input (true, config.samplerate, 1);
+        juce::AudioBuffer<float> output (2, config.blocksize);
+        juce::MidiBuffer midi;
+        
+        runner.measure ("Harmonizer::render, multithreaded", config, [&]
+                        {
+                            juce::AudioBuffer<float> block (input.source.getArrayOfWritePointers(), 1, input.advance (config.blocksize), config.blocksize);
+                            midi.clear();
+                            harmonizer.render (block, output, midi);
+                        });
+    }
+}
+
+
+// the MIDI note ranges of the processor's soprano, alto, tenor & bass vocal range presets
+static const std::pair<int, int> vocalRangeNotes[] = { { 57, 88 }, { 50, 81 }, { 43, 76 }, { 36, 67 } };
+
+
+// the FFT-based YIN detector against the time domain one, for each vocal range; then with & without decimation at high samplerates; then the sliding tracker, by blocksize
+static void comparePitchDetectors (BenchmarkRunner& runner)
+{
+    for (const auto& range : vocalRangeNotes)
+    {
+        const auto config = makeComparisonConfig();
+        
+        const auto minHz = juce::roundToInt (bav::math::midiToFreq (range.first));
+        const auto maxHz = juce::roundToInt (bav::math::midiToFreq (range.second));
+        
+        bav::FFTPitchDetector<float> fftDetector;
+        fftDetector.setHzRange (minHz, maxHz);
+        fftDetector.setSamplerate (config.samplerate);
+        
+        bav::dsp::PitchDetector<float> timeDomainDetector;
+        timeDomainDetector.initialize();
+        timeDomainDetector.setHzRange (minHz, maxHz);
+        timeDomainDetector.setSamplerate (config.samplerate);
+        
+        const auto frameSize = std::max (fftDetector.getLatencySamples(), timeDomainDetector.getLatencySamples());
+        
+        InputLoop<float> input (true, config.samplerate, 1, bav::math::midiToFreq ((range.first + range.second) / 2));
+        juce::AudioBuffer<float> frame (input.source.getArrayOfWritePointers(), 1, 0, frameSize);
+        
+        const auto rangeName = ", notes " + juce::String (range.first) + "-" + juce::String (range.second);
+        
+        runner.measure ("PitchDetector::detectPitch, time domain YIN" + rangeName, config, [&] { timeDomainDetector.detectPitch (frame); });
+        runner.measure ("FFTPitchDetector::detectPitch" + rangeName, config, [&] { fftDetector.detectPitch (frame); });
+    }
+    
+    for (double samplerate : { 96000.0, 192000.0 })
+    {
+        const auto config = makeComparisonConfig (0, bvi_DEFAULT_BLOCKSIZE, samplerate);
+        
+        bav::FFTPitchDetector<float> decimated, fullRate;
+        fullRate.setAllowDecimation (false);
+        
+        for (auto* detector : { &decimated, &fullRate })
+        {
+            detector->setHzRange (bvi_MIN_DETECTION_HZ, bvi_MAX_DETECTION_HZ);
+            detector->setSamplerate (samplerate);
+        }
+        
+        InputLoop<float> input (true, samplerate, 1);
+        juce::AudioBuffer<float> frame (input.source.getArrayOfWritePointers(), 1, 0, std::max (decimated.getLatencySamples(), fullRate.getLatencySamples()));
+        
+        runner.measure ("FFTPitchDetector::detectPitch, full rate", config, [&] { fullRate.detectPitch (frame); });
+        runner.measure ("FFTPitchDetector::detectPitch, decimated by " + juce::String (decimated.getDecimationFactor()), config, [&] { decimated.detectPitch (frame); });
+    }
+    
+    for (int blocksize : { 64, 256, 1104 })
+    {
+        const auto config = makeComparisonConfig (0, blocksize);
+        
+        bav::SlidingPitchTracker<float> tracker;
+        tracker.setHzRange (bvi_MIN_DETECTION_HZ, bvi_MAX_DETECTION_HZ);
+        tracker.setSamplerate (config.samplerate);
+        
+        InputLoop<float> input (true, config.samplerate, 1);
+        
+        juce::Array<bav::SlidingPitchTracker<float>::Estimate> estimates;
+        estimates.ensureStorageAllocated (blocksize / tracker.getHopSize() + 1);
+        
+        runner.measure ("SlidingPitchTracker::process", config, [&]
+                        {
+                            tracker.process (input.source.getReadPointer (0, input.advance (blocksize)), blocksize, estimates);
+                        });
+    }
+}
+
+
+// an offline bounce at a large host blocksize, with the output gain automated along a fade: updated once per block, against sample-accurate events at a few minimum sub-block lengths
+static void compareAutomation (BenchmarkRunner& runner)
+{
+    constexpr int hostBlocksize = 4096;
+    constexpr int eventSpacing = 16;
+    
+    const auto config = makeComparisonConfig (bvi_DEFAULT_NUM_VOICES, hostBlocksize);
+    
+    auto fadeGain = [] (int s) { return 1.0f - 0.5f * float(s) / float(hostBlocksize); };
+    
+    InputLoop<float> input (true, config.samplerate, 2);
+    juce::AudioBuffer<float> output (2, hostBlocksize);
+    juce::MidiBuffer midi;
+    
+    auto nextBlock = [&] { return juce::AudioBuffer<float> (input.source.getArrayOfWritePointers(), 2, input.advance (hostBlocksize), hostBlocksize); };
+    
+    {
+        bav::ImogenEngine<float> engine;
+        prepareEngine (engine, makeComparisonConfig (bvi_DEFAULT_NUM_VOICES), false);
+        
+        bool fadeStart = true;
+        
+        runner.measure ("ImogenEngine::process, block-quantized automation", config, [&]
+                        {
+                            engine.updateOutputGain (fadeGain (fadeStart ? 0 : hostBlocksize / 2));
+                            fadeStart = ! fadeStart;
+                            
+                            auto block = nextBlock();
+                            engine.process (block, output, midi, false);
+                        });
+    }
+    
+    for (int minSubBlock : { 1, 32, 128 })
+    {
+        bav::ImogenEngine<float> engine;
+        prepareEngine (engine, makeComparisonConfig (bvi_DEFAULT_NUM_VOICES), false);
+        engine.setMinimumAutomationSubBlock (minSubBlock);
+        
+        runner.measure ("ImogenEngine::process, automation every " + juce::String (eventSpacing) + " samples, minimum sub-block of " + juce::String (minSubBlock), config, [&]
+                        {
+                            for (int s = 0; s < hostBlocksize; s += eventSpacing)
+                                engine.queueAutomationEvent ({ s, bav::ImogenEngine<float>::automatedOutputGain, fadeGain (s) });
+                            
+                            auto block = nextBlock();
+                            engine.process (block, output, midi, false);
+                        });
+    }
+}
+
+
+// the shared-detector vocal dynamics against the gate, de-esser & compressor in series that they replaced
+static void compareDynamics (BenchmarkRunner& runner)
+{
+    const auto config = makeComparisonConfig();
+    
+    InputLoop<float> input (true, config.samplerate, 1);
+    juce::AudioBuffer<float> signal (1, config.blocksize);
+    
+    bav::dsp::FX::NoiseGate<float>  gate;
+    bav::dsp::FX::DeEsser<float>    deEsser;
+    bav::dsp::FX::Compressor<float> compressor;
+    
+    gate.prepare (1, config.blocksize, config.samplerate);
+    gate.setThreshold (-40.0f);
+    gate.setRatio (10.0f);
+    gate.setAttack (25.0f);
+    gate.setRelease (100.0f);
+    
+    deEsser.prepare (config.blocksize, config.samplerate);
+    deEsser.setThresh (-20.0f);
+    deEsser.setDeEssAmount (0.5f);
+    
+    compressor.prepare (config.blocksize, config.samplerate, 1);
+    compressor.setThreshold (-20.0f);
+    compressor.setRatio (4.0f);
+    compressor.setAttack (4.0f);
+    compressor.setRelease (200.0f);
+    
+    bav::VocalDynamics<float> dynamics;
+    dynamics.prepare (config.samplerate, config.blocksize);
+    dynamics.setGate (-40.0f, true);
+    dynamics.setDeEsser (0.5f, -20.0f, true);
+    dynamics.setCompressor (-20.0f, 4.0f, true);
+    
+    runner.measure ("Gate, de-esser & compressor in series", config, [&]
+                    {
+                        signal.copyFrom (0, 0, input.source, 0, input.advance (config.blocksize), config.blocksize);
+                        gate.process (signal);
+                        deEsser.process (signal);
+                        compressor.process (signal);
+                    });
+    
+    runner.measure ("VocalDynamics::process", config, [&]
+                    {
+                        signal.copyFrom (0, 0, input.source, 0, input.advance (config.blocksize), config.blocksize);
+                        dynamics.process (signal.getWritePointer (0), config.blocksize);
+                    });
+}
+
+
+// the FDN reverb against the reverb it replaced
+static void compareReverbs (BenchmarkRunner& runner)
+{
+    const auto config = makeComparisonConfig();
+    
+    InputLoop<float> input (true, config.samplerate, 2);
+    juce::AudioBuffer<float> buffer (2, config.blocksize);
+    
+    bav::dsp::FX::Reverb previous;
+    previous.prepare (config.blocksize, config.samplerate, 2);
+    previous.setDryWet (35);
+    previous.setDamping (0.4f);
+    previous.setRoomSize (0.6f);
+    previous.setDuckAmount (0.3f);
+    
+    bav::FDNReverb<float> fdn;
+    fdn.prepare (config.samplerate);
+    fdn.setDryWet (35);
+    fdn.setDecay (0.6f);
+    fdn.setDuckAmount (0.3f);
+    
+    auto nextBlock = [&]
+    {
+        const auto start = input.advance (config.blocksize);
+        
+        for (int chan = 0; chan < 2; ++chan)
+            buffer.copyFrom (chan, 0, input.source, chan, start, config.blocksize);
+    };
+    
+    runner.measure ("Reverb::process", config, [&] { nextBlock(); previous.process (buffer); });
+    runner.measure ("FDNReverb::process", config, [&] { nextBlock(); fdn.process (buffer); });
+}
+
+
+// the engine with silent input & no notes sounding, once it has gone idle
+static void compareIdleEngine (BenchmarkRunner& runner)
+{
+    auto config = makeComparisonConfig (bvi_DEFAULT_NUM_VOICES);
+    config.input = "silent";
+    
+    juce::AudioBuffer<float> input (2, config.blocksize), output (2, config.blocksize);
+    juce::MidiBuffer midi;
+    input.clear();
+    
+    bav::ImogenEngine<float> engine;
+    prepareEngine (engine, config, false);
+    engine.killAllMidi();
+    
+    runner.measure ("ImogenEngine::process, idle", config, [&] { engine.process (input, output, midi, false); });
+}
+
+
+// multi-singer mode, by number of singers, each singing a different pitch into its own channel. The singers always render on the shared pool; each one's voices are rendered
+// serially within its job, or as a nested batch on the same pool, with its analysis on the process-wide worker too when pipelined. The time per singer shows how well each mode scales.
+static void compareSingerCounts (BenchmarkRunner& runner)
+{
+    const auto config = makeComparisonConfig (bvi_DEFAULT_NUM_VOICES);
+    
+    enum SingerMode { serialVoices, multithreadedVoices, multithreadedAndPipelined };
+    
+    for (auto mode : { serialVoices, multithreadedVoices, multithreadedAndPipelined })
+    {
+        const juce::String modeName = mode == serialVoices        ? ""
+                                    : mode == multithreadedVoices ? ", multithreaded voices"
+                                                                  : ", multithreaded voices & pipelined analysis";
+        
+        for (int numSingers : { 1, 2, 4, 8 })
+        {
+            juce::AudioBuffer<float> input (numSingers, config.blocksize), output (2, config.blocksize);
+            juce::MidiBuffer midi;
+            
+            for (int chan = 0; chan < numSingers; ++chan)
+                for (int s = 0; s < config.blocksize; ++s)
+                    input.setSample (chan, s, static_cast<float> (0.5 * std::sin (juce::MathConstants<double>::twoPi * (196.0 + 20.0 * chan) * s / config.samplerate)));
+            
+            bav::ImogenEngine<float> engine;
+            engine.setNumSingers (numSingers);
+            prepareEngine (engine, config, false);
+            engine.setUseMultithreadedRendering (mode != serialVoices);
+            engine.setUsePipelinedAnalysis (mode == multithreadedAndPipelined);
+            
+            const auto name = "ImogenEngine::process, " + juce::String (numSingers) + (numSingers == 1 ? " singer" : " singers") + modeName;
+            
+            const auto perBlock = runner.measure (name, config, [&]
+                                                  {
+                                                      midi.clear();
+                                                      engine.process (input, output, midi, false);
+                                                  });
+            
+            runner.addDerivedResult (name + ", per singer", config, perBlock / numSingers);
+        }
+    }
+}
+
+
+// the engine with & without its stage telemetry, including the reader's side, so that the ring never fills up
+static void compareStageTelemetry (BenchmarkRunner& runner)
+{
+    const auto config = makeComparisonConfig (bvi_DEFAULT_NUM_VOICES);
+    
+    for (bool withTelemetry : { false, true })
+    {
+        bav::StageTelemetry telemetry;
+        bav::StageLoadMeter meter;
+        
+        bav::ImogenEngine<float> engine;
+        prepareEngine (engine, config, true);
+        
+        if (withTelemetry)
+            engine.setStageTelemetry (&telemetry);
+        
+        InputLoop<float> input (true, config.samplerate, 2);
+        juce::AudioBuffer<float> output (2, config.blocksize);
+        juce::MidiBuffer midi;
+        
+        runner.measure (withTelemetry ? "ImogenEngine::process, with stage telemetry" : "ImogenEngine::process, without stage telemetry", config, [&]
+                        {
+                            juce::AudioBuffer<float> block (input.source.getArrayOfWritePointers(), 2, input.advance (config.blocksize), config.blocksize);
+                            midi.clear();
+                            engine.process (block, output, midi, false);
+                            meter.update (telemetry, config.samplerate);
+                        });
+    }
+}
+
+
+/*===========================================================================================================================
+ ============================================================================================================================*/
+
+static void printUsage()
+{
+    std::cout << "Usage: ImogenBenchmarks [--output <results.json>] [--filter <benchmark name>] [--quick]" << std::endl;
+}
+
+
+int main (int argc, char* argv[])
+{
+    juce::ArgumentList args (argc, argv);
+    
+    if (args.containsOption ("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+    
+    const auto outputPath = args.removeValueForOption ("--output");
+    const auto filter     = args.removeValueForOption ("--filter");
+    
+    BenchmarkRunner runner (args.removeOptionIfFound ("--quick") ? 0.05 : 0.25);
+    runner.setFilter (filter);
+    
+   #if JUCE_DEBUG
+    std::cerr << "Warning: this is a debug build, so these timings aren't representative" << std::endl;
+   #endif
+    
+    juce::ScopedNoDenormals nodenorms;
+    
+    for (bool pitched : { true, false })
+    {
+        if (runner.shouldRun ("Harmonizer::render") || runner.shouldRun ("HarmonizerVoice::renderPlease"))
+        {
+            for (const auto& config : makeSweep (true, true, true))
+            {
+                benchmarkHarmonizer<float>  (runner, config, pitched);
+                benchmarkHarmonizer<double> (runner, config, pitched);
+            }
+        }
+        
+        if (runner.shouldRun ("GrainExtractor::getGrainOnsetIndices"))
+        {
+            for (const auto& config : makeSweep (false, true, true))
+            {
+                benchmarkGrainExtractor<float>  (runner, config, pitched);
+                benchmarkGrainExtractor<double> (runner, config, pitched);
+            }
+        }
+        
+        if (runner.shouldRun ("AnalysisGrain::storeNewGrain"))
+        {
+            for (const auto& config : makeSweep (false, true, true))
+            {
+                benchmarkAnalysisGrains<float>  (runner, config, pitched);
+                benchmarkAnalysisGrains<double> (runner, config, pitched);
+            }
+        }
+        
+        if (runner.shouldRun ("ImogenEngine::process"))
+        {
+            for (const auto& config : makeSweep (true, true, true))
+            {
+                benchmarkEngine<float, float>   (runner, config, pitched);
+                benchmarkEngine<double, double> (runner, config, pitched);
+                benchmarkEngine<double, float>  (runner, config, pitched);
+            }
+        }
+    }
+    
+    // each comparison runs if any of its benchmarks' names match the filter
+    if (runner.shouldRun ("GrainExtractor peak search"))
+        comparePeakSearches (runner);
+    
+    if (runner.shouldRun ("Harmonizer::render, multithreaded"))
+        compareMultithreadedHarmonizer (runner);
+    
+    if (runner.shouldRun ("PitchDetector::detectPitch") || runner.shouldRun ("FFTPitchDetector::detectPitch") || runner.shouldRun ("SlidingPitchTracker::process"))
+        comparePitchDetectors (runner);
+    
+    if (runner.shouldRun ("ImogenEngine::process, block-quantized automation") || runner.shouldRun ("ImogenEngine::process, automation every"))
+        compareAutomation (runner);
+    
+    if (runner.shouldRun ("Gate, de-esser & compressor in series") || runner.shouldRun ("VocalDynamics::process"))
+        compareDynamics (runner);
+    
+    if (runner.shouldRun ("Reverb::process") || runner.shouldRun ("FDNReverb::process"))
+        compareReverbs (runner);
+    
+    if (runner.shouldRun ("ImogenEngine::process, idle"))
+        compareIdleEngine (runner);
+    
+    if (runner.shouldRun ("ImogenEngine::process, 1 singer") || runner.shouldRun ("ImogenEngine::process, 8 singers"))
+        compareSingerCounts (runner);
+    
+    if (runner.shouldRun ("ImogenEngine::process, with stage telemetry") || runner.shouldRun ("ImogenEngine::process, without stage telemetry"))
+        compareStageTelemetry (runner);
+    
+    const auto json = runner.toJSON();
+    
+    if (outputPath.isEmpty())
+    {
+        std::cout << json << std::endl;
+    }
+    else if (! juce::File::getCurrentWorkingDirectory().getChildFile (outputPath).replaceWithText (json))
+    {
+        std::cerr << "Can't write the results to " << outputPath << std::endl;
+        return 1;
+    }
+    
+    return runner.getNumResults() > 0 ? 0 : 1;
+}
+
+#undef bvi_DEFAULT_NUM_VOICES
+#undef bvi_DEFAULT_BLOCKSIZE
+#undef bvi_DEFAULT_SAMPLERATE
+#undef bvi_PITCHED_INPUT_HZ
+#undef bvi_MIN_DETECTION_HZ
+#undef bvi_MAX_DETECTION_HZ
+#undef bvi_UNPITCHED_PERIOD
@@ -0,0 +1,124 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ AnalysisRingBuffer.h: This file defines the AnalysisRingBuffer class, the contiguous ring of samples that the Harmonizer keeps its analysed input audio in, and also the windowed samples of its AnalysisGrains.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+    
+
+/*
+    AnalysisRingBuffer : a history-preserving ring buffer of samples, addressed by absolute sample position (the number of samples written before it).
+    Every sample is stored twice, one capacity apart, so that any span of up to getCapacity() samples that is still in the history can be read contiguously from a single pointer, even if it wraps around the end of the ring.
+*/
+
+template<typename SampleType>
+class AnalysisRingBuffer
+{
+public:
+    AnalysisRingBuffer(): capacity(0), totalWritten(0) { }
+    
+    void prepare (const int newCapacity)
+    {
+        jassert (newCapacity > 0);
+        capacity = newCapacity;
+        storage.setSize (1, capacity * 2);
+        clear();
+    }
+    
+    void release()
+    {
+        storage.setSize (0, 0);
+        capacity = 0;
+        totalWritten = 0;
+    }
+    
+    void clear()
+    {
+        storage.clear();
+        totalWritten = 0;
+    }
+    
+    // appends samples to the history, optionally reversing their polarity. Returns the absolute position of the first sample written.
+    juce::int64 write (const SampleType* samples, const int numSamples, const bool invertPolarity = false)
+    {
+        jassert (numSamples <= capacity);
+        
+        const auto firstPosition = totalWritten;
+        auto* writing = storage.getWritePointer(0);
+        
+        int samplesWritten = 0;
+        
+        while (samplesWritten < numSamples)
+        {
+            const auto ringIndex = static_cast<int> ((firstPosition + samplesWritten) % capacity);
+            const auto chunkSize = std::min (numSamples - samplesWritten, capacity - ringIndex);
+            
+            for (auto* dest : { writing + ringIndex, writing + ringIndex + capacity })
+            {
+                vecops::copy (samples + samplesWritten, dest, chunkSize);
+                
+                if (invertPolarity)
+                    vecops::multiplyC (dest, SampleType(-1), chunkSize);
+            }
+            
+            samplesWritten += chunkSize;
+        }
+        
+        totalWritten += numSamples;
+        return firstPosition;
+    }
+    
+    // returns a pointer to the sample at the given absolute position; the following getCapacity() - 1 samples can be read contiguously after it
+    const SampleType* getReadPointer (const juce::int64 absolutePosition) const
+    {
+        jassert (containsPosition (absolutePosition));
+        return storage.getReadPointer(0) + static_cast<int> (absolutePosition % capacity);
+    }
+    
+    bool containsPosition (const juce::int64 absolutePosition) const noexcept
+    {
+        return absolutePosition >= getOldestPosition() && absolutePosition < totalWritten;
+    }
+    
+    // the absolute position of the oldest sample still held in the history
+    juce::int64 getOldestPosition() const noexcept { return std::max (juce::int64(0), totalWritten - capacity); }
+    
+    // the absolute position that the next sample written will have
+    juce::int64 getNextWritePosition() const noexcept { return totalWritten; }
+    
+    int getCapacity() const noexcept { return capacity; }
+    
+    
+private:
+    int capacity;
+    
+    juce::int64 totalWritten;
+    
+    juce::AudioBuffer<SampleType> storage;
+};
+
+
+}  // namespace
@@ -29,6 +29,9 @@
 #define bvhge_NUM_PEAKS_TO_TEST 10
 #define bvhge_DEFAULT_FINAL_HANDFUL_SIZE 5
 
+// each round of candidate picking removes at most one minimum & one maximum, so this many of each is always enough to replay every round
+#define bvhge_NUM_EXTREMA_TO_KEEP (bvhge_NUM_PEAKS_TO_TEST * 2)
+
 
 namespace bav
 {
@@ -53,6 +56,19 @@ void GrainExtractor<SampleType>::releaseResources()
     candidateDeltas.clear();
     finalHandful.clear();
     finalHandfulDeltas.clear();
+    lowestCandidates.clear();
+    highestCandidates.clear();
+    takenRanks.clear();
+    weightedFrame.setSize (0, 0);
+    distanceWeights.setLengths ({});
+}
+    
+    
+// frames are a period long, apart from the last one in a block, which may be cut short -- that one just computes its own weights
+template<typename SampleType>
+void GrainExtractor<SampleType>::setPeriodRange (const juce::Range<int> periods)
+{
+    distanceWeights.setLengths ({ periods.getStart(), periods.getEnd() + 1 });
 }
     
     
@@ -75,6 +91,14 @@ void GrainExtractor<SampleType>::prepare (const int maxBlocksize)
     finalHandful.clearQuick();
     finalHandfulDeltas.ensureStorageAllocated (bvhge_NUM_PEAKS_TO_TEST);
     finalHandfulDeltas.clearQuick();
+    lowestCandidates.ensureStorageAllocated (bvhge_NUM_EXTREMA_TO_KEEP);
+    lowestCandidates.clearQuick();
+    highestCandidates.ensureStorageAllocated (bvhge_NUM_EXTREMA_TO_KEEP);
+    highestCandidates.clearQuick();
+    takenRanks.ensureStorageAllocated (bvhge_NUM_EXTREMA_TO_KEEP);
+    takenRanks.clearQuick();
+    
+    weightedFrame.setSize (1, maxBlocksize + 1);
 }
 
 
@@ -196,19 +220,40 @@ inline int GrainExtractor<SampleType>::findNextPeak (const int frameStart, const
     jassert (predictedPeak >= frameStart && predictedPeak <= frameEnd);
     
     peakSearchingOrder.clearQuick();
-    sortSampleIndicesForPeakSearching (peakSearchingOrder, frameStart, frameEnd, predictedPeak);
+    const auto searchedRange = sortSampleIndicesForPeakSearching (peakSearchingOrder, frameStart, frameEnd, predictedPeak);
     
     jassert (peakSearchingOrder.size() == frameEnd - frameStart);
+    jassert (searchedRange.getLength() == peakSearchingOrder.size());
+    
+    const auto firstIndex = searchedRange.getStart();
+    auto* weighted = weightedFrame.getWritePointer(0);
+    
+    const auto frameLength = frameEnd - frameStart;
+    
+    const bool frameIsFlat = weightFrameAndCheckIfFlat (reading + firstIndex, weighted, searchedRange.getLength(),
+                                                        predictedPeak - firstIndex, frameLength,
+                                                        distanceWeights.get (frameLength));
     
     peakCandidates.clearQuick();
     
-    for (int i = 0; i < bvhge_NUM_PEAKS_TO_TEST; ++i)
-        getPeakCandidateInRange (peakCandidates, reading, frameStart, frameEnd, predictedPeak, peakSearchingOrder);
+    if (frameIsFlat)
+    {
+        // a flat frame (usually digital silence): every round of the search would just take the first remaining sample in the searching order
+        for (int i = 0; i < std::min (bvhge_NUM_PEAKS_TO_TEST, peakSearchingOrder.size()); ++i)
+            peakCandidates.add (peakSearchingOrder.getUnchecked (i));
+    }
+    else if (useSinglePassPeakSearch)
+    {
+        getPeakCandidates (peakCandidates, weighted, firstIndex, peakSearchingOrder);
+    }
+    else
+    {
+        for (int i = 0; i < bvhge_NUM_PEAKS_TO_TEST; ++i)
+            getPeakCandidateInRange (peakCandidates, weighted, firstIndex, peakSearchingOrder);
+    }
     
     jassert (! peakCandidates.isEmpty());
     
-#undef bvhge_NUM_PEAKS_TO_TEST
-    
     switch (peakCandidates.size())
     {
         case 1:
@@ -230,9 +275,112 @@ inline int GrainExtractor<SampleType>::findNextPeak (const int frameStart, const
 }
     
 
+/*
+    Finds the same peak candidates as calling getPeakCandidateInRange() bvhge_NUM_PEAKS_TO_TEST times, but in a single pass through the frame.
+    Each round of the iterative search takes the weighted minimum and/or maximum of the samples not yet chosen, so the whole sequence of rounds can be replayed from the lowest & highest few weighted samples. These are collected with two bounded heaps, and then the rounds are replayed over those short lists.
+*/
+template<typename SampleType>
+inline void GrainExtractor<SampleType>::getPeakCandidates (IArray& candidates, const SampleType* weightedSamples, const int firstIndex,
+                                                           const IArray& searchingOrder)
+{
+    jassert (! searchingOrder.isEmpty());
+    
+    // "better" means nearer to the front of the list; equal samples are ordered by their rank in the searching order
+    const auto isLower  = [] (const PeakCandidate& a, const PeakCandidate& b)
+                          { return a.weightedSample < b.weightedSample || (a.weightedSample == b.weightedSample && a.searchRank < b.searchRank); };
+    
+    const auto isHigher = [] (const PeakCandidate& a, const PeakCandidate& b)
+                          { return a.weightedSample > b.weightedSample || (a.weightedSample == b.weightedSample && a.searchRank < b.searchRank); };
+    
+    lowestCandidates.clearQuick();
+    highestCandidates.clearQuick();
+    
+    int rank = 0;
+    
+    // 1. one pass through the frame, keeping the lowest & highest weighted samples in two bounded heaps. The top of each heap is its worst kept sample.
+    
+    for (int index : searchingOrder)
+    {
+        const PeakCandidate current { weightedSamples[index - firstIndex], index, rank++ };
+        
+        if (lowestCandidates.size() < bvhge_NUM_EXTREMA_TO_KEEP)
+        {
+            lowestCandidates.add (current);
+            std::push_heap (lowestCandidates.begin(), lowestCandidates.end(), isLower);
+        }
+        else if (isLower (current, lowestCandidates.getReference (0)))
+        {
+            std::pop_heap (lowestCandidates.begin(), lowestCandidates.end(), isLower);
+            lowestCandidates.getReference (bvhge_NUM_EXTREMA_TO_KEEP - 1) = current;
+            std::push_heap (lowestCandidates.begin(), lowestCandidates.end(), isLower);
+        }
+        
+        if (highestCandidates.size() < bvhge_NUM_EXTREMA_TO_KEEP)
+        {
+            highestCandidates.add (current);
+            std::push_heap (highestCandidates.begin(), highestCandidates.end(), isHigher);
+        }
+        else if (isHigher (current, highestCandidates.getReference (0)))
+        {
+            std::pop_heap (highestCandidates.begin(), highestCandidates.end(), isHigher);
+            highestCandidates.getReference (bvhge_NUM_EXTREMA_TO_KEEP - 1) = current;
+            std::push_heap (highestCandidates.begin(), highestCandidates.end(), isHigher);
+        }
+    }
+    
+    std::sort_heap (lowestCandidates.begin(), lowestCandidates.end(), isLower);
+    std::sort_heap (highestCandidates.begin(), highestCandidates.end(), isHigher);
+    
+    // 2. replay the rounds of the iterative search. A sample can be in both lists, so the ranks already chosen are skipped when moving down either list.
+    
+    takenRanks.clearQuick();
+    
+    const auto numLowest  = lowestCandidates.size();
+    const auto numHighest = highestCandidates.size();
+    int lo = 0, hi = 0;
+    
+    for (int i = 0; i < bvhge_NUM_PEAKS_TO_TEST; ++i)
+    {
+        while (lo < numLowest && takenRanks.contains (lowestCandidates.getReference (lo).searchRank))
+            ++lo;
+        
+        while (hi < numHighest && takenRanks.contains (highestCandidates.getReference (hi).searchRank))
+            ++hi;
+        
+        if (lo >= numLowest || hi >= numHighest)  // every sample in the frame has already been chosen
+            return;
+        
+        const auto& localMin = lowestCandidates.getReference (lo);
+        const auto& localMax = highestCandidates.getReference (hi);
+        
+        if (localMin.searchRank == localMax.searchRank)
+        {
+            candidates.add (localMax.sampleIndex);
+            takenRanks.add (localMax.searchRank);
+        }
+        else if (localMax.weightedSample < SampleType(0.0))
+        {
+            candidates.add (localMin.sampleIndex);
+            takenRanks.add (localMin.searchRank);
+        }
+        else if (localMin.weightedSample > SampleType(0.0))
+        {
+            candidates.add (localMax.sampleIndex);
+            takenRanks.add (localMax.searchRank);
+        }
+        else
+        {
+            candidates.add (std::min (localMax.sampleIndex, localMin.sampleIndex));
+            candidates.add (std::max (localMax.sampleIndex, localMin.sampleIndex));
+            takenRanks.add (localMin.searchRank);
+            takenRanks.add (localMax.searchRank);
+        }
+    }
+}
+    
+
 template<typename SampleType>
-inline void GrainExtractor<SampleType>::getPeakCandidateInRange (IArray& candidates, const SampleType* input,
-                                                                 const int startSample, const int endSample, const int predictedPeak,
+inline void GrainExtractor<SampleType>::getPeakCandidateInRange (IArray& candidates, const SampleType* weightedSamples, const int firstIndex,
                                                                  const IArray& searchingOrder)
 {
     jassert (! searchingOrder.isEmpty());
@@ -251,13 +399,7 @@ inline void GrainExtractor<SampleType>::getPeakCandidateInRange (IArray& candida
     if (starting == -1)
         return;
     
-#define bvhge_WEIGHT(index, predicted, numSamples) SampleType(1.0 - ((abs(index - predicted) / numSamples) * 0.5))
-    
-    jassert (starting >= startSample && starting <= endSample);
-    
-    const auto numSamples = endSample - startSample;
-    
-    auto localMin = input[starting] * bvhge_WEIGHT(starting, predictedPeak, numSamples);
+    auto localMin = weightedSamples[starting - firstIndex];
     auto localMax = localMin;
     auto indexOfLocalMin = starting;
     auto indexOfLocalMax = starting;
@@ -267,9 +409,7 @@ inline void GrainExtractor<SampleType>::getPeakCandidateInRange (IArray& candida
         if (index == starting || candidates.contains (index))
             continue;
         
-        jassert (index >= startSample && index <= endSample);
-        
-        const auto currentSample = input[index] * bvhge_WEIGHT(index, predictedPeak, numSamples);
+        const auto currentSample = weightedSamples[index - firstIndex];
         
         if (currentSample < localMin)
         {
@@ -284,8 +424,6 @@ inline void GrainExtractor<SampleType>::getPeakCandidateInRange (IArray& candida
         }
     }
     
-#undef bvhge_WEIGHT
-    
     if (indexOfLocalMax == indexOfLocalMin)
     {
         candidates.add (indexOfLocalMax);
@@ -401,7 +539,7 @@ inline int GrainExtractor<SampleType>::choosePeakWithGreatestPower (const IArray
 
 
 template<typename SampleType>
-inline void GrainExtractor<SampleType>::sortSampleIndicesForPeakSearching (IArray& output, // array to write the sorted sample indices to
+inline juce::Range<int> GrainExtractor<SampleType>::sortSampleIndicesForPeakSearching (IArray& output, // array to write the sorted sample indices to
                                                                            const int startSample, const int endSample,
                                                                            const int predictedPeak)
 {
@@ -449,6 +587,9 @@ inline void GrainExtractor<SampleType>::sortSampleIndicesForPeakSearching (IArra
             }
         }
     }
+    
+    // the searching order spreads outwards from the predicted peak, so it always covers one contiguous range of samples
+    return { predictedPeak + m + 1, predictedPeak + p };
 }
 
 
@@ -456,5 +597,9 @@ inline void GrainExtractor<SampleType>::sortSampleIndicesForPeakSearching (IArra
 template class GrainExtractor<float>;
 template class GrainExtractor<double>;
 
+    
+#undef bvhge_NUM_PEAKS_TO_TEST
+#undef bvhge_NUM_EXTREMA_TO_KEEP
+
 
 } // namespace
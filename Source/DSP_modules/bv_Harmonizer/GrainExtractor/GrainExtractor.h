@@ -27,6 +27,8 @@
 
 #pragma once
 
+#include "WeightedExtrema.h"
+
 
 namespace bav
 {
@@ -51,14 +53,29 @@ public:
     
     void releaseResources();
     
+    // keeps the peak-picking weights for every frame length these periods can produce in the WindowTableCache. Don't call this while getGrainOnsetIndices() may be running
+    void setPeriodRange (const juce::Range<int> periods);
+    
     
     void getGrainOnsetIndices (IArray& targetArray,
                                const juce::AudioBuffer<SampleType>& inputAudio,
                                const int period);
     
+    // selects between the single-pass peak candidate search (the default) and the original iterative search, which is kept as a reference implementation
+    void setUseSinglePassPeakSearch (const bool shouldUseSinglePass) noexcept { useSinglePassPeakSearch = shouldUseSinglePass; }
+    
     
 private:
     
+    struct PeakCandidate
+    {
+        SampleType weightedSample;
+        int sampleIndex;
+        int searchRank;  // this sample's position in the peak searching order; ties between equal samples go to the lower rank, just like the iterative search
+    };
+    
+    using CArray = juce::Array<PeakCandidate>;
+    
     IArray peakIndices; // used by all the kinds of peak picking algorithms to store their output for transformation to grains
     
     IArray peakCandidates;
@@ -68,6 +85,17 @@ private:
     IArray   finalHandful;
     FArray finalHandfulDeltas;
     
+    CArray lowestCandidates;  // the weighted minima of the current frame, lowest first
+    CArray highestCandidates; // the weighted maxima of the current frame, highest first
+    IArray takenRanks;
+    
+    juce::AudioBuffer<SampleType> weightedFrame; // the current frame's samples, weighted by their distance from the predicted peak
+    
+    juce::SharedResourcePointer< WindowTableCache<SampleType> > windowTables;
+    typename WindowTableCache<SampleType>::Lease distanceWeights { *windowTables, WindowTableCache<SampleType>::distanceWeights };
+    
+    bool useSinglePassPeakSearch = true;
+    
     // functions used for finding of PSOLA peaks
     
     void findPsolaPeaks (IArray& targetArray,
@@ -78,10 +106,12 @@ private:
     int findNextPeak (const int frameStart, const int frameEnd, int predictedPeak, const SampleType* reading, const IArray& targetArray,
                       const int period, const int grainSize);
     
-    void sortSampleIndicesForPeakSearching (IArray& output, const int startSample, const int endSample, const int predictedPeak);
+    juce::Range<int> sortSampleIndicesForPeakSearching (IArray& output, const int startSample, const int endSample, const int predictedPeak);
+    
+    void getPeakCandidates (IArray& candidates, const SampleType* weightedSamples, const int firstIndex,
+                            const IArray& searchingOrder);
     
-    void getPeakCandidateInRange (IArray& candidates, const SampleType* input,
-                                  const int startSample, const int endSample, const int predictedPeak,
+    void getPeakCandidateInRange (IArray& candidates, const SampleType* weightedSamples, const int firstIndex,
                                   const IArray& searchingOrder);
     
     int chooseIdealPeakCandidate (const IArray& candidates, const SampleType* reading,
@@ -0,0 +1,84 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ WeightedExtrema.h: This file defines the vectorised kernel at the heart of the GrainExtractor's PSOLA peak picking. It weights a frame of samples by their distance from the predicted peak location, and checks whether the weighted frame is flat.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+
+
+/*
+    Writes input * weight to output, where the weight falls away linearly from 1 at peakOffset to 0.5 at a distance of weightingLength samples.
+    If a precomputed table of weights is passed in (see WindowTableCache::distanceWeights), the weighting of the samples after the peak is a single vector multiply; otherwise, the weights are computed by two branch-free loops that the compiler can vectorise.
+*/
+template<typename SampleType>
+inline void applyDistanceWeighting (const SampleType* input, SampleType* output, const int numSamples,
+                                    const int peakOffset, const int weightingLength,
+                                    const SampleType* weightTable = nullptr)
+{
+    jassert (numSamples > 0 && weightingLength > 0);
+    jassert (peakOffset >= 0 && peakOffset < numSamples);
+    jassert (numSamples - peakOffset <= weightingLength + 1);
+    
+    if (weightTable != nullptr)
+    {
+        for (int s = 0; s < peakOffset; ++s)
+            output[s] = input[s] * weightTable[peakOffset - s];
+        
+        juce::FloatVectorOperations::multiply (output + peakOffset, input + peakOffset, weightTable, numSamples - peakOffset);
+        return;
+    }
+    
+    const auto slope = SampleType(0.5) / static_cast<SampleType> (weightingLength);
+    const auto peak = static_cast<SampleType> (peakOffset);
+    
+    for (int s = 0; s < peakOffset; ++s)
+        output[s] = SampleType(1.0) - (peak - static_cast<SampleType> (s)) * slope;
+    
+    for (int s = peakOffset; s < numSamples; ++s)
+        output[s] = SampleType(1.0) - (static_cast<SampleType> (s) - peak) * slope;
+    
+    juce::FloatVectorOperations::multiply (output, input, numSamples);
+}
+    
+
+/*
+    Weights the frame as described above, leaving the weighted samples in the output array, and returns true if every weighted sample is the same (usually because the frame is digital silence).
+    The peak search does its own ranking of the weighted samples, so only the frame's range is needed here, which is a single vectorised pass.
+*/
+template<typename SampleType>
+inline bool weightFrameAndCheckIfFlat (const SampleType* input, SampleType* output, const int numSamples,
+                                       const int peakOffset, const int weightingLength,
+                                       const SampleType* weightTable = nullptr)
+{
+    applyDistanceWeighting (input, output, numSamples, peakOffset, weightingLength, weightTable);
+    
+    const auto range = juce::FloatVectorOperations::findMinAndMax (output, numSamples);
+    
+    return range.getStart() == range.getEnd();
+}
+
+
+} // namespace
@@ -0,0 +1,154 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ LightweightSemaphore.cpp: This file defines implementation details for the LightweightSemaphore class.
+ 
+======================================================================================================================================================*/
+
+
+#include "LightweightSemaphore.h"
+
+#if JUCE_WINDOWS
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+  #include <dispatch/dispatch.h>
+#else
+  #include <semaphore.h>
+  #include <cerrno>
+#endif
+
+
+// a waiting thread checks the count this many times before it goes to sleep
+#define bvls_SPIN_COUNT 1000
+
+
+namespace bav
+{
+
+
+struct LightweightSemaphore::OSSemaphore
+{
+#if JUCE_WINDOWS
+    OSSemaphore()  : handle (CreateSemaphoreW (nullptr, 0, MAXLONG, nullptr)) { }
+    ~OSSemaphore() { CloseHandle (handle); }
+    
+    void post (int num) noexcept { ReleaseSemaphore (handle, static_cast<LONG> (num), nullptr); }
+    void wait() noexcept         { WaitForSingleObject (handle, INFINITE); }
+    
+    HANDLE handle;
+#elif JUCE_MAC || JUCE_IOS
+    OSSemaphore()  : semaphore (dispatch_semaphore_create (0)) { }
+    ~OSSemaphore() { dispatch_release (semaphore); }
+    
+    void post (int num) noexcept
+    {
+        while (--num >= 0)
+            dispatch_semaphore_signal (semaphore);
+    }
+    
+    void wait() noexcept { dispatch_semaphore_wait (semaphore, DISPATCH_TIME_FOREVER); }
+    
+    dispatch_semaphore_t semaphore;
+#else
+    OSSemaphore()  { sem_init (&semaphore, 0, 0); }
+    ~OSSemaphore() { sem_destroy (&semaphore); }
+    
+    void post (int num) noexcept
+    {
+        while (--num >= 0)
+            sem_post (&semaphore);
+    }
+    
+    void wait() noexcept
+    {
+        while (sem_wait (&semaphore) != 0 && errno == EINTR)
+        { }
+    }
+    
+    sem_t semaphore;
+#endif
+};
+
+
+LightweightSemaphore::LightweightSemaphore (int maxCountToUse)
+    : osSemaphore (std::make_unique<OSSemaphore>()), maxCount (maxCountToUse)
+{
+    jassert (maxCount > 0);
+}
+
+
+LightweightSemaphore::~LightweightSemaphore() = default;
+
+
+void LightweightSemaphore::signal (int numToRelease) noexcept
+{
+    auto oldCount = count.load (std::memory_order_relaxed);
+    int released;
+    
+    do
+    {
+        released = std::min (numToRelease, maxCount - oldCount);
+        
+        if (released <= 0)
+            return;
+    }
+    while (! count.compare_exchange_weak (oldCount, oldCount + released, std::memory_order_release, std::memory_order_relaxed));
+    
+    // only the threads that are asleep need the OS to wake them
+    const auto numToWake = std::min (released, -oldCount);
+    
+    if (numToWake > 0)
+        osSemaphore->post (numToWake);
+}
+
+
+bool LightweightSemaphore::tryWait() noexcept
+{
+    auto oldCount = count.load (std::memory_order_relaxed);
+    
+    while (oldCount > 0)
+        if (count.compare_exchange_weak (oldCount, oldCount - 1, std::memory_order_acquire, std::memory_order_relaxed))
+            return true;
+    
+    return false;
+}
+
+
+void LightweightSemaphore::wait() noexcept
+{
+    for (int spin = 0; spin < bvls_SPIN_COUNT; ++spin)
+    {
+        if (tryWait())
+            return;
+        
+        spinPause();
+    }
+    
+    if (count.fetch_sub (1, std::memory_order_acquire) <= 0)
+        osSemaphore->wait();
+}
+
+
+} // namespace
+
+
+#undef bvls_SPIN_COUNT
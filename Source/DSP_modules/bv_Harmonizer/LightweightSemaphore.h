@@ -0,0 +1,87 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ LightweightSemaphore.h: This file defines the LightweightSemaphore class, a counting semaphore that only enters the OS when a thread actually has to sleep, and spinPause(), a CPU hint for spin-wait loops.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+#if JUCE_INTEL
+  #if JUCE_MSVC
+    #include <intrin.h>
+  #else
+    #include <x86intrin.h>
+  #endif
+#endif
+
+
+namespace bav
+{
+
+
+// tells the CPU that this thread is spinning on a flag, so that it can save power & give way to its hyperthread sibling. Never enters the OS.
+static inline void spinPause() noexcept
+{
+#if JUCE_INTEL
+    _mm_pause();
+#elif JUCE_ARM && ! JUCE_MSVC
+    asm volatile ("yield");
+#endif
+}
+
+
+/*
+    LightweightSemaphore : a counting semaphore whose count lives in an atomic. signal() never blocks or takes a lock, so it is safe to call from the audio thread: it is a single
+    compare-and-swap when nobody is waiting, and otherwise only posts to the OS semaphore that the sleeping threads are parked on. wait() spins briefly before it goes to sleep.
+    The count never rises above maxCount, so signals that nobody is waiting for can't pile up & cause a burst of pointless wake-ups later.
+*/
+
+class LightweightSemaphore
+{
+public:
+    
+    explicit LightweightSemaphore (int maxCountToUse);
+    
+    ~LightweightSemaphore();
+    
+    void signal (int numToRelease = 1) noexcept;
+    
+    void wait() noexcept;
+    
+    // takes one from the count if it is positive, without ever sleeping
+    bool tryWait() noexcept;
+    
+    
+private:
+    
+    struct OSSemaphore;
+    
+    std::unique_ptr<OSSemaphore> osSemaphore;
+    
+    std::atomic<int> count { 0 };  // when negative, this is minus the number of threads asleep on the OS semaphore
+    
+    const int maxCount;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LightweightSemaphore)
+};
+
+
+} // namespace
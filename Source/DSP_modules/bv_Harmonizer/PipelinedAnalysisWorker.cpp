@@ -0,0 +1,114 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ PipelinedAnalysisWorker.cpp: This file defines implementation details for the PipelinedAnalysisWorker class.
+ 
+======================================================================================================================================================*/
+
+
+#include "PipelinedAnalysisWorker.h"
+
+
+#define bvpaw_THREAD_PRIORITY 9
+
+
+namespace bav
+{
+
+
+PipelinedAnalysisWorker::PipelinedAnalysisWorker()
+    : juce::Thread ("Imogen pipelined analysis")
+{
+    for (auto& client : clients)
+        client.store (nullptr, std::memory_order_relaxed);
+    
+    startThread (bvpaw_THREAD_PRIORITY);
+}
+
+
+PipelinedAnalysisWorker::~PipelinedAnalysisWorker()
+{
+    signalThreadShouldExit();
+    workAvailable.signal();
+    stopThread (1000);
+}
+
+
+void PipelinedAnalysisWorker::addClient (Client& client)
+{
+    for (auto& slot : clients)
+    {
+        Client* empty = nullptr;
+        
+        if (slot.compare_exchange_strong (empty, &client))
+            return;
+    }
+    
+    jassertfalse;  // more pipelined harmonizers than the worker has room for!
+}
+
+
+void PipelinedAnalysisWorker::removeClient (Client& client)
+{
+    for (auto& slot : clients)
+    {
+        auto* expected = &client;
+        
+        if (slot.compare_exchange_strong (expected, nullptr))
+            break;
+    }
+    
+    while (clientInUse.load() == &client)
+        juce::Thread::yield();
+}
+
+
+// a hand-off that arrives while the worker is busy is left in the semaphore's count, so the worker goes round again instead of sleeping
+void PipelinedAnalysisWorker::run()
+{
+    while (! threadShouldExit())
+    {
+        bool analysedAny = false;
+        
+        for (auto& slot : clients)
+        {
+            auto* client = slot.load (std::memory_order_acquire);
+            
+            if (client == nullptr)
+                continue;
+            
+            // publishing the client before checking it's still registered means removeClient() either sees it in use, or has already unregistered it
+            clientInUse.store (client);
+            
+            if (slot.load() == client && client->analysePendingFrame())
+                analysedAny = true;
+            
+            clientInUse.store (nullptr);
+        }
+        
+        if (! analysedAny)
+            workAvailable.wait();
+    }
+}
+
+
+} // namespace
+
+
+#undef bvpaw_THREAD_PRIORITY
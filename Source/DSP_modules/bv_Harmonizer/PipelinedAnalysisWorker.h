@@ -0,0 +1,77 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ PipelinedAnalysisWorker.h: This file defines the PipelinedAnalysisWorker class, the one thread, shared by every Harmonizer in the process, that analyses the blocks handed off by pipelined harmonizers.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+
+
+/*
+    PipelinedAnalysisWorker : a thread that sleeps until a client hands off a block to analyse, then analyses every client's pending blocks until none are left.
+    Handing off never blocks: frameHandedOff() just signals a LightweightSemaphore, so it is safe to call from the audio thread. An idle worker is asleep, & costs nothing.
+    Access the worker through a juce::SharedResourcePointer<PipelinedAnalysisWorker>, so that the whole process shares one thread.
+*/
+
+class PipelinedAnalysisWorker  :   private juce::Thread
+{
+public:
+    
+    struct Client
+    {
+        virtual ~Client() = default;
+        
+        // analyses one pending block, if there is one. Returns false if there was nothing to analyse.
+        virtual bool analysePendingFrame() = 0;
+    };
+    
+    PipelinedAnalysisWorker();
+    
+    ~PipelinedAnalysisWorker() override;
+    
+    // call these from the message thread. Once removeClient() returns, the worker will never touch the client again.
+    void addClient (Client& client);
+    void removeClient (Client& client);
+    
+    void frameHandedOff() noexcept { workAvailable.signal(); }
+    
+    static constexpr int maxClients = 64;
+    
+    
+private:
+    
+    void run() override;
+    
+    std::atomic<Client*> clients[maxClients];
+    
+    std::atomic<Client*> clientInUse { nullptr };  // the client the worker is analysing, which removeClient() waits for
+    
+    LightweightSemaphore workAvailable { 1 };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PipelinedAnalysisWorker)
+};
+
+
+} // namespace
@@ -0,0 +1,254 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ FFTPitchDetector.cpp: This file defines implementation details for the FFTPitchDetector class.
+ 
+======================================================================================================================================================*/
+
+
+#include "FFTPitchDetector.h"
+
+
+#define bvhpd_DEFAULT_MIN_HZ 80
+#define bvhpd_DEFAULT_MAX_HZ 2400
+#define bvhpd_DEFAULT_CONFIDENCE_THRESH 0.15
+
+
+namespace bav
+{
+    
+
+template<typename SampleType>
+FFTPitchDetector<SampleType>::FFTPitchDetector()
+    : hzRange (bvhpd_DEFAULT_MIN_HZ, bvhpd_DEFAULT_MAX_HZ), samplerate (0.0), confidenceThresh (SampleType(bvhpd_DEFAULT_CONFIDENCE_THRESH)),
+      minPeriod (0), maxPeriod (0), windowSize (0), frameSize (0),
+      allowDecimation (true), decimationFactor (1),
+      analysisMinPeriod (0), analysisMaxPeriod (0), analysisWindowSize (0), analysisFrameSize (0)
+{ }
+    
+#undef bvhpd_DEFAULT_MIN_HZ
+#undef bvhpd_DEFAULT_MAX_HZ
+#undef bvhpd_DEFAULT_CONFIDENCE_THRESH
+
+
+template<typename SampleType>
+void FFTPitchDetector<SampleType>::initialize()
+{
+    updateSizes();
+}
+
+
+template<typename SampleType>
+void FFTPitchDetector<SampleType>::releaseResources()
+{
+    fft.reset();
+    windowSpectrum.free();
+    frameSpectrum.free();
+    runningEnergy.free();
+    yinBuffer.free();
+    decimatedFrame.free();
+}
+
+
+template<typename SampleType>
+void FFTPitchDetector<SampleType>::setHzRange (const int newMinHz, const int newMaxHz)
+{
+    jassert (newMinHz > 0 && newMaxHz > newMinHz);
+    hzRange = { newMinHz, newMaxHz };
+    updateSizes();
+}
+
+
+template<typename SampleType>
+void FFTPitchDetector<SampleType>::setSamplerate (const double newSamplerate)
+{
+    jassert (newSamplerate > 0);
+    samplerate = newSamplerate;
+    updateSizes();
+}
+
+
+template<typename SampleType>
+void FFTPitchDetector<SampleType>::setAllowDecimation (const bool shouldDecimate)
+{
+    if (allowDecimation == shouldDecimate)
+        return;
+    
+    allowDecimation = shouldDecimate;
+    updateSizes();
+}
+
+
+// reallocates everything for the current samplerate & Hz range. Don't call this from the audio thread!
+template<typename SampleType>
+void FFTPitchDetector<SampleType>::updateSizes()
+{
+    if (samplerate <= 0)
+        return;
+    
+    minPeriod = std::max (2, static_cast<int> (std::floor (samplerate / hzRange.getEnd())));
+    maxPeriod = std::max (minPeriod + 2, static_cast<int> (std::ceil (samplerate / hzRange.getStart())));
+    
+    decimationFactor = allowDecimation ? chooseDecimationFactor (samplerate, hzRange.getEnd()) : 1;
+    
+    analysisMinPeriod  = std::max (2, minPeriod / decimationFactor);
+    analysisMaxPeriod  = std::max (analysisMinPeriod + 2, (maxPeriod + decimationFactor - 1) / decimationFactor);
+    analysisWindowSize = analysisMaxPeriod;
+    analysisFrameSize  = analysisWindowSize + analysisMaxPeriod;
+    
+    windowSize = maxPeriod;
+    frameSize  = std::max (windowSize + maxPeriod, analysisFrameSize * decimationFactor);
+    
+    // a circular correlation of this size never wraps for lags up to analysisMaxPeriod, because analysisWindowSize - 1 + analysisMaxPeriod < analysisFrameSize
+    const auto fftOrder = juce::roundToInt (std::ceil (std::log2 (analysisFrameSize)));
+    const auto fftSize  = 1 << fftOrder;
+    
+    fft = std::make_unique<juce::dsp::FFT> (fftOrder);
+    
+    windowSpectrum.allocate (static_cast<size_t> (fftSize * 2), true);
+    frameSpectrum.allocate  (static_cast<size_t> (fftSize * 2), true);
+    runningEnergy.allocate  (static_cast<size_t> (analysisFrameSize + 1), true);
+    yinBuffer.allocate      (static_cast<size_t> (analysisMaxPeriod + 1), true);
+    
+    decimator.prepare (decimationFactor, frameSize);
+    decimatedFrame.allocate (static_cast<size_t> (analysisFrameSize), true);
+}
+
+
+template<typename SampleType>
+float FFTPitchDetector<SampleType>::detectPitch (const juce::AudioBuffer<SampleType>& inputAudio)
+{
+    jassert (fft != nullptr);
+    
+    const auto numSamples = inputAudio.getNumSamples();
+    
+    if (fft == nullptr || numSamples < frameSize)
+        return 0.0f;
+    
+    // analyse the most recent frameSize samples
+    const auto* reading = inputAudio.getReadPointer(0) + (numSamples - frameSize);
+    
+    if (decimationFactor == 1)
+    {
+        const auto period = estimatePeriod (reading);
+        
+        if (period <= SampleType(0))
+            return 0.0f;  // silent or unpitched
+        
+        return static_cast<float> (samplerate / static_cast<double> (period));
+    }
+    
+    // the decimator is primed with whatever precedes the frame, so each frame is decimated independently of what was passed in last time
+    const auto numPrecedingSamples = std::min (decimator.getHistoryLength(), numSamples - frameSize);
+    decimator.prime (reading - numPrecedingSamples, numPrecedingSamples);
+    
+    const auto numDecimated = decimator.process (reading, frameSize, decimatedFrame.get());
+    juce::ignoreUnused (numDecimated);
+    jassert (numDecimated == analysisFrameSize);
+    
+    const auto coarsePeriod = estimatePeriod (decimatedFrame.get());
+    
+    if (coarsePeriod <= SampleType(0))
+        return 0.0f;
+    
+    const auto period = refinePeriod (reading, windowSize, coarsePeriod * static_cast<SampleType> (decimationFactor), decimationFactor, getPeriodRange());
+    
+    return static_cast<float> (samplerate / static_cast<double> (period));
+}
+
+
+// runs YIN on analysisFrameSize samples at the analysis rate, and returns the fractional period in analysis-rate samples, or -1 if the frame is silent or unpitched
+template<typename SampleType>
+SampleType FFTPitchDetector<SampleType>::estimatePeriod (const SampleType* frame)
+{
+    const auto fftSize = fft->getSize();
+    
+    juce::FloatVectorOperations::clear (frameSpectrum.get(), fftSize * 2);
+    juce::FloatVectorOperations::clear (windowSpectrum.get(), fftSize * 2);
+    
+    runningEnergy[0] = 0.0;
+    
+    // the FFT only works in float, so the energies are summed from the same float samples it sees -- otherwise, with double input, the energy & correlation terms
+    // of d(tau) would describe slightly different signals, and their difference would be biased by the rounding
+    for (int s = 0; s < analysisFrameSize; ++s)
+    {
+        const auto sample = static_cast<float> (frame[s]);
+        frameSpectrum[s] = sample;
+        runningEnergy[s + 1] = runningEnergy[s] + static_cast<double> (sample) * static_cast<double> (sample);
+    }
+    
+    const auto windowEnergy = runningEnergy[analysisWindowSize];
+    
+    if (windowEnergy <= 0.0)
+        return SampleType(-1);  // silence
+    
+    juce::FloatVectorOperations::copy (windowSpectrum.get(), frameSpectrum.get(), analysisWindowSize);
+    
+    fft->performRealOnlyForwardTransform (frameSpectrum.get());
+    fft->performRealOnlyForwardTransform (windowSpectrum.get());
+    
+    // the cross-correlation of the window with the frame is the inverse transform of conj(window) * frame
+    for (int bin = 0; bin < fftSize; ++bin)
+    {
+        const auto wRe = windowSpectrum[2 * bin], wIm = windowSpectrum[2 * bin + 1];
+        const auto fRe = frameSpectrum[2 * bin],  fIm = frameSpectrum[2 * bin + 1];
+        
+        frameSpectrum[2 * bin]     = wRe * fRe + wIm * fIm;
+        frameSpectrum[2 * bin + 1] = wRe * fIm - wIm * fRe;
+    }
+    
+    fft->performRealOnlyInverseTransform (frameSpectrum.get());
+    
+    const auto* correlation = frameSpectrum.get();
+    
+    // the correlation at lag 0 is exactly the window's energy, so scaling to match it cancels out whatever normalisation the FFT engine applies
+    if (correlation[0] <= 0.0f)
+        return SampleType(-1);
+    
+    const auto correlationScale = windowEnergy / static_cast<double> (correlation[0]);
+    
+    // d(tau) = sum of x[j]^2 + sum of x[j+tau]^2 - 2 * sum of x[j] * x[j+tau], each sum over j in [0, analysisWindowSize)
+    // ...then the cumulative mean normalised difference: d'(tau) = d(tau) * tau / sum of d over [1, tau]
+    yinBuffer[0] = SampleType(1);
+    double runningSum = 0.0;
+    
+    for (int tau = 1; tau <= analysisMaxPeriod; ++tau)
+    {
+        const auto laggedEnergy = runningEnergy[tau + analysisWindowSize] - runningEnergy[tau];
+        const auto difference = std::max (0.0, windowEnergy + laggedEnergy - 2.0 * correlationScale * correlation[tau]);
+        
+        runningSum += difference;
+        
+        yinBuffer[tau] = runningSum > 0.0 ? static_cast<SampleType> (difference * tau / runningSum) : SampleType(1);
+    }
+    
+    const auto tau = findPeriodCandidate (yinBuffer.get(), analysisMinPeriod, analysisMaxPeriod, confidenceThresh);
+    
+    if (tau < 0)
+        return SampleType(-1);  // unpitched
+    
+    return interpolatePeriod (yinBuffer.get(), tau, analysisMaxPeriod);
+}
+
+
+template class FFTPitchDetector<float>;
+template class FFTPitchDetector<double>;
+
+
+} // namespace
@@ -0,0 +1,107 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ FFTPitchDetector.h: The FFTPitchDetector class estimates the fundamental frequency of a block of audio with the YIN algorithm, computing YIN's difference function from an FFT-based cross-correlation instead of directly.
+ The direct difference function costs O(n * maxPeriod) per frame, where this costs O(n log n). Its interface matches dsp::PitchDetector's, so the two are interchangeable.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+#include "PolyphaseDecimator.h"
+#include "YinPeriodPicking.h"
+
+
+namespace bav
+{
+
+
+template<typename SampleType>
+class FFTPitchDetector
+{
+public:
+    
+    FFTPitchDetector();
+    
+    void initialize();
+    
+    void releaseResources();
+    
+    // returns the detected frequency of the most recent getLatencySamples() samples of the input, or 0 if the frame is unpitched
+    float detectPitch (const juce::AudioBuffer<SampleType>& inputAudio);
+    
+    void setHzRange (const int newMinHz, const int newMaxHz);
+    
+    void setSamplerate (const double newSamplerate);
+    
+    // a frame is only considered pitched if the minimum of its normalised difference function falls below this threshold
+    void setConfidenceThresh (const SampleType newThresh) noexcept { confidenceThresh = newThresh; }
+    
+    // the detector needs two of its longest periods' worth of samples to analyse a frame
+    int getLatencySamples() const noexcept { return frameSize; }
+    
+    juce::Range<int> getPeriodRange() const noexcept { return { minPeriod, maxPeriod }; }
+    
+    /*
+        At high samplerates, the detector finds a coarse period on a decimated copy of the frame -- where the FFT & the difference function are a fraction of the size -- and then refines it with a handful of lags of the difference function at the full rate.
+        The decimation factor is chosen automatically from the samplerate & the maximum frequency; it's 1 (no decimation) at 44.1 kHz.
+    */
+    void setAllowDecimation (const bool shouldDecimate);
+    
+    int getDecimationFactor() const noexcept { return decimationFactor; }
+    
+    
+private:
+    
+    void updateSizes();
+    
+    SampleType estimatePeriod (const SampleType* frame);
+    
+    juce::Range<int> hzRange;
+    double samplerate;
+    SampleType confidenceThresh;
+    
+    int minPeriod, maxPeriod;
+    int windowSize;  // the number of samples summed for each lag of the difference function
+    int frameSize;   // windowSize + maxPeriod, rounded up to a whole number of decimated samples
+    
+    bool allowDecimation;
+    int decimationFactor;
+    
+    // the sizes above, at the decimated rate. When the decimation factor is 1 these are the same as the full rate sizes
+    int analysisMinPeriod, analysisMaxPeriod, analysisWindowSize, analysisFrameSize;
+    
+    PolyphaseDecimator<SampleType> decimator;
+    juce::HeapBlock<SampleType> decimatedFrame;
+    
+    std::unique_ptr<juce::dsp::FFT> fft;
+    
+    // juce::dsp::FFT is float only, so the coarse analysis is always in float, whatever SampleType is; the full rate refinement of the period is in SampleType
+    juce::HeapBlock<float> windowSpectrum, frameSpectrum;  // each is 2 * the FFT size, as juce::dsp::FFT's real-only transforms require
+    
+    juce::HeapBlock<double> runningEnergy;  // runningEnergy[k] is the sum of the squares of the first k samples of the frame, as rounded to float for the FFT
+    
+    juce::HeapBlock<SampleType> yinBuffer;  // the cumulative mean normalised difference function, for lags 0 to analysisMaxPeriod
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFTPitchDetector)
+};
+
+
+} // namespace
@@ -0,0 +1,156 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ PolyphaseDecimator.h: This file defines the PolyphaseDecimator class, an anti-aliased integer-factor downsampler used to run pitch detection at a reduced sample rate.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+
+
+/*
+    PolyphaseDecimator : low-pass filters a stream of samples with a windowed-sinc FIR and keeps every factor-th output.
+    Only the outputs that are kept are ever computed, so the cost per input sample is tapsPerPhase multiplies -- the same as running each polyphase branch at the output rate.
+    The branches are stored interleaved & reversed, so that each output is one contiguous dot product over the filter's history. The filter's state carries over between calls to process().
+*/
+
+template<typename SampleType>
+class PolyphaseDecimator
+{
+public:
+    PolyphaseDecimator(): factor(1), numTaps(0), samplesUntilNextOutput(0) { }
+    
+    // designs the filter and allocates the history for blocks of up to maxBlocksize input samples. Don't call this from the audio thread!
+    void prepare (const int decimationFactor, const int maxBlocksize, const int tapsPerPhase = 12)
+    {
+        jassert (decimationFactor >= 1 && maxBlocksize > 0 && tapsPerPhase > 0);
+        
+        factor = decimationFactor;
+        numTaps = tapsPerPhase * factor;
+        
+        coefficients.allocate (static_cast<size_t> (numTaps), true);
+        history.allocate (static_cast<size_t> (numTaps - 1 + maxBlocksize), true);
+        maxInputSamples = maxBlocksize;
+        
+        // cut off a little below the output Nyquist, so that the transition band is aliased out of the way
+        const auto cutoff = 0.4 / factor;  // in cycles per input sample
+        const auto centre = (numTaps - 1) * 0.5;
+        
+        double sum = 0.0;
+        
+        for (int k = 0; k < numTaps; ++k)
+        {
+            const auto t = k - centre;
+            const auto sinc = t == 0.0 ? 2.0 * cutoff
+                                       : std::sin (juce::MathConstants<double>::twoPi * cutoff * t) / (juce::MathConstants<double>::pi * t);
+            
+            const auto x = juce::MathConstants<double>::twoPi * k / (numTaps - 1);
+            const auto blackman = 0.42 - 0.5 * std::cos (x) + 0.08 * std::cos (2.0 * x);
+            
+            coefficients[numTaps - 1 - k] = static_cast<SampleType> (sinc * blackman);  // reversed
+            sum += sinc * blackman;
+        }
+        
+        // unity gain at DC
+        for (int k = 0; k < numTaps; ++k)
+            coefficients[k] = static_cast<SampleType> (coefficients[k] / sum);
+        
+        reset();
+    }
+    
+    void reset()
+    {
+        if (numTaps > 0)
+            juce::FloatVectorOperations::clear (history.get(), numTaps - 1);
+        
+        samplesUntilNextOutput = 0;
+    }
+    
+    // loads the filter's history with the samples that precede the next call to process(), without producing any output, so that the first outputs aren't coloured by the filter starting from silence
+    void prime (const SampleType* input, const int numSamples)
+    {
+        reset();
+        
+        const auto historyLength = numTaps - 1;
+        const auto numToCopy = std::min (numSamples, historyLength);
+        
+        if (numToCopy > 0)
+            juce::FloatVectorOperations::copy (history.get() + historyLength - numToCopy, input + numSamples - numToCopy, numToCopy);
+    }
+    
+    // filters numSamples input samples and writes the decimated samples to output. Returns the number of samples written, which is at most numSamples / factor rounded up.
+    int process (const SampleType* input, const int numSamples, SampleType* output)
+    {
+        jassert (numSamples <= maxInputSamples);
+        
+        if (factor == 1)
+        {
+            juce::FloatVectorOperations::copy (output, input, numSamples);
+            return numSamples;
+        }
+        
+        // history holds the last numTaps - 1 samples of the previous call, followed by this call's input
+        auto* buffer = history.get();
+        juce::FloatVectorOperations::copy (buffer + numTaps - 1, input, numSamples);
+        
+        int numOutputs = 0;
+        int n = samplesUntilNextOutput;
+        
+        for (; n < numSamples; n += factor)
+        {
+            const auto* window = buffer + n;  // the numTaps samples ending at input sample n
+            
+            SampleType sum = 0;
+            
+            for (int k = 0; k < numTaps; ++k)
+                sum += coefficients[k] * window[k];
+            
+            output[numOutputs++] = sum;
+        }
+        
+        samplesUntilNextOutput = n - numSamples;
+        
+        std::memmove (buffer, buffer + numSamples, sizeof (SampleType) * static_cast<size_t> (numTaps - 1));  // the regions overlap if numSamples < numTaps - 1
+        
+        return numOutputs;
+    }
+    
+    int getFactor() const noexcept { return factor; }
+    
+    // the number of preceding input samples that prime() can make use of
+    int getHistoryLength() const noexcept { return std::max (0, numTaps - 1); }
+    
+    
+private:
+    int factor;
+    int numTaps;
+    int maxInputSamples = 0;
+    int samplesUntilNextOutput;  // the offset into the next block of the next input sample that produces an output
+    
+    juce::HeapBlock<SampleType> coefficients;  // reversed
+    juce::HeapBlock<SampleType> history;
+};
+
+
+} // namespace
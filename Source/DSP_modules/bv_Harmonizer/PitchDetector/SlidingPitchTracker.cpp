@@ -0,0 +1,324 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ SlidingPitchTracker.cpp: This file defines implementation details for the SlidingPitchTracker class.
+ 
+======================================================================================================================================================*/
+
+
+#include "SlidingPitchTracker.h"
+
+
+#define bvhpd_DEFAULT_MIN_HZ 80
+#define bvhpd_DEFAULT_MAX_HZ 2400
+#define bvhpd_DEFAULT_CONFIDENCE_THRESH 0.15
+#define bvhpd_DEFAULT_HOP_SIZE 64
+
+// the running differences are recomputed exactly every this many hops
+#define bvhpd_RECOMPUTE_INTERVAL_HOPS 256
+
+// windows whose mean square is below this are treated as silent, as the running sums never quite return to 0
+#define bvhpd_SILENCE_MEAN_SQUARE 1.0e-12
+
+
+namespace bav
+{
+
+
+template<typename SampleType>
+SlidingPitchTracker<SampleType>::SlidingPitchTracker()
+    : hzRange (bvhpd_DEFAULT_MIN_HZ, bvhpd_DEFAULT_MAX_HZ), samplerate (0.0), confidenceThresh (SampleType(bvhpd_DEFAULT_CONFIDENCE_THRESH)),
+      hopSize (bvhpd_DEFAULT_HOP_SIZE),
+      minPeriod (0), maxPeriod (0), windowSize (0),
+      decimationFactor (1), analysisMinPeriod (0), analysisMaxPeriod (0), analysisWindowSize (0)
+{ }
+
+#undef bvhpd_DEFAULT_MIN_HZ
+#undef bvhpd_DEFAULT_MAX_HZ
+#undef bvhpd_DEFAULT_CONFIDENCE_THRESH
+#undef bvhpd_DEFAULT_HOP_SIZE
+
+
+template<typename SampleType>
+void SlidingPitchTracker<SampleType>::setHzRange (const int newMinHz, const int newMaxHz)
+{
+    jassert (newMinHz > 0 && newMaxHz > newMinHz);
+    hzRange = { newMinHz, newMaxHz };
+    updateSizes();
+}
+
+
+template<typename SampleType>
+void SlidingPitchTracker<SampleType>::setSamplerate (const double newSamplerate)
+{
+    jassert (newSamplerate > 0);
+    samplerate = newSamplerate;
+    updateSizes();
+}
+
+
+template<typename SampleType>
+void SlidingPitchTracker<SampleType>::setHopSize (const int newHopSize)
+{
+    jassert (newHopSize > 0);
+    hopSize = newHopSize;
+    updateSizes();
+}
+
+
+// reallocates everything for the current samplerate, Hz range & hop size, and clears the history. Don't call this from the audio thread!
+template<typename SampleType>
+void SlidingPitchTracker<SampleType>::updateSizes()
+{
+    if (samplerate <= 0)
+        return;
+    
+    minPeriod = std::max (2, static_cast<int> (std::floor (samplerate / hzRange.getEnd())));
+    maxPeriod = std::max (minPeriod + 2, static_cast<int> (std::ceil (samplerate / hzRange.getStart())));
+    windowSize = maxPeriod;
+    
+    decimationFactor = chooseDecimationFactor (samplerate, hzRange.getEnd());
+    
+    analysisMinPeriod  = std::max (2, minPeriod / decimationFactor);
+    analysisMaxPeriod  = std::max (analysisMinPeriod + 2, (maxPeriod + decimationFactor - 1) / decimationFactor);
+    analysisWindowSize = analysisMaxPeriod;
+    
+    analysisHistorySize = analysisWindowSize + analysisMaxPeriod + 1;
+    analysisHistory.allocate (static_cast<size_t> (analysisHistorySize * 2), true);
+    
+    if (decimationFactor > 1)
+    {
+        fullRateHistorySize = windowSize + maxPeriod;
+        fullRateHistory.allocate (static_cast<size_t> (fullRateHistorySize * 2), true);
+        decimatedHop.allocate (static_cast<size_t> (hopSize / decimationFactor + 1), true);
+    }
+    else
+    {
+        fullRateHistorySize = 0;
+        fullRateHistory.free();
+        decimatedHop.free();
+    }
+    
+    decimator.prepare (decimationFactor, hopSize);
+    
+    differences.allocate (static_cast<size_t> (analysisMaxPeriod + 1), true);
+    yinBuffer.allocate (static_cast<size_t> (analysisMaxPeriod + 1), true);
+    
+    reset();
+}
+
+
+template<typename SampleType>
+void SlidingPitchTracker<SampleType>::reset()
+{
+    if (analysisHistorySize > 0)
+    {
+        juce::FloatVectorOperations::clear (analysisHistory.get(), analysisHistorySize * 2);
+        std::fill (differences.get(), differences.get() + analysisMaxPeriod + 1, 0.0);
+    }
+    
+    if (fullRateHistorySize > 0)
+        juce::FloatVectorOperations::clear (fullRateHistory.get(), fullRateHistorySize * 2);
+    
+    decimator.reset();
+    
+    analysisWritePosition = 0;
+    fullRateWritePosition = 0;
+    windowEnergy = 0.0;
+    hopsSinceRecompute = 0;
+    samplesIntoHop = 0;
+    latestFrequency = 0.0f;
+}
+
+
+template<typename SampleType>
+void SlidingPitchTracker<SampleType>::releaseResources()
+{
+    analysisHistory.free();
+    fullRateHistory.free();
+    decimatedHop.free();
+    differences.free();
+    yinBuffer.free();
+    
+    analysisHistorySize = 0;
+    fullRateHistorySize = 0;
+}
+
+
+template<typename SampleType>
+void SlidingPitchTracker<SampleType>::process (const SampleType* input, const int numSamples, juce::Array<Estimate>& estimates)
+{
+    jassert (analysisHistorySize > 0);
+    
+    estimates.clearQuick();
+    
+    if (analysisHistorySize == 0)
+        return;
+    
+    int s = 0;
+    
+    while (s < numSamples)
+    {
+        const auto chunk = std::min (numSamples - s, hopSize - samplesIntoHop);
+        const auto* reading = input + s;
+        
+        if (decimationFactor > 1)
+        {
+            for (int i = 0; i < chunk; ++i)
+            {
+                fullRateHistory[fullRateWritePosition] = reading[i];
+                fullRateHistory[fullRateWritePosition + fullRateHistorySize] = reading[i];
+                
+                if (++fullRateWritePosition == fullRateHistorySize)
+                    fullRateWritePosition = 0;
+            }
+            
+            const auto numDecimated = decimator.process (reading, chunk, decimatedHop.get());
+            
+            for (int i = 0; i < numDecimated; ++i)
+                pushAnalysisSample (decimatedHop[i]);
+        }
+        else
+        {
+            for (int i = 0; i < chunk; ++i)
+                pushAnalysisSample (reading[i]);
+        }
+        
+        s += chunk;
+        samplesIntoHop += chunk;
+        
+        if (samplesIntoHop == hopSize)
+        {
+            samplesIntoHop = 0;
+            
+            if (++hopsSinceRecompute >= bvhpd_RECOMPUTE_INTERVAL_HOPS)
+                recomputeDifferences();
+            
+            latestFrequency = estimateFrequency();
+            estimates.add ({ s, latestFrequency });
+        }
+    }
+}
+
+#undef bvhpd_RECOMPUTE_INTERVAL_HOPS
+
+
+// adds one analysis-rate sample to the window, and drops the oldest one from it: every lag's difference gains the new sample's term & loses the oldest sample's term.
+// this costs 2 * analysisMaxPeriod multiply-adds per sample, in a loop that the compiler can vectorise.
+template<typename SampleType>
+void SlidingPitchTracker<SampleType>::pushAnalysisSample (const SampleType sample)
+{
+    analysisHistory[analysisWritePosition] = sample;
+    analysisHistory[analysisWritePosition + analysisHistorySize] = sample;
+    
+    if (++analysisWritePosition == analysisHistorySize)
+        analysisWritePosition = 0;
+    
+    // the last analysisHistorySize samples, oldest first
+    const auto* history = analysisHistory.get() + analysisWritePosition;
+    
+    const auto newest = analysisHistorySize - 1;
+    const auto leaving = newest - analysisWindowSize;  // the sample that just left the window
+    
+    const auto newSample = static_cast<double> (history[newest]);
+    const auto oldSample = static_cast<double> (history[leaving]);
+    
+    windowEnergy += newSample * newSample - oldSample * oldSample;
+    
+    auto* diffs = differences.get();
+    
+    for (int tau = 1; tau <= analysisMaxPeriod; ++tau)
+    {
+        const auto added   = newSample - static_cast<double> (history[newest - tau]);
+        const auto removed = oldSample - static_cast<double> (history[leaving - tau]);
+        
+        diffs[tau] += added * added - removed * removed;
+    }
+}
+
+
+template<typename SampleType>
+void SlidingPitchTracker<SampleType>::recomputeDifferences()
+{
+    hopsSinceRecompute = 0;
+    
+    const auto* history = analysisHistory.get() + analysisWritePosition;
+    const auto firstInWindow = analysisHistorySize - analysisWindowSize;
+    
+    windowEnergy = 0.0;
+    
+    for (int j = firstInWindow; j < analysisHistorySize; ++j)
+        windowEnergy += static_cast<double> (history[j]) * static_cast<double> (history[j]);
+    
+    for (int tau = 1; tau <= analysisMaxPeriod; ++tau)
+    {
+        double sum = 0.0;
+        
+        for (int j = firstInWindow; j < analysisHistorySize; ++j)
+        {
+            const auto delta = static_cast<double> (history[j]) - static_cast<double> (history[j - tau]);
+            sum += delta * delta;
+        }
+        
+        differences[tau] = sum;
+    }
+}
+
+
+template<typename SampleType>
+float SlidingPitchTracker<SampleType>::estimateFrequency()
+{
+    if (windowEnergy <= bvhpd_SILENCE_MEAN_SQUARE * analysisWindowSize)
+        return 0.0f;
+    
+    // the cumulative mean normalised difference: d'(tau) = d(tau) * tau / sum of d over [1, tau]
+    yinBuffer[0] = SampleType(1);
+    double runningSum = 0.0;
+    
+    for (int tau = 1; tau <= analysisMaxPeriod; ++tau)
+    {
+        const auto difference = std::max (0.0, differences[tau]);
+        
+        runningSum += difference;
+        
+        yinBuffer[tau] = runningSum > 0.0 ? static_cast<SampleType> (difference * tau / runningSum) : SampleType(1);
+    }
+    
+    const auto tau = findPeriodCandidate (yinBuffer.get(), analysisMinPeriod, analysisMaxPeriod, confidenceThresh);
+    
+    if (tau < 0)
+        return 0.0f;  // unpitched
+    
+    auto period = interpolatePeriod (yinBuffer.get(), tau, analysisMaxPeriod);
+    
+    if (decimationFactor > 1)
+        period = refinePeriod (fullRateHistory.get() + fullRateWritePosition, windowSize,
+                               period * static_cast<SampleType> (decimationFactor), decimationFactor, getPeriodRange());
+    
+    return static_cast<float> (samplerate / static_cast<double> (period));
+}
+
+#undef bvhpd_SILENCE_MEAN_SQUARE
+
+
+template class SlidingPitchTracker<float>;
+template class SlidingPitchTracker<double>;
+
+
+} // namespace
@@ -0,0 +1,127 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ SlidingPitchTracker.h: This file defines the SlidingPitchTracker class, which keeps YIN's difference function up to date over a sliding window so that it can report a new pitch estimate every few dozen samples.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+#include "PolyphaseDecimator.h"
+#include "YinPeriodPicking.h"
+
+
+namespace bav
+{
+
+
+/*
+    SlidingPitchTracker : an incremental YIN pitch tracker.
+    Rather than analysing a whole frame at a time like the FFTPitchDetector, it updates the difference function for every lag as each sample arrives & another leaves the window, and picks a period from it every hop.
+    This means the estimates don't depend on how the input is split into blocks, and the caller's block size isn't tied to the length of the analysis window.
+    At high samplerates the tracking runs on a decimated copy of the input, and each estimate is refined at the full rate, as the FFTPitchDetector does.
+*/
+
+template<typename SampleType>
+class SlidingPitchTracker
+{
+public:
+    
+    struct Estimate
+    {
+        int sampleOffset;  // the offset into the block passed to process() of the first sample after the hop that this estimate was made at
+        float frequency;   // 0 if the window was unpitched
+    };
+    
+    SlidingPitchTracker();
+    
+    void setHzRange (const int newMinHz, const int newMaxHz);
+    
+    void setSamplerate (const double newSamplerate);
+    
+    void setHopSize (const int newHopSize);
+    
+    void setConfidenceThresh (const SampleType newThresh) noexcept { confidenceThresh = newThresh; }
+    
+    // clears the signal history, as if the tracker had only ever heard silence
+    void reset();
+    
+    void releaseResources();
+    
+    // feeds a block of input to the tracker, and replaces the contents of estimates with one Estimate for each hop completed during the block.
+    // estimates should have room for numSamples / getHopSize() + 1 elements allocated beforehand, so that this never allocates.
+    void process (const SampleType* input, const int numSamples, juce::Array<Estimate>& estimates);
+    
+    // the most recent estimate, which may have been made during an earlier block
+    float getLatestFrequency() const noexcept { return latestFrequency; }
+    
+    int getHopSize() const noexcept { return hopSize; }
+    
+    int getDecimationFactor() const noexcept { return decimationFactor; }
+    
+    juce::Range<int> getPeriodRange() const noexcept { return { minPeriod, maxPeriod }; }
+    
+    
+private:
+    
+    void updateSizes();
+    
+    void pushAnalysisSample (const SampleType sample);
+    
+    void recomputeDifferences();
+    
+    float estimateFrequency();
+    
+    juce::Range<int> hzRange;
+    double samplerate;
+    SampleType confidenceThresh;
+    int hopSize;
+    
+    int minPeriod, maxPeriod, windowSize;  // at the full rate
+    
+    int decimationFactor;
+    int analysisMinPeriod, analysisMaxPeriod, analysisWindowSize;
+    
+    // the last analysisWindowSize + analysisMaxPeriod + 1 analysis-rate samples, written twice so that they can always be read as one contiguous span (see AnalysisRingBuffer)
+    juce::HeapBlock<SampleType> analysisHistory;
+    int analysisHistorySize = 0, analysisWritePosition = 0;
+    
+    // the last windowSize + maxPeriod full rate samples, for refining the decimated estimates. Only used when decimating
+    juce::HeapBlock<SampleType> fullRateHistory;
+    int fullRateHistorySize = 0, fullRateWritePosition = 0;
+    
+    PolyphaseDecimator<SampleType> decimator;
+    juce::HeapBlock<SampleType> decimatedHop;
+    
+    // differences[tau] is the sum of (x[t] - x[t - tau])^2 over the window. These are accumulated in doubles & periodically recomputed from scratch, so rounding errors can't build up
+    juce::HeapBlock<double> differences;
+    double windowEnergy = 0.0;
+    int hopsSinceRecompute = 0;
+    
+    juce::HeapBlock<SampleType> yinBuffer;  // the cumulative mean normalised difference function, for lags 0 to analysisMaxPeriod
+    
+    int samplesIntoHop = 0;
+    float latestFrequency = 0.0f;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SlidingPitchTracker)
+};
+
+
+} // namespace
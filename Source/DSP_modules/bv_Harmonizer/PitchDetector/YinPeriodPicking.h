@@ -0,0 +1,155 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ YinPeriodPicking.h: This file defines the steps of YIN pitch detection that are shared by the FFTPitchDetector and the SlidingPitchTracker: choosing the period from the cumulative mean normalised difference function, interpolating it, and refining a period estimated at a decimated rate.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+    
+
+/*
+    Chooses how far the pitch detectors can decimate their input: the decimated rate is kept at least 24 kHz, and at least 4x the highest frequency to be detected, and the factor is capped at 8.
+    Returns 1 (no decimation) at 44.1 kHz.
+*/
+inline int chooseDecimationFactor (const double samplerate, const int maxHz)
+{
+    constexpr double minAnalysisSamplerate = 24000.0;
+    constexpr int maxFactor = 8;
+    
+    const auto minRate = std::max (minAnalysisSamplerate, 4.0 * maxHz);
+    
+    return juce::jlimit (1, maxFactor, static_cast<int> (std::floor (samplerate / minRate)));
+}
+
+
+/*
+    Returns the first lag within [minPeriod, maxPeriod] where the normalised difference dips below the confidence threshold, followed down to the bottom of that dip.
+    Returns -1 if there's no such lag.
+*/
+template<typename SampleType>
+inline int findPeriodCandidate (const SampleType* yinBuffer, const int minPeriod, const int maxPeriod, const SampleType confidenceThresh)
+{
+    for (int tau = minPeriod; tau <= maxPeriod; ++tau)
+    {
+        if (yinBuffer[tau] >= confidenceThresh)
+            continue;
+        
+        while (tau + 1 <= maxPeriod && yinBuffer[tau + 1] < yinBuffer[tau])
+            ++tau;
+        
+        return tau;
+    }
+    
+    return -1;
+}
+
+
+/*
+    Refines an integer period with parabolic interpolation through its neighbouring lags.
+*/
+template<typename SampleType>
+inline SampleType interpolatePeriod (const SampleType* yinBuffer, const int tau, const int maxPeriod)
+{
+    if (tau <= 1 || tau >= maxPeriod)
+        return static_cast<SampleType> (tau);
+    
+    const auto prev = yinBuffer[tau - 1];
+    const auto curr = yinBuffer[tau];
+    const auto next = yinBuffer[tau + 1];
+    
+    const auto denominator = prev + next - SampleType(2) * curr;
+    
+    if (std::abs (denominator) < std::numeric_limits<SampleType>::epsilon())
+        return static_cast<SampleType> (tau);
+    
+    const auto shift = SampleType(0.5) * (prev - next) / denominator;
+    
+    if (std::abs (shift) >= SampleType(1))
+        return static_cast<SampleType> (tau);
+    
+    return static_cast<SampleType> (tau) + shift;
+}
+
+
+/*
+    A period estimated at a decimated rate is only accurate to within a sample or so at that rate, so it's refined by evaluating the plain difference function at the full rate, for the lags within searchRadius of it.
+    The frame must hold windowSize + periodRange.getEnd() samples. Returns the coarse period unchanged if the minimum falls at either end of the searched lags.
+*/
+template<typename SampleType>
+inline SampleType refinePeriod (const SampleType* frame, const int windowSize, const SampleType coarsePeriod,
+                                const int searchRadius, const juce::Range<int> periodRange)
+{
+    const auto centre = juce::roundToInt (coarsePeriod);
+    const auto lowest  = std::max (periodRange.getStart(), centre - searchRadius);
+    const auto highest = std::min (periodRange.getEnd(),   centre + searchRadius);
+    
+    if (highest - lowest < 2)
+        return coarsePeriod;
+    
+    auto differenceAt = [frame, windowSize] (const int tau)
+    {
+        double sum = 0.0;
+        
+        for (int j = 0; j < windowSize; ++j)
+        {
+            const auto delta = static_cast<double> (frame[j]) - static_cast<double> (frame[j + tau]);
+            sum += delta * delta;
+        }
+        
+        return sum;
+    };
+    
+    auto bestTau = lowest;
+    auto best = differenceAt (lowest);
+    
+    for (int tau = lowest + 1; tau <= highest; ++tau)
+    {
+        const auto difference = differenceAt (tau);
+        
+        if (difference < best)
+        {
+            best = difference;
+            bestTau = tau;
+        }
+    }
+    
+    if (bestTau == lowest || bestTau == highest)
+        return coarsePeriod;
+    
+    const auto prev = differenceAt (bestTau - 1);
+    const auto next = differenceAt (bestTau + 1);
+    
+    const auto denominator = prev + next - 2.0 * best;
+    
+    if (denominator <= 0.0)
+        return static_cast<SampleType> (bestTau);
+    
+    const auto shift = 0.5 * (prev - next) / denominator;
+    
+    return static_cast<SampleType> (bestTau + juce::jlimit (-0.5, 0.5, shift));
+}
+
+
+} // namespace
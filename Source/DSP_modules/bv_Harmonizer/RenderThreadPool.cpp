@@ -0,0 +1,169 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ RenderThreadPool.cpp: This file defines implementation details for the RenderThreadPool class.
+ 
+======================================================================================================================================================*/
+
+
+#include "RenderThreadPool.h"
+
+
+#define bvrtp_WORKER_THREAD_PRIORITY 9
+
+
+namespace bav
+{
+    
+
+class RenderThreadPool::Worker  :   public juce::Thread
+{
+public:
+    Worker (RenderThreadPool& p, int index)
+        : juce::Thread ("Imogen voice renderer " + juce::String (index + 1)),
+          pool (p)
+    { }
+    
+    // a signal that arrives while the worker is still busy is left in the semaphore's count, so a new batch is never missed; a stale one just finds nothing to claim
+    void run() override
+    {
+        while (! threadShouldExit())
+            if (! pool.runAnyJob())
+                pool.workAvailable.wait();
+    }
+    
+private:
+    RenderThreadPool& pool;
+};
+
+
+RenderThreadPool::RenderThreadPool (int numWorkerThreads)
+{
+    if (numWorkerThreads <= 0)
+        numWorkerThreads = juce::SystemStats::getNumCpus() - 1;
+    
+    numWorkerThreads = juce::jlimit (1, maxWorkerThreads, numWorkerThreads);
+    
+    for (int i = 0; i < numWorkerThreads; ++i)
+    {
+        auto* worker = workers.add (new Worker (*this, i));
+        worker->startThread (bvrtp_WORKER_THREAD_PRIORITY);
+    }
+}
+
+
+RenderThreadPool::~RenderThreadPool()
+{
+    for (auto* worker : workers)
+        worker->signalThreadShouldExit();
+    
+    workAvailable.signal (workers.size());
+    
+    for (auto* worker : workers)
+        worker->stopThread (1000);
+}
+
+
+void RenderThreadPool::run (int numJobs, JobFunction job, void* context) noexcept
+{
+    jassert (job != nullptr);
+    
+    if (numJobs <= 0)
+        return;
+    
+    auto* batch = numJobs > 1 ? claimBatchSlot() : nullptr;
+    
+    // there's nothing to share out, or every slot is taken by other batches, so this batch runs right here instead
+    if (batch == nullptr)
+    {
+        for (int i = 0; i < numJobs; ++i)
+            job (context, i);
+        
+        return;
+    }
+    
+    batch->job.store (job, std::memory_order_relaxed);
+    batch->context.store (context, std::memory_order_relaxed);
+    batch->jobsRemaining.store (numJobs, std::memory_order_relaxed);
+    batch->range.store (static_cast<juce::uint64> (numJobs), std::memory_order_release);
+    
+    // only as many workers as there are jobs for are woken
+    workAvailable.signal (std::min (workers.size(), numJobs - 1));
+    
+    while (runNextJob (*batch))
+    { }
+    
+    // every job has been claimed by now, so this only waits for workers to finish the ones they are already running -- never longer than one job, so it spins rather than sleeping
+    while (batch->jobsRemaining.load (std::memory_order_acquire) > 0)
+        spinPause();
+    
+    batch->inUse.store (false, std::memory_order_release);
+}
+
+
+RenderThreadPool::BatchSlot* RenderThreadPool::claimBatchSlot() noexcept
+{
+    for (auto& batch : batches)
+        if (! batch.inUse.load (std::memory_order_relaxed) && ! batch.inUse.exchange (true, std::memory_order_acquire))
+            return &batch;
+    
+    return nullptr;
+}
+
+
+// claims & runs one job from the batch. Returns false if it had none left to claim.
+bool RenderThreadPool::runNextJob (BatchSlot& batch) noexcept
+{
+    auto range = batch.range.load (std::memory_order_acquire);
+    
+    for (;;)
+    {
+        const auto next = range >> 32;
+        const auto end  = range & 0xffffffff;
+        
+        if (next >= end)
+            return false;
+        
+        if (batch.range.compare_exchange_weak (range, range + (juce::uint64 (1) << 32),
+                                               std::memory_order_acq_rel, std::memory_order_acquire))
+            break;
+    }
+    
+    // the batch can't finish while this job is unfinished, so its slot can't be refilled under us
+    batch.job.load (std::memory_order_relaxed) (batch.context.load (std::memory_order_relaxed), static_cast<int> (range >> 32));
+    batch.jobsRemaining.fetch_sub (1, std::memory_order_acq_rel);
+    return true;
+}
+
+
+// called by the workers: runs one job from any running batch. Returns false if no batch had a job left to claim.
+bool RenderThreadPool::runAnyJob() noexcept
+{
+    for (auto& batch : batches)
+        if (batch.inUse.load (std::memory_order_acquire) && runNextJob (batch))
+            return true;
+    
+    return false;
+}
+
+
+} // namespace
+
+
+#undef bvrtp_WORKER_THREAD_PRIORITY
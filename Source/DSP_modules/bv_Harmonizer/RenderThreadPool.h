@@ -0,0 +1,93 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ RenderThreadPool.h: This file defines the RenderThreadPool class, a pool of pre-spawned worker threads, shared by every Harmonizer & engine in the process, that renders voices & singers in parallel.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+    
+
+/*
+    RenderThreadPool : runs batches of independent jobs across a set of pre-spawned worker threads and the calling thread.
+    run() is safe to call from the audio thread: it never allocates, takes a lock or sleeps. Each call publishes its batch in a slot of its own, so several threads -- or several plugin instances
+    sharing the pool -- can run batches at once, and a job can run a batch of its own (an engine's singer job runs its harmonizer's voice batch): the idle workers just take jobs from
+    whichever batches have some left. The calling thread claims jobs from its own batch too, so a batch always completes even if every worker is busy elsewhere.
+    Idle workers sleep on a LightweightSemaphore, which run() signals without locking, so an idle pool costs nothing.
+    Access the pool through a juce::SharedResourcePointer<RenderThreadPool>, so that the whole process shares one set of workers.
+*/
+
+class RenderThreadPool
+{
+public:
+    
+    using JobFunction = void (*) (void* context, int jobIndex);
+    
+    // creates the worker threads. Pass 0 to use one worker per CPU core, minus one for the calling thread.
+    explicit RenderThreadPool (int numWorkerThreads = 0);
+    
+    ~RenderThreadPool();
+    
+    // calls job (context, i) once for every i in [0, numJobs), and returns once they have all finished. Jobs may call run() themselves.
+    void run (int numJobs, JobFunction job, void* context) noexcept;
+    
+    int getNumWorkerThreads() const noexcept { return workers.size(); }
+    
+    static constexpr int maxWorkerThreads = 15;
+    
+    // if this many batches are already running, run() just runs the jobs itself
+    static constexpr int maxConcurrentBatches = 32;
+    
+    
+private:
+    
+    class Worker;
+    
+    // one running batch. Its unclaimed range of job indices is packed into one atomic, so that a claim can never race with the slot being refilled for another batch
+    struct alignas(64) BatchSlot
+    {
+        std::atomic<bool> inUse { false };
+        std::atomic<juce::uint64> range { 0 };  // next job in the high 32 bits, end of the range in the low 32 bits
+        std::atomic<JobFunction> job { nullptr };
+        std::atomic<void*> context { nullptr };
+        std::atomic<int> jobsRemaining { 0 };
+    };
+    
+    BatchSlot* claimBatchSlot() noexcept;
+    
+    bool runNextJob (BatchSlot& batch) noexcept;
+    
+    bool runAnyJob() noexcept;
+    
+    BatchSlot batches[maxConcurrentBatches];
+    
+    LightweightSemaphore workAvailable { maxWorkerThreads };
+    
+    juce::OwnedArray<Worker> workers;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RenderThreadPool)
+};
+
+
+} // namespace
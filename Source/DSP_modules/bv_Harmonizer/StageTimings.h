@@ -0,0 +1,299 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ StageTimings.h: This file defines the per-stage CPU telemetry used to show where each block's processing time goes: a cycle counter, a scoped stage timer, a lock-free ring that carries one record per block from the audio thread to a reader, and a meter that turns those records into load figures.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+#if BV_HARMONIZER_STAGE_TIMING && JUCE_INTEL
+  #if JUCE_MSVC
+    #include <intrin.h>
+  #else
+    #include <x86intrin.h>
+  #endif
+#endif
+
+
+namespace bav
+{
+
+
+// the stages that each block's timings are broken down into. Stages a block doesn't run, or that are compiled out, just read 0.
+enum RenderStage
+{
+    pitchDetectionStage,
+    grainExtractionStage,
+    voiceRenderingStage,
+    dynamicsStage,  // the gate, de-esser & compressor share one detector, so they're timed together
+    reverbStage,
+    limiterStage,
+    wholeBlockStage,
+    numRenderStages
+};
+
+
+static inline const char* getRenderStageName (RenderStage stage) noexcept
+{
+    switch (stage)
+    {
+        case pitchDetectionStage:  return "Pitch";
+        case grainExtractionStage: return "Grains";
+        case voiceRenderingStage:  return "Voices";
+        case dynamicsStage:        return "Dynamics";
+        case reverbStage:          return "Reverb";
+        case limiterStage:         return "Limiter";
+        case wholeBlockStage:      return "Total";
+        case numRenderStages:      break;
+    }
+    
+    return "";
+}
+
+
+// reads the cheapest monotonic counter available. Its rate is only known to the StageLoadMeter, which calibrates it against the wall clock.
+static inline juce::uint64 readCycleCounter() noexcept
+{
+#if BV_HARMONIZER_STAGE_TIMING && JUCE_INTEL
+    return static_cast<juce::uint64> (__rdtsc());
+#elif BV_HARMONIZER_STAGE_TIMING && JUCE_ARM && JUCE_64BIT && ! JUCE_MSVC
+    juce::uint64 ticks;
+    asm volatile ("mrs %0, cntvct_el0" : "=r" (ticks));
+    return ticks;
+#else
+    return static_cast<juce::uint64> (juce::Time::getHighResolutionTicks());
+#endif
+}
+
+
+/*
+    StageTimings: the counter ticks spent in each stage of one block.
+*/
+
+struct StageTimings
+{
+    juce::uint64& operator[] (RenderStage stage) noexcept { return cycles[stage]; }
+    
+    juce::uint64 operator[] (RenderStage stage) const noexcept { return cycles[stage]; }
+    
+    void clear() noexcept
+    {
+        std::fill (std::begin (cycles), std::end (cycles), juce::uint64 (0));
+        numSamples = 0;
+    }
+    
+    // adds another set of timings for the same block, e.g. from one of several harmonizers
+    void addFrom (const StageTimings& other) noexcept
+    {
+        for (int stage = 0; stage < numRenderStages; ++stage)
+            cycles[stage] += other.cycles[stage];
+    }
+    
+    juce::uint64 cycles[numRenderStages] = {};
+    int numSamples = 0;
+};
+
+
+/*
+    ScopedStageTimer: adds the counter ticks between its construction & destruction to a running total.
+    With BV_HARMONIZER_STAGE_TIMING disabled this is an empty object, so the timed code compiles exactly as it would without it.
+*/
+
+class ScopedStageTimer
+{
+public:
+    explicit ScopedStageTimer (juce::uint64& totalToAddTo) noexcept
+#if BV_HARMONIZER_STAGE_TIMING
+        : total (totalToAddTo), start (readCycleCounter())
+#endif
+    {
+        juce::ignoreUnused (totalToAddTo);
+    }
+    
+    ~ScopedStageTimer() noexcept
+    {
+#if BV_HARMONIZER_STAGE_TIMING
+        total += readCycleCounter() - start;
+#endif
+    }
+    
+private:
+#if BV_HARMONIZER_STAGE_TIMING
+    juce::uint64& total;
+    const juce::uint64 start;
+#endif
+    
+    JUCE_DECLARE_NON_COPYABLE (ScopedStageTimer)
+};
+
+
+/*
+    StageTelemetry: a single-producer, single-consumer ring of per-block timings.
+    push() is called by the audio thread once per block, and never blocks or allocates; if the reader has fallen behind, the block's timings are dropped.
+    readAll() may only be called from one thread at a time.
+*/
+
+class StageTelemetry
+{
+public:
+    StageTelemetry()
+    {
+        records.allocate (capacity, true);
+    }
+    
+    void push (const StageTimings& block) noexcept
+    {
+#if BV_HARMONIZER_STAGE_TIMING
+        const auto scope = fifo.write (1);
+        
+        if (scope.blockSize1 > 0)
+            records[scope.startIndex1] = block;
+#else
+        juce::ignoreUnused (block);
+#endif
+    }
+    
+    // calls the function with each record that has been pushed since the last call, oldest first
+    template<typename Function>
+    void readAll (Function&& function)
+    {
+        const auto scope = fifo.read (fifo.getNumReady());
+        
+        for (int i = 0; i < scope.blockSize1; ++i)
+            function (records[scope.startIndex1 + i]);
+        
+        for (int i = 0; i < scope.blockSize2; ++i)
+            function (records[scope.startIndex2 + i]);
+    }
+    
+private:
+    // a couple of seconds of blocks at the engine's smallest internal blocksize, so a reader polling at the GUI's framerate never falls behind
+    static constexpr int capacity = 1024;
+    
+    juce::AbstractFifo fifo { capacity };
+    juce::HeapBlock<StageTimings> records;
+    
+    JUCE_DECLARE_NON_COPYABLE (StageTelemetry)
+};
+
+
+/*
+    StageLoadMeter: the reader side of a StageTelemetry ring. Call update() regularly (e.g. from a GUI timer), always from the same thread.
+    Each stage's load is the time it took as a percentage of the audio time it processed, averaged over the last complete window; the worst block is the slowest single block in that window.
+    The counter's rate is calibrated against the wall clock between calls to update(), so the first figures appear after a fraction of a second.
+*/
+
+class StageLoadMeter
+{
+public:
+    explicit StageLoadMeter (double windowSecondsToUse = 0.5) : windowSeconds (windowSecondsToUse) { }
+    
+    void update (StageTelemetry& telemetry, double samplerate)
+    {
+        calibrate();
+        
+        telemetry.readAll ([this] (const StageTimings& block)
+                           {
+                               windowTimings.addFrom (block);
+                               windowTimings.numSamples += block.numSamples;
+                               
+                               if (block[wholeBlockStage] > windowWorstBlock[wholeBlockStage])
+                                   windowWorstBlock = block;
+                           });
+        
+        if (samplerate <= 0.0 || cyclesPerSecond <= 0.0 || windowTimings.numSamples < windowSeconds * samplerate)
+            return;
+        
+        const auto audioCycles = windowTimings.numSamples / samplerate * cyclesPerSecond;
+        
+        for (int stage = 0; stage < numRenderStages; ++stage)
+            stageLoads[stage] = 100.0 * static_cast<double> (windowTimings.cycles[stage]) / audioCycles;
+        
+        worstBlockSeconds = static_cast<double> (windowWorstBlock[wholeBlockStage]) / cyclesPerSecond;
+        worstBlockBudgetSeconds = windowWorstBlock.numSamples / samplerate;
+        
+        windowTimings.clear();
+        windowWorstBlock.clear();
+        hasResults = true;
+    }
+    
+    bool hasMeasured() const noexcept { return hasResults; }
+    
+    // as a percentage of real time
+    double getStageLoad (RenderStage stage) const noexcept { return stageLoads[stage]; }
+    
+    // the time the slowest block of the last window took, and the audio time that block had to fit into
+    double getWorstBlockSeconds() const noexcept { return worstBlockSeconds; }
+    double getWorstBlockBudgetSeconds() const noexcept { return worstBlockBudgetSeconds; }
+    
+    // a one-line summary, e.g. "Pitch 2.1%  Grains 0.3%  ...  Total 14.6%  |  Worst block 0.42 / 11.61 ms"
+    juce::String getSummary() const
+    {
+        if (! hasResults)
+            return {};
+        
+        juce::String summary;
+        
+        for (int stage = 0; stage < numRenderStages; ++stage)
+            summary << getRenderStageName (static_cast<RenderStage> (stage)) << " "
+                    << juce::String (stageLoads[stage], 1) << "%  ";
+        
+        return summary << "|  Worst block " << juce::String (worstBlockSeconds * 1000.0, 2)
+                       << " / " << juce::String (worstBlockBudgetSeconds * 1000.0, 2) << " ms";
+    }
+    
+private:
+    void calibrate()
+    {
+        const auto nowCycles = readCycleCounter();
+        const auto nowMs = juce::Time::getMillisecondCounterHiRes();
+        
+        if (calibrationStartMs <= 0.0)
+        {
+            calibrationStartCycles = nowCycles;
+            calibrationStartMs = nowMs;
+            return;
+        }
+        
+        // measured from the first call, so the estimate gets steadily more precise
+        const auto elapsedMs = nowMs - calibrationStartMs;
+        
+        if (elapsedMs >= 100.0)
+            cyclesPerSecond = static_cast<double> (nowCycles - calibrationStartCycles) / (elapsedMs * 0.001);
+    }
+    
+    const double windowSeconds;
+    
+    juce::uint64 calibrationStartCycles = 0;
+    double calibrationStartMs = 0.0;
+    double cyclesPerSecond = 0.0;
+    
+    StageTimings windowTimings, windowWorstBlock;
+    
+    double stageLoads[numRenderStages] = {};
+    double worstBlockSeconds = 0.0, worstBlockBudgetSeconds = 0.0;
+    bool hasResults = false;
+    
+    JUCE_DECLARE_NON_COPYABLE (StageLoadMeter)
+};
+
+
+} // namespace
@@ -0,0 +1,299 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ TraceRecorder.cpp: This file contains the TraceRecorder's event ring and the background thread that writes the trace file.
+ 
+======================================================================================================================================================*/
+
+
+namespace bav
+{
+
+
+// how long the writer sleeps between draining the ring
+#define bvh_TRACE_WRITER_INTERVAL_MS 20
+
+
+class TraceRecorder::WriterThread  :   public juce::Thread
+{
+public:
+    WriterThread (TraceRecorder& recorderToDrain, std::unique_ptr<juce::FileOutputStream> streamToUse, Format formatToUse)
+        : juce::Thread ("Imogen trace writer"),
+          recorder (recorderToDrain), stream (std::move (streamToUse)), format (formatToUse),
+          startTicks (TraceRecorder::now())
+    {
+        if (format == chromeTrace)
+            *stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        else
+            *stream << "event,phase,thread,start_us,duration_us,index,value\n";
+    }
+    
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            drain();
+            wait (bvh_TRACE_WRITER_INTERVAL_MS);
+        }
+    }
+    
+    // called once this thread has stopped, after the last events have been added
+    void finish()
+    {
+        drain();
+        
+        const auto numDropped = recorder.numDropped.exchange (0);
+        
+        if (numDropped > 0)
+            write ({ "Dropped events", TraceEvent::counter, TraceRecorder::now(), 0, juce::Thread::getCurrentThreadId(), -1, float (numDropped) });
+        
+        if (format == chromeTrace)
+            *stream << "]}\n";
+        
+        stream->flush();
+    }
+    
+private:
+    void drain()
+    {
+        TraceEvent event;
+        
+        while (recorder.pop (event))
+            write (event);
+        
+        stream->flush();
+    }
+    
+    void write (const TraceEvent& event)
+    {
+        const auto start = ticksToMicroseconds (event.startTicks - startTicks);
+        const auto duration = event.phase == TraceEvent::complete ? ticksToMicroseconds (event.endTicks - event.startTicks) : 0.0;
+        const auto thread = getThreadNumber (event.thread);
+        
+        if (format == csv)
+        {
+            *stream << event.name << ',' << getPhaseName (event.phase) << ',' << thread << ','
+                    << juce::String (start, 3) << ',' << juce::String (duration, 3) << ','
+                    << event.index << ',' << juce::String (event.value) << '\n';
+            return;
+        }
+        
+        if (numWritten++ > 0)
+            *stream << ",\n";
+        
+        *stream << "{\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << thread << ",\"ts\":" << juce::String (start, 3);
+        
+        switch (event.phase)
+        {
+            case TraceEvent::complete:
+                *stream << ",\"ph\":\"X\",\"dur\":" << juce::String (duration, 3);
+                
+                if (event.index >= 0)
+                    *stream << ",\"args\":{\"index\":" << event.index << "}";
+                
+                break;
+                
+            case TraceEvent::instant:
+                *stream << ",\"ph\":\"i\",\"s\":\"p\",\"args\":{\"index\":" << event.index << ",\"value\":" << juce::String (event.value) << "}";
+                break;
+                
+            case TraceEvent::counter:
+                *stream << ",\"ph\":\"C\",\"args\":{\"value\":" << juce::String (event.value) << "}";
+                break;
+        }
+        
+        *stream << "}";
+    }
+    
+    static double ticksToMicroseconds (juce::int64 ticks) noexcept
+    {
+        return juce::Time::highResolutionTicksToSeconds (ticks) * 1.0e6;
+    }
+    
+    static const char* getPhaseName (TraceEvent::Phase phase) noexcept
+    {
+        switch (phase)
+        {
+            case TraceEvent::complete: return "complete";
+            case TraceEvent::instant:  return "instant";
+            case TraceEvent::counter:  return "counter";
+        }
+        
+        return "";
+    }
+    
+    // threads are numbered in the order they first appear, which is easier to read than their system IDs
+    int getThreadNumber (juce::Thread::ThreadID thread)
+    {
+        const auto existing = threads.indexOf (thread);
+        
+        if (existing >= 0)
+            return existing;
+        
+        threads.add (thread);
+        return threads.size() - 1;
+    }
+    
+    TraceRecorder& recorder;
+    std::unique_ptr<juce::FileOutputStream> stream;
+    const Format format;
+    const juce::int64 startTicks;
+    juce::Array<juce::Thread::ThreadID> threads;
+    int numWritten = 0;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WriterThread)
+};
+
+#undef bvh_TRACE_WRITER_INTERVAL_MS
+
+
+/*===========================================================================================================================
+ ============================================================================================================================*/
+
+
+TraceRecorder::TraceRecorder()
+    : slots (new Slot[capacity])
+{
+    // a slot whose sequence equals the enqueue position is free for that position
+    for (size_t i = 0; i < capacity; ++i)
+        slots[i].sequence.store (i, std::memory_order_relaxed);
+}
+
+
+TraceRecorder::~TraceRecorder()
+{
+    stop();
+}
+
+
+TraceRecorder::Format TraceRecorder::getFormatForFile (const juce::File& file)
+{
+    return file.hasFileExtension ("csv") ? csv : chromeTrace;
+}
+
+
+bool TraceRecorder::start (const juce::File& file, Format format)
+{
+    stop();
+    
+    file.deleteFile();
+    
+    auto stream = std::make_unique<juce::FileOutputStream> (file);
+    
+    if (! stream->openedOk())
+        return false;
+    
+    // anything left from the last recording was either written or dropped; start from an empty ring
+    TraceEvent stale;
+    while (pop (stale)) { }
+    
+    numDropped.store (0);
+    
+    writer = std::make_unique<WriterThread> (*this, std::move (stream), format);
+    writer->startThread();
+    
+    recording.store (true, std::memory_order_release);
+    return true;
+}
+
+
+void TraceRecorder::stop()
+{
+    if (writer == nullptr)
+        return;
+    
+    recording.store (false, std::memory_order_release);
+    
+    writer->stopThread (1000);
+    writer->finish();
+    writer.reset();
+}
+
+
+void TraceRecorder::addComplete (const char* name, juce::int64 startTicks, juce::int64 endTicks, int index) noexcept
+{
+    if (isRecording())
+        push ({ name, TraceEvent::complete, startTicks, endTicks, juce::Thread::getCurrentThreadId(), index, 0.0f });
+}
+
+
+void TraceRecorder::addInstant (const char* name, int index, float value) noexcept
+{
+    if (isRecording())
+        push ({ name, TraceEvent::instant, now(), 0, juce::Thread::getCurrentThreadId(), index, value });
+}
+
+
+void TraceRecorder::addCounter (const char* name, float value) noexcept
+{
+    if (isRecording())
+        push ({ name, TraceEvent::counter, now(), 0, juce::Thread::getCurrentThreadId(), -1, value });
+}
+
+
+// claims the slot at the enqueue position with a compare-and-swap, so that any number of threads can push at once without locking
+void TraceRecorder::push (const TraceEvent& event) noexcept
+{
+    auto position = enqueuePosition.load (std::memory_order_relaxed);
+    
+    for (;;)
+    {
+        auto& slot = slots[position & (capacity - 1)];
+        const auto sequence = slot.sequence.load (std::memory_order_acquire);
+        const auto difference = static_cast<juce::pointer_sized_int> (sequence) - static_cast<juce::pointer_sized_int> (position);
+        
+        if (difference == 0)
+        {
+            if (enqueuePosition.compare_exchange_weak (position, position + 1, std::memory_order_relaxed))
+            {
+                slot.event = event;
+                slot.sequence.store (position + 1, std::memory_order_release);
+                return;
+            }
+        }
+        else if (difference < 0)
+        {
+            numDropped.fetch_add (1, std::memory_order_relaxed);  // the ring is full
+            return;
+        }
+        else
+        {
+            position = enqueuePosition.load (std::memory_order_relaxed);
+        }
+    }
+}
+
+
+// only called from one thread at a time: the writer, or the message thread while the writer isn't running
+bool TraceRecorder::pop (TraceEvent& event) noexcept
+{
+    auto& slot = slots[dequeuePosition & (capacity - 1)];
+    const auto sequence = slot.sequence.load (std::memory_order_acquire);
+    
+    if (static_cast<juce::pointer_sized_int> (sequence) - static_cast<juce::pointer_sized_int> (dequeuePosition + 1) < 0)
+        return false;
+    
+    event = slot.event;
+    slot.sequence.store (dequeuePosition + capacity, std::memory_order_release);
+    ++dequeuePosition;
+    return true;
+}
+
+
+} // namespace
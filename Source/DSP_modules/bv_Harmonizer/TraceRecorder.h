@@ -0,0 +1,145 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ TraceRecorder.h: This file defines the TraceRecorder class, which captures timestamped per-block events from the audio thread and writes them to a Chrome trace or CSV file for offline profiling.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+
+
+/*
+    TraceEvent: one timestamped event. Timestamps are juce high resolution ticks.
+*/
+
+struct TraceEvent
+{
+    enum Phase { complete, instant, counter };
+    
+    const char* name;  // must be a string literal, since the audio thread can't copy strings
+    Phase phase;
+    juce::int64 startTicks, endTicks;  // instant & counter events only use startTicks
+    juce::Thread::ThreadID thread;
+    int index;    // e.g. a voice number, a parameter number, or a blocksize; -1 for none
+    float value;  // a counter's value, or the new value of a parameter
+};
+
+
+/*
+    TraceRecorder: while recording, any thread can add events without blocking, allocating or touching the file, and a background thread drains them into the file.
+    Events are passed through a bounded multi-producer ring, because the voices, the singers & the pipelined analysis all run on worker threads. If the writer falls behind, events are dropped and counted, and the count is written at the end of the file.
+    Adding an event while not recording costs a single atomic load. Start & stop recording from the message thread.
+*/
+
+class TraceRecorder
+{
+public:
+    enum Format
+    {
+        chromeTrace,  // JSON for chrome://tracing or Perfetto
+        csv
+    };
+    
+    TraceRecorder();
+    
+    ~TraceRecorder();
+    
+    // chooses the format from the file's extension: .csv for CSV, anything else for a Chrome trace
+    static Format getFormatForFile (const juce::File& file);
+    
+    // replaces the file, and returns false if it couldn't be opened. Any recording already running is stopped first.
+    bool start (const juce::File& file, Format format);
+    bool start (const juce::File& file) { return start (file, getFormatForFile (file)); }
+    
+    // writes any remaining events and finishes the file
+    void stop();
+    
+    bool isRecording() const noexcept { return recording.load (std::memory_order_acquire); }
+    
+    static juce::int64 now() noexcept { return juce::Time::getHighResolutionTicks(); }
+    
+    // these can be called from any thread, and are ignored while not recording
+    void addComplete (const char* name, juce::int64 startTicks, juce::int64 endTicks, int index = -1) noexcept;
+    void addInstant  (const char* name, int index = -1, float value = 0.0f) noexcept;
+    void addCounter  (const char* name, float value) noexcept;
+    
+    
+private:
+    void push (const TraceEvent& event) noexcept;
+    bool pop (TraceEvent& event) noexcept;
+    
+    class WriterThread;
+    
+    // 2^15 events is several seconds of even the busiest sessions, far longer than the writer ever sleeps for
+    static constexpr size_t capacity = size_t(1) << 15;
+    
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        TraceEvent event;
+    };
+    
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> enqueuePosition { 0 };
+    size_t dequeuePosition = 0;  // only touched by the writer
+    
+    std::atomic<bool> recording { false };
+    std::atomic<int> numDropped { 0 };
+    
+    std::unique_ptr<WriterThread> writer;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TraceRecorder)
+};
+
+
+/*
+    ScopedTraceEvent: adds a complete event covering its own lifetime. The recorder may be nullptr; if it isn't recording when this is created, this does nothing.
+*/
+
+class ScopedTraceEvent
+{
+public:
+    ScopedTraceEvent (TraceRecorder* recorderToUse, const char* eventName, int eventIndex = -1) noexcept
+        : recorder (recorderToUse != nullptr && recorderToUse->isRecording() ? recorderToUse : nullptr),
+          name (eventName), index (eventIndex),
+          start (recorder != nullptr ? TraceRecorder::now() : 0)
+    { }
+    
+    ~ScopedTraceEvent() noexcept
+    {
+        if (recorder != nullptr)
+            recorder->addComplete (name, start, TraceRecorder::now(), index);
+    }
+    
+private:
+    TraceRecorder* const recorder;
+    const char* const name;
+    const int index;
+    const juce::int64 start;
+    
+    JUCE_DECLARE_NON_COPYABLE (ScopedTraceEvent)
+};
+
+
+} // namespace
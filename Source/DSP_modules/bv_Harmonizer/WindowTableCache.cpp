@@ -0,0 +1,141 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ WindowTableCache.cpp: This file defines implementation details for the WindowTableCache class.
+ 
+======================================================================================================================================================*/
+
+
+#include "WindowTableCache.h"
+
+
+namespace bav
+{
+    
+
+template<typename SampleType>
+WindowTableCache<SampleType>::TableSet::TableSet (FillFunction function)
+    : fill (function),
+      tables    (new std::atomic<const SampleType*>[maxTableLength + 1]),
+      storage   (new juce::HeapBlock<SampleType>[maxTableLength + 1]),
+      numLeases (new int[maxTableLength + 1])
+{
+    for (int i = 0; i <= maxTableLength; ++i)
+    {
+        tables[i].store (nullptr);
+        numLeases[i] = 0;
+    }
+}
+    
+
+template<typename SampleType>
+WindowTableCache<SampleType>::WindowTableCache()
+    : hannWindowSet (fillHannWindow), distanceWeightSet (fillDistanceWeights)
+{ }
+
+
+template<typename SampleType>
+void WindowTableCache<SampleType>::Lease::setLengths (juce::Range<int> newLengths)
+{
+    newLengths = newLengths.getIntersectionWith ({ 1, maxTableLength + 1 });
+    
+    if (newLengths == lengths)
+        return;
+    
+    cache.addLeases (type, newLengths);
+    cache.removeLeases (type, lengths);
+    
+    lengths = newLengths;
+}
+    
+
+template<typename SampleType>
+void WindowTableCache<SampleType>::addLeases (TableType type, juce::Range<int> lengths)
+{
+    if (lengths.isEmpty())
+        return;
+    
+    auto& set = getSet (type);
+    
+    const juce::ScopedLock sl (lock);
+    
+    for (int length = lengths.getStart(); length < lengths.getEnd(); ++length)
+    {
+        if (set.numLeases[length]++ > 0)
+            continue;
+        
+        set.storage[length].allocate (length + 1, false);
+        set.fill (set.storage[length].get(), length);
+        
+        set.tables[length].store (set.storage[length].get(), std::memory_order_release);
+    }
+}
+
+
+// frees every table in the range that no other lease still holds. By then, no lease can hand out a pointer to it
+template<typename SampleType>
+void WindowTableCache<SampleType>::removeLeases (TableType type, juce::Range<int> lengths)
+{
+    auto& set = getSet (type);
+    
+    const juce::ScopedLock sl (lock);
+    
+    for (int length = lengths.getStart(); length < lengths.getEnd(); ++length)
+    {
+        jassert (set.numLeases[length] > 0);
+        
+        if (--set.numLeases[length] > 0)
+            continue;
+        
+        set.tables[length].store (nullptr, std::memory_order_release);
+        set.storage[length].free();
+    }
+}
+    
+
+template<typename SampleType>
+void WindowTableCache<SampleType>::fillHannWindow (SampleType* table, const int length)
+{
+    if (length < 2)
+    {
+        table[0] = SampleType(1.0);
+        return;
+    }
+    
+    const auto step = juce::MathConstants<double>::twoPi / double(length - 1);
+    
+    for (int i = 0; i < length; ++i)
+        table[i] = static_cast<SampleType> (0.5 - 0.5 * std::cos (step * i));
+}
+    
+
+template<typename SampleType>
+void WindowTableCache<SampleType>::fillDistanceWeights (SampleType* table, const int frameLength)
+{
+    // the weighting falls away linearly from 1 at the predicted peak, to 0.5 a whole frame away from it
+    for (int d = 0; d <= frameLength; ++d)
+        table[d] = static_cast<SampleType> (1.0 - (double(d) / double(frameLength)) * 0.5);
+}
+
+
+template class WindowTableCache<float>;
+template class WindowTableCache<double>;
+
+
+} // namespace
@@ -0,0 +1,122 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ WindowTableCache.h: This file defines the WindowTableCache class, which owns precomputed Hann windows & peak-picking distance weightings, keyed by their length. A single cache of each sample type is shared by every Harmonizer in the process, and only keeps the lengths that its users have leased.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+    
+
+/*
+    Each table is built off the audio thread, and is only freed once nothing holds a lease on its length, so the audio thread can read tables without locking.
+    A user of the cache takes out a Lease on the range of lengths it may ask for, when it's prepared. Any tables in that range that don't exist yet are built before the lease is returned, so every length in a leased range can be read straight away.
+    Memory use is bounded by the union of the leased ranges.
+    Access a cache through a juce::SharedResourcePointer<WindowTableCache<SampleType>> so that it is shared between all grains, voices & plugin instances.
+*/
+
+template<typename SampleType>
+class WindowTableCache
+{
+public:
+    
+    enum TableType
+    {
+        hannWindows,     // element i of a table of length n is the Hann window of length n at i
+        distanceWeights  // element d is the peak-picking weighting for a sample d samples away from the predicted peak, in a frame of the table's length; the table has length + 1 elements
+    };
+    
+    WindowTableCache();
+    
+    static constexpr int maxTableLength = 16384;
+    
+    
+    /*
+        Lease: keeps the tables of one type for a range of lengths alive, and is the only way to read them.
+        Change the range from the message thread while the owner isn't rendering, as this builds the new tables; get() is safe to call from the audio thread.
+    */
+    class Lease
+    {
+    public:
+        Lease (WindowTableCache& cacheToUse, TableType typeToUse) noexcept : cache (cacheToUse), type (typeToUse) { }
+        
+        ~Lease() { setLengths ({}); }
+        
+        // the tables in the new range are leased before the old range is given up, so tables in both are never freed & rebuilt
+        void setLengths (juce::Range<int> newLengths);
+        
+        juce::Range<int> getLengths() const noexcept { return lengths; }
+        
+        // returns the table of the requested length, or nullptr if it's outside the leased range
+        const SampleType* get (const int length) const noexcept
+        {
+            return lengths.contains (length) ? cache.getSet (type).tables[length].load (std::memory_order_acquire) : nullptr;
+        }
+        
+    private:
+        WindowTableCache& cache;
+        const TableType type;
+        juce::Range<int> lengths;
+        
+        JUCE_DECLARE_NON_COPYABLE (Lease)
+    };
+    
+    
+private:
+    
+    using FillFunction = void (*) (SampleType* table, const int length);
+    
+    struct TableSet
+    {
+        TableSet (FillFunction function);
+        
+        FillFunction fill;
+        
+        std::unique_ptr< std::atomic<const SampleType*>[] > tables;  // indexed by length
+        
+        // these are only touched with the cache's lock held
+        std::unique_ptr< juce::HeapBlock<SampleType>[] > storage;   // indexed by length
+        std::unique_ptr< int[] > numLeases;                         // indexed by length
+    };
+    
+    TableSet& getSet (TableType type) noexcept { return type == hannWindows ? hannWindowSet : distanceWeightSet; }
+    
+    // builds any tables in the range that no other lease already holds
+    void addLeases (TableType type, juce::Range<int> lengths);
+    
+    void removeLeases (TableType type, juce::Range<int> lengths);
+    
+    static void fillHannWindow (SampleType* table, const int length);
+    
+    static void fillDistanceWeights (SampleType* table, const int frameLength);
+    
+    TableSet hannWindowSet, distanceWeightSet;
+    
+    juce::CriticalSection lock;  // guards the storage & lease counts, since leases belonging to different plugin instances may change at once
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WindowTableCache)
+};
+
+
+} // namespace
@@ -23,7 +23,14 @@
 
 
 #include "bv_HarmonizerVoice.cpp"
+#include "PitchDetector/FFTPitchDetector.cpp"
+#include "PitchDetector/SlidingPitchTracker.cpp"
 #include "GrainExtractor/GrainExtractor.cpp"
+#include "WindowTableCache.cpp"
+#include "LightweightSemaphore.cpp"
+#include "RenderThreadPool.cpp"
+#include "PipelinedAnalysisWorker.cpp"
+#include "TraceRecorder.cpp"
 
 
 #define bvh_ADSR_QUICK_ATTACK_MS 5
@@ -36,6 +43,11 @@
 
 #define bvh_NUM_ANALYSIS_GRAINS 32
 
+// the analysis ring holds this many blocks of input history, so that grains from earlier blocks stay valid while synthesis grains are still playing them
+#define bvh_ANALYSIS_HISTORY_BLOCKS 3
+
+#define bvh_PIPELINE_MIDI_BYTES 4096
+
 
 namespace bav
 {
@@ -47,6 +59,7 @@ Harmonizer<SampleType>::Harmonizer()
     Base::setConcertPitchHz(440);
     
     pitchDetector.setConfidenceThresh (SampleType(bvh_PITCH_DETECTION_CONFIDENCE_THRESH));
+    pitchTracker.setConfidenceThresh (SampleType(bvh_PITCH_DETECTION_CONFIDENCE_THRESH));
     
     Base::updateQuickAttackMs (bvh_ADSR_QUICK_ATTACK_MS);
     Base::updateQuickReleaseMs (bvh_ADSR_QUICK_RELEASE_MS);
@@ -55,6 +68,18 @@ Harmonizer<SampleType>::Harmonizer()
     Base::softPedalMultiplier = float(bvh_SOFT_PEDAL_GAIN_MULTIPLIER);
 }
     
+
+template<typename SampleType>
+Harmonizer<SampleType>::~Harmonizer()
+{
+    if (usePipelinedAnalysis)
+        (*analysisWorker)->removeClient (*this);
+    
+    // the voices belong to the pool, so the base class mustn't delete them too
+    Base::voices.clearQuick (false);
+}
+
+    
 #undef bvh_ADSR_QUICK_ATTACK_MS
 #undef bvh_ADSR_QUICK_RELEASE_MS
 #undef bvh_PLAYING_BUT_RELEASED_GAIN_MULTIPLIER
@@ -72,44 +97,161 @@ void Harmonizer<SampleType>::initialized (const double initSamplerate, const int
 template<typename SampleType>
 void Harmonizer<SampleType>::prepared (int blocksize)
 {
-    inputStorage.setSize (1, blocksize);
+    const ScopedPipelinePause pause (*this);
+    
+    preparedBlocksize = blocksize;
+    
+    for (auto& frame : pipelineFrames)
+        frame.input.setSize (1, blocksize);
     
-    indicesOfGrainOnsets.ensureStorageAllocated (blocksize);
+    pipelineMidi.ensureSize (bvh_PIPELINE_MIDI_BYTES);
+    
+    analysisRing.prepare (requiredRingCapacity (blocksize));
+    
+    // grains overlap by half a grain, so their windowed copies take up twice the space of the input they cover
+    grainStore.prepare (analysisRing.getCapacity() * 2);
+    grainWindowingBuffer.setSize (1, analysisRing.getCapacity());
+    
+    // at most one period change per hop, plus the one at the start of the block
+    const auto maxPeriodChanges = blocksize / pitchTracker.getHopSize() + 2;
+    
+    for (auto* periods : { &blockPeriods, &serialAnalysis.periods, &pipelineFrames[0].analysis.periods, &pipelineFrames[1].analysis.periods, &lateFrameAnalysis.periods })
+        periods->ensureStorageAllocated (maxPeriodChanges);
+    
+    trackerEstimates.ensureStorageAllocated (maxPeriodChanges);
+    pitchTracker.reset();
+    lastTrackedPeriod = 0;
+    lastTrackedPeriodWasPitched = false;
+    
+    const auto peakPickingLength = blocksize + peakPickingLookback();
+    
+    trackedInput.setSize (1, peakPickingLength);
+    trackedInputLength = 0;
+    
+    for (auto* onsets : { &serialAnalysis.grainOnsets, &pipelineFrames[0].analysis.grainOnsets, &pipelineFrames[1].analysis.grainOnsets })
+        onsets->ensureStorageAllocated (peakPickingLength);
 
-    grains.prepare (blocksize);
+    grains.prepare (peakPickingLength);
     
     while (analysisGrains.size() < bvh_NUM_ANALYSIS_GRAINS)
         analysisGrains.add (new Analysis_Grain());
     
-    for (auto* grain : analysisGrains)
-        grain->reserveSize (blocksize);
+    grainsByStart.ensureStorageAllocated (analysisGrains.size());
+    emptyGrains.ensureStorageAllocated (analysisGrains.size());
+    
+    resetGrainStorage();
+    
+    updateWindowTableLeases();
+}
+
+
+// leases the Hann windows for every grain size the current period ranges can produce, and the peak-picking weights that go with them
+template<typename SampleType>
+void Harmonizer<SampleType>::updateWindowTableLeases()
+{
+    auto periods = pitchDetector.getPeriodRange();
+    
+    if (! pitchTracker.getPeriodRange().isEmpty())
+        periods = periods.getUnionWith (pitchTracker.getPeriodRange());
+    
+    auto grainSizes = juce::Range<int> (periods.getStart() * 2, periods.getEnd() * 2 + 1)
+                        .getUnionWith ({ unpitchedArbitraryPeriodRange.getStart() * 2, unpitchedArbitraryPeriodRange.getEnd() * 2 });
+    
+    hannWindows.setLengths (grainSizes);
+    grains.setPeriodRange (periods);
+}
+
+
+// the ring has to hold a few blocks' worth of history, and always at least a few of the longest grains, however short the blocks are
+template<typename SampleType>
+int Harmonizer<SampleType>::requiredRingCapacity (int blocksize) const noexcept
+{
+    const auto longestGrain = 2 * std::max (pitchDetector.getPeriodRange().getEnd(), unpitchedArbitraryPeriodRange.getEnd());
+    
+    return std::max (blocksize, longestGrain) * bvh_ANALYSIS_HISTORY_BLOCKS;
+}
+
+
+// with incremental tracking, the peak picker looks back this far into the input before each block -- enough for a grain of the longest period to end at the block's first sample
+template<typename SampleType>
+int Harmonizer<SampleType>::peakPickingLookback() const noexcept
+{
+    return 2 * std::max (pitchDetector.getPeriodRange().getEnd(), pitchTracker.getPeriodRange().getEnd());
 }
 
 
 template<typename SampleType>
 void Harmonizer<SampleType>::samplerateChanged (double newSamplerate)
 {
+    const ScopedPipelinePause pause (*this);
+    
     pitchDetector.setSamplerate (newSamplerate);
+    pitchTracker.setSamplerate (newSamplerate);
 }
     
 
 template<typename SampleType>
 void Harmonizer<SampleType>::updatePitchDetectionHzRange (const int minHz, const int maxHz)
 {
+    const ScopedPipelinePause pause (*this);
+    
     pitchDetector.setHzRange (minHz, maxHz);
+    pitchTracker.setHzRange (minHz, maxHz);
 
     if (Base::sampleRate > 0)
+    {
         pitchDetector.setSamplerate (Base::sampleRate);
+        pitchTracker.setSamplerate (Base::sampleRate);
+    }
+    
+    if (preparedBlocksize > 0)
+        updateWindowTableLeases();
+    
+    // with incremental tracking the latency doesn't change with the range, so there may be no re-prepare to make room for longer grains
+    if (preparedBlocksize > 0
+        && (analysisRing.getCapacity() < requiredRingCapacity (preparedBlocksize)
+            || trackedInput.getNumSamples() < preparedBlocksize + peakPickingLookback()))
+        prepared (preparedBlocksize);
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::setUseIncrementalPitchTracking (bool shouldUseIncrementalTracking, int internalBlocksize, int hopSize)
+{
+    jassert (internalBlocksize > 0 && hopSize > 0);
+    
+    const ScopedPipelinePause pause (*this);
+    
+    useIncrementalTracking = shouldUseIncrementalTracking;
+    incrementalBlocksize = internalBlocksize;
+    
+    if (hopSize != pitchTracker.getHopSize())
+        pitchTracker.setHopSize (hopSize);
+    
+    pitchTracker.reset();
+    lastTrackedPeriod = 0;
+    lastTrackedPeriodWasPitched = false;
+    trackedInputLength = 0;
 }
 
     
 template<typename SampleType>
 void Harmonizer<SampleType>::release()
 {
-    inputStorage.clear();
-    indicesOfGrainOnsets.clear();
+    const ScopedPipelinePause pause (*this);
+    
+    resetGrainStorage();
+    hannWindows.setLengths ({});
+    analysisRing.release();
+    grainStore.release();
+    grainWindowingBuffer.setSize (0, 0);
     grains.releaseResources();
     pitchDetector.releaseResources();
+    pitchTracker.reset();
+    trackedInput.setSize (0, 0);
+    trackedInputLength = 0;
+    grainsByStart.clear();
+    emptyGrains.clear();
     analysisGrains.clear();
 }
 
@@ -119,70 +261,736 @@ void Harmonizer<SampleType>::render (const AudioBuffer& input, AudioBuffer& outp
 {
     jassert (input.getNumSamples() == output.getNumSamples());
     jassert (output.getNumChannels() == 2);
+    
+    blockTimings.clear();
+    
+    if (usePipelinedAnalysis)
+    {
+        renderPipelined (input, output, midiMessages);
+        return;
+    }
+    
     analyzeInput (input);
+    renderVoices (output, midiMessages);
+}
+
+
+// renders the voices from the most recently committed block of analysis
+template<typename SampleType>
+void Harmonizer<SampleType>::renderVoices (AudioBuffer& output, juce::MidiBuffer& midiMessages)
+{
+    const ScopedStageTimer timer (blockTimings[voiceRenderingStage]);
+    const ScopedTraceEvent trace (traceRecorder, "Voices");
+    
+    hideDormantVoices();
+    
+    parallelSpanStart = -1;
+    
     Base::renderVoices (midiMessages, output);
+    
+    // a voice whose span was prerendered, but that wasn't rendered after all, goes back to where it was
+    for (auto* voice : voicePool)
+        voice->discardPrerender();
+    
+    restoreDormantVoices();
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::setActiveVoiceCeiling (int newCeiling) noexcept
+{
+    jassert (newCeiling > 0);
+    activeVoiceCeiling.store (std::max (1, newCeiling), std::memory_order_relaxed);
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::playChord (const juce::Array<int>& desiredNotes, const float velocity, const bool allowTailOffOfOld)
+{
+    hideDormantVoices();
+    Base::playChord (desiredNotes, velocity, allowTailOffOfOld);
+    restoreDormantVoices();
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::bypassedBlock (const int numSamples, juce::MidiBuffer& midiMessages)
+{
+    hideDormantVoices();
+    Base::bypassedBlock (numSamples, midiMessages);
+    restoreDormantVoices();
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::changeNumVoices (const int newNumVoices)
+{
+    jassert (newNumVoices > 0);
+    
+    if (newNumVoices > voicePool.size())
+        addNumVoices (newNumVoices - voicePool.size());
+    
+    setActiveVoiceCeiling (newNumVoices);
+}
+
+
+/*
+    Takes the voices above the active ceiling out of Base::voices for the length of one block, so that they can't be given notes, and cost nothing to render.
+    Every voice that's still sounding stays in, and the rest of the places under the ceiling go to idle voices in pool order. Base::voices has room for the whole pool, so this never allocates.
+*/
+template<typename SampleType>
+void Harmonizer<SampleType>::hideDormantVoices()
+{
+    const auto ceiling = activeVoiceCeiling.load (std::memory_order_relaxed);
+    
+    if (ceiling >= voicePool.size())
+        return;
+    
+    int numSounding = 0;
+    
+    for (auto* voice : voicePool)
+        if (voice->isVoiceActive())
+            ++numSounding;
+    
+    auto idlePlaces = ceiling - numSounding;
+    
+    Base::voices.clearQuick (false);
+    
+    for (auto* voice : voicePool)
+    {
+        if (voice->isVoiceActive())
+            Base::voices.add (voice);
+        else if (idlePlaces > 0)
+        {
+            Base::voices.add (voice);
+            --idlePlaces;
+        }
+    }
+    
+    dormantVoicesHidden = true;
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::restoreDormantVoices()
+{
+    if (! dormantVoicesHidden)
+        return;
+    
+    Base::voices.clearQuick (false);
+    
+    for (auto* voice : voicePool)
+        Base::voices.add (voice);
+    
+    dormantVoicesHidden = false;
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::setUsePipelinedAnalysis (bool shouldUsePipeline)
+{
+    if (shouldUsePipeline == usePipelinedAnalysis)
+        return;
+    
+    const ScopedPipelinePause pause (*this);
+    
+    // the worker is shared by every Harmonizer in the process; it's acquired here, on the message thread, the first time it's needed
+    if (analysisWorker == nullptr)
+        analysisWorker = std::make_unique<juce::SharedResourcePointer<PipelinedAnalysisWorker>>();
+    
+    if (shouldUsePipeline)
+        (*analysisWorker)->addClient (*this);
+    else
+        (*analysisWorker)->removeClient (*this);
+    
+    usePipelinedAnalysis = shouldUsePipeline;
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::pausePipeline()
+{
+    if (pipelinePauseDepth++ > 0)
+        return;
+    
+    // a frame that the worker hasn't picked up yet is just dropped; one it's already analysing is waited for
+    for (auto& frame : pipelineFrames)
+    {
+        while (true)
+        {
+            auto state = frame.state.load (std::memory_order_acquire);
+            
+            jassert (state != pipelinePaused);
+            
+            if (state == frameAnalysing)
+            {
+                juce::Thread::yield();
+                continue;
+            }
+            
+            if (frame.state.compare_exchange_weak (state, pipelinePaused, std::memory_order_acq_rel))
+                break;
+        }
+    }
+    
+    // an offline render may be waiting for a frame that was just dropped
+    frameAnalysed.signal();
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::resumePipeline()
+{
+    jassert (pipelinePauseDepth > 0);
+    
+    if (--pipelinePauseDepth > 0)
+        return;
+    
+    pipelineMidi.clear();
+    
+    for (auto& frame : pipelineFrames)
+        frame.state.store (frameEmpty, std::memory_order_release);
+}
+
+
+// the voices render the block that was handed to the analysis worker last time, while the worker analyses this one
+template<typename SampleType>
+void Harmonizer<SampleType>::renderPipelined (const AudioBuffer& input, AudioBuffer& output, juce::MidiBuffer& midiMessages)
+{
+    const auto numSamples = input.getNumSamples();
+    
+    // the pipeline is only paused while the harmonizer is being reconfigured, which shouldn't happen while rendering -- but if it does, there's nothing safe to render
+    if (pipelineFrames[0].state.load (std::memory_order_acquire) == pipelinePaused)
+    {
+        handedOffFrame = -1;
+        output.clear();
+        bypassedBlock (numSamples, midiMessages);
+        return;
+    }
+    
+    // the MIDI is delayed by one block along with the audio, so that notes line up with the input they were played over.
+    // Swapping exchanges the buffers' storage, so this never allocates
+    pipelineMidi.swapWith (midiMessages);
+    
+    const bool haveFrame = collectPipelinedFrame();
+    
+    handOffFrame (input);
+    
+    if (! haveFrame)  // the very first block after the pipeline starts has nothing to render yet
+    {
+        output.clear();
+        bypassedBlock (numSamples, midiMessages);
+        return;
+    }
+    
+    renderVoices (output, midiMessages);
+}
+
+
+// called by the analysis worker. Only the worker ever analyses pipelined frames, so two frames are never analysed at once.
+template<typename SampleType>
+bool Harmonizer<SampleType>::analysePendingFrame()
+{
+    for (auto& frame : pipelineFrames)
+    {
+        int expected = framePending;
+        
+        if (! frame.state.compare_exchange_strong (expected, frameAnalysing, std::memory_order_acq_rel))
+            continue;
+        
+        analyseFrame (frame.input, frame.analysis);
+        
+        frame.state.store (frameReady, std::memory_order_release);
+        frameAnalysed.signal();
+        return true;
+    }
+    
+    return false;
+}
+
+
+// commits the block handed off last time. Returns false if no block was handed off.
+// If the worker hasn't finished analysing it, this doesn't wait: the block's grains are laid out with the last committed period instead, and the late analysis is discarded.
+// Rendering offline, there's no deadline to miss, so this waits for the worker instead.
+template<typename SampleType>
+bool Harmonizer<SampleType>::collectPipelinedFrame()
+{
+    if (handedOffFrame < 0)
+        return false;
+    
+    auto& frame = pipelineFrames[handedOffFrame];
+    handedOffFrame = -1;
+    
+    auto state = frame.state.load (std::memory_order_acquire);
+    
+    if (nonRealtime.load (std::memory_order_relaxed))
+    {
+        while (state == framePending || state == frameAnalysing)
+        {
+            frameAnalysed.wait();
+            state = frame.state.load (std::memory_order_acquire);
+        }
+    }
+    else if (state == framePending)
+    {
+        if (frame.state.compare_exchange_strong (state, frameEmpty, std::memory_order_acq_rel))
+            trackedInputIsStale.store (true, std::memory_order_release);  // this block is committed, but the tracker never sees it
+        else
+            state = frame.state.load (std::memory_order_acquire);  // the worker has just picked it up
+    }
+    
+    if (state == frameReady)
+    {
+        commitFrame (frame.input, frame.analysis);
+        return true;
+    }
+    
+    if (state != framePending && state != frameAnalysing)  // dropped by a pause
+        return false;
+    
+    lateFrameAnalysis.periods.clearQuick();
+    lateFrameAnalysis.periods.add ({ 0, nextFramesPeriod > 0 ? nextFramesPeriod : unpitchedArbitraryPeriodRange.getStart() });
+    lateFrameAnalysis.invertPolarity = lastBlockWasInverted;
+    
+    commitFrame (frame.input, lateFrameAnalysis);
+    return true;
+}
+
+
+// copies the block into a frame the worker isn't analysing, & wakes the worker. Only the frame handed off last time can still be in the worker's hands, so the other one is always free.
+template<typename SampleType>
+void Harmonizer<SampleType>::handOffFrame (const AudioBuffer& input)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        auto& frame = pipelineFrames[i];
+        auto state = frame.state.load (std::memory_order_acquire);
+        
+        if (state != frameEmpty && state != frameReady)
+            continue;
+        
+        frame.input.setSize (1, input.getNumSamples(), false, false, true);
+        frame.input.copyFrom (0, 0, input, 0, 0, input.getNumSamples());
+        
+        if (frame.state.compare_exchange_strong (state, framePending, std::memory_order_acq_rel))
+        {
+            handedOffFrame = i;
+            (*analysisWorker)->frameHandedOff();
+        }
+        
+        return;
+    }
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::setUseMultithreadedRendering (bool shouldUseMultithreading)
+{
+    // the pool is shared by every Harmonizer in the process; it's acquired here, on the message thread, the first time it's needed
+    if (shouldUseMultithreading && renderPool == nullptr)
+        renderPool = std::make_unique<juce::SharedResourcePointer<RenderThreadPool>>();
+    
+    useMultithreadedRendering.store (shouldUseMultithreading, std::memory_order_release);
+}
+
+
+// called by each voice as it starts rendering a span of the block. The synth base handles all of a span's MIDI before it renders any voice, so by the time the first voice asks
+// for a span, every voice's pitch for that span is known: that first call renders the whole span for all of the active voices on the render pool, & the rest just collect the results.
+template<typename SampleType>
+void Harmonizer<SampleType>::renderSpanInParallel (int startSample, int numSamples)
+{
+    if (startSample == parallelSpanStart || ! useMultithreadedRendering.load (std::memory_order_acquire))
+        return;
+    
+    parallelSpanStart = startSample;
+    parallelSpanLength = numSamples;
+    
+    voicesToPrerender.clearQuick();
+    
+    for (auto* voice : voicePool)
+    {
+        voice->discardPrerender();
+        
+        if (voice->isVoiceActive())
+            voicesToPrerender.add (voice);
+    }
+    
+    // with only one voice, there's nothing to gain from handing it off
+    if (voicesToPrerender.size() < 2)
+        return;
+    
+    (*renderPool)->run (voicesToPrerender.size(), prerenderVoiceJob, this);
+}
+
+
+template<typename SampleType>
+void Harmonizer<SampleType>::prerenderVoiceJob (void* harmonizer, int voiceIndex)
+{
+    auto* harm = static_cast<Harmonizer*> (harmonizer);
+    harm->voicesToPrerender.getUnchecked (voiceIndex)->prerenderSpan (harm->parallelSpanStart, harm->parallelSpanLength);
 }
 
     
 template<typename SampleType>
 void Harmonizer<SampleType>::analyzeInput (const AudioBuffer& inputAudio)
+{
+    analyseFrame (inputAudio, serialAnalysis);
+    commitFrame (inputAudio, serialAnalysis);
+}
+
+
+// detects the pitch of a block of input. This only touches the pitch detector & grain extractor, so it can run on the analysis thread while the voices render.
+template<typename SampleType>
+void Harmonizer<SampleType>::analyseFrame (const AudioBuffer& inputAudio, FrameAnalysis& analysis)
 {
     jassert (Base::sampleRate > 0);
     
-//    const auto inputFrequency = pitchDetector.detectPitch (inputAudio);  // outputs 0.0 if frame is unpitched
-//    const bool frameIsPitched = inputFrequency > 0;
+    analysis.pitchDetectionCycles = 0;
+    analysis.peakPickingCycles = 0;
+    
+    analysis.periods.clearQuick();
+    analysis.grainOnsets.clearQuick();
+    
+    const ScopedStageTimer timer (analysis.pitchDetectionCycles);
+    const ScopedTraceEvent trace (traceRecorder, "Pitch detection");
     
-    const float inputFrequency = 440.0f;
-    const bool frameIsPitched = true;
+    if (useIncrementalTracking)
+    {
+        trackFramePitch (inputAudio, analysis);
+        return;
+    }
+    
+    const auto inputFrequency = pitchDetector.detectPitch (inputAudio);  // outputs 0.0 if frame is unpitched
+    const bool frameIsPitched = inputFrequency > 0;
+    
+    const auto period = frameIsPitched ? juce::roundToInt (Base::sampleRate / inputFrequency)
+                                       : unpitchedRandom.nextInt (unpitchedArbitraryPeriodRange);
+    
+    jassert (period > 0);
     
+    analysis.periods.add ({ 0, period });
+    
+    // for unpitched frames, reverse the polarity approx 50% of the time
+    analysis.invertPolarity = ! frameIsPitched && unpitchedRandom.nextBool();
+    
+    // centres each pitched grain on a PSOLA peak. Unpitched frames have no peaks to find, so their grains are just spaced a period apart
+    if (frameIsPitched && inputAudio.getNumSamples() >= 2 * period)
+    {
+        const ScopedStageTimer peakTimer (analysis.peakPickingCycles);
+        grains.getGrainOnsetIndices (analysis.grainOnsets, inputAudio, period);
+    }
+}
+
+
+// runs the sliding pitch tracker over the block, and starts a new period at each hop whose estimate differs from the last.
+// A block that's pitched throughout with a single period has its grains centred on PSOLA peaks, the same as a pitch detector frame.
+template<typename SampleType>
+void Harmonizer<SampleType>::trackFramePitch (const AudioBuffer& inputAudio, FrameAnalysis& analysis)
+{
     const auto numSamples = inputAudio.getNumSamples();
     
-    vecops::copy (inputAudio.getReadPointer(0), inputStorage.getWritePointer(0), numSamples);
+    pitchTracker.process (inputAudio.getReadPointer(0), numSamples, trackerEstimates);
+    
+    const auto historyLength = appendTrackedInput (inputAudio);
     
-    nextFramesPeriod = frameIsPitched ? juce::roundToInt (Base::sampleRate / inputFrequency)
-                                      : juce::Random::getSystemRandom().nextInt (unpitchedArbitraryPeriodRange);
+    // every unpitched hop in the block shares one arbitrary period
+    const auto unpitchedPeriod = unpitchedRandom.nextInt (unpitchedArbitraryPeriodRange);
     
-    jassert (nextFramesPeriod > 0);
+    bool anyHopIsPitched = false;
     
-    if (! frameIsPitched && bav::math::probability (50)) // for unpitched frames, reverse the polarity approx 50% of the time
+    if (lastTrackedPeriod <= 0)
+        lastTrackedPeriod = unpitchedPeriod;
+    
+    bool wholeBlockIsPitched = lastTrackedPeriodWasPitched;
+    
+    analysis.periods.add ({ 0, lastTrackedPeriod });
+    
+    for (const auto& estimate : trackerEstimates)
     {
-        vecops::multiplyC (inputStorage.getWritePointer(0), SampleType(-1), numSamples); // negate the samples -- reverse polarity
+        const bool hopIsPitched = estimate.frequency > 0;
+        anyHopIsPitched = anyHopIsPitched || hopIsPitched;
+        
+        lastTrackedPeriod = hopIsPitched ? juce::roundToInt (Base::sampleRate / estimate.frequency) : unpitchedPeriod;
+        lastTrackedPeriodWasPitched = hopIsPitched;
+        
+        // an estimate made at the very end of the block takes effect from the start of the next one
+        if (estimate.sampleOffset >= numSamples)
+            continue;
+        
+        // an estimate at the block's first sample replaces the period carried over from the last block
+        wholeBlockIsPitched = hopIsPitched && (wholeBlockIsPitched || estimate.sampleOffset == 0);
+        
+        auto& latest = analysis.periods.getReference (analysis.periods.size() - 1);
+        
+        if (lastTrackedPeriod == latest.period)
+            continue;
+        
+        if (latest.startSample == estimate.sampleOffset)
+            latest.period = lastTrackedPeriod;
+        else
+            analysis.periods.add ({ estimate.sampleOffset, lastTrackedPeriod });
     }
     
-    //grains.getGrainOnsetIndices (indicesOfGrainOnsets, inputStorage, nextFramesPeriod);
+    jassert (lastTrackedPeriod > 0);
     
-    indicesOfGrainOnsets.clear();
+    // the polarity can only flip between blocks, so it's only reversed when the whole block was unpitched
+    analysis.invertPolarity = ! anyHopIsPitched && ! trackerEstimates.isEmpty() && unpitchedRandom.nextBool();
+    
+    if (! wholeBlockIsPitched || analysis.periods.size() > 1)
+        return;
+    
+    // the peak picker sees the block and up to two periods of the input before it, so that the grains can reach back across the boundary with the last block
+    const auto period = analysis.periods.getFirst().period;
+    const auto windowStart = std::max (0, historyLength - 2 * period);
+    const auto windowLength = trackedInputLength - windowStart;
+    
+    if (windowLength < 2 * period)
+        return;
+    
+    const ScopedStageTimer peakTimer (analysis.peakPickingCycles);
+    
+    auto* windowChannel = trackedInput.getWritePointer (0, windowStart);
+    const AudioBuffer window (&windowChannel, 1, windowLength);
+    
+    grains.getGrainOnsetIndices (analysis.grainOnsets, window, period);
+    
+    const auto windowOffset = windowStart - historyLength;
+    
+    for (auto& onset : analysis.grainOnsets)
+        onset += windowOffset;
+}
 
-    indicesOfGrainOnsets.add (0);
 
-    int grainStart = nextFramesPeriod;
+// appends the block to trackedInput, after as much of the input before it as the peak picker can look back over. Returns the number of samples of that history.
+template<typename SampleType>
+int Harmonizer<SampleType>::appendTrackedInput (const AudioBuffer& inputAudio)
+{
+    const auto numSamples = inputAudio.getNumSamples();
+    
+    jassert (numSamples <= trackedInput.getNumSamples());
+    
+    if (trackedInputIsStale.exchange (false, std::memory_order_acquire))
+        trackedInputLength = 0;
+    
+    const auto historyLength = std::min (trackedInputLength, trackedInput.getNumSamples() - numSamples);
+    
+    auto* history = trackedInput.getWritePointer (0);
+    
+    if (historyLength < trackedInputLength)
+        std::copy (history + trackedInputLength - historyLength, history + trackedInputLength, history);  // the ranges may overlap, but the copy runs towards the front
+    
+    vecops::copy (inputAudio.getReadPointer(0), history + historyLength, numSamples);
+    
+    trackedInputLength = historyLength + numSamples;
+    return historyLength;
+}
+
 
-    while (grainStart + nextFramesPeriod <= numSamples)
+// writes an analysed block into the analysis ring and lays out its grains. This changes what the voices read, so it always runs on the audio thread.
+template<typename SampleType>
+void Harmonizer<SampleType>::commitFrame (const AudioBuffer& inputAudio, const FrameAnalysis& analysis)
+{
+    blockTimings[pitchDetectionStage] += analysis.pitchDetectionCycles - analysis.peakPickingCycles;
+    blockTimings[grainExtractionStage] += analysis.peakPickingCycles;
+    const ScopedStageTimer timer (blockTimings[grainExtractionStage]);
+    const ScopedTraceEvent trace (traceRecorder, "Grain extraction");
+    
+    const auto numSamples = inputAudio.getNumSamples();
+    const bool invertPolarity = analysis.invertPolarity;
+    
+    jassert (! analysis.periods.isEmpty());
+    
+    blockPeriods.clearQuick();
+    blockPeriods.addArray (analysis.periods);
+    
+    nextFramesPeriod = blockPeriods.getLast().period;
+    
+    currentBlockStart = analysisRing.write (inputAudio.getReadPointer(0), numSamples, invertPolarity);
+    
+    reclaimAnalysisGrains();
+    
+    // grains carry on from where the last block's left off, so a grain may span the boundary between blocks -- unless the polarity flipped between them
+    const bool polarityFlipped = invertPolarity != lastBlockWasInverted;
+    
+    if (polarityFlipped)
+        nextGrainOnset = currentBlockStart;
+    
+    lastBlockWasInverted = invertPolarity;
+    
+    nextGrainOnset = std::max (nextGrainOnset, analysisRing.getOldestPosition());
+    
+    if (! analysis.grainOnsets.isEmpty())
     {
-        indicesOfGrainOnsets.add (grainStart);
-        grainStart += nextFramesPeriod;
+        // the peak picker only runs on frames with a single period, and keeps its grains within the end of the block
+        const auto period = blockPeriods.getFirst().period;
+        const auto grainSize = period * 2;
+        const auto* window = hannWindows.get (grainSize);
+        
+        // incremental frames' onsets can reach back into the last blocks, which already have grains up to nextGrainOnset
+        const auto earliestOnset = polarityFlipped ? nextGrainOnset
+                                                   : std::max (nextGrainOnset - period / 2, analysisRing.getOldestPosition());
+        
+        auto lastOnset = juce::int64 (-1);
+        
+        for (int onset : analysis.grainOnsets)
+        {
+            const auto grainStart = currentBlockStart + onset;
+            
+            if (grainStart < earliestOnset)
+                continue;
+            
+            storeNewGrain (grainStart, grainSize, window);
+            lastOnset = grainStart;
+        }
+        
+        // if the next frame isn't pitched, its grains carry on at the same spacing
+        if (lastOnset >= 0)
+        {
+            nextGrainOnset = lastOnset + period;
+            return;
+        }
     }
     
-    const auto grainSize = nextFramesPeriod * 2;
+    const auto blockEnd = currentBlockStart + numSamples;
     
-    //  write to analysis grains...
-    for (int index : indicesOfGrainOnsets)
-        if (auto* grain = getEmptyGrain())
-            grain->storeNewGrain (inputStorage.getReadPointer(0), index, index + grainSize);
+    //  write to analysis grains, each sized by the period in effect where it starts...
+    while (true)
+    {
+        const auto onsetInBlock = static_cast<int> (std::max (juce::int64 (0), nextGrainOnset - currentBlockStart));
+        const auto period = getPeriodAt (onsetInBlock);
+        const auto grainSize = period * 2;
+        
+        if (nextGrainOnset + grainSize > blockEnd)
+            break;
+        
+        storeNewGrain (nextGrainOnset, grainSize, hannWindows.get (grainSize));
+        nextGrainOnset += period;
+    }
 }
 
 
-// adds a specified # of voices
+// windows the given span of analysisRing into the grain store, and points an empty analysis grain from the stack at it, keeping grainsByStart sorted.
+// The store is a ring, so the new grain overwrites the oldest grains in it. A grain that a voice is still playing is never overwritten; the new grain is dropped instead.
+template<typename SampleType>
+void Harmonizer<SampleType>::storeNewGrain (juce::int64 startSample, int grainSize, const SampleType* window)
+{
+    jassert (grainSize > 1 && grainSize <= grainWindowingBuffer.getNumSamples());
+    
+    const auto overwrittenEnd = grainStore.getNextWritePosition() + grainSize - grainStore.getCapacity();
+    
+    for (auto* stored : grainsByStart)
+        if (stored->isReferenced() && stored->getStorePosition() < overwrittenEnd)
+            return;
+    
+    for (int i = grainsByStart.size(); --i >= 0;)
+    {
+        auto* stored = grainsByStart.getUnchecked (i);
+        
+        if (stored->getStorePosition() < overwrittenEnd)
+        {
+            stored->clear();
+            grainsByStart.remove (i);
+            emptyGrains.add (stored);
+        }
+    }
+    
+    if (emptyGrains.isEmpty())
+        return;
+    
+    const auto* input = analysisRing.getReadPointer (startSample);
+    auto* windowed = grainWindowingBuffer.getWritePointer (0);
+    
+    // updateWindowTableLeases() leases every size a grain can have, so this only falls back to computing the window if that's been broken
+    jassert (window != nullptr);
+    
+    if (window != nullptr)
+    {
+        juce::FloatVectorOperations::multiply (windowed, input, window, grainSize);
+    }
+    else
+    {
+        const auto step = juce::MathConstants<double>::twoPi / double(grainSize - 1);
+        
+        for (int s = 0; s < grainSize; ++s)
+            windowed[s] = input[s] * static_cast<SampleType> (0.5 - 0.5 * std::cos (step * s));
+    }
+    
+    const auto storePosition = grainStore.write (windowed, grainSize);
+    
+    auto* grain = emptyGrains.removeAndReturn (emptyGrains.size() - 1);
+    
+    grain->storeNewGrain (grainStore.getReadPointer (storePosition), startSample, storePosition, grainSize);
+    
+    // onsets only ever move forwards, so this is almost always an append
+    const auto insertAt = std::upper_bound (grainsByStart.begin(), grainsByStart.end(), startSample,
+                                            [] (juce::int64 position, const Analysis_Grain* other) { return position < other->getStartSample(); });
+    
+    grainsByStart.insert (static_cast<int> (insertAt - grainsByStart.begin()), grain);
+}
+
+
+// frees up analysis grains that no SynthesisGrain is using anymore, and that lie entirely before the current block
+template<typename SampleType>
+void Harmonizer<SampleType>::reclaimAnalysisGrains()
+{
+    for (int i = grainsByStart.size(); --i >= 0;)
+    {
+        auto* grain = grainsByStart.getUnchecked (i);
+        
+        if (! grain->isReferenced() && grain->getEndSample() <= currentBlockStart)
+        {
+            grain->clear();
+            grainsByStart.remove (i);
+            emptyGrains.add (grain);
+        }
+    }
+}
+
+
+// drops every voice's references to the analysis grains, then empties them all. Called whenever the analysis ring is reallocated or released.
+template<typename SampleType>
+void Harmonizer<SampleType>::resetGrainStorage()
+{
+    for (auto* voice : Base::voices)
+        if (auto* harmVoice = dynamic_cast<Voice*> (voice))
+            harmVoice->dropAllGrains();
+    
+    grainsByStart.clearQuick();
+    emptyGrains.clearQuick();
+    grainStore.clear();
+    
+    for (auto* grain : analysisGrains)
+    {
+        grain->clear();
+        emptyGrains.add (grain);
+    }
+    
+    currentBlockStart = 0;
+    nextGrainOnset = 0;
+    lastBlockWasInverted = false;
+}
+
+
+// adds a specified # of voices to the pool. This allocates, so call it from the message thread.
 template<typename SampleType>
 void Harmonizer<SampleType>::addNumVoices (const int voicesToAdd)
 {
     if (voicesToAdd == 0)
         return;
     
+    jassert (! dormantVoicesHidden);
+    
     for (int i = 0; i < voicesToAdd; ++i)
-        Base::voices.add (new Voice(this));
+    {
+        auto* voice = voicePool.add (new Voice(this));
+        voice->poolIndex = voicePool.size() - 1;
+        Base::voices.add (voice);
+    }
+    
+    Base::voices.ensureStorageAllocated (voicePool.size());
+    voicesToPrerender.ensureStorageAllocated (voicePool.size());
     
-    jassert (Base::voices.size() >= voicesToAdd);
+    jassert (Base::voices.size() == voicePool.size());
     
     Base::numVoicesChanged();
 }
@@ -193,5 +1001,7 @@ template class Harmonizer<double>;
 
     
 #undef bvh_NUM_ANALYSIS_GRAINS
+#undef bvh_ANALYSIS_HISTORY_BLOCKS
+#undef bvh_PIPELINE_MIDI_BYTES
 
 } // namespace
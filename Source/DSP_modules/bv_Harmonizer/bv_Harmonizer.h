@@ -38,8 +38,27 @@
 
 #include <climits>  // for INT_MAX
 
+
+/** Config: BV_HARMONIZER_STAGE_TIMING
+    Times each stage of every block with the CPU's cycle counter, for the load breakdown shown in the editor. This costs a few counter reads per block;
+    set it to 0 to compile the timing out entirely.
+*/
+#ifndef BV_HARMONIZER_STAGE_TIMING
+  #define BV_HARMONIZER_STAGE_TIMING 1
+#endif
+
+
 #include "bv_SynthBase/bv_SynthBase.h"  // this file includes the bv_SharedCode header
+#include "WindowTableCache.h"
+#include "PitchDetector/FFTPitchDetector.h"
+#include "PitchDetector/SlidingPitchTracker.h"
 #include "GrainExtractor/GrainExtractor.h"
+#include "AnalysisRingBuffer.h"
+#include "LightweightSemaphore.h"
+#include "RenderThreadPool.h"
+#include "PipelinedAnalysisWorker.h"
+#include "StageTimings.h"
+#include "TraceRecorder.h"
 #include "psola_resynthesis.h"
 #include "bv_HarmonizerVoice.h"
 
@@ -57,7 +76,8 @@ namespace bav
 */
 
 template<typename SampleType>
-class Harmonizer  :     public dsp::SynthBase<SampleType>
+class Harmonizer  :     public dsp::SynthBase<SampleType>,
+                        private PipelinedAnalysisWorker::Client
 {
     using AudioBuffer = juce::AudioBuffer<SampleType>;
     using MidiBuffer  = juce::MidiBuffer;
@@ -65,41 +85,135 @@ class Harmonizer  :     public dsp::SynthBase<SampleType>
     using Base = dsp::SynthBase<SampleType>;
     using FVO = juce::FloatVectorOperations;
     using Analysis_Grain = AnalysisGrain<SampleType>;
+    // the minimum allocated size stops these arrays from shrinking (and later reallocating) as grains are removed on the audio thread
+    using GrainList = juce::Array<Analysis_Grain*, juce::DummyCriticalSection, 32>;
     
     
 public:
     Harmonizer();
     
+    ~Harmonizer();
+    
     void render (const AudioBuffer& input, AudioBuffer& output, juce::MidiBuffer& midiMessages);
     
+    /*
+        Every voice the harmonizer will ever need is allocated up front; the ceiling only sets how many of them may be used. This is safe to call from any thread, and the audio thread applies it at the start of the next block without locking or allocating.
+        Voices above the ceiling aren't rendered at all. Lowering the ceiling never cuts off a sounding voice; voices above it are left to ring out.
+    */
+    void setActiveVoiceCeiling (int newCeiling) noexcept;
+    
+    int getActiveVoiceCeiling() const noexcept { return std::min (activeVoiceCeiling.load (std::memory_order_relaxed), voicePool.size()); }
+    
+    // true if any voice is playing a note, or is still ringing out after one
+    bool isAnyVoiceActive() const noexcept
+    {
+        for (auto* voice : voicePool)
+            if (voice->isVoiceActive())
+                return true;
+        
+        return false;
+    }
+    
+    // allocates more voices if the pool is smaller than newNumVoices (so call this from the message thread), then sets the active voice ceiling. Voices are never deleted once allocated.
+    void changeNumVoices (const int newNumVoices);
+    
+    // these start notes, so they only offer the voices under the active ceiling
+    void playChord (const juce::Array<int>& desiredNotes, const float velocity, const bool allowTailOffOfOld);
+    void bypassedBlock (const int numSamples, juce::MidiBuffer& midiMessages);
+    
     void release() override;
     
-    int getLatencySamples() const noexcept { return pitchDetector.getLatencySamples(); }
+    // with incremental pitch tracking, this is the internal blocksize passed to setUseIncrementalPitchTracking(); otherwise it's the length of the pitch detector's analysis frame
+    int getLatencySamples() const noexcept { return useIncrementalTracking ? incrementalBlocksize : pitchDetector.getLatencySamples(); }
     
     void updatePitchDetectionHzRange (const int minHz, const int maxHz);
     
+    // the period at the end of the block currently being rendered
     int getCurrentPeriod() const noexcept { return nextFramesPeriod; }
     
+    // the period in effect at the given sample of the block currently being rendered. Unless incremental pitch tracking is enabled, this is the same for the whole block.
+    int getPeriodAt (int sampleInBlock) const noexcept
+    {
+        for (int i = blockPeriods.size(); --i > 0;)
+            if (blockPeriods.getReference (i).startSample <= sampleInBlock)
+                return blockPeriods.getReference (i).period;
+        
+        return blockPeriods.isEmpty() ? nextFramesPeriod : blockPeriods.getReference (0).period;
+    }
+    
+    // the number of samples from the given sample of the current block until the period next changes, or INT_MAX if it doesn't change again in this block
+    int samplesUntilPeriodChange (int sampleInBlock) const noexcept
+    {
+        for (const auto& change : blockPeriods)
+            if (change.startSample > sampleInBlock)
+                return change.startSample - sampleInBlock;
+        
+        return INT_MAX;
+    }
+    
+    /*
+        When enabled, the input's pitch is tracked with a sliding window that produces a new estimate every hopSize samples, so the period can change partway through a block.
+        Because the tracker keeps its own history between blocks, the internal blocksize -- and so the latency reported by getLatencySamples() -- no longer has to be as long as the analysis window.
+        Call this from the message thread while not rendering, then re-prepare with the new getLatencySamples().
+    */
+    void setUseIncrementalPitchTracking (bool shouldUseIncrementalTracking, int internalBlocksize = 256, int hopSize = 64);
+    
+    bool isUsingIncrementalPitchTracking() const noexcept { return useIncrementalTracking; }
+    
+    // when enabled (the default), voices mix whole spans of each grain with vector operations instead of rendering one sample at a time
+    void setUseBlockRendering (bool shouldUseBlockRendering) noexcept { useBlockRendering = shouldUseBlockRendering; }
+    
+    // when enabled, each span of the block is rendered for all of the active voices in parallel, on the process-wide render pool, once the span's MIDI has been handled.
+    // the output is identical to serial rendering. Call this from the message thread.
+    void setUseMultithreadedRendering (bool shouldUseMultithreading);
+    
+    bool isUsingMultithreadedRendering() const noexcept { return useMultithreadedRendering.load (std::memory_order_relaxed); }
+    
+    // when enabled, each block's pitch detection & grain analysis runs on the process-wide analysis worker while the voices render the previous block, so the output is delayed by one extra block.
+    // Don't call this while rendering.
+    void setUsePipelinedAnalysis (bool shouldUsePipeline);
+    
+    bool isUsingPipelinedAnalysis() const noexcept { return usePipelinedAnalysis; }
+    
+    // the latency that pipelined analysis adds on top of getLatencySamples(), or 0 if it isn't enabled
+    int getPipelineLatencySamples() const noexcept { return usePipelinedAnalysis ? preparedBlocksize : 0; }
+    
+    // while rendering in real time (the default), a pipelined block whose analysis is late is rendered with the last block's period rather than waited for.
+    // Offline, it's waited for, so that the output is the same every time. This is safe to call from any thread.
+    void setNonRealtime (bool isNonRealtime) noexcept { nonRealtime.store (isNonRealtime, std::memory_order_relaxed); }
+    
+    bool isNonRealtime() const noexcept { return nonRealtime.load (std::memory_order_relaxed); }
+    
+    // the pitch detection, grain extraction & voice rendering time of the last block rendered. With pipelined analysis, the pitch detection time is that of the frame committed in that block.
+    const StageTimings& getLastBlockTimings() const noexcept { return blockTimings; }
+    
+    // while the recorder is recording, the analysis & each voice's rendering are added to it as trace events. Set this while not rendering; nullptr turns tracing off.
+    void setTraceRecorder (TraceRecorder* recorderToUse) noexcept { traceRecorder = recorderToUse; }
+    
+    // the synthesis marker is relative to the start of the block currently being rendered, and may lie outside of it.
+    // if two grains are equally close, the earlier one is returned.
     Analysis_Grain* findClosestGrain (int synthesisMarker)
     {
-        Analysis_Grain* closestGrain = nullptr;
-        int distance = INT_MAX;
+        if (grainsByStart.isEmpty())
+            return nullptr;
+        
+        const auto target = currentBlockStart + synthesisMarker;
+        
+        const auto* first = grainsByStart.begin();
+        const auto* last  = grainsByStart.end();
+        
+        const auto* after = std::lower_bound (first, last, target,
+                                              [] (const Analysis_Grain* grain, juce::int64 position) { return grain->getStartSample() < position; });
+        
+        if (after == last)
+            return *(last - 1);
         
-        for (auto* grain : analysisGrains)
-        {
-            if (grain->isEmpty())
-                continue;
-            
-            const auto newDist = abs(synthesisMarker - grain->getStartSample());
-            
-            if (closestGrain == nullptr || newDist < distance)
-            {
-                closestGrain = grain;
-                distance = newDist;
-            }
-        }
+        if (after == first)
+            return *after;
         
-        return closestGrain;
+        auto* before = *(after - 1);
+        
+        return (target - before->getStartSample() <= (*after)->getStartSample() - target) ? before : *after;
     }
     
     
@@ -107,8 +221,47 @@ public:
 private:
     friend class HarmonizerVoice<SampleType>;
     
+    struct PeriodChange
+    {
+        int startSample;  // relative to the start of the block
+        int period;
+    };
+    
+    using PeriodList = juce::Array<PeriodChange>;
+    
+    // the results of analysing one block of input, before they are committed to the analysis ring & grains
+    struct FrameAnalysis
+    {
+        PeriodList periods;  // in order of start sample; the first always starts at sample 0
+        bool invertPolarity = false;
+        juce::Array<int> grainOnsets;  // relative to the start of the block, and negative for grains that start in the input before it. Only pitched frames have these; otherwise grains are spaced one period apart
+        juce::uint64 pitchDetectionCycles = 0, peakPickingCycles = 0;  // travel with the frame, since it may be analysed on another thread
+    };
+    
     void analyzeInput (const AudioBuffer& inputAudio);
     
+    void analyseFrame (const AudioBuffer& inputAudio, FrameAnalysis& analysis);
+    
+    void trackFramePitch (const AudioBuffer& inputAudio, FrameAnalysis& analysis);
+    
+    int appendTrackedInput (const AudioBuffer& inputAudio);
+    
+    int peakPickingLookback() const noexcept;
+    
+    int requiredRingCapacity (int blocksize) const noexcept;
+    
+    void commitFrame (const AudioBuffer& inputAudio, const FrameAnalysis& analysis);
+    
+    void renderVoices (AudioBuffer& output, juce::MidiBuffer& midiMessages);
+    
+    void renderPipelined (const AudioBuffer& input, AudioBuffer& output, juce::MidiBuffer& midiMessages);
+    
+    bool analysePendingFrame() override;
+    
+    bool collectPipelinedFrame();
+    
+    void handOffFrame (const AudioBuffer& input);
+    
     void initialized (const double initSamplerate, const int initBlocksize) override;
     
     void prepared (int blocksize) override;
@@ -117,30 +270,119 @@ private:
     
     void addNumVoices (const int voicesToAdd) override;
     
+    void hideDormantVoices();
+    
+    void restoreDormantVoices();
+    
+    void renderSpanInParallel (int startSample, int numSamples);
+    
+    static void prerenderVoiceJob (void* harmonizer, int voiceIndex);
+    
     
-    dsp::PitchDetector<SampleType> pitchDetector;
+    FFTPitchDetector<SampleType> pitchDetector;
+    
+    SlidingPitchTracker<SampleType> pitchTracker;
+    juce::Array<typename SlidingPitchTracker<SampleType>::Estimate> trackerEstimates;
+    bool useIncrementalTracking = false;
+    int incrementalBlocksize = 0;
+    int lastTrackedPeriod = 0;  // the period at the end of the last block analysed by the tracker
+    bool lastTrackedPeriodWasPitched = false;
+    
+    // incremental blocks are usually shorter than a grain, so the peak picker also sees the input before the block: the last peakPickingLookback() samples of it, followed by the block itself
+    AudioBuffer trackedInput;
+    int trackedInputLength = 0;
+    std::atomic<bool> trackedInputIsStale { false };  // set when a pipelined frame is dropped before it was analysed, leaving a gap in trackedInput's history
     
     GrainExtractor<SampleType> grains;
-    juce::Array<int> indicesOfGrainOnsets;
     
     // the arbitrary "period" imposed on the signal for analysis for unpitched frames of audio will be randomized within this range
     // NB max value should be 1 greater than the largest possible generated number 
     const juce::Range<int> unpitchedArbitraryPeriodRange { 50, 201 };
     
-    AudioBuffer inputStorage;
+    // each harmonizer has its own generator, so that several can analyse at once on different threads. Every instance starts from the same seed, so renders are repeatable
+    juce::Random unpitchedRandom { 0x1a2b3c };
+    
+    AnalysisRingBuffer<SampleType> analysisRing;
+    
+    // each analysis grain's windowed samples are written here once, when the grain is stored, and voices read them back from here
+    AnalysisRingBuffer<SampleType> grainStore;
+    AudioBuffer grainWindowingBuffer;
+    
+    juce::int64 currentBlockStart = 0;  // the absolute position in analysisRing of the first sample of the block being rendered
+    juce::int64 nextGrainOnset = 0;     // the absolute position of the next analysis grain to be stored; grains may span block boundaries
+    bool lastBlockWasInverted = false;
     
     juce::OwnedArray<Analysis_Grain> analysisGrains;
     
-    Analysis_Grain* getEmptyGrain()
+    GrainList grainsByStart;  // every non-empty analysis grain, in order of start sample
+    GrainList emptyGrains;    // used as a stack
+    
+    void storeNewGrain (juce::int64 startSample, int grainSize, const SampleType* window);
+    
+    void reclaimAnalysisGrains();
+    
+    void resetGrainStorage();
+    
+    void updateWindowTableLeases();
+    
+    juce::SharedResourcePointer< WindowTableCache<SampleType> > windowTables;
+    typename WindowTableCache<SampleType>::Lease hannWindows { *windowTables, WindowTableCache<SampleType>::hannWindows };
+    
+    int nextFramesPeriod = 0;
+    
+    PeriodList blockPeriods;  // the periods of the block currently being rendered
+    FrameAnalysis serialAnalysis;
+    
+    StageTimings blockTimings;
+    TraceRecorder* traceRecorder = nullptr;
+    
+    bool useBlockRendering = true;
+    
+    // the pool owns every voice. Outside of rendering, Base::voices holds all of them, so that they all get prepared & updated; while rendering, it only holds the ones under the active ceiling
+    juce::OwnedArray<Voice> voicePool;
+    std::atomic<int> activeVoiceCeiling { INT_MAX };
+    bool dormantVoicesHidden = false;
+    
+    std::atomic<bool> useMultithreadedRendering { false };
+    std::unique_ptr<juce::SharedResourcePointer<RenderThreadPool>> renderPool;
+    juce::Array<Voice*> voicesToPrerender;
+    int parallelSpanStart = -1, parallelSpanLength = 0;  // the span of the current block that was last handed to the render pool
+    
+    // pipelined analysis: the audio thread hands each block to the analysis worker in one of two frames, and each frame's state says who owns it.
+    // A frame whose analysis was too late to use may still be with the worker when the next block is handed off, so that block goes in the other frame.
+    enum PipelineFrameState { frameEmpty, framePending, frameAnalysing, frameReady, pipelinePaused };
+    
+    struct PipelineFrame
+    {
+        std::atomic<int> state { frameEmpty };
+        AudioBuffer input;
+        FrameAnalysis analysis;
+    };
+    
+    // the message thread pauses the pipeline around anything that reconfigures what a frame's analysis reads, so the worker is never analysing while it changes.
+    // Pausing waits for any frame in flight to finish, and blocks new hand-offs; the frames are dropped when the pipeline resumes. Pauses may be nested.
+    void pausePipeline();
+    void resumePipeline();
+    
+    struct ScopedPipelinePause
     {
-        for (auto* grain : analysisGrains)
-            if (grain->isEmpty())
-                return grain;
+        explicit ScopedPipelinePause (Harmonizer& h) : harmonizer (h) { harmonizer.pausePipeline(); }
+        ~ScopedPipelinePause() { harmonizer.resumePipeline(); }
         
-        return nullptr;
-    }
+        Harmonizer& harmonizer;
+    };
     
-    int nextFramesPeriod = 0;
+    int pipelinePauseDepth = 0;  // only touched by the message thread
+    
+    bool usePipelinedAnalysis = false;
+    int preparedBlocksize = 0;
+    PipelineFrame pipelineFrames[2];
+    int handedOffFrame = -1;  // the frame holding the block handed off last, or -1 if there isn't one. Only touched by the audio thread
+    FrameAnalysis lateFrameAnalysis;  // used in place of an analysis that wasn't ready in time
+    juce::MidiBuffer pipelineMidi;  // the MIDI of the block handed off last, which is rendered along with it
+    std::atomic<bool> nonRealtime { false };
+    LightweightSemaphore frameAnalysed { 1 };  // signalled by the worker as it finishes each of this harmonizer's frames
+    std::unique_ptr<juce::SharedResourcePointer<PipelinedAnalysisWorker>> analysisWorker;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Harmonizer)
 };
@@ -48,9 +48,14 @@ template<typename SampleType>
 void HarmonizerVoice<SampleType>::prepared (const int blocksize)
 {
     jassert (blocksize > 0);
+    static_assert (bvh_NUM_SYNTHESIS_GRAINS < 32, "The active grain mask only has room for 31 synthesis grains");
 
     while (synthesisGrains.size() < bvh_NUM_SYNTHESIS_GRAINS)
         synthesisGrains.add (new Synthesis_Grain());
+    
+    grainSnapshot.resize (synthesisGrains.size());
+    
+    prerenderBuffer.setSize (1, blocksize);
 }
 
     
@@ -58,7 +63,7 @@ void HarmonizerVoice<SampleType>::prepared (const int blocksize)
 template<typename SampleType>
 void HarmonizerVoice<SampleType>::released()
 {
-    nextSynthesisIndex = 0;
+    dropAllGrains();
 }
 
     
@@ -72,24 +77,113 @@ void HarmonizerVoice<SampleType>::bypassedBlockRecieved (int numSamples)
 template<typename SampleType>
 void HarmonizerVoice<SampleType>::renderPlease (AudioBuffer& output, float desiredFrequency, double currentSamplerate, int origStartSample)
 {
-    juce::ignoreUnused (origStartSample);
     jassert (desiredFrequency > 0 && currentSamplerate > 0);
     
-    const auto origPeriod = parent->getCurrentPeriod();
-    jassert (origPeriod > 0);
-
+    const ScopedTraceEvent trace (parent->traceRecorder, "Voice", poolIndex);
+    
     auto* writing = output.getWritePointer(0);
+    const auto numSamples = output.getNumSamples();
+    
+    // the first voice to render each span has every active voice's span rendered in parallel
+    parent->renderSpanInParallel (origStartSample, numSamples);
+    
+    if (prerenderedSamples > 0)
+    {
+        if (desiredFrequency == prerenderFrequency && origStartSample == prerenderStart && numSamples == prerenderedSamples)
+        {
+            vecops::copy (prerenderBuffer.getReadPointer (0), writing, numSamples);
+            prerenderedSamples = 0;
+            return;
+        }
+        
+        discardPrerender();
+    }
+    
+    renderGrains (writing, numSamples, origStartSample, desiredFrequency, currentSamplerate);
+}
 
+
+template<typename SampleType>
+void HarmonizerVoice<SampleType>::renderGrains (SampleType* writing, const int numSamples, const int startSample, const float desiredFrequency, const double currentSamplerate)
+{
     const auto newPeriod = juce::roundToInt (currentSamplerate / desiredFrequency);
 //    const auto scaleFactor = (float(newPeriod) / float(origPeriod));
 //    const auto synthesisHopSize = juce::roundToInt (scaleFactor * origPeriod);
     
-    const auto numSamples = output.getNumSamples();
+    renderPosition = startSample;
     
-    for (int s = 0; s < numSamples; ++s)
+    if (! parent->useBlockRendering)
     {
-        writing[s] = getNextSample (origPeriod, newPeriod);
+        for (int s = 0; s < numSamples; ++s)
+        {
+            writing[s] = getNextSample (parent->getPeriodAt (renderPosition), newPeriod);
+            ++renderPosition;
+        }
+        
+        return;
+    }
+    
+    FVO::clear (writing, numSamples);
+    
+    int s = 0;
+    
+    while (s < numSamples)
+    {
+        const auto origPeriod = parent->getPeriodAt (renderPosition);
+        jassert (origPeriod > 0);
+        
+        // between grain events & changes of the input's period, every active grain's span is mixed in with a single vector add
+        const auto span = std::min ({ numSamples - s, samplesUntilNextGrainEvent (origPeriod), parent->samplesUntilPeriodChange (renderPosition) });
+        
+        if (span > 0)
+        {
+            for (auto remaining = activeGrains; remaining != 0; remaining &= remaining - 1u)
+            {
+                const auto index = lowestSetBit (remaining);
+                auto* grain = synthesisGrains.getUnchecked (index);
+                
+                grain->addNextSamples (writing + s, span);
+                
+                if (! grain->isActive())
+                    activeGrains &= ~(1u << index);
+            }
+            
+            nextSynthesisIndex = std::max (0, nextSynthesisIndex - span);
+            renderPosition += span;
+            s += span;
+        }
+        
+        // the sample on which a grain ends or a new grain must be started is rendered the same way as the per-sample path
+        if (s < numSamples)
+        {
+            writing[s++] = getNextSample (parent->getPeriodAt (renderPosition), newPeriod);
+            ++renderPosition;
+        }
+    }
+}
+
+
+// returns the number of samples that can be rendered before a grain ends or a grain reaches the point where the next one must be started.
+// returns 0 if no grains are active, so that the next sample goes through getNextSample() and starts one.
+template<typename SampleType>
+inline int HarmonizerVoice<SampleType>::samplesUntilNextGrainEvent (const int halfGrainSize) const
+{
+    if (! anyGrainsAreActive())
+        return 0;
+    
+    int samplesToEvent = INT_MAX;
+    
+    for (auto remaining = activeGrains; remaining != 0; remaining &= remaining - 1u)
+    {
+        const auto samplesLeft = synthesisGrains.getUnchecked (lowestSetBit (remaining))->samplesLeft();
+        
+        // getNextSample() starts a new grain when samplesLeft drops to exactly halfGrainSize, and a grain stops once its final sample is read
+        const auto grainEvent = samplesLeft > halfGrainSize ? samplesLeft - halfGrainSize - 1 : samplesLeft - 1;
+        
+        samplesToEvent = std::min (samplesToEvent, grainEvent);
     }
+    
+    return samplesToEvent;
 }
     
 
@@ -107,15 +201,22 @@ inline SampleType HarmonizerVoice<SampleType>::getNextSample (const int halfGrai
     
     auto sample = SampleType(0);
     
-    for (auto* grain : synthesisGrains)
+    // grains are read in slot order; a grain started partway through is also read on this sample if its slot comes after the one that started it
+    auto remaining = activeGrains;
+    
+    while (remaining != 0)
     {
-        if (! grain->isActive())
-            continue;
+        const auto index = lowestSetBit (remaining);
+        auto* grain = synthesisGrains.getUnchecked (index);
 
         sample += grain->getNextSample();
         
-        if (grain->samplesLeft() == halfGrainSize)
+        if (! grain->isActive())
+            activeGrains &= ~(1u << index);
+        else if (grain->samplesLeft() == halfGrainSize)
             startNewGrain (newPeriod);
+        
+        remaining = activeGrains & ~((2u << index) - 1u);
     }
     
     if (nextSynthesisIndex > 0)
@@ -128,15 +229,29 @@ inline SampleType HarmonizerVoice<SampleType>::getNextSample (const int halfGrai
 template<typename SampleType>
 inline void HarmonizerVoice<SampleType>::startNewGrain (const int newPeriod)
 {
-    if (auto* newGrain = getAvailableGrain())
+    const auto index = getAvailableGrainIndex();
+    
+    if (index < 0)
+        return;
+    
+    if (auto* analysisGrain = parent->findClosestGrain (renderPosition + nextSynthesisIndex))
     {
-        if (auto* analysisGrain = parent->findClosestGrain (nextSynthesisIndex))
-        {
-            newGrain->startNewGrain (analysisGrain, nextSynthesisIndex);
-            nextSynthesisIndex += newPeriod;
-        }
+        synthesisGrains.getUnchecked (index)->startNewGrain (analysisGrain, nextSynthesisIndex);
+        activeGrains |= (1u << index);
+        nextSynthesisIndex += newPeriod;
     }
 }
+
+
+// returns the lowest idle slot in synthesisGrains, or -1 if every grain is playing
+template<typename SampleType>
+inline int HarmonizerVoice<SampleType>::getAvailableGrainIndex() const noexcept
+{
+    const auto allGrains = (juce::uint32 (1) << synthesisGrains.size()) - 1u;
+    const auto idleGrains = allGrains & ~activeGrains;
+    
+    return idleGrains == 0 ? -1 : lowestSetBit (idleGrains);
+}
     
 
 // this function is called to reset the HarmonizerVoice's internal state to neutral / initial
@@ -146,6 +261,63 @@ void HarmonizerVoice<SampleType>::noteCleared()
     nextSynthesisIndex = 0;
 }
 
+
+// called by the parent Harmonizer when its analysis grains are reset, so no synthesis grain is left pointing at stale audio
+template<typename SampleType>
+void HarmonizerVoice<SampleType>::dropAllGrains()
+{
+    for (auto* grain : synthesisGrains)
+        grain->drop();
+    
+    activeGrains = 0;
+    nextSynthesisIndex = 0;
+    prerenderedSamples = 0;
+}
+
+
+// renders a span of the Harmonizer's block into prerenderBuffer, at the pitch this voice is playing now. This is called on one of the render pool's threads, once the span's MIDI has been handled.
+template<typename SampleType>
+void HarmonizerVoice<SampleType>::prerenderSpan (const int startSample, const int numSamples)
+{
+    jassert (prerenderedSamples == 0);
+    
+    const auto frequency = Base::getCurrentOutputFreq();
+    
+    if (numSamples > prerenderBuffer.getNumSamples() || frequency <= 0)
+        return;
+    
+    const ScopedTraceEvent trace (parent->traceRecorder, "Voice", poolIndex);
+    
+    for (int i = 0; i < synthesisGrains.size(); ++i)
+        grainSnapshot.getReference (i) = *synthesisGrains.getUnchecked (i);
+    
+    snapshotSynthesisIndex = nextSynthesisIndex;
+    snapshotActiveGrains = activeGrains;
+    
+    prerenderFrequency = frequency;
+    prerenderStart = startSample;
+    
+    renderGrains (prerenderBuffer.getWritePointer(0), numSamples, startSample, frequency, parent->sampleRate);
+    
+    prerenderedSamples = numSamples;
+}
+
+
+// puts the voice back into the state it was in before its span was prerendered, for when the span wasn't rendered after all, or not at the predicted pitch
+template<typename SampleType>
+void HarmonizerVoice<SampleType>::discardPrerender()
+{
+    if (prerenderedSamples == 0)
+        return;
+    
+    for (int i = 0; i < synthesisGrains.size(); ++i)
+        synthesisGrains.getUnchecked (i)->restoreFrom (grainSnapshot.getReference (i));
+    
+    nextSynthesisIndex = snapshotSynthesisIndex;
+    activeGrains = snapshotActiveGrains;
+    prerenderedSamples = 0;
+}
+
     
 #undef bvhv_MIN_SMOOTHED_GAIN
 #undef _SMOOTHING_ZERO_CHECK
@@ -35,6 +35,8 @@ private:
     
     void bypassedBlockRecieved (int numSamples) override;
     
+    void renderGrains (SampleType* writing, const int numSamples, const int startSample, const float desiredFrequency, const double currentSamplerate);
+    
     Harmonizer<SampleType>* parent;
     
     void prepared (const int blocksize) override;
@@ -45,28 +47,39 @@ private:
     
     inline SampleType getNextSample (const int halfGrainSize, const int newPeriod);
     
-    inline bool anyGrainsAreActive()
-    {
-        for (auto* grain : synthesisGrains)
-            if (grain->isActive())
-                return true;
-        
-        return false;
-    }
-    
-    inline Synthesis_Grain* getAvailableGrain()
-    {
-        for (auto* grain : synthesisGrains)
-            if (! grain->isActive())
-                return grain;
-        
-        return nullptr;
-    }
+    inline int samplesUntilNextGrainEvent (const int halfGrainSize) const;
+    
+    inline bool anyGrainsAreActive() const noexcept { return activeGrains != 0; }
+    
+    inline int getAvailableGrainIndex() const noexcept;
+    
+    static inline int lowestSetBit (juce::uint32 mask) noexcept { return juce::countNumberOfBits ((mask & (~mask + 1u)) - 1u); }
     
     inline void startNewGrain (const int newPeriod);
     
+    void dropAllGrains();
+    
+    void prerenderSpan (const int startSample, const int numSamples);
+    
+    void discardPrerender();
+    
     int nextSynthesisIndex = 0;
     
+    // bit i is set while synthesisGrains[i] is playing. Idle grains are always handed out lowest slot first, because slot order decides whether a grain started partway through getNextSample() is read on that same sample.
+    juce::uint32 activeGrains = 0;
+    
+    // state for multithreaded rendering: the span rendered on a worker thread, plus a snapshot of the grains from before it, in case the span isn't rendered the way it was predicted
+    AudioBuffer prerenderBuffer;
+    juce::Array<Synthesis_Grain> grainSnapshot;
+    int snapshotSynthesisIndex = 0;
+    juce::uint32 snapshotActiveGrains = 0;
+    int prerenderStart = 0, prerenderedSamples = 0;
+    float prerenderFrequency = 0.0f;
+    
+    int poolIndex = 0;  // this voice's place in the Harmonizer's voice pool, which identifies it in traces
+    
+    int renderPosition = 0;  // the position within the Harmonizer's current block of the next sample to be rendered
+    
     juce::OwnedArray<Synthesis_Grain> synthesisGrains;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HarmonizerVoice)
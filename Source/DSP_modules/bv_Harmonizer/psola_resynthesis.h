@@ -26,82 +26,84 @@ namespace bav
 {
 
 /*------------------------------------------------------------------------------------------------------------------------------------------------------
- AnalysisGrain :    This class stores the actual audio samples that comprise a single audio grain, with a Hann window applied. The parent Harmonizer object owns a collection of these grains.
+ AnalysisGrain :    This class is a lightweight view of a single windowed audio grain within the parent Harmonizer's store of grains. The Hann window is applied once, when the Harmonizer writes the grain into its store, so reading a grain back is a plain copy. The parent Harmonizer object owns a collection of these grains, and reclaims them once no SynthesisGrain refers to them anymore.
 ------------------------------------------------------------------------------------------------------------------------------------------------------*/
 
 template<typename SampleType>
 class AnalysisGrain
 {
 public:
-    AnalysisGrain(): numActive(0), size(0), empty(true) { }
+    AnalysisGrain(): origStart(0), storePosition(0), size(0), empty(true), samples(nullptr) { }
     
-    void reserveSize (int numSamples) { samples.setSize(1, numSamples); }
+    // voices rendering on different threads may share a grain, so the reference count is atomic
+    void incNumActive() noexcept { numActive.fetch_add (1, std::memory_order_relaxed); }
     
-    void incNumActive() noexcept { ++numActive; }
-    
-    void decNumActive() {
-        --numActive;
-        if (numActive == 0) clear();
+    void decNumActive() noexcept
+    {
+        const auto prev = numActive.fetch_sub (1, std::memory_order_relaxed);
+        jassert (prev > 0);
+        juce::ignoreUnused (prev);
     }
     
-    void storeNewGrain (const SampleType* inputSamples, int startSample, int endSample)
+    bool isReferenced() const noexcept { return numActive.load (std::memory_order_relaxed) > 0; }
+    
+    // windowedSamples should point to the grain's already windowed samples, and storePositionToUse is their absolute position in the Harmonizer's grain store.
+    // startSample is the absolute position of the grain's first sample in the input, which is what voices choose grains by.
+    void storeNewGrain (const SampleType* windowedSamples, juce::int64 startSample, juce::int64 storePositionToUse, int grainSize)
     {
+        jassert (windowedSamples != nullptr && grainSize > 0);
         empty = false;
-        samples.clear();
+        samples = windowedSamples;
         origStart = startSample;
-        origEnd = endSample;
-        size = endSample - startSample;
-        jassert (size > 0);
-        auto* writing = samples.getWritePointer(0);
-        vecops::copy (inputSamples + startSample, writing, size);
-        
-        //  apply Hann window to input samples
-        for (int s = 0; s < size; ++s)
-            writing[s] *= getWindowValue (size, s);
+        storePosition = storePositionToUse;
+        size = grainSize;
     }
     
     SampleType getSample (int index) const
     {
         jassert (index < size);
-        return samples.getSample (0, index);
+        return samples[index];
     }
     
-    int getSize() const noexcept { return size; }
+    // adds numSamples windowed samples, starting from startIndex within the grain, to the output
+    void addSamplesTo (SampleType* output, int startIndex, int numSamples) const
+    {
+        jassert (startIndex >= 0 && startIndex + numSamples <= size);
+        juce::FloatVectorOperations::add (output, samples + startIndex, numSamples);
+    }
     
-    int getStartSample() const noexcept { return origStart; }
+    int getSize() const noexcept { return size; }
     
-    int getEndSample() const noexcept { return origEnd; }
+    juce::int64 getStartSample() const noexcept { return origStart; }
     
-    bool isEmpty() const noexcept { return empty; }
+    juce::int64 getStorePosition() const noexcept { return storePosition; }
     
+    juce::int64 getEndSample() const noexcept { return origStart + size; }
     
-private:
-    inline SampleType getWindowValue (int windowSize, int index)
-    {
-        const auto cos2 = std::cos (static_cast<SampleType> (2 * index)
-                                    * juce::MathConstants<SampleType>::pi / static_cast<SampleType> (windowSize - 1));
-        
-        return static_cast<SampleType> (0.5 - 0.5 * cos2);
-    }
+    bool isEmpty() const noexcept { return empty; }
     
-    void clear()
+    void clear() noexcept
     {
-        samples.clear();
+        numActive.store (0, std::memory_order_relaxed);
         size = 0;
         empty = true;
         origStart = 0;
-        origEnd = 0;
+        storePosition = 0;
+        samples = nullptr;
     }
     
-    int numActive; // this counts the number of SynthesisGrains that are referring to this AnalysisGrain
     
-    int origStart, origEnd;  // the original start & end sample indices of this grain
+private:
+    std::atomic<int> numActive { 0 }; // this counts the number of SynthesisGrains that are referring to this AnalysisGrain
+    
+    juce::int64 origStart;      // the absolute position of this grain's first sample in the input
+    juce::int64 storePosition;  // the absolute position of this grain's first sample in the Harmonizer's grain store
     
     int size;
     
     bool empty;
     
-    juce::AudioBuffer<SampleType> samples;
+    const SampleType* samples;  // points into the Harmonizer's grain store
 };
 
 template class AnalysisGrain<float>;
@@ -149,6 +151,26 @@ public:
         return sample;
     }
     
+    // adds the next numSamples samples of this grain to the output. Equivalent to summing getNextSample() numSamples times.
+    void addNextSamples (SampleType* output, int numSamples)
+    {
+        jassert (active && numSamples <= samplesLeft());
+        
+        const auto zeroes = std::min (zeroesLeft, numSamples);
+        zeroesLeft -= zeroes;
+        
+        const auto numToAdd = numSamples - zeroes;
+        
+        if (numToAdd <= 0)
+            return;
+        
+        grain->addSamplesTo (output + zeroes, readingIndex, numToAdd);
+        readingIndex += numToAdd;
+        
+        if (readingIndex >= grain->getSize())
+            stop();
+    }
+    
     void skipSamples (int numSamples)
     {
         for (int i = 0; i < numSamples; ++i)
@@ -169,6 +191,30 @@ public:
         }
     }
     
+    // returns this grain to a state saved earlier, moving its analysis grain reference along with it
+    void restoreFrom (const SynthesisGrain& savedState) noexcept
+    {
+        if (active)
+            grain->decNumActive();
+        
+        active = savedState.active;
+        readingIndex = savedState.readingIndex;
+        grain = savedState.grain;
+        zeroesLeft = savedState.zeroesLeft;
+        
+        if (active)
+            grain->incNumActive();
+    }
+    
+    // releases this grain's analysis grain without touching it, for when the analysis grains themselves have been reset
+    void drop() noexcept
+    {
+        active = false;
+        readingIndex = 0;
+        zeroesLeft = 0;
+        grain = nullptr;
+    }
+    
     int samplesLeft() const
     {
         if (active)
@@ -0,0 +1,390 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ FDNReverb.cpp: This file defines implementation details for the FDNReverb class.
+ 
+======================================================================================================================================================*/
+
+
+#include "FDNReverb.h"
+
+
+// the longest stretch of samples processed at once. Must be no longer than the shortest delay line
+#define bvie_FDN_MAX_CHUNK 64
+
+#define bvie_FDN_MIN_DECAY_SECONDS 0.2
+#define bvie_FDN_MAX_DECAY_SECONDS 10.0
+
+#define bvie_FDN_DUCK_ATTACK_MS 10.0
+#define bvie_FDN_DUCK_RELEASE_MS 250.0
+#define bvie_FDN_DUCK_DEPTH 10.0
+
+// the reverb sleeps once its tail has fallen this far below the level of the input
+#define bvie_FDN_SILENCE_DB -100.0
+
+#define bvie_FDN_RAMP_SECONDS 0.05
+
+
+namespace bav
+{
+    
+    
+// mutually prime lengths, in samples at 44.1 kHz -- between about 23 & 67 ms
+static constexpr int fdnDelayLengths[] = { 1031, 1327, 1523, 1801, 2053, 2377, 2687, 2971 };
+
+// each line receives the send with its own sign, so the taps summed into each output channel don't start out correlated
+static constexpr int fdnInputSigns[] = { 1, 1, -1, -1, 1, 1, -1, -1 };
+    
+
+template<typename SampleType>
+FDNReverb<SampleType>::FDNReverb()
+{
+    static_assert (sizeof (fdnDelayLengths) / sizeof (int) == numDelayLines, "There must be a length for every delay line");
+    
+    chunkData.allocate (size_t((numDelayLines + 2) * bvie_FDN_MAX_CHUNK), true);
+}
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::prepare (double samplerate)
+{
+    jassert (samplerate > 0);
+    
+    sampleRate = samplerate;
+    
+    const auto scale = samplerate / 44100.0;
+    size_t totalSize = 0;
+    juce::uint32 sizes[numDelayLines];
+    
+    for (int i = 0; i < numDelayLines; ++i)
+    {
+        lines[i].length = juce::roundToInt (fdnDelayLengths[i] * scale);
+        
+        jassert (lines[i].length >= bvie_FDN_MAX_CHUNK);
+        
+        sizes[i] = juce::uint32 (juce::nextPowerOfTwo (lines[i].length + 1));
+        totalSize += sizes[i];
+    }
+    
+    if (totalSize != delayMemorySize)
+    {
+        delayMemory.allocate (totalSize, true);
+        delayMemorySize = totalSize;
+    }
+    
+    auto* samples = delayMemory.get();
+    
+    for (int i = 0; i < numDelayLines; ++i)
+    {
+        lines[i].samples = samples;
+        lines[i].mask = sizes[i] - 1;
+        samples += sizes[i];
+    }
+    
+    wetProportion.reset (samplerate, bvie_FDN_RAMP_SECONDS);
+    
+    duckAttack  = static_cast<SampleType> (std::exp (-1.0 / (bvie_FDN_DUCK_ATTACK_MS * 0.001 * samplerate)));
+    duckRelease = static_cast<SampleType> (std::exp (-1.0 / (bvie_FDN_DUCK_RELEASE_MS * 0.001 * samplerate)));
+    
+    setLoCutFrequency (loCutHz);
+    setHiCutFrequency (hiCutHz);
+    updateFeedbackGains();
+    
+    reset();
+}
+
+#undef bvie_FDN_DUCK_ATTACK_MS
+#undef bvie_FDN_DUCK_RELEASE_MS
+#undef bvie_FDN_RAMP_SECONDS
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::reset()
+{
+    if (delayMemory != nullptr)
+        FVO::clear (delayMemory.get(), int(delayMemorySize));
+    
+    for (auto& line : lines)
+        line.dampingState = 0;
+    
+    writePosition = 0;
+    loCutState = 0;
+    duckState = 0;
+    silentSamples = 0;
+    asleep = false;
+    
+    wetProportion.setCurrentAndTargetValue (wetProportion.getTargetValue());
+}
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::release()
+{
+    delayMemory.free();
+    delayMemorySize = 0;
+    
+    for (auto& line : lines)
+        line.samples = nullptr;
+}
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::setDryWet (int wetPercent)
+{
+    jassert (wetPercent >= 0 && wetPercent <= 100);
+    
+    wetProportion.setTargetValue (static_cast<SampleType> (juce::jlimit (0, 100, wetPercent) * 0.01));
+}
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::setDecay (float decay)
+{
+    jassert (decay >= 0.0f && decay <= 1.0f);
+    
+    decayTimeSeconds = static_cast<SampleType> (bvie_FDN_MIN_DECAY_SECONDS
+                                                * std::pow (bvie_FDN_MAX_DECAY_SECONDS / bvie_FDN_MIN_DECAY_SECONDS,
+                                                            double (juce::jlimit (0.0f, 1.0f, decay))));
+    updateFeedbackGains();
+}
+
+#undef bvie_FDN_MIN_DECAY_SECONDS
+#undef bvie_FDN_MAX_DECAY_SECONDS
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::setDuckAmount (float amount)
+{
+    jassert (amount >= 0.0f && amount <= 1.0f);
+    
+    duckAmount = static_cast<SampleType> (juce::jlimit (0.0f, 1.0f, amount) * bvie_FDN_DUCK_DEPTH);
+}
+
+#undef bvie_FDN_DUCK_DEPTH
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::setLoCutFrequency (float hz)
+{
+    loCutHz = hz;
+    loCutCoefficient = static_cast<SampleType> (1.0 - std::exp (-juce::MathConstants<double>::twoPi * hz / sampleRate));
+}
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::setHiCutFrequency (float hz)
+{
+    hiCutHz = hz;
+    dampingCoefficient = static_cast<SampleType> (1.0 - std::exp (-juce::MathConstants<double>::twoPi * hz / sampleRate));
+}
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::setWidth (float newWidth)
+{
+    width = static_cast<SampleType> (juce::jlimit (0.0f, 1.0f, newWidth));
+}
+
+
+// each line loses 60 dB over the decay time, however long it is
+template<typename SampleType>
+void FDNReverb<SampleType>::updateFeedbackGains()
+{
+    const auto samplesPerDecay = double(decayTimeSeconds) * sampleRate;
+    int longestLine = 0;
+    
+    for (auto& line : lines)
+    {
+        line.feedbackGain = static_cast<SampleType> (std::pow (10.0, -3.0 * line.length / samplesPerDecay));
+        longestLine = std::max (longestLine, line.length);
+    }
+    
+    tailLengthSamples = longestLine + int (samplesPerDecay * (bvie_FDN_SILENCE_DB / -60.0));
+}
+
+
+template<typename SampleType>
+SampleType* FDNReverb<SampleType>::getChunk (int index) noexcept
+{
+    return chunkData.get() + index * bvie_FDN_MAX_CHUNK;
+}
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::goToSleep()
+{
+    reset();
+    asleep = true;
+}
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::process (juce::AudioBuffer<SampleType>& buffer)
+{
+    jassert (buffer.getNumChannels() >= 2);
+    jassert (delayMemory != nullptr);
+    
+    const auto numSamples = buffer.getNumSamples();
+    
+    if (numSamples == 0)
+        return;
+    
+    if (buffer.getMagnitude (0, numSamples) > juce::Decibels::decibelsToGain (SampleType(bvie_FDN_SILENCE_DB)))
+        silentSamples = 0;
+    else
+        silentSamples = std::min (silentSamples + numSamples, tailLengthSamples + 1);
+    
+    const bool wetIsOff = wetProportion.getTargetValue() == SampleType(0) && ! wetProportion.isSmoothing();
+    
+    if (wetIsOff || silentSamples > tailLengthSamples)
+    {
+        if (! asleep)
+            goToSleep();
+        
+        // nothing is left but the (silent) dry signal
+        const auto startGain = SampleType(1) - wetProportion.getCurrentValue();
+        wetProportion.skip (numSamples);
+        buffer.applyGainRamp (0, numSamples, startGain, SampleType(1) - wetProportion.getCurrentValue());
+        return;
+    }
+    
+    asleep = false;
+    
+    auto* left  = buffer.getWritePointer (0);
+    auto* right = buffer.getWritePointer (1);
+    
+    for (int start = 0; start < numSamples; start += bvie_FDN_MAX_CHUNK)
+    {
+        const auto chunkSize = std::min (bvie_FDN_MAX_CHUNK, numSamples - start);
+        processChunk (left + start, right + start, chunkSize);
+    }
+}
+
+#undef bvie_FDN_SILENCE_DB
+
+
+template<typename SampleType>
+void FDNReverb<SampleType>::processChunk (SampleType* left, SampleType* right, const int numSamples)
+{
+    auto* send = getChunk (numDelayLines);
+    auto* duck = getChunk (numDelayLines + 1);
+    
+    // the send into the network, lo cut, and the envelope of the dry signal for the ducking
+    for (int s = 0; s < numSamples; ++s)
+    {
+        const auto x = (left[s] + right[s]) * SampleType(0.5);
+        
+        loCutState += loCutCoefficient * (x - loCutState);
+        send[s] = x - loCutState;
+        
+        const auto level = std::abs (x);
+        duckState = level + (level > duckState ? duckAttack : duckRelease) * (duckState - level);
+        duck[s] = SampleType(1) / (SampleType(1) + duckAmount * duckState);
+    }
+    
+    // read each line's chunk, damping it & applying its feedback gain
+    for (int i = 0; i < numDelayLines; ++i)
+    {
+        auto& line = lines[i];
+        auto* out = getChunk (i);
+        const auto readPosition = writePosition - juce::uint32 (line.length);
+        
+        for (int s = 0; s < numSamples; ++s)
+            out[s] = line.samples[(readPosition + juce::uint32 (s)) & line.mask];
+        
+        auto state = line.dampingState;
+        
+        for (int s = 0; s < numSamples; ++s)
+        {
+            state += dampingCoefficient * (out[s] - state);
+            out[s] = state * line.feedbackGain;
+        }
+        
+        line.dampingState = state;
+    }
+    
+    // the even lines are tapped for the left output & the odd lines for the right
+    {
+        const auto midScale  = SampleType(0.5);
+        const auto sideScale = SampleType(0.5) * width;
+        
+        const auto* l0 = getChunk (0); const auto* l2 = getChunk (2); const auto* l4 = getChunk (4); const auto* l6 = getChunk (6);
+        const auto* l1 = getChunk (1); const auto* l3 = getChunk (3); const auto* l5 = getChunk (5); const auto* l7 = getChunk (7);
+        
+        for (int s = 0; s < numSamples; ++s)
+        {
+            const auto wetLeft  = l0[s] + l2[s] + l4[s] + l6[s];
+            const auto wetRight = l1[s] + l3[s] + l5[s] + l7[s];
+            
+            const auto mid  = (wetLeft + wetRight) * midScale;
+            const auto side = (wetLeft - wetRight) * sideScale;
+            
+            const auto wet = wetProportion.getNextValue();
+            const auto dry = SampleType(1) - wet;
+            const auto wetGain = wet * duck[s];
+            
+            left[s]  = left[s]  * dry + (mid + side) * wetGain;
+            right[s] = right[s] * dry + (mid - side) * wetGain;
+        }
+    }
+    
+    // the feedback matrix: a fast Walsh-Hadamard transform across the lines, one butterfly stage at a time
+    for (int stride = 1; stride < numDelayLines; stride *= 2)
+    {
+        for (int i = 0; i < numDelayLines; i += 2 * stride)
+        {
+            for (int j = i; j < i + stride; ++j)
+            {
+                auto* a = getChunk (j);
+                auto* b = getChunk (j + stride);
+                
+                for (int s = 0; s < numSamples; ++s)
+                {
+                    const auto sum = a[s] + b[s];
+                    b[s] = a[s] - b[s];
+                    a[s] = sum;
+                }
+            }
+        }
+    }
+    
+    // normalise the matrix, add the send, and write each chunk back into its line
+    const auto matrixScale = static_cast<SampleType> (1.0 / std::sqrt (double (numDelayLines)));
+    
+    for (int i = 0; i < numDelayLines; ++i)
+    {
+        auto& line = lines[i];
+        const auto* in = getChunk (i);
+        const auto sendGain = static_cast<SampleType> (fdnInputSigns[i]);
+        
+        for (int s = 0; s < numSamples; ++s)
+            line.samples[(writePosition + juce::uint32 (s)) & line.mask] = in[s] * matrixScale + send[s] * sendGain;
+    }
+    
+    writePosition += juce::uint32 (numSamples);
+}
+
+#undef bvie_FDN_MAX_CHUNK
+
+
+template class FDNReverb<float>;
+template class FDNReverb<double>;
+
+
+} // namespace
@@ -0,0 +1,125 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ FDNReverb.h: This file defines the FDNReverb class, a feedback delay network reverb that Imogen runs on its output.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+
+
+/*
+    FDNReverb : eight delay lines, mixed through a Hadamard matrix on every pass round the loop.
+    The loop is processed in chunks no longer than the shortest delay line, so that each line's chunk can be read, filtered, mixed & written back as a whole -- the matrix then runs as plain loops over contiguous samples, one pair of lines at a time.
+    The lo cut filters the signal going into the network, the hi cut damps every line inside the loop, and the wet signal is ducked by the level of the dry signal.
+    When the wet level is zero, or the input has been silent for longer than the tail takes to die away, the reverb clears its delay lines once and does no further work until it's needed again.
+*/
+
+template<typename SampleType>
+class FDNReverb
+{
+    using FVO = juce::FloatVectorOperations;
+    
+public:
+    FDNReverb();
+    
+    void prepare (double samplerate);
+    
+    void reset();
+    
+    void release();
+    
+    void setDryWet (int wetPercent);
+    
+    // 0 to 1, mapped exponentially onto the reverb time
+    void setDecay (float decay);
+    
+    // 0 to 1. How far the wet signal is turned down while the dry signal is loud
+    void setDuckAmount (float amount);
+    
+    void setLoCutFrequency (float hz);
+    
+    void setHiCutFrequency (float hz);
+    
+    // 0 to 1; 0 is a mono wet signal
+    void setWidth (float width);
+    
+    bool isAsleep() const noexcept { return asleep; }
+    
+    // how long the tail takes to die away after the input stops, at the current decay setting
+    double getTailLengthSeconds() const noexcept { return tailLengthSamples / sampleRate; }
+    
+    // processes a stereo buffer in place
+    void process (juce::AudioBuffer<SampleType>& buffer);
+    
+    static constexpr int numDelayLines = 8;
+    
+    
+private:
+    
+    void processChunk (SampleType* left, SampleType* right, const int numSamples);
+    
+    void goToSleep();
+    
+    void updateFeedbackGains();
+    
+    SampleType* getChunk (int index) noexcept;
+    
+    struct DelayLine
+    {
+        SampleType* samples = nullptr;
+        juce::uint32 mask = 0;
+        int length = 0;
+        SampleType feedbackGain = 0, dampingState = 0;
+    };
+    
+    DelayLine lines[numDelayLines];
+    
+    // every line's samples, one after another, each padded to a power of two so that a shared write position can be wrapped with a mask
+    juce::HeapBlock<SampleType> delayMemory;
+    size_t delayMemorySize = 0;
+    
+    juce::uint32 writePosition = 0;
+    
+    // scratch space for one chunk: a channel for each line's output, then the send & the ducking gain
+    juce::HeapBlock<SampleType> chunkData;
+    
+    double sampleRate = 44100.0;
+    
+    juce::SmoothedValue<SampleType> wetProportion;
+    
+    SampleType decayTimeSeconds = 2, width = 1, duckAmount = 0;
+    SampleType loCutCoefficient = 0, dampingCoefficient = 0, duckAttack = 0, duckRelease = 0;
+    float loCutHz = 80.0f, hiCutHz = 5500.0f;
+    
+    SampleType loCutState = 0, duckState = 0;
+    
+    int silentSamples = 0, tailLengthSamples = 0;
+    bool asleep = false;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FDNReverb)
+};
+
+
+} // namespace
@@ -0,0 +1,165 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ ImogenParameters.h: This file defines how the values of Imogen's parameters are applied to an ImogenEngine, so that the plugin & the offline renderer always set the engine up the same way.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+
+
+// the default value of each of Imogen's parameters, in the parameter's own units. ImogenAudioProcessor::createParameters() creates its parameters with these.
+struct ImogenParameterDefaults
+{
+    static constexpr bool  mainBypass = false, leadBypass = false, harmonyBypass = false;
+    static constexpr int   numVoices = 12, inputSource = 1, dryPan = 64;
+    static constexpr float adsrAttack = 0.35f, adsrDecay = 0.06f, adsrSustain = 0.8f, adsrRelease = 0.1f;
+    static constexpr bool  adsrOnOff = true;
+    static constexpr int   stereoWidth = 100, lowestPan = 0, midiVelocitySens = 100, pitchBendRange = 2, concertPitch = 440;
+    static constexpr bool  voiceStealing = false, aftertouchGainToggle = true;
+    static constexpr bool  pedalPitchToggle = false;
+    static constexpr int   pedalPitchThresh = 0, pedalPitchInterval = 12;
+    static constexpr bool  descantToggle = false;
+    static constexpr int   descantThresh = 127, descantInterval = 12;
+    static constexpr int   masterDryWet = 100;
+    static constexpr float inputGain = 0.0f, outputGain = -4.0f;
+    static constexpr bool  limiterIsOn = true, noiseGateIsOn = true;
+    static constexpr float noiseGateThresh = -20.0f;
+    static constexpr bool  deEsserIsOn = true;
+    static constexpr float deEsserThresh = -6.0f, deEsserAmount = 0.5f;
+    static constexpr bool  compressorToggle = false;
+    static constexpr float compressorAmount = 0.35f;
+    static constexpr bool  reverbIsOn = false;
+    static constexpr int   reverbDryWet = 35;
+    static constexpr float reverbDecay = 0.6f, reverbDuck = 0.3f, reverbLoCut = 80.0f, reverbHiCut = 5500.0f;
+    static constexpr int   vocalRangeType = 0;
+    static constexpr bool  pipelinedAnalysis = false, multithreadedRendering = false;
+    static constexpr int   numSingers = 1;
+    static constexpr bool  mixedPrecision = false, incrementalPitchTracking = false;
+};
+
+
+// sets the engine's pitch detection Hz range for the "vocalRangeType" parameter. This changes the engine's latency, so call it before the engine is prepared, or while processing is suspended.
+template<typename SampleType, typename HarmonySampleType>
+void applyVocalRangeType (ImogenEngine<SampleType, HarmonySampleType>& engine, const int rangeType)
+{
+    jassert (rangeType >= 0 && rangeType <= 3);
+    
+    int minHz, maxHz;
+    
+    switch (rangeType)
+    {
+        default:
+            minHz = bav::math::midiToFreq (57);
+            maxHz = bav::math::midiToFreq (88);
+            break;
+        case (1):
+            minHz = bav::math::midiToFreq (50);
+            maxHz = bav::math::midiToFreq (81);
+            break;
+        case (2):
+            minHz = bav::math::midiToFreq (43);
+            maxHz = bav::math::midiToFreq (76);
+            break;
+        case (3):
+            minHz = bav::math::midiToFreq (36);
+            maxHz = bav::math::midiToFreq (67);
+            break;
+    }
+    
+    engine.updatePitchDetectionHzRange (minHz, maxHz);
+}
+
+
+// the "compressorAmount" knob sets the threshold & ratio together
+template<typename SampleType, typename HarmonySampleType>
+void applyCompressorAmount (ImogenEngine<SampleType, HarmonySampleType>& engine, const bool compressorIsOn, const float knobValue)
+{
+    jassert (knobValue >= 0.0f && knobValue <= 1.0f);
+    
+    engine.updateCompressor (juce::jmap (knobValue, 0.0f, -60.0f),  // threshold (dB)
+                             juce::jmap (knobValue, 1.0f, 10.0f),  // ratio
+                             compressorIsOn);
+}
+
+
+/*
+    Applies every parameter that the engine reads, except for the ones that are only read when the engine is prepared ("mixedPrecision" & "incrementalPitchTracking").
+    getValue (const char* parameterID, float defaultValue) returns a parameter's value in its own units -- with bools as 0 or 1 -- or defaultValue if the source doesn't have one, as a preset may not.
+    This changes the engine's structure & latency, and isn't called from the audio thread, so call it before the engine is prepared, or while processing is suspended. Re-report the latency afterwards.
+*/
+template<typename SampleType, typename HarmonySampleType, typename ValueGetter>
+void applyImogenParameters (ImogenEngine<SampleType, HarmonySampleType>& engine, ValueGetter&& getValue)
+{
+    using Defaults = ImogenParameterDefaults;
+    using Engine   = ImogenEngine<SampleType, HarmonySampleType>;
+    
+    auto getFloat = [&getValue] (const char* paramID, float defaultValue) { return float (getValue (paramID, defaultValue)); };
+    auto getInt   = [&getValue] (const char* paramID, int defaultValue)   { return juce::roundToInt (getValue (paramID, float (defaultValue))); };
+    auto getBool  = [&getValue] (const char* paramID, bool defaultValue)  { return getValue (paramID, defaultValue ? 1.0f : 0.0f) >= 0.5f; };
+    
+    // first, so that any new singers get the rest of the settings
+    engine.setNumSingers (getInt ("numSingers", Defaults::numSingers));
+    
+    applyVocalRangeType (engine, getInt ("vocalRangeType", Defaults::vocalRangeType));
+    engine.setUsePipelinedAnalysis (getBool ("pipelinedAnalysis", Defaults::pipelinedAnalysis));
+    engine.setUseMultithreadedRendering (getBool ("multithreadedRendering", Defaults::multithreadedRendering));
+    
+    // every voice is allocated up front, so this doesn't suspend processing
+    engine.updateNumVoices (getInt ("numVoices", Defaults::numVoices));
+    
+    engine.updateBypassStates (getBool ("leadBypass", Defaults::leadBypass), getBool ("harmonyBypass", Defaults::harmonyBypass));
+    
+    // set rather than queued, so the next automation ramps of these parameters start from these values
+    engine.setAutomatedParameter (Engine::automatedInputGain, juce::Decibels::decibelsToGain (getFloat ("inputGain", Defaults::inputGain)));
+    engine.setAutomatedParameter (Engine::automatedOutputGain, juce::Decibels::decibelsToGain (getFloat ("outputGain", Defaults::outputGain)));
+    engine.setAutomatedParameter (Engine::automatedDryPan, float (getInt ("dryPan", Defaults::dryPan)));
+    engine.setAutomatedParameter (Engine::automatedDryWet, float (getInt ("masterDryWet", Defaults::masterDryWet)));
+    
+    engine.updateAdsr (getFloat ("adsrAttack", Defaults::adsrAttack), getFloat ("adsrDecay", Defaults::adsrDecay), getFloat ("adsrSustain", Defaults::adsrSustain),
+                       getFloat ("adsrRelease", Defaults::adsrRelease), getBool ("adsrOnOff", Defaults::adsrOnOff));
+    engine.updateStereoWidth (getInt ("stereoWidth", Defaults::stereoWidth), getInt ("lowestPan", Defaults::lowestPan));
+    engine.updateMidiVelocitySensitivity (getInt ("midiVelocitySens", Defaults::midiVelocitySens));
+    engine.updatePitchbendRange (getInt ("PitchBendRange", Defaults::pitchBendRange));
+    engine.updatePedalPitch (getBool ("pedalPitchToggle", Defaults::pedalPitchToggle), getInt ("pedalPitchThresh", Defaults::pedalPitchThresh),
+                             getInt ("pedalPitchInterval", Defaults::pedalPitchInterval));
+    engine.updateDescant (getBool ("descantToggle", Defaults::descantToggle), getInt ("descantThresh", Defaults::descantThresh),
+                          getInt ("descantInterval", Defaults::descantInterval));
+    engine.updateConcertPitch (getInt ("concertPitch", Defaults::concertPitch));
+    engine.updateNoteStealing (getBool ("voiceStealing", Defaults::voiceStealing));
+    engine.updateAftertouchGainOnOff (getBool ("aftertouchGainToggle", Defaults::aftertouchGainToggle));
+    engine.setModulatorSource (getInt ("inputSource", Defaults::inputSource));
+    engine.updateLimiter (getBool ("limiterIsOn", Defaults::limiterIsOn));
+    engine.updateNoiseGate (getFloat ("noiseGateThresh", Defaults::noiseGateThresh), getBool ("noiseGateIsOn", Defaults::noiseGateIsOn));
+    engine.updateDeEsser (getFloat ("deEsserAmount", Defaults::deEsserAmount), getFloat ("deEsserThresh", Defaults::deEsserThresh),
+                          getBool ("deEsserIsOn", Defaults::deEsserIsOn));
+    
+    applyCompressorAmount (engine, getBool ("compressorToggle", Defaults::compressorToggle), getFloat ("compressorAmount", Defaults::compressorAmount));
+    
+    engine.updateReverb (getInt ("reverbDryWet", Defaults::reverbDryWet), getFloat ("reverbDecay", Defaults::reverbDecay), getFloat ("reverbDuck", Defaults::reverbDuck),
+                         getFloat ("reverbLoCut", Defaults::reverbLoCut), getFloat ("reverbHiCut", Defaults::reverbHiCut), getBool ("reverbIsOn", Defaults::reverbIsOn));
+}
+
+
+}  // namespace
@@ -0,0 +1,84 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ StereoMixKernel.h: This file defines the fused kernel that builds the ImogenEngine's stereo output in one pass: it pans the dry signal, mixes it with the harmonies, and applies the output gain.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+
+
+template<typename SampleType>
+struct StereoMixGains
+{
+    SampleType dryLeft, dryRight;  // the dry panning gains, times the dry mix level
+    SampleType wet;                // the wet mix level
+};
+
+
+/*
+    Computes the dry & wet levels for a wet proportion between 0 and 1, following juce::dsp::DryWetMixingRule::balanced: both signals are at full level at 50% wet, and each one fades out over the other half of the range.
+    The panning & output gains are folded in here, so that the mixing loops below only do two multiply-adds per output sample.
+*/
+template<typename SampleType>
+inline StereoMixGains<SampleType> getStereoMixGains (const SampleType wetProportion, const SampleType dryLeftGain, const SampleType dryRightGain, const SampleType outputGain)
+{
+    const auto dryLevel = SampleType(2) * std::min (SampleType(0.5), SampleType(1) - wetProportion);
+    const auto wetLevel = SampleType(2) * std::min (SampleType(0.5), wetProportion);
+    
+    return { dryLeftGain * dryLevel * outputGain, dryRightGain * dryLevel * outputGain, wetLevel * outputGain };
+}
+
+
+// writes the mix of a mono dry signal & a stereo wet signal with constant gains. The outputs must not overlap the inputs; the loop is simple enough for the compiler to vectorise.
+template<typename SampleType>
+inline void mixStereo (const SampleType* dry, const SampleType* wetLeft, const SampleType* wetRight,
+                       SampleType* outLeft, SampleType* outRight, const int numSamples,
+                       const StereoMixGains<SampleType>& gains)
+{
+    for (int s = 0; s < numSamples; ++s)
+    {
+        outLeft[s]  = dry[s] * gains.dryLeft  + wetLeft[s]  * gains.wet;
+        outRight[s] = dry[s] * gains.dryRight + wetRight[s] * gains.wet;
+    }
+}
+
+
+// the same mix, for while any of the gains are ramping. getNextGains() is called once per sample, and returns that sample's StereoMixGains.
+template<typename SampleType, typename GainSource>
+inline void mixStereoRamped (const SampleType* dry, const SampleType* wetLeft, const SampleType* wetRight,
+                             SampleType* outLeft, SampleType* outRight, const int numSamples,
+                             GainSource&& getNextGains)
+{
+    for (int s = 0; s < numSamples; ++s)
+    {
+        const StereoMixGains<SampleType> gains = getNextGains();
+        
+        outLeft[s]  = dry[s] * gains.dryLeft  + wetLeft[s]  * gains.wet;
+        outRight[s] = dry[s] * gains.dryRight + wetRight[s] * gains.wet;
+    }
+}
+
+
+} // namespace
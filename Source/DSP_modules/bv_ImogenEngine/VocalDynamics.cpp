@@ -0,0 +1,318 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ VocalDynamics.cpp: This file defines implementation details for the VocalDynamics class.
+ 
+======================================================================================================================================================*/
+
+
+#include "VocalDynamics.h"
+
+
+#define bvie_NOISE_GATE_ATTACK_MS 25.0
+#define bvie_NOISE_GATE_RELEASE_MS 100.0
+#define bvie_NOISE_GATE_FLOOR_RATIO_TO_ONE 10.0
+
+#define bvie_COMPRESSOR_ATTACK_MS 4.0
+#define bvie_COMPRESSOR_RELEASE_MS 200.0
+
+#define bvie_DEESSER_ATTACK_MS 1.0
+#define bvie_DEESSER_RELEASE_MS 60.0
+#define bvie_DEESSER_HIPASS_HZ 5500.0
+#define bvie_DEESSER_MAX_RATIO 10.0
+
+// keep the gain curves away from log(0), and within the range of a float
+#define bvie_MIN_ENVELOPE_RATIO 0.000001
+#define bvie_MAX_ENVELOPE_RATIO 1.0e30
+
+
+namespace bav
+{
+    
+
+template<typename SampleType>
+VocalDynamics<SampleType>::VocalDynamics()
+{
+    prepare (sampleRate, 0);
+}
+    
+
+template<typename SampleType>
+void VocalDynamics<SampleType>::prepare (double samplerate, int blocksize)
+{
+    jassert (samplerate > 0);
+    
+    sampleRate = samplerate;
+    
+    gateAttack        = getBallisticsCoefficient (samplerate, bvie_NOISE_GATE_ATTACK_MS);
+    gateRelease       = getBallisticsCoefficient (samplerate, bvie_NOISE_GATE_RELEASE_MS);
+    compressorAttack  = getBallisticsCoefficient (samplerate, bvie_COMPRESSOR_ATTACK_MS);
+    compressorRelease = getBallisticsCoefficient (samplerate, bvie_COMPRESSOR_RELEASE_MS);
+    deEsserAttack     = getBallisticsCoefficient (samplerate, bvie_DEESSER_ATTACK_MS);
+    deEsserRelease    = getBallisticsCoefficient (samplerate, bvie_DEESSER_RELEASE_MS);
+    
+    highPassCoefficient = static_cast<SampleType> (std::exp (-juce::MathConstants<double>::twoPi * bvie_DEESSER_HIPASS_HZ / samplerate));
+    
+    if (blocksize > 0)
+        detectorData.setSize (numDetectorChannels, blocksize);
+    
+    reset();
+}
+
+#undef bvie_NOISE_GATE_ATTACK_MS
+#undef bvie_NOISE_GATE_RELEASE_MS
+#undef bvie_COMPRESSOR_ATTACK_MS
+#undef bvie_COMPRESSOR_RELEASE_MS
+#undef bvie_DEESSER_ATTACK_MS
+#undef bvie_DEESSER_RELEASE_MS
+#undef bvie_DEESSER_HIPASS_HZ
+
+
+template<typename SampleType>
+void VocalDynamics<SampleType>::reset()
+{
+    rmsState = 0;
+    peakState = 0;
+    highBandState = 0;
+    highPassState = 0;
+    lastInput = 0;
+}
+
+
+template<typename SampleType>
+void VocalDynamics<SampleType>::release()
+{
+    detectorData.setSize (0, 0);
+    reset();
+}
+
+
+template<typename SampleType>
+SampleType VocalDynamics<SampleType>::getBallisticsCoefficient (double samplerate, double timeMs)
+{
+    if (timeMs <= 0.0)
+        return 0;
+    
+    return static_cast<SampleType> (std::exp (-1.0 / (timeMs * 0.001 * samplerate)));
+}
+
+
+template<typename SampleType>
+void VocalDynamics<SampleType>::setGate (float thresholdDB, bool isOn)
+{
+    gateThreshold = juce::Decibels::decibelsToGain (static_cast<SampleType> (thresholdDB));
+    gateIsOn = isOn;
+}
+
+
+template<typename SampleType>
+void VocalDynamics<SampleType>::setDeEsser (float amount, float thresholdDB, bool isOn)
+{
+    jassert (amount >= 0.0f && amount <= 1.0f);
+    
+    deEsserThreshold = juce::Decibels::decibelsToGain (static_cast<SampleType> (thresholdDB));
+    deEsserRatio = static_cast<SampleType> (1.0 + juce::jlimit (0.0f, 1.0f, amount) * (bvie_DEESSER_MAX_RATIO - 1.0));
+    deEsserIsOn = isOn;
+}
+
+#undef bvie_DEESSER_MAX_RATIO
+
+
+template<typename SampleType>
+void VocalDynamics<SampleType>::setCompressor (float thresholdDB, float ratio, bool isOn)
+{
+    jassert (ratio >= 1.0f);
+    
+    compressorThreshold = juce::Decibels::decibelsToGain (static_cast<SampleType> (thresholdDB));
+    compressorRatio = static_cast<SampleType> (std::max (1.0f, ratio));
+    compressorIsOn = isOn;
+}
+
+
+template<typename SampleType>
+void VocalDynamics<SampleType>::process (SampleType* signal, const int numSamples)
+{
+    jassert (numSamples <= detectorData.getNumSamples());
+    
+    if (! isActive() || numSamples == 0)
+        return;
+    
+    detect (signal, numSamples);
+    
+    auto* gains = detectorData.getWritePointer (broadbandGain);
+    FVO::fill (gains, SampleType(1), numSamples);
+    
+    bool anyBroadbandGain = false;
+    
+    if (gateIsOn)
+        anyBroadbandGain |= applyGainCurve (detectorData.getReadPointer (rmsEnvelope), gains, numSamples,
+                                            gateThreshold, SampleType(bvie_NOISE_GATE_FLOOR_RATIO_TO_ONE - 1.0), true);
+    
+    if (compressorIsOn)
+        anyBroadbandGain |= applyGainCurve (detectorData.getReadPointer (peakEnvelope), gains, numSamples,
+                                            compressorThreshold, SampleType(1) / compressorRatio - SampleType(1), false);
+    
+    if (deEsserIsOn)
+    {
+        auto* deEssGains = detectorData.getWritePointer (deEssGain);
+        FVO::fill (deEssGains, SampleType(1), numSamples);
+        
+        if (applyGainCurve (detectorData.getReadPointer (highBandEnvelope), deEssGains, numSamples,
+                            deEsserThreshold, SampleType(1) / deEsserRatio - SampleType(1), false))
+        {
+            // turns down just the high band: x + highBand * (gain - 1)
+            const auto* high = detectorData.getReadPointer (highBand);
+            
+            for (int s = 0; s < numSamples; ++s)
+                signal[s] += high[s] * (deEssGains[s] - SampleType(1));
+        }
+    }
+    
+    if (anyBroadbandGain)
+        FVO::multiply (signal, gains, numSamples);
+}
+
+#undef bvie_NOISE_GATE_FLOOR_RATIO_TO_ONE
+
+
+// the only part of the processing that has to run one sample after another: the envelope followers & the de-esser's high-pass filter
+template<typename SampleType>
+void VocalDynamics<SampleType>::detect (const SampleType* signal, const int numSamples)
+{
+    auto* rms      = detectorData.getWritePointer (rmsEnvelope);
+    auto* peak     = detectorData.getWritePointer (peakEnvelope);
+    auto* high     = detectorData.getWritePointer (highBand);
+    auto* highPeak = detectorData.getWritePointer (highBandEnvelope);
+    
+    for (int s = 0; s < numSamples; ++s)
+    {
+        const auto x = signal[s];
+        
+        const auto squared = x * x;
+        rmsState = squared + (squared > rmsState ? gateAttack : gateRelease) * (rmsState - squared);
+        rms[s] = rmsState;
+        
+        const auto level = std::abs (x);
+        peakState = level + (level > peakState ? compressorAttack : compressorRelease) * (peakState - level);
+        peak[s] = peakState;
+        
+        highPassState = highPassCoefficient * (highPassState + x - lastInput);
+        lastInput = x;
+        high[s] = highPassState;
+        
+        const auto highLevel = std::abs (highPassState);
+        highBandState = highLevel + (highLevel > highBandState ? deEsserAttack : deEsserRelease) * (highBandState - highLevel);
+        highPeak[s] = highBandState;
+    }
+    
+    for (int s = 0; s < numSamples; ++s)
+        rms[s] = std::sqrt (rms[s]);
+}
+
+
+template<typename SampleType>
+bool VocalDynamics<SampleType>::applyGainCurve (const SampleType* envelope, SampleType* gains, const int numSamples,
+                                                const SampleType threshold, const SampleType exponent, const bool isExpander)
+{
+    const auto range = FVO::findMinAndMax (envelope, numSamples);
+    
+    if (isExpander ? range.getStart() >= threshold : range.getEnd() <= threshold)
+        return false;
+    
+    auto* curve = detectorData.getWritePointer (gainCurve);
+    
+    // (envelope / threshold)^exponent, clamped to unity gain on the far side of the threshold -- computed as exp2 (exponent * log2 (ratio)), one vectorised pass at a time
+    FVO::multiply (curve, envelope, SampleType(1) / threshold, numSamples);
+    
+    if (isExpander)
+        FVO::clip (curve, curve, SampleType(bvie_MIN_ENVELOPE_RATIO), SampleType(1), numSamples);
+    else
+        FVO::clip (curve, curve, SampleType(1), SampleType(bvie_MAX_ENVELOPE_RATIO), numSamples);
+    
+    approximateLog2 (curve, numSamples);
+    
+    FVO::multiply (curve, exponent, numSamples);
+    FVO::clip (curve, curve, SampleType(-126), SampleType(127), numSamples);
+    
+    approximateExp2 (curve, numSamples);
+    
+    FVO::multiply (gains, curve, numSamples);
+    
+    return true;
+}
+
+#undef bvie_MIN_ENVELOPE_RATIO
+#undef bvie_MAX_ENVELOPE_RATIO
+
+
+// the exponent is read from the float's bits, with the mantissa shifted into [sqrt(0.5), sqrt(2)); then log2 (m) = 2/ln(2) * atanh ((m - 1) / (m + 1)), by its series.
+// The maths is done in single precision for both sample types, which is plenty for a gain
+template<typename SampleType>
+void VocalDynamics<SampleType>::approximateLog2 (SampleType* data, const int numSamples) noexcept
+{
+    for (int s = 0; s < numSamples; ++s)
+    {
+        const auto x = static_cast<float> (data[s]);
+        
+        juce::int32 bits;
+        std::memcpy (&bits, &x, sizeof (bits));
+        
+        const auto exponent = (bits - 0x3f3504f3) >> 23;  // 0x3f3504f3 is sqrt(0.5)
+        bits -= exponent * (1 << 23);
+        
+        float mantissa;
+        std::memcpy (&mantissa, &bits, sizeof (mantissa));
+        
+        const auto t = (mantissa - 1.0f) / (mantissa + 1.0f);
+        const auto t2 = t * t;
+        
+        data[s] = static_cast<SampleType> (static_cast<float> (exponent)
+                                           + t * (2.88539008f + t2 * (0.961796694f + t2 * (0.577078016f + t2 * 0.412198583f))));
+    }
+}
+
+
+// 2^x = 2^n * e^(f * ln(2)), where n is x rounded to the nearest integer, and |f| <= 0.5. 2^n is built from its bits, and e^(f * ln(2)) by its Taylor series
+template<typename SampleType>
+void VocalDynamics<SampleType>::approximateExp2 (SampleType* data, const int numSamples) noexcept
+{
+    for (int s = 0; s < numSamples; ++s)
+    {
+        const auto x = static_cast<float> (data[s]);
+        
+        const auto whole = static_cast<juce::int32> (x + 128.5f) - 128;  // truncating a positive number rounds it down, without a call to std::floor
+        const auto g = (x - static_cast<float> (whole)) * 0.693147181f;
+        
+        const auto fraction = 1.0f + g * (1.0f + g * (0.5f + g * (1.0f / 6.0f + g * (1.0f / 24.0f + g * (1.0f / 120.0f + g * (1.0f / 720.0f))))));
+        
+        const auto bits = static_cast<juce::int32> ((whole + 127) * (1 << 23));
+        
+        float scale;
+        std::memcpy (&scale, &bits, sizeof (scale));
+        
+        data[s] = static_cast<SampleType> (fraction * scale);
+    }
+}
+
+
+template class VocalDynamics<float>;
+template class VocalDynamics<double>;
+
+
+} // namespace
@@ -0,0 +1,104 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ VocalDynamics.h: This file defines the VocalDynamics class, which runs Imogen's noise gate, de-esser & compressor from a single shared sidechain analysis of the input.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+
+namespace bav
+{
+
+
+/*
+    VocalDynamics : the noise gate, de-esser & compressor, driven by one level detector.
+    Each block goes through the detector once, which follows an RMS envelope for the gate, a peak envelope for the compressor, and the envelope of a high band for the de-esser. All three stages then work out their gains from that data -- they all listen to the signal as it comes in, rather than each to the output of the stage before.
+    The gain curves are computed by branch-free loops over the whole block, and a stage whose envelope stays on one side of its threshold for the whole block skips its gain computation altogether.
+*/
+
+template<typename SampleType>
+class VocalDynamics
+{
+    using FVO = juce::FloatVectorOperations;
+    
+public:
+    VocalDynamics();
+    
+    void prepare (double samplerate, int blocksize);
+    
+    void reset();
+    
+    void release();
+    
+    void setGate (float thresholdDB, bool isOn);
+    
+    void setDeEsser (float amount, float thresholdDB, bool isOn);
+    
+    void setCompressor (float thresholdDB, float ratio, bool isOn);
+    
+    bool isActive() const noexcept { return gateIsOn || deEsserIsOn || compressorIsOn; }
+    
+    // true if the gate is on, and the level at the end of the last block was below its threshold
+    bool isGateClosed() const noexcept { return gateIsOn && rmsState < gateThreshold * gateThreshold; }
+    
+    // processes the samples in place. numSamples may be anything up to the blocksize passed to prepare().
+    void process (SampleType* signal, const int numSamples);
+    
+    
+private:
+    
+    // the detector's outputs for the current block, one channel each
+    enum DetectorChannel { rmsEnvelope, peakEnvelope, highBand, highBandEnvelope, broadbandGain, deEssGain, gainCurve, numDetectorChannels };
+    
+    void detect (const SampleType* signal, const int numSamples);
+    
+    // multiplies gains by the gain curve (envelope / threshold)^exponent, either below (isExpander) or above the threshold. Returns false if the envelope stayed on the unity-gain side of the threshold, and nothing was written.
+    bool applyGainCurve (const SampleType* envelope, SampleType* gains, const int numSamples,
+                         const SampleType threshold, const SampleType exponent, const bool isExpander);
+    
+    // fast approximations of log2 & exp2, in place & without branches, so that the compiler can vectorise them. Both are accurate to a few parts per million.
+    // approximateLog2() expects positive, finite inputs; approximateExp2() expects inputs within [-126, 127], the range of a float's normal exponents
+    static void approximateLog2 (SampleType* data, const int numSamples) noexcept;
+    
+    static void approximateExp2 (SampleType* data, const int numSamples) noexcept;
+    
+    static SampleType getBallisticsCoefficient (double samplerate, double timeMs);
+    
+    juce::AudioBuffer<SampleType> detectorData;
+    
+    double sampleRate = 44100.0;
+    
+    // envelope & filter coefficients
+    SampleType gateAttack = 0, gateRelease = 0, compressorAttack = 0, compressorRelease = 0, deEsserAttack = 0, deEsserRelease = 0, highPassCoefficient = 0;
+    
+    // detector state, carried from one block to the next
+    SampleType rmsState = 0, peakState = 0, highBandState = 0, highPassState = 0, lastInput = 0;
+    
+    bool gateIsOn = false, deEsserIsOn = false, compressorIsOn = false;
+    SampleType gateThreshold = 0, deEsserThreshold = 0, compressorThreshold = 0;
+    SampleType deEsserRatio = 1, compressorRatio = 1;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (VocalDynamics)
+};
+
+
+} // namespace
@@ -24,25 +24,43 @@
 
 
 #include "bv_ImogenEngineParameters.cpp"
+#include "VocalDynamics.cpp"
+#include "FDNReverb.cpp"
 
 
 #define bvie_LIMITER_THRESH_DB 0.0f
 #define bvie_LIMITER_RELEASE_MS 35.0f
 
-#define bvie_NOISE_GATE_ATTACK_MS 25.0f
-#define bvie_NOISE_GATE_RELEASE_MS 100.0f
-#define bvie_NOISE_GATE_FLOOR_RATIO_TO_ONE 10.0f
-
 #define bvie_INIT_MIN_HZ 80
 #define bvie_INIT_MAX_HZ 2400
 
 #define bvie_INITIAL_HIDDEN_HI_PASS_FREQ 65
 
-#define bvie_COMPRESSOR_ATTACK_MS 4.0f
-#define bvie_COMPRESSOR_RELEASE_MS 200.0f
+// the most the dry signal can be delayed by to line up with pipelined harmonies
+#define bvie_MAX_DRY_DELAY_SAMPLES 16384
+
+// the same ramp time that juce::dsp::DryWetMixer uses
+#define bvie_DRY_WET_RAMP_SECONDS 0.05
+
+// the capacity of the automation event queue. Events queued past this are applied straight away
+#define bvie_MAX_QUEUED_AUTOMATION_EVENTS 1024
+
+#define bvie_DEFAULT_MIN_AUTOMATION_SUBBLOCK 32
+
+// a ramp queued by queueAutomationRamp() is split into at most this many events, however long the host's block is
+#define bvie_MAX_AUTOMATION_RAMP_STEPS 64
 
+// input below this level counts as silence
+#define bvie_SILENCE_THRESHOLD_DB -90.0f
 
-#define bvie_VOID_TEMPLATE template<typename SampleType> void ImogenEngine<SampleType>
+// room for each block's incoming midi to be copied to every singer without allocating
+#define bvie_SINGER_MIDI_BYTES 4096
+
+// how often the incremental pitch tracker makes a new estimate, or once per block if the blocks are shorter
+#define bvie_INCREMENTAL_TRACKING_HOP 64
+
+
+#define bvie_VOID_TEMPLATE template<typename SampleType, typename HarmonySampleType> void ImogenEngine<SampleType, HarmonySampleType>
 
 
 namespace bav
@@ -50,10 +68,10 @@ namespace bav
 {
     
 
-template<typename SampleType>
-ImogenEngine<SampleType>::ImogenEngine(): FIFOEngine()
+template<typename SampleType, typename HarmonySampleType>
+ImogenEngine<SampleType, HarmonySampleType>::ImogenEngine(): FIFOEngine()
 {
-    modulatorInput.store(0);
+    modulatorInput.store(1);
     
     limiterIsOn.store(false);
     
@@ -64,28 +82,205 @@ ImogenEngine<SampleType>::ImogenEngine(): FIFOEngine()
     leadBypass.store (false);
     harmonyBypass.store (false);
     
-    deEsserIsOn.store (false);
     reverbIsOn.store (false);
     
-    dryWetMixer.setMixingRule (juce::dsp::DryWetMixingRule::balanced);
-    dryWetMixer.setWetLatency (SampleType(0.0));
+    automationEvents.ensureStorageAllocated (bvie_MAX_QUEUED_AUTOMATION_EVENTS);
+    minAutomationSubBlock.store (bvie_DEFAULT_MIN_AUTOMATION_SUBBLOCK);
+    
+    for (auto& value : lastQueuedAutomationValues)
+        value = std::numeric_limits<float>::quiet_NaN();
+    
+    minDetectionHz = bvie_INIT_MIN_HZ;
+    maxDetectionHz = bvie_INIT_MAX_HZ;
+}
+
+#undef bvie_DEFAULT_MIN_AUTOMATION_SUBBLOCK
+
+
+/*
+    Automation events are timestamped in samples along the input timeline, counted from the last prepare, reset, or latency change. The FIFO hands renderBlock() consecutive internal blocks of that same timeline, so an event can be placed on its own sample of whichever internal block it falls in, regardless of how the host's blocks line up with the internal ones.
+*/
+bvie_VOID_TEMPLATE::process (AudioBuffer& input, AudioBuffer& output, MidiBuffer& midiMessages, const bool isBypassed)
+{
+    FIFOEngine::process (input, output, midiMessages, isBypassed);
+    
+    inputSamplesReceived += input.getNumSamples();
+}
+
+
+bvie_VOID_TEMPLATE::queueAutomationEvent (const AutomationEvent& event)
+{
+    jassert (event.sampleOffset >= 0);
+    
+    const PendingAutomationEvent pending { inputSamplesReceived + std::max (0, event.sampleOffset), event.parameter, event.value };
+    
+    lastQueuedAutomationValues[event.parameter] = event.value;
+    
+    if (automationEvents.size() >= bvie_MAX_QUEUED_AUTOMATION_EVENTS)
+    {
+        jassertfalse;
+        applyAutomationEvent (pending);
+        return;
+    }
+    
+    auto index = automationEvents.size();
+    
+    while (index > 0 && automationEvents.getReference (index - 1).position > pending.position)
+        --index;
+    
+    automationEvents.insert (index, pending);
+}
+
+
+bvie_VOID_TEMPLATE::setAutomatedParameter (const AutomatedParameter parameter, const float value)
+{
+    automationEvents.removeIf ([parameter] (const PendingAutomationEvent& event) { return event.parameter == parameter; });
+    
+    lastQueuedAutomationValues[parameter] = value;
+    
+    applyAutomationEvent ({ inputSamplesReceived, parameter, value });
+}
+
+
+bvie_VOID_TEMPLATE::queueAutomationRamp (const AutomatedParameter parameter, const float newValue, const int numSamples)
+{
+    const auto startValue = lastQueuedAutomationValues[parameter];
+    const auto numSteps = std::min (bvie_MAX_AUTOMATION_RAMP_STEPS, numSamples / minAutomationSubBlock.load());
+    
+    if (std::isnan (startValue) || numSteps < 2)
+    {
+        queueAutomationEvent ({ 0, parameter, newValue });
+        return;
+    }
+    
+    // each step holds its value for one sub-block, and the last one reaches newValue
+    const auto stepLength = numSamples / numSteps;
+    
+    for (int step = 1; step <= numSteps; ++step)
+        queueAutomationEvent ({ (step - 1) * stepLength, parameter, startValue + (newValue - startValue) * float(step) / float(numSteps) });
+}
+
+#undef bvie_MAX_AUTOMATION_RAMP_STEPS
+
+#undef bvie_MAX_QUEUED_AUTOMATION_EVENTS
+
+
+bvie_VOID_TEMPLATE::setMinimumAutomationSubBlock (const int minNumSamples)
+{
+    jassert (minNumSamples > 0);
+    minAutomationSubBlock.store (std::max (1, minNumSamples));
+}
+
+
+bvie_VOID_TEMPLATE::applyAutomationEvent (const PendingAutomationEvent& event)
+{
+    if (traceRecorder != nullptr)
+        traceRecorder->addInstant ("Automation", event.parameter, event.value);
+    
+    switch (event.parameter)
+    {
+        case (automatedInputGain):  updateInputGain (event.value);  break;
+        case (automatedOutputGain): updateOutputGain (event.value);  break;
+        case (automatedDryPan):     updateDryVoxPan (juce::roundToInt (event.value));  break;
+        case (automatedDryWet):     updateDryWet (juce::roundToInt (event.value));  break;
+    }
+}
+
+
+bvie_VOID_TEMPLATE::applyAutomationEventsBefore (const juce::int64 endPosition)
+{
+    for (const auto& event : automationEvents)
+    {
+        if (event.position >= endPosition)
+            break;
+        
+        applyAutomationEvent (event);
+    }
+    
+    discardAutomationEventsBefore (endPosition);
+}
+
+
+bvie_VOID_TEMPLATE::discardAutomationEventsBefore (const juce::int64 endPosition)
+{
+    int numToRemove = 0;
+    
+    while (numToRemove < automationEvents.size() && automationEvents.getReference (numToRemove).position < endPosition)
+        ++numToRemove;
+    
+    automationEvents.removeRange (0, numToRemove);
+}
+
+
+// the FIFO starts over, so anything still queued takes effect now
+bvie_VOID_TEMPLATE::resetAutomationTimeline()
+{
+    for (const auto& event : automationEvents)
+        applyAutomationEvent (event);
+    
+    automationEvents.clearQuick();
+    
+    inputSamplesReceived = 0;
+    internalBlockStart = 0;
+}
+
+
+/*
+    Renders one stage of the current internal block in pieces, applying this stage's automation events in between them.
+    A new sub-block only begins at an event if the previous one would be at least the minimum sub-block length; otherwise the event is applied at the start of the sub-block it falls in.
+*/
+template<typename SampleType, typename HarmonySampleType>
+template<typename SubBlockRenderer>
+void ImogenEngine<SampleType, HarmonySampleType>::renderStageInSubBlocks (const int blockSize, const AutomationStage stage, SubBlockRenderer&& renderSubBlock)
+{
+    const auto minSubBlock = minAutomationSubBlock.load();
+    const auto blockEnd = internalBlockStart + blockSize;
+    
+    int subBlockStart = 0;
+    
+    for (const auto& event : automationEvents)
+    {
+        if (event.position >= blockEnd)
+            break;
+        
+        if (getStage (event.parameter) != stage)
+            continue;
+        
+        const auto offset = static_cast<int> (std::max (juce::int64(0), event.position - internalBlockStart));
+        
+        if (offset - subBlockStart >= minSubBlock)
+        {
+            renderSubBlock (subBlockStart, offset - subBlockStart);
+            subBlockStart = offset;
+        }
+        
+        applyAutomationEvent (event);
+    }
+    
+    renderSubBlock (subBlockStart, blockSize - subBlockStart);
 }
     
 
 bvie_VOID_TEMPLATE::resetTriggered()
 {
-    harmonizer.allNotesOff(false);
+    forEachHarmonizer ([] (auto& harm) { harm.allNotesOff (false); });
     
     initialHiddenLoCut.reset();
-    gate.reset();
-    dryWetMixer.reset();
+    forEachDynamics ([] (auto& dyn) { dyn.reset(); });
     limiter.reset();
-    deEsser.reset();
     reverb.reset();
     
     monoBuffer.clear();
+    primeDryDelay();
+    
+    samplesWithoutHarmonies = 0;
+    samplesOfSilence = 0;
+    engineIsIdle = false;
     
     resetSmoothedValues (FIFOEngine::getLatency());
+    wetProportion.setCurrentAndTargetValue (wetProportion.getTargetValue());
+    
+    resetAutomationTimeline();
 }
     
 
@@ -95,19 +290,19 @@ bvie_VOID_TEMPLATE::resetSmoothedValues (int blocksize)
     outputGain.reset (blocksize);
     dryLgain.reset (blocksize);
     dryRgain.reset (blocksize);
-    harmonizer.resetRampedValues (blocksize);
+    forEachHarmonizer ([blocksize] (auto& harm) { harm.resetRampedValues (blocksize); });
 }
     
 
 bvie_VOID_TEMPLATE::killAllMidi()
 {
-    harmonizer.allNotesOff(false);
+    forEachHarmonizer ([] (auto& harm) { harm.allNotesOff (false); });
 }
 
 
 bvie_VOID_TEMPLATE::playChord (const juce::Array<int>& desiredNotes, const float velocity, const bool allowTailOffOfOld)
 {
-    harmonizer.playChord (desiredNotes, velocity, allowTailOffOfOld);
+    forEachHarmonizer ([&] (auto& harm) { harm.playChord (desiredNotes, velocity, allowTailOffOfOld); });
 }
 
 
@@ -119,7 +314,7 @@ bvie_VOID_TEMPLATE::returnActivePitches (juce::Array<int>& outputArray) const
     
 bvie_VOID_TEMPLATE::recieveExternalPitchbend (const int bend)
 {
-    harmonizer.handlePitchWheel (bend);
+    forEachHarmonizer ([bend] (auto& harm) { harm.handlePitchWheel (bend); });
 }
     
 
@@ -127,28 +322,23 @@ bvie_VOID_TEMPLATE::initialized (int newInternalBlocksize, double samplerate)
 {
     jassert (samplerate > 0 && newInternalBlocksize > 0);
 
-    harmonizer.initialize (12, samplerate, newInternalBlocksize);
+    harmonizer.initialize (bvie_MAX_POSSIBLE_NUM_VOICES, samplerate, newInternalBlocksize);
+    harmonizer.setActiveVoiceCeiling (12);
     
-    monoBuffer.setSize (1, newInternalBlocksize);
-    dryBuffer.setSize (2, newInternalBlocksize);
+    for (auto* singer : extraSingers)
+        prepareSinger (*singer, samplerate, newInternalBlocksize);
+    
+    monoBuffer.setSize (getNumSingers(), newInternalBlocksize);
     wetBuffer.setSize (2, newInternalBlocksize);
+    setHarmonyBufferSizes (newInternalBlocksize);
     
     // constant limiter settings
     limiter.setRelease (bvie_LIMITER_RELEASE_MS);
     limiter.setThreshold (bvie_LIMITER_THRESH_DB);
     
-    // constant noise gate settings
-    gate.setRatio (bvie_NOISE_GATE_FLOOR_RATIO_TO_ONE);
-    gate.setAttack (bvie_NOISE_GATE_ATTACK_MS);
-    gate.setRelease (bvie_NOISE_GATE_RELEASE_MS);
-    
-    // constant compressor settings
-    compressor.setAttack (bvie_COMPRESSOR_ATTACK_MS);
-    compressor.setRelease (bvie_COMPRESSOR_RELEASE_MS);
+    dynamics.prepare (samplerate, newInternalBlocksize);
     
-    deEsser.prepare (newInternalBlocksize, samplerate);
-    
-    reverb.prepare (newInternalBlocksize, samplerate, 2);
+    reverb.prepare (samplerate);
     
     resetSmoothedValues (newInternalBlocksize);
     
@@ -157,13 +347,8 @@ bvie_VOID_TEMPLATE::initialized (int newInternalBlocksize, double samplerate)
     
 #undef bvie_LIMITER_RELEASE_MS
 #undef bvie_LIMITER_THRESH_DB
-#undef bvie_NOISE_GATE_FLOOR_RATIO_TO_ONE
-#undef bvie_NOISE_GATE_ATTACK_MS
-#undef bvie_NOISE_GATE_RELEASE_MS
 #undef bvie_INIT_MIN_HZ
 #undef bvie_INIT_MAX_HZ
-#undef bvie_COMPRESSOR_ATTACK_MS
-#undef bvie_COMPRESSOR_RELEASE_MS
     
 
 bvie_VOID_TEMPLATE::prepareToPlay (double samplerate)
@@ -173,72 +358,212 @@ bvie_VOID_TEMPLATE::prepareToPlay (double samplerate)
     dspSpec.sampleRate = samplerate;
     dspSpec.numChannels = 2;
     
-    harmonizer.setCurrentPlaybackSampleRate (samplerate);
+    forEachHarmonizer ([samplerate] (auto& harm) { harm.setCurrentPlaybackSampleRate (samplerate); });
     
     if (harmonizer.getLatencySamples() != FIFOEngine::getLatency())
         FIFOEngine::changeLatency (harmonizer.getLatencySamples());
     
     const auto blocksize = FIFOEngine::getLatency();
     
-    harmonizer.prepare (blocksize);
+    forEachHarmonizer ([blocksize] (auto& harm) { harm.prepare (blocksize); });
     
     initialHiddenLoCut.prepare(dspSpec);
     
-    gate.prepare (1, blocksize, samplerate);
+    forEachDynamics ([samplerate, blocksize] (auto& dyn) { dyn.prepare (samplerate, blocksize); });
     
-    dryWetMixer.prepare (dspSpec);
+    wetProportion.reset (samplerate, bvie_DRY_WET_RAMP_SECONDS);
     
-    limiter.prepare (blocksize, samplerate, 2);
+    updateDryLatency();
     
-    compressor.prepare (blocksize, samplerate, 1);
+    limiter.prepare (blocksize, samplerate, 2);
     
     initialHiddenLoCut.coefficients = juce::dsp::IIR::Coefficients<SampleType>::makeLowPass (samplerate,
                                                                                              SampleType(bvie_INITIAL_HIDDEN_HI_PASS_FREQ));
     initialHiddenLoCut.reset();
     
-    deEsser.prepare (blocksize, samplerate);
-    
-    reverb.prepare (blocksize, samplerate, 2);
+    reverb.prepare (samplerate);
     
-    tone.setFrequency(SampleType(440.0), SampleType(samplerate));
+    resetAutomationTimeline();
 }
     
 #undef bvie_INITIAL_HIDDEN_HI_PASS_FREQ
+#undef bvie_DRY_WET_RAMP_SECONDS
     
 
 bvie_VOID_TEMPLATE::latencyChanged (int newInternalBlocksize)
 {
     jassert (newInternalBlocksize == FIFOEngine::getLatency());
     
-    harmonizer.prepare (newInternalBlocksize);
+    if (traceRecorder != nullptr)
+        traceRecorder->addInstant ("Latency change", newInternalBlocksize);
+    
+    forEachHarmonizer ([newInternalBlocksize] (auto& harm) { harm.prepare (newInternalBlocksize); });
     
-    dryBuffer.setSize  (2, newInternalBlocksize, true, true, true);
     wetBuffer.setSize  (2, newInternalBlocksize, true, true, true);
-    monoBuffer.setSize (1, newInternalBlocksize, true, true, true);
+    monoBuffer.setSize (getNumSingers(), newInternalBlocksize, true, true, true);
+    
+    for (auto* singer : extraSingers)
+        singer->wetBuffer.setSize (2, newInternalBlocksize, true, true, true);
+    
+    setHarmonyBufferSizes (newInternalBlocksize);
+    
+    const auto samplerate = FIFOEngine::getSamplerate();
+    forEachDynamics ([samplerate, newInternalBlocksize] (auto& dyn) { dyn.prepare (samplerate, newInternalBlocksize); });
+    
+    updateDryLatency();
     
     dspSpec.maximumBlockSize = uint32(newInternalBlocksize);
     
     resetSmoothedValues (newInternalBlocksize);
+    
+    resetAutomationTimeline();
 }
     
 #undef bvie_LIMITER_RELEASE_MS
 #undef bvie_LIMITER_THRESH_DB
 
+
+bvie_VOID_TEMPLATE::setUsePipelinedAnalysis (const bool shouldUsePipeline)
+{
+    if (shouldUsePipeline == harmonizer.isUsingPipelinedAnalysis())
+        return;
+    
+    forEachHarmonizer ([shouldUsePipeline] (auto& harm) { harm.setUsePipelinedAnalysis (shouldUsePipeline); });
+    updateDryLatency();
+}
+
+
+bvie_VOID_TEMPLATE::setUseIncrementalPitchTracking (const bool shouldUseIncrementalTracking, const int internalBlocksize)
+{
+    jassert (internalBlocksize > 0);
+    
+    const auto hopSize = std::min (bvie_INCREMENTAL_TRACKING_HOP, internalBlocksize);
+    
+    forEachHarmonizer ([shouldUseIncrementalTracking, internalBlocksize, hopSize] (auto& harm)
+                       {
+                           harm.setUseIncrementalPitchTracking (shouldUseIncrementalTracking, internalBlocksize, hopSize);
+                       });
+    
+    if (harmonizer.getLatencySamples() != FIFOEngine::getLatency())
+        FIFOEngine::changeLatency (harmonizer.getLatencySamples());
+}
+
+
+bvie_VOID_TEMPLATE::setNumSingers (const int newNumSingers)
+{
+    jassert (newNumSingers > 0 && newNumSingers <= bvie_MAX_NUM_SINGERS);
+    
+    const auto numExtraSingers = juce::jlimit (1, bvie_MAX_NUM_SINGERS, newNumSingers) - 1;
+    
+    while (extraSingers.size() > numExtraSingers)
+        extraSingers.removeLast();
+    
+    while (extraSingers.size() < numExtraSingers)
+    {
+        auto* singer = extraSingers.add (new Singer());
+        singer->harmonizer.setTraceRecorder (traceRecorder);
+        
+        if (FIFOEngine::hasBeenInitialized())
+            prepareSinger (*singer, FIFOEngine::getSamplerate(), FIFOEngine::getLatency());
+    }
+    
+    if (numExtraSingers > 0 && singerPool == nullptr)
+        singerPool = std::make_unique<juce::SharedResourcePointer<RenderThreadPool>>();
+    
+    if (FIFOEngine::hasBeenInitialized())
+        monoBuffer.setSize (getNumSingers(), FIFOEngine::getLatency(), true, true, true);
+}
+
+
+// gives a new singer the same structure -- and so the same latency -- as the first singer. Its parameters are set when the engine's parameters are next applied.
+bvie_VOID_TEMPLATE::prepareSinger (Singer& singer, const double samplerate, const int blocksize)
+{
+    singer.harmonizer.initialize (bvie_MAX_POSSIBLE_NUM_VOICES, samplerate, blocksize);
+    singer.harmonizer.setActiveVoiceCeiling (harmonizer.getActiveVoiceCeiling());
+    singer.harmonizer.setUseIncrementalPitchTracking (harmonizer.isUsingIncrementalPitchTracking(), blocksize, std::min (bvie_INCREMENTAL_TRACKING_HOP, blocksize));
+    singer.harmonizer.setUsePipelinedAnalysis (harmonizer.isUsingPipelinedAnalysis());
+    singer.harmonizer.setNonRealtime (harmonizer.isNonRealtime());
+    singer.harmonizer.setUseMultithreadedRendering (harmonizer.isUsingMultithreadedRendering());
+    singer.harmonizer.updatePitchDetectionHzRange (minDetectionHz, maxDetectionHz);
+    singer.harmonizer.setCurrentPlaybackSampleRate (samplerate);
+    singer.harmonizer.prepare (blocksize);
+    
+    jassert (singer.harmonizer.getLatencySamples() == harmonizer.getLatencySamples());
+    
+    singer.dynamics.prepare (samplerate, blocksize);
+    
+    singer.wetBuffer.setSize (2, blocksize);
+    
+    if constexpr (harmonizerIsMixedPrecision)
+    {
+        singer.harmonyInput.setSize  (1, blocksize);
+        singer.harmonyOutput.setSize (2, blocksize);
+    }
+    
+    singer.midi.ensureSize (bvie_SINGER_MIDI_BYTES);
+}
+
+#undef bvie_SINGER_MIDI_BYTES
+#undef bvie_INCREMENTAL_TRACKING_HOP
+
+
+// when the harmonizer's analysis is pipelined, its output comes a block late, so the dry signal is delayed to match
+bvie_VOID_TEMPLATE::updateDryLatency()
+{
+    const auto pipelineLatency = harmonizer.getPipelineLatencySamples();
+    jassert (pipelineLatency <= bvie_MAX_DRY_DELAY_SAMPLES);
+    
+    dryLatency = std::min (pipelineLatency, bvie_MAX_DRY_DELAY_SAMPLES);
+    
+    if (dryLatency == 0)
+    {
+        dryDelay.release();
+        return;
+    }
+    
+    // room for the delay, plus one block's worth of new samples to read back contiguously
+    dryDelay.prepare (dryLatency + monoBuffer.getNumSamples());
+    primeDryDelay();
+}
+
+
+// fills the dry delay with dryLatency samples of silence. This uses monoBuffer as its source of silence, so only call it when monoBuffer can be cleared.
+bvie_VOID_TEMPLATE::primeDryDelay()
+{
+    if (dryLatency == 0)
+        return;
+    
+    dryDelay.clear();
+    monoBuffer.clear();
+    
+    for (int written = 0; written < dryLatency;)
+    {
+        const auto chunk = std::min (dryLatency - written, monoBuffer.getNumSamples());
+        dryDelay.write (monoBuffer.getReadPointer (0), chunk);
+        written += chunk;
+    }
+}
+
+#undef bvie_MAX_DRY_DELAY_SAMPLES
+
     
 bvie_VOID_TEMPLATE::release()
 {
-    harmonizer.releaseResources();
+    forEachHarmonizer ([] (auto& harm) { harm.releaseResources(); });
     
     wetBuffer.setSize (0, 0, false, false, false);
-    dryBuffer.setSize (0, 0, false, false, false);
     monoBuffer.setSize(0, 0, false, false, false);
     
+    for (auto* singer : extraSingers)
+        singer->wetBuffer.setSize (0, 0, false, false, false);
+    
+    setHarmonyBufferSizes (0);
+    dryDelay.release();
+    
     initialHiddenLoCut.reset();
-    gate.reset();
-    dryWetMixer.reset();
+    forEachDynamics ([] (auto& dyn) { dyn.release(); });
     limiter.reset();
-    deEsser.reset();
-    reverb.reset();
+    reverb.release();
 }
     
 
@@ -248,110 +573,390 @@ bvie_VOID_TEMPLATE::bypassedBlock (const AudioBuffer& input, MidiBuffer& midiMes
     
     jassert (numSamples == FIFOEngine::getLatency());
     
+    internalBlockStart += numSamples;
+    applyAutomationEventsBefore (internalBlockStart);
+    
     inputGain.skip (numSamples);
     outputGain.skip (numSamples);
     dryLgain.skip (numSamples);
     dryRgain.skip (numSamples);
+    wetProportion.skip (numSamples);
     
-    harmonizer.bypassedBlock (numSamples, midiMessages);
+    bypassHarmonizers (numSamples, midiMessages);
 }
 
     
+// times the whole block around the stages, which add their own timings to blockTimings as they go
 bvie_VOID_TEMPLATE::renderBlock (const AudioBuffer& input, AudioBuffer& output, MidiBuffer& midiMessages)
+{
+    blockTimings.clear();
+    
+    // the number of midi events in each block, so that dropouts can be matched up with bursts of midi
+    if (traceRecorder != nullptr && traceRecorder->isRecording())
+        traceRecorder->addCounter ("MIDI events", float (midiMessages.getNumEvents()));
+    
+    {
+        const ScopedStageTimer timer (blockTimings[wholeBlockStage]);
+        const ScopedTraceEvent trace (traceRecorder, "Block", input.getNumSamples());
+        renderBlockStages (input, output, midiMessages);
+    }
+    
+    blockTimings.numSamples = input.getNumSamples();
+    
+    if (stageTelemetry != nullptr)
+        stageTelemetry->push (blockTimings);
+}
+
+
+bvie_VOID_TEMPLATE::renderBlockStages (const AudioBuffer& input, AudioBuffer& output, MidiBuffer& midiMessages)
 {
     const auto blockSize = input.getNumSamples();
 
     jassert (blockSize == FIFOEngine::getLatency() && blockSize == output.getNumSamples() && blockSize == wetBuffer.getNumSamples());
+    jassert (output.getNumChannels() >= 2);
 
     const bool leadIsBypassed = leadBypass.load();
     const bool harmoniesAreBypassed = harmonyBypass.load();
 
-    output.clear();
-
     if (leadIsBypassed && harmoniesAreBypassed)
     {
-        harmonizer.bypassedBlock (blockSize, midiMessages);
+        output.clear();
+        internalBlockStart += blockSize;
+        applyAutomationEventsBefore (internalBlockStart);
+        bypassHarmonizers (blockSize, midiMessages);
         return;
     }
     
-    // write test tone samples to mono buffer
-    tone.setFrequency (SampleType(440.0), SampleType(FIFOEngine::getSamplerate()));
-    tone.getSamples (monoBuffer.getWritePointer(0), blockSize);
-    
-//    switch (modulatorInput.load()) // isolate a mono input buffer from the input bus, mixing to mono if necessary
-//    {
-//        case (2):  // take only the right channel
-//        {
-//            monoBuffer.copyFrom (0, 0, input, (input.getNumChannels() > 1), 0, blockSize);
-//        }
-//
-//        case (3):  // mix all input channels to mono
-//        {
-//            monoBuffer.copyFrom (0, 0, input, 0, 0, blockSize);
-//
-//            const int totalNumChannels = input.getNumChannels();
-//
-//            if (totalNumChannels == 1)
-//                break;
-//
-//            for (int channel = 1; channel < totalNumChannels; ++channel)
-//                monoBuffer.addFrom (0, 0, input, channel, 0, blockSize);
-//
-//            monoBuffer.applyGain (1.0f / totalNumChannels);
-//        }
-//
-//        default:  // take only the left channel
-//        {
-//            monoBuffer.copyFrom (0, 0, input, 0, 0, blockSize);
-//        }
-//    }
-    
-    inputGain.applyGain (monoBuffer, blockSize);
-
-//    juce::dsp::AudioBlock<SampleType> monoBlock (monoBuffer);
-//    initialHiddenLoCut.process ( juce::dsp::ProcessContextReplacing<SampleType>(monoBlock) );
+    updateSilenceState (input, midiMessages);
+    
+    // the dry delay, the harmonizer's pipeline & the reverb have all finished their tails, so the whole block would be silent
+    engineIsIdle = samplesOfSilence > std::max (dryLatency, harmonizer.getPipelineLatencySamples())
+                && (! reverbIsOn.load() || reverb.isAsleep());
+    
+    if (engineIsIdle)
+    {
+        output.clear();
+        bypassedBlock (input, midiMessages);  // keeps the automation, the smoothed values & the midi up to date
+        return;
+    }
+    
+    if (! extraSingers.isEmpty())
+    {
+        // in multi-singer mode, each singer is the input channel of the same index
+        for (int singer = 0; singer < monoBuffer.getNumChannels(); ++singer)
+        {
+            if (singer < input.getNumChannels())
+                monoBuffer.copyFrom (singer, 0, input, singer, 0, blockSize);
+            else
+                monoBuffer.clear (singer, 0, blockSize);
+        }
+    }
+    else
+    {
+        switch (modulatorInput.load()) // isolate a mono input buffer from the input bus, mixing to mono if necessary
+        {
+            case (2):  // take only the right channel
+            {
+                monoBuffer.copyFrom (0, 0, input, (input.getNumChannels() > 1), 0, blockSize);
+                break;
+            }
+                
+            case (3):  // mix all input channels to mono
+            {
+                monoBuffer.copyFrom (0, 0, input, 0, 0, blockSize);
+                
+                const int totalNumChannels = input.getNumChannels();
+                
+                if (totalNumChannels == 1)
+                    break;
+                
+                for (int channel = 1; channel < totalNumChannels; ++channel)
+                    monoBuffer.addFrom (0, 0, input, channel, 0, blockSize);
+                
+                monoBuffer.applyGain (SampleType(1.0) / SampleType(totalNumChannels));
+                break;
+            }
+                
+            default:  // take only the left channel
+            {
+                monoBuffer.copyFrom (0, 0, input, 0, 0, blockSize);
+            }
+        }
+    }
+    
+    // the harmonizer needs the whole block at once, so only the stages either side of it are split up at automation events
+    renderStageInSubBlocks (blockSize, inputStage,
+                            [this] (int startSample, int numSamples) { renderInputStage (startSample, numSamples); });
 
-    if (noiseGateIsOn.load())
-        gate.process (monoBuffer);
+    wetBuffer.clear();
+
+    // with no notes sounding and no singing coming in, the pitch detection & the voices would only produce silence
+    if (harmoniesAreBypassed || samplesWithoutHarmonies > harmonizer.getPipelineLatencySamples())
+        bypassHarmonizers (blockSize, midiMessages);
+    else
+        renderHarmonizers (midiMessages);  // renders the stereo output into wetBuffer
+    
+    // the other singers' dry signals join the first singer's, which the output stage pans & mixes
+    for (int singer = 1; singer < monoBuffer.getNumChannels(); ++singer)
+        monoBuffer.addFrom (0, 0, monoBuffer, singer, 0, blockSize);
+    
+    // the output stage writes the first two channels
+    for (int chan = 2; chan < output.getNumChannels(); ++chan)
+        output.clear (chan, 0, blockSize);
+    
+    renderStageInSubBlocks (blockSize, outputStage,
+                            [this, leadIsBypassed, &output] (int startSample, int numSamples) { renderOutputStage (startSample, numSamples, leadIsBypassed, output); });
+    
+    internalBlockStart += blockSize;
+    discardAutomationEventsBefore (internalBlockStart);  // each of these was applied by its own stage
+}
 
-    if (deEsserIsOn.load())
-        deEsser.process (monoBuffer);
 
-    if (compressorIsOn.load())
-        compressor.process (monoBuffer);
+bvie_VOID_TEMPLATE::renderHarmonizers (MidiBuffer& midiMessages)
+{
+    const ScopedTraceEvent trace (traceRecorder, "Harmonizers");
+    
+    if (extraSingers.isEmpty())
+    {
+        renderSinger (0, midiMessages);
+        blockTimings.addFrom (harmonizer.getLastBlockTimings());
+        return;
+    }
+    
+    copyMidiToSingers (midiMessages);
+    
+    // with multithreaded rendering, each singer's job hands its voices to the same pool as a nested batch, so workers that finish a singer go on to help with the others' voices
+    singerPoolMidi = &midiMessages;
+    (*singerPool)->run (getNumSingers(), renderSingerJob, this);
+    singerPoolMidi = nullptr;
+    
+    // the singers render in parallel, so their stages add up to more CPU time than the block took
+    forEachHarmonizer ([this] (auto& harm) { blockTimings.addFrom (harm.getLastBlockTimings()); });
+    
+    for (auto* singer : extraSingers)
+        for (int chan = 0; chan < 2; ++chan)
+            wetBuffer.addFrom (chan, 0, singer->wetBuffer, chan, 0, wetBuffer.getNumSamples());
+}
 
-    dryBuffer.clear();
 
-    //  write to dry buffer & apply panning
-    if (! leadIsBypassed)
+// renders one singer from its channel of monoBuffer. The first singer renders into wetBuffer, and the others into their own wet buffers, which are added to it once they've all finished.
+bvie_VOID_TEMPLATE::renderSinger (const int singerIndex, MidiBuffer& midiMessages)
+{
+    const ScopedTraceEvent trace (traceRecorder, "Singer", singerIndex);
+    
+    auto* singer = singerIndex > 0 ? extraSingers.getUnchecked (singerIndex - 1) : nullptr;
+    
+    auto& singerHarmonizer = singer != nullptr ? singer->harmonizer : harmonizer;
+    auto& wet = singer != nullptr ? singer->wetBuffer : wetBuffer;
+    
+    AudioBuffer mono (monoBuffer.getArrayOfWritePointers() + singerIndex, 1, monoBuffer.getNumSamples());
+    
+    if (singer != nullptr)
+        wet.clear();  // renderBlock() has already cleared wetBuffer
+    
+    if constexpr (harmonizerIsMixedPrecision)
+    {
+        auto& in  = singer != nullptr ? singer->harmonyInput  : harmonyInput;
+        auto& out = singer != nullptr ? singer->harmonyOutput : harmonyOutput;
+        
+        in.makeCopyOf (mono, true);
+        singerHarmonizer.render (in, out, midiMessages);
+        wet.makeCopyOf (out, true);
+    }
+    else
     {
-        dryBuffer.copyFrom (0, 0, monoBuffer, 0, 0, blockSize);
-        dryBuffer.copyFrom (1, 0, monoBuffer, 0, 0, blockSize);
-        dryLgain.applyGain (dryBuffer.getWritePointer(0), blockSize);
-        dryRgain.applyGain (dryBuffer.getWritePointer(1), blockSize);
+        singerHarmonizer.render (mono, wet, midiMessages);
     }
+}
 
-    dryWetMixer.pushDrySamples ( juce::dsp::AudioBlock<SampleType>(dryBuffer) );
 
-    wetBuffer.clear();
+bvie_VOID_TEMPLATE::renderSingerJob (void* engine, int singerIndex)
+{
+    auto* imogen = static_cast<ImogenEngine*> (engine);
+    
+    imogen->renderSinger (singerIndex, singerIndex == 0 ? *imogen->singerPoolMidi
+                                                        : imogen->extraSingers.getUnchecked (singerIndex - 1)->midi);
+}
+
+
+bvie_VOID_TEMPLATE::bypassHarmonizers (const int numSamples, MidiBuffer& midiMessages)
+{
+    copyMidiToSingers (midiMessages);
+    
+    for (auto* singer : extraSingers)
+        singer->harmonizer.bypassedBlock (numSamples, singer->midi);
+    
+    harmonizer.bypassedBlock (numSamples, midiMessages);
+}
 
-    if (harmoniesAreBypassed)
-        harmonizer.bypassedBlock (blockSize, midiMessages);
+
+// each extra singer gets its own copy of the block's incoming midi, before any harmonizer has changed it
+bvie_VOID_TEMPLATE::copyMidiToSingers (const MidiBuffer& midiMessages)
+{
+    for (auto* singer : extraSingers)
+    {
+        singer->midi.clear();
+        singer->midi.addEvents (midiMessages, 0, -1, 0);
+    }
+}
+
+
+template<typename SampleType, typename HarmonySampleType>
+bool ImogenEngine<SampleType, HarmonySampleType>::anySingerIsSounding() const noexcept
+{
+    if (harmonizer.isAnyVoiceActive())
+        return true;
+    
+    for (auto* singer : extraSingers)
+        if (singer->harmonizer.isAnyVoiceActive())
+            return true;
+    
+    return false;
+}
+
+
+template<typename SampleType, typename HarmonySampleType>
+bool ImogenEngine<SampleType, HarmonySampleType>::allGatesAreClosed() const noexcept
+{
+    if (! dynamics.isGateClosed())
+        return false;
+    
+    for (auto* singer : extraSingers)
+        if (! singer->dynamics.isGateClosed())
+            return false;
+    
+    return true;
+}
+
+
+bvie_VOID_TEMPLATE::setHarmonyBufferSizes (int blocksize)
+{
+    if constexpr (harmonizerIsMixedPrecision)
+    {
+        harmonyInput.setSize  (1, blocksize, true, true, true);
+        harmonyOutput.setSize (2, blocksize, true, true, true);
+        
+        for (auto* singer : extraSingers)
+        {
+            singer->harmonyInput.setSize  (1, blocksize, true, true, true);
+            singer->harmonyOutput.setSize (2, blocksize, true, true, true);
+        }
+    }
     else
-        harmonizer.render (monoBuffer, wetBuffer, midiMessages);  // renders the stereo output into wetBuffer
+    {
+        juce::ignoreUnused (blocksize);
+    }
+}
 
-    dryWetMixer.mixWetSamples ( juce::dsp::AudioBlock<SampleType>(wetBuffer) ); // puts the mixed dry & wet samples into wetBuffer
 
-    if (reverbIsOn.load())
-        reverb.process (wetBuffer);
+bvie_VOID_TEMPLATE::updateSilenceState (const AudioBuffer& input, const MidiBuffer& midiMessages)
+{
+    const auto blockSize = input.getNumSamples();
+    constexpr auto maxCount = std::numeric_limits<int>::max() / 2;
+    
+    // any incoming midi might start a note, so that block is always rendered
+    const bool nothingToHarmonize = midiMessages.isEmpty() && ! anySingerIsSounding();
+    
+    const bool inputIsSilent = input.getMagnitude (0, blockSize) * inputGain.getTargetValue()
+                             < juce::Decibels::decibelsToGain (SampleType(bvie_SILENCE_THRESHOLD_DB));
+    
+    if (nothingToHarmonize && (inputIsSilent || allGatesAreClosed()))
+        samplesWithoutHarmonies = std::min (samplesWithoutHarmonies + blockSize, maxCount);
+    else
+        samplesWithoutHarmonies = 0;
+    
+    if (nothingToHarmonize && inputIsSilent)
+        samplesOfSilence = std::min (samplesOfSilence + blockSize, maxCount);
+    else
+        samplesOfSilence = 0;
+}
 
-    outputGain.applyGain (wetBuffer, blockSize);
+#undef bvie_SILENCE_THRESHOLD_DB
 
-    if (limiterIsOn.load())
-        limiter.process (wetBuffer);
+
+bvie_VOID_TEMPLATE::renderInputStage (const int startSample, const int numSamples)
+{
+    const ScopedTraceEvent trace (traceRecorder, "Input stage", numSamples);
+    
+    auto mono = getSubBuffer (monoBuffer, startSample, numSamples);  // every singer's channel
+    
+    inputGain.applyGain (mono, numSamples);
+
+//    juce::dsp::AudioBlock<SampleType> monoBlock (mono);
+//    initialHiddenLoCut.process ( juce::dsp::ProcessContextReplacing<SampleType>(monoBlock) );
+
+    const ScopedStageTimer timer (blockTimings[dynamicsStage]);
+    const ScopedTraceEvent dynamicsTrace (traceRecorder, "Dynamics");
+    
+    dynamics.process (mono.getWritePointer (0), numSamples);
+    
+    for (int singer = 0; singer < extraSingers.size(); ++singer)
+        extraSingers.getUnchecked (singer)->dynamics.process (mono.getWritePointer (singer + 1), numSamples);
+}
+
+
+/*
+    Pans the dry signal, mixes it with the harmonies, and applies the output gain, all in a single pass that writes straight into the output.
+    The reverb has to hear the mix before the output gain, so when it's on, the output gain is applied separately afterwards.
+*/
+bvie_VOID_TEMPLATE::renderOutputStage (const int startSample, const int numSamples, const bool leadIsBypassed, AudioBuffer& output)
+{
+    const ScopedTraceEvent trace (traceRecorder, "Output stage", numSamples);
+    
+    const auto* dry = monoBuffer.getReadPointer (0, startSample);
+    
+    if (dryLatency > 0)
+        dry = dryDelay.getReadPointer (dryDelay.write (dry, numSamples) - dryLatency);
+    
+    auto out = getSubBuffer (output, startSample, numSamples);
+    auto* outLeft  = out.getWritePointer (0);
+    auto* outRight = out.getWritePointer (1);
+    const auto* wetLeft  = wetBuffer.getReadPointer (0, startSample);
+    const auto* wetRight = wetBuffer.getReadPointer (1, startSample);
+    
+    const bool reverbOn = reverbIsOn.load();
+    const auto dryScale = leadIsBypassed ? SampleType(0) : SampleType(1);
+    
+    const bool ramping = dryLgain.isSmoothing() || dryRgain.isSmoothing() || wetProportion.isSmoothing()
+                      || (outputGain.isSmoothing() && ! reverbOn);
+    
+    if (ramping)
+    {
+        mixStereoRamped (dry, wetLeft, wetRight, outLeft, outRight, numSamples,
+                         [this, dryScale, reverbOn]
+                         {
+                             return getStereoMixGains (wetProportion.getNextValue(),
+                                                       dryLgain.getNextValue() * dryScale,
+                                                       dryRgain.getNextValue() * dryScale,
+                                                       reverbOn ? SampleType(1) : outputGain.getNextValue());
+                         });
+    }
+    else
+    {
+        mixStereo (dry, wetLeft, wetRight, outLeft, outRight, numSamples,
+                   getStereoMixGains (wetProportion.getNextValue(),
+                                      dryLgain.getNextValue() * dryScale,
+                                      dryRgain.getNextValue() * dryScale,
+                                      reverbOn ? SampleType(1) : outputGain.getNextValue()));
+    }
     
-    for (int chan = 0; chan < 2; ++chan)
-        output.copyFrom (chan, 0, wetBuffer, chan, 0, blockSize);
+    if (reverbOn)
+    {
+        {
+            const ScopedStageTimer timer (blockTimings[reverbStage]);
+            const ScopedTraceEvent reverbTrace (traceRecorder, "Reverb");
+            reverb.process (out);
+        }
+        
+        outputGain.applyGain (out, numSamples);
+    }
+
+    if (limiterIsOn.load())
+    {
+        const ScopedStageTimer timer (blockTimings[limiterStage]);
+        const ScopedTraceEvent limiterTrace (traceRecorder, "Limiter");
+        limiter.process (out);
+    }
 }
     
 
@@ -359,6 +964,7 @@ bvie_VOID_TEMPLATE::renderBlock (const AudioBuffer& input, AudioBuffer& output,
     
 template class ImogenEngine<float>;
 template class ImogenEngine<double>;
+template class ImogenEngine<double, float>;
 
 
 } // namespace
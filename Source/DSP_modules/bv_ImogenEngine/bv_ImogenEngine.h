@@ -38,13 +38,28 @@
 
 #include "bv_Harmonizer/bv_Harmonizer.h"
 
+#include "StereoMixKernel.h"
+#include "VocalDynamics.h"
+#include "FDNReverb.h"
+
+
+// every one of these voices is allocated when the engine is initialized, so that changing the number of voices never allocates
+#define bvie_MAX_POSSIBLE_NUM_VOICES 20
+
+// the most input channels that can each be harmonized as a separate singer
+#define bvie_MAX_NUM_SINGERS 8
+
 
 
 namespace bav
 {
 
 
-template<typename SampleType>
+/*
+    The engine's I/O, dynamics, mix, reverb & limiter all run at SampleType. The harmonizer -- pitch detection, grain storage & the voices -- runs at HarmonySampleType, which defaults to the same type.
+    ImogenEngine<double, float> is the mixed precision engine: the mono input is converted to float on its way into the harmonizer, and the harmonies back to double on their way out.
+*/
+template<typename SampleType, typename HarmonySampleType = SampleType>
 class ImogenEngine  :   public bav::dsp::FIFOWrappedEngine<SampleType>
 {
     
@@ -55,14 +70,94 @@ class ImogenEngine  :   public bav::dsp::FIFOWrappedEngine<SampleType>
     
     
 public:
+    // the parameters whose changes can be applied part of the way through an internal block
+    enum AutomatedParameter
+    {
+        automatedInputGain,
+        automatedDryPan,
+        automatedDryWet,
+        automatedOutputGain
+    };
+    
+    static constexpr int numAutomatedParameters = automatedOutputGain + 1;
+    
+    struct AutomationEvent
+    {
+        int sampleOffset;  // relative to the start of the next block passed to process()
+        AutomatedParameter parameter;
+        float value;  // a linear gain for the two gains, a midi pan value for the dry pan, and a percentage for the dry/wet
+    };
+    
     ImogenEngine();
     
+    // processes a block of any size, applying each queued automation event at its own sample
+    void process (AudioBuffer& input, AudioBuffer& output, MidiBuffer& midiMessages, const bool isBypassed);
+    
+    // queues a parameter change to be applied sampleOffset samples into the next block passed to process(). Call this from the audio thread, with each block's events in chronological order.
+    // The queue isn't locked, so nothing else may queue events at the same time; other threads use setAutomatedParameter() instead.
+    void queueAutomationEvent (const AutomationEvent& event);
+    
+    // applies a value straight away, dropping any events still queued for the parameter, and makes it the value that the parameter's next ramp starts from.
+    // This is for callers that aren't on the audio thread, e.g. applying every parameter when a preset is loaded, so call it before the engine is prepared, or while processing is suspended.
+    void setAutomatedParameter (const AutomatedParameter parameter, const float value);
+    
+    // queues a linear ramp from the parameter's last queued value to newValue across the next numSamples samples passed to process(), as a series of events at least the minimum sub-block apart.
+    // for parameter changes that aren't timestamped within the block. A parameter that hasn't been queued before jumps straight to newValue.
+    void queueAutomationRamp (const AutomatedParameter parameter, const float newValue, const int numSamples);
+    
+    // events closer together than this are applied at the start of the same sub-block, so that dense automation doesn't chop the internal blocks into slivers too short to vectorise
+    void setMinimumAutomationSubBlock (const int minNumSamples);
+    int getMinimumAutomationSubBlock() const noexcept { return minAutomationSubBlock.load(); }
+    
     void killAllMidi();
     
-    int reportLatency() const noexcept { return FIFOEngine::getLatency(); }
+    int reportLatency() const noexcept { return FIFOEngine::getLatency() + harmonizer.getPipelineLatencySamples(); }
+    
+    // the reverb's tail, if it's on. The harmonies' release tails are up to the ADSR settings.
+    double getTailLengthSeconds() const noexcept { return reverbIsOn.load() ? reverb.getTailLengthSeconds() : 0.0; }
+    
+    // true if the last internal block was skipped because the input was silent, no notes were sounding, and every tail had finished
+    bool isIdle() const noexcept { return engineIsIdle; }
+    
+    // each internal block's per-stage CPU timings are pushed into this ring, for a reader on another thread. Set it while processing is suspended; nullptr turns the telemetry off.
+    void setStageTelemetry (StageTelemetry* telemetryToUse) noexcept { stageTelemetry = telemetryToUse; }
+    
+    // while the recorder is recording, each block, its stages, the voices, automation & latency changes are added to it as trace events. Set it while processing is suspended; nullptr turns tracing off.
+    void setTraceRecorder (TraceRecorder* recorderToUse) noexcept
+    {
+        traceRecorder = recorderToUse;
+        forEachHarmonizer ([recorderToUse] (auto& harm) { harm.setTraceRecorder (recorderToUse); });
+    }
+    
+    // runs the harmonizer's pitch detection one block ahead on the process-wide analysis worker, at the cost of one more block of latency. Call this while processing is suspended, then re-report the latency.
+    void setUsePipelinedAnalysis (const bool shouldUsePipeline);
+    
+    // in real time, a pipelined block whose analysis is late is rendered with the last block's period; offline, it's waited for. This is safe to call from the audio thread.
+    void setNonRealtime (const bool isNonRealtime) noexcept
+    {
+        forEachHarmonizer ([isNonRealtime] (auto& harm) { harm.setNonRealtime (isNonRealtime); });
+    }
     
-    void updateNumVoices (const int newNumVoices); // updates the # of cuncurrently running instances of the pitch shifting algorithm
-    int getCurrentNumVoices() const { return harmonizer.getNumVoices(); }
+    // renders each singer's voices in parallel on the process-wide render pool. The output & latency don't change, so this can be called from the message thread at any time.
+    void setUseMultithreadedRendering (const bool shouldUseMultithreading)
+    {
+        forEachHarmonizer ([shouldUseMultithreading] (auto& harm) { harm.setUseMultithreadedRendering (shouldUseMultithreading); });
+    }
+    
+    // tracks the input's pitch with a sliding window that updates every few dozen samples, which lets the internal blocksize -- and so the latency -- be much shorter than the pitch detector's analysis frame.
+    // While it's on, the internal blocksize is internalBlocksize whatever the vocal range; while it's off, it's the length of the pitch detector's frame. Call this while processing is suspended, then re-report the latency.
+    void setUseIncrementalPitchTracking (const bool shouldUseIncrementalTracking, const int internalBlocksize = 256);
+    
+    /*
+        Multi-singer mode: each of the first numSingers input channels is harmonized separately, with its own dynamics, pitch detection & voices, and the singers are rendered in parallel on the process-wide render pool.
+        Every singer plays the same MIDI, and they all share one output stage, reverb & limiter, and one latency. 1 is the usual single modulator.
+        Call this while processing is suspended. Any new singers are allocated here and start out with default settings, so re-apply the parameters afterwards.
+    */
+    void setNumSingers (const int newNumSingers);
+    int getNumSingers() const noexcept { return extraSingers.size() + 1; }
+    
+    void updateNumVoices (const int newNumVoices); // updates the # of cuncurrently running instances of the pitch shifting algorithm. This doesn't lock or allocate, so it can be called from the audio thread.
+    int getCurrentNumVoices() const { return harmonizer.getActiveVoiceCeiling(); }
     
     void returnActivePitches (juce::Array<int>& outputArray) const;
     
@@ -101,13 +196,15 @@ public:
 private:
     
     // determines how the modulator signal is parsed from the [usually] stereo buffer passed into processBlock
-    // 0 - left channel only
-    // 1 - right channel only
-    // 2 - mix all input channels to mono
+    // 1 - left channel only
+    // 2 - right channel only
+    // 3 - mix all input channels to mono
     std::atomic<int> modulatorInput;
     
     void renderBlock (const AudioBuffer& input, AudioBuffer& output, MidiBuffer& midiMessages) override;
     
+    void renderBlockStages (const AudioBuffer& input, AudioBuffer& output, MidiBuffer& midiMessages);
+    
     void bypassedBlock (const AudioBuffer& input, MidiBuffer& midiMessages) override;
     
     void initialized (int newInternalBlocksize, double samplerate) override;
@@ -120,28 +217,129 @@ private:
     
     void release() override;
     
-    Harmonizer<SampleType> harmonizer;
-    
-    AudioBuffer monoBuffer;  // this buffer is used to store the mono input signal so that input gain can be applied
+    void updateDryLatency();
+    
+    void primeDryDelay();
+    
+    // an automation event, timestamped in samples since the start of the input timeline
+    struct PendingAutomationEvent
+    {
+        juce::int64 position;
+        AutomatedParameter parameter;
+        float value;
+    };
+    
+    // the input stage covers everything before the harmonizer; the output stage covers everything after it, including the panning of the dry signal
+    enum AutomationStage { inputStage, outputStage };
+    
+    static AutomationStage getStage (const AutomatedParameter parameter) noexcept
+    {
+        return parameter == automatedInputGain ? inputStage : outputStage;
+    }
+    
+    void applyAutomationEvent (const PendingAutomationEvent& event);
+    void applyAutomationEventsBefore (const juce::int64 endPosition);
+    void discardAutomationEventsBefore (const juce::int64 endPosition);
+    void resetAutomationTimeline();
+    
+    template<typename SubBlockRenderer>
+    void renderStageInSubBlocks (const int blockSize, const AutomationStage stage, SubBlockRenderer&& renderSubBlock);
+    
+    // counts how long the input has been silent with no notes sounding, which is how renderBlock() knows what it can skip
+    void updateSilenceState (const AudioBuffer& input, const MidiBuffer& midiMessages);
+    
+    void renderInputStage  (const int startSample, const int numSamples);
+    void renderOutputStage (const int startSample, const int numSamples, const bool leadIsBypassed, AudioBuffer& output);
+    
+    static AudioBuffer getSubBuffer (AudioBuffer& buffer, const int startSample, const int numSamples)
+    {
+        return AudioBuffer (buffer.getArrayOfWritePointers(), buffer.getNumChannels(), startSample, numSamples);
+    }
+    
+    juce::Array<PendingAutomationEvent> automationEvents;  // sorted by position
+    float lastQueuedAutomationValues[numAutomatedParameters];  // NaN until the parameter's first event is queued
+    juce::int64 inputSamplesReceived = 0;  // the input timeline position of the start of the next block passed to process()
+    juce::int64 internalBlockStart = 0;  // the input timeline position of the start of the next internal block
+    std::atomic<int> minAutomationSubBlock;
+    
+    Harmonizer<HarmonySampleType> harmonizer;  // the first singer's
+    
+    // in multi-singer mode, each singer after the first gets its own harmonizer & dynamics
+    struct Singer
+    {
+        Harmonizer<HarmonySampleType> harmonizer;
+        VocalDynamics<SampleType> dynamics;
+        AudioBuffer wetBuffer;
+        juce::AudioBuffer<HarmonySampleType> harmonyInput, harmonyOutput;
+        MidiBuffer midi;  // a copy of each block's incoming midi, since every harmonizer consumes the midi it renders
+    };
+    
+    juce::OwnedArray<Singer> extraSingers;
+    std::unique_ptr<juce::SharedResourcePointer<RenderThreadPool>> singerPool;  // the same pool the harmonizers render their voices on
+    MidiBuffer* singerPoolMidi = nullptr;  // the first singer's midi, while the pool is rendering
+    
+    int minDetectionHz, maxDetectionHz;  // so that new singers can be given the same latency as the first
+    
+    void prepareSinger (Singer& singer, const double samplerate, const int blocksize);
+    
+    template<typename Function>
+    void forEachHarmonizer (Function&& function)
+    {
+        function (harmonizer);
+        
+        for (auto* singer : extraSingers)
+            function (singer->harmonizer);
+    }
+    
+    template<typename Function>
+    void forEachDynamics (Function&& function)
+    {
+        function (dynamics);
+        
+        for (auto* singer : extraSingers)
+            function (singer->dynamics);
+    }
+    
+    bool anySingerIsSounding() const noexcept;
+    bool allGatesAreClosed() const noexcept;
+    
+    AudioBuffer monoBuffer;  // one channel per singer, so that input gain can be applied. After the harmonizers have run, the first channel holds the mix of every singer's dry signal
     AudioBuffer wetBuffer; // this buffer is where the 12 harmony voices' output gets added together
-    AudioBuffer dryBuffer; // this buffer is used for panning & delaying the dry signal
     
-    juce::dsp::ProcessSpec dspSpec;
+    static constexpr bool harmonizerIsMixedPrecision = ! std::is_same<SampleType, HarmonySampleType>::value;
     
-    bav::dsp::FX::NoiseGate<SampleType> gate;
-    std::atomic<bool> noiseGateIsOn;
+    // with mixed precision, the harmonizer's input & output are converted through these. Otherwise they're left empty
+    juce::AudioBuffer<HarmonySampleType> harmonyInput, harmonyOutput;
     
-    bav::dsp::FX::DeEsser<SampleType> deEsser;
-    std::atomic<bool> deEsserIsOn;
+    // renders every singer's harmonies, adding them all into wetBuffer
+    void renderHarmonizers (MidiBuffer& midiMessages);
+    void renderSinger (const int singerIndex, MidiBuffer& midiMessages);
+    static void renderSingerJob (void* engine, int singerIndex);
     
-    juce::dsp::DryWetMixer<SampleType> dryWetMixer;
+    void bypassHarmonizers (const int numSamples, MidiBuffer& midiMessages);
+    void copyMidiToSingers (const MidiBuffer& midiMessages);
     
-    juce::dsp::IIR::Filter<SampleType> initialHiddenLoCut;
+    void setHarmonyBufferSizes (int blocksize);
+    
+    StageTimings blockTimings;  // the internal block currently being rendered
+    StageTelemetry* stageTelemetry = nullptr;
+    TraceRecorder* traceRecorder = nullptr;
     
-    bav::dsp::FX::Compressor<SampleType> compressor;
-    std::atomic<bool> compressorIsOn;
+    // when the harmonies come a block late, the mono dry signal is delayed through this to line up with them. It's panned as it's mixed into the output.
+    AnalysisRingBuffer<SampleType> dryDelay;
+    int dryLatency = 0;
     
-    bav::dsp::FX::Reverb reverb;
+    // samples for which there has been nothing for the harmonizer to do; and of those, samples for which the input has also been silent
+    int samplesWithoutHarmonies = 0, samplesOfSilence = 0;
+    bool engineIsIdle = false;
+    
+    juce::dsp::ProcessSpec dspSpec;
+    
+    VocalDynamics<SampleType> dynamics;  // the noise gate, de-esser & compressor
+    
+    juce::dsp::IIR::Filter<SampleType> initialHiddenLoCut;
+    
+    FDNReverb<SampleType> reverb;
     std::atomic<bool> reverbIsOn;
     
     bav::dsp::FX::Limiter<SampleType> limiter;
@@ -153,13 +351,14 @@ private:
     std::atomic<bool> leadBypass, harmonyBypass;
     
     juce::SmoothedValue<SampleType, juce::ValueSmoothingTypes::Multiplicative> inputGain, outputGain, dryLgain, dryRgain;
+    juce::SmoothedValue<SampleType> wetProportion;
     
     void resetSmoothedValues (int blocksize);
     
-    dsp::osc::Sine<SampleType> tone;
-    
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ImogenEngine)
 };
 
 
 } // namespace
+
+#include "ImogenParameters.h"
@@ -30,7 +30,7 @@
 #define _SMOOTHING_ZERO_CHECK(inputGain) std::max(SampleType(bvie_MIN_SMOOTHED_GAIN), SampleType (inputGain))
 
 
-#define bvie_VOID_TEMPLATE template<typename SampleType> void ImogenEngine<SampleType>
+#define bvie_VOID_TEMPLATE template<typename SampleType, typename HarmonySampleType> void ImogenEngine<SampleType, HarmonySampleType>
 
 
 namespace bav
@@ -38,12 +38,9 @@ namespace bav
 
 bvie_VOID_TEMPLATE::updateNumVoices (const int newNumVoices)
 {
-    jassert (newNumVoices > 0);
+    jassert (newNumVoices > 0 && newNumVoices <= bvie_MAX_POSSIBLE_NUM_VOICES);
     
-    if (harmonizer.getNumVoices() == newNumVoices)
-        return;
-        
-    harmonizer.changeNumVoices (newNumVoices);
+    forEachHarmonizer ([newNumVoices] (auto& harm) { harm.setActiveVoiceCeiling (newNumVoices); });
 }
     
     
@@ -82,68 +79,81 @@ bvie_VOID_TEMPLATE::updateDryVoxPan  (const int newMidiPan)
 
 bvie_VOID_TEMPLATE::updateDryWet (const int percentWet)
 {
-    dryWetMixer.setWetMixProportion (percentWet * SampleType(0.01));
+    wetProportion.setTargetValue (juce::jlimit (SampleType(0), SampleType(1), percentWet * SampleType(0.01)));
 }
 
 
 bvie_VOID_TEMPLATE::updateAdsr (const float attack, const float decay, const float sustain, const float release, const bool isOn)
 {
-    harmonizer.updateADSRsettings (attack, decay, sustain, release);
-    harmonizer.setADSRonOff (isOn);
+    forEachHarmonizer ([&] (auto& harm)
+                       {
+                           harm.updateADSRsettings (attack, decay, sustain, release);
+                           harm.setADSRonOff (isOn);
+                       });
 }
     
 
 bvie_VOID_TEMPLATE::updateStereoWidth (const int newStereoWidth, const int lowestPannedNote)
 {
-    harmonizer.updateLowestPannedNote (lowestPannedNote);
-    harmonizer.updateStereoWidth (newStereoWidth);
+    forEachHarmonizer ([&] (auto& harm)
+                       {
+                           harm.updateLowestPannedNote (lowestPannedNote);
+                           harm.updateStereoWidth (newStereoWidth);
+                       });
+    
     reverb.setWidth (newStereoWidth * 0.01f);
 }
 
 
 bvie_VOID_TEMPLATE::updateMidiVelocitySensitivity (const int newSensitivity)
 {
-    harmonizer.updateMidiVelocitySensitivity (newSensitivity);
+    forEachHarmonizer ([newSensitivity] (auto& harm) { harm.updateMidiVelocitySensitivity (newSensitivity); });
 }
 
 
 bvie_VOID_TEMPLATE::updatePitchbendRange (const int rangeST)
 {
-    harmonizer.updatePitchbendSettings (rangeST, rangeST);
+    forEachHarmonizer ([rangeST] (auto& harm) { harm.updatePitchbendSettings (rangeST, rangeST); });
 }
 
 
 bvie_VOID_TEMPLATE::updatePedalPitch (const bool isOn, const int upperThresh, const int interval)
 {
-    harmonizer.setPedalPitch (isOn);
-    harmonizer.setPedalPitchUpperThresh (upperThresh);
-    harmonizer.setPedalPitchInterval (interval);
+    forEachHarmonizer ([&] (auto& harm)
+                       {
+                           harm.setPedalPitch (isOn);
+                           harm.setPedalPitchUpperThresh (upperThresh);
+                           harm.setPedalPitchInterval (interval);
+                       });
 }
 
 
 bvie_VOID_TEMPLATE::updateDescant (const bool isOn, const int lowerThresh, const int interval)
 {
-    harmonizer.setDescant (isOn);
-    harmonizer.setDescantLowerThresh (lowerThresh);
-    harmonizer.setDescantInterval (interval);
+    forEachHarmonizer ([&] (auto& harm)
+                       {
+                           harm.setDescant (isOn);
+                           harm.setDescantLowerThresh (lowerThresh);
+                           harm.setDescantInterval (interval);
+                       });
 }
 
 
 bvie_VOID_TEMPLATE::updateConcertPitch (const int newConcertPitchHz)
 {
-    harmonizer.setConcertPitchHz (newConcertPitchHz);
+    forEachHarmonizer ([newConcertPitchHz] (auto& harm) { harm.setConcertPitchHz (newConcertPitchHz); });
 }
 
 
 bvie_VOID_TEMPLATE::updateNoteStealing (const bool shouldSteal)
 {
-    harmonizer.setNoteStealingEnabled (shouldSteal);
+    forEachHarmonizer ([shouldSteal] (auto& harm) { harm.setNoteStealingEnabled (shouldSteal); });
 }
 
 
 bvie_VOID_TEMPLATE::updateMidiLatch (const bool isLatched)
 {
-    harmonizer.setMidiLatch (isLatched, true);
+    forEachHarmonizer ([isLatched] (auto& harm) { harm.setMidiLatch (isLatched, true); });
 }
 
 
@@ -155,17 +165,13 @@ bvie_VOID_TEMPLATE::updateLimiter (const bool isOn)
 
 bvie_VOID_TEMPLATE::updateCompressor (const float threshDB, const float ratio, const bool isOn)
 {
-    compressor.setThreshold (threshDB);
-    compressor.setRatio (ratio);
-    compressorIsOn.store (isOn);
+    forEachDynamics ([&] (auto& dyn) { dyn.setCompressor (threshDB, ratio, isOn); });
 }
     
 
 bvie_VOID_TEMPLATE::updateDeEsser (const float deEssAmount, const float thresh_dB, const bool isOn)
 {
-    deEsser.setThresh (thresh_dB);
-    deEsser.setDeEssAmount (deEssAmount);
-    deEsserIsOn.store (isOn);
+    forEachDynamics ([&] (auto& dyn) { dyn.setDeEsser (deEssAmount, thresh_dB, isOn); });
 }
 
 
@@ -173,7 +179,10 @@ bvie_VOID_TEMPLATE::updatePitchDetectionHzRange (const int minHz, const int maxH
 {
     jassert (harmonizer.getSamplerate() > 0);
     
-    harmonizer.updatePitchDetectionHzRange (minHz, maxHz);
+    minDetectionHz = minHz;
+    maxDetectionHz = maxHz;
+    
+    forEachHarmonizer ([minHz, maxHz] (auto& harm) { harm.updatePitchDetectionHzRange (minHz, maxHz); });
 
     FIFOEngine::changeLatency (harmonizer.getLatencySamples());
 }
@@ -181,27 +190,28 @@ bvie_VOID_TEMPLATE::updatePitchDetectionHzRange (const int minHz, const int maxH
 
 bvie_VOID_TEMPLATE::updateAftertouchGainOnOff (const bool shouldBeOn)
 {
-    harmonizer.setAftertouchGainOnOff (shouldBeOn);
+    forEachHarmonizer ([shouldBeOn] (auto& harm) { harm.setAftertouchGainOnOff (shouldBeOn); });
 }
 
     
 bvie_VOID_TEMPLATE::updateNoiseGate (const float newThreshDB, const bool isOn)
 {
-    gate.setThreshold (newThreshDB);
-    noiseGateIsOn.store (isOn);
+    forEachDynamics ([newThreshDB, isOn] (auto& dyn) { dyn.setGate (newThreshDB, isOn); });
 }
     
 
 bvie_VOID_TEMPLATE::updateReverb (int wetPcnt, float decay, float duckAmount, float loCutFreq, float hiCutFreq, bool isOn)
 {
+    // don't let a tail left over from the last time the reverb was on play out
+    if (isOn && ! reverbIsOn.load())
+        reverb.reset();
+    
     reverbIsOn.store (isOn);
     reverb.setDryWet (wetPcnt);
-    reverb.setDamping (1.0f - decay);
-    reverb.setRoomSize (decay);
+    reverb.setDecay (decay);
     reverb.setDuckAmount (duckAmount);
-    //reverb.setLoCutFrequency (loCutFreq);
-    //reverb.setHiCutFrequency (hiCutFreq);
-    juce::ignoreUnused (loCutFreq, hiCutFreq);
+    reverb.setLoCutFrequency (loCutFreq);
+    reverb.setHiCutFrequency (hiCutFreq);
 }
 
 
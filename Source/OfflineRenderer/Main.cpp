@@ -0,0 +1,87 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ Main.cpp: This file contains the entry point for ImogenRenderer, the command line tool that harmonizes vocal recordings offline.
+ 
+======================================================================================================================================================*/
+
+
+#include <iostream>
+
+#include "OfflineRenderer.h"
+
+
+static void printUsage()
+{
+    std::cout << "Usage: ImogenRenderer [--preset <preset.xml>] [--threads <n>] [--blocksize <n>] [--trace <trace.json|trace.csv>] "
+                 "<vocal.wav> <harmony.mid> <output.wav> [<vocal.wav> <harmony.mid> <output.wav> ...]" << std::endl;
+}
+
+
+int main (int argc, char* argv[])
+{
+    juce::ArgumentList args (argc, argv);
+    
+    if (args.size() == 0 || args.containsOption ("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+    
+    const auto presetPath = args.removeValueForOption ("--preset");
+    const auto numThreads = args.removeValueForOption ("--threads").getIntValue();
+    const auto blocksize  = args.removeValueForOption ("--blocksize").getIntValue();
+    const auto tracePath  = args.removeValueForOption ("--trace");
+    
+    if (args.size() == 0 || args.size() % 3 != 0)
+    {
+        printUsage();
+        return 1;
+    }
+    
+    ImogenOfflineRenderer renderer (std::max (0, blocksize));  // without --blocksize, the blocksize is set the same way as in the plugin
+    
+    if (presetPath.isNotEmpty() && ! renderer.loadPreset (juce::File::getCurrentWorkingDirectory().getChildFile (presetPath)))
+    {
+        std::cerr << "Can't load the preset " << presetPath << std::endl;
+        return 1;
+    }
+    
+    juce::Array<ImogenRenderJob> jobs;
+    
+    for (int i = 0; i < args.size(); i += 3)
+        jobs.add ({ args[i].resolveAsFile(), args[i + 1].resolveAsFile(), args[i + 2].resolveAsFile() });
+    
+    bav::TraceRecorder traceRecorder;
+    
+    if (tracePath.isNotEmpty())
+    {
+        if (! traceRecorder.start (juce::File::getCurrentWorkingDirectory().getChildFile (tracePath)))
+        {
+            std::cerr << "Can't write the trace file " << tracePath << std::endl;
+            return 1;
+        }
+        
+        renderer.setTraceRecorder (&traceRecorder);
+    }
+    
+    const auto numFailures = renderer.renderAll (jobs, numThreads > 0 ? numThreads : juce::SystemStats::getNumCpus());
+    
+    return numFailures == 0 ? 0 : 1;
+}
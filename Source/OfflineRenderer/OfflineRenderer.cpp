@@ -0,0 +1,284 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ OfflineRenderer.cpp: This file contains the guts of Imogen's offline renderer.
+ 
+======================================================================================================================================================*/
+
+
+#include <iostream>
+
+#include "OfflineRenderer.h"
+
+
+// the host blocksize is this many internal blocks, so that the engine's FIFO always has whole blocks to render
+#define bvi_INTERNAL_BLOCKS_PER_HOST_BLOCK 8
+
+// how often the main thread checks whether the render jobs have finished
+#define bvi_JOB_POLL_MS 50
+
+// the engine only starts with this blocksize; unless a blocksize was requested, preparing it changes it to the length of the pitch detector's frame
+#define bvi_INITIAL_BLOCKSIZE 512
+
+
+ImogenOfflineRenderer::ImogenOfflineRenderer (int internalBlocksizeToUse)
+    : internalBlocksize (internalBlocksizeToUse)
+{
+    jassert (internalBlocksize >= 0);
+}
+
+
+bool ImogenOfflineRenderer::loadPreset (const juce::File& presetFile)
+{
+    auto xml = juce::parseXML (presetFile);
+    
+    if (xml == nullptr || ! xml->hasTagName ("IMOGEN_PARAMETERS"))
+        return false;
+    
+    presetValues.clear();
+    
+    for (auto* param : xml->getChildWithTagNameIterator ("PARAM"))
+        presetValues.set (juce::Identifier (param->getStringAttribute ("id")), param->getDoubleAttribute ("value"));
+    
+    return true;
+}
+
+
+/*===========================================================================================================================
+ ============================================================================================================================*/
+
+namespace
+{
+    class RenderThreadJob  : public juce::ThreadPoolJob
+    {
+    public:
+        RenderThreadJob (const ImogenOfflineRenderer& rendererToUse, const ImogenRenderJob& jobToRender, std::atomic<int>& failureCount)
+            : juce::ThreadPoolJob (jobToRender.vocalFile.getFileName()),
+              renderer (rendererToUse), job (jobToRender), numFailures (failureCount)
+        { }
+        
+        JobStatus runJob() override
+        {
+            const auto error = renderer.render (job);
+            
+            const juce::ScopedLock sl (consoleLock);
+            
+            if (error.isEmpty())
+            {
+                std::cout << "Rendered " << job.outputFile.getFullPathName() << std::endl;
+            }
+            else
+            {
+                ++numFailures;
+                std::cerr << "Failed to render " << job.vocalFile.getFullPathName() << ": " << error << std::endl;
+            }
+            
+            return jobHasFinished;
+        }
+        
+    private:
+        const ImogenOfflineRenderer& renderer;
+        const ImogenRenderJob job;
+        std::atomic<int>& numFailures;
+        
+        static juce::CriticalSection consoleLock;
+    };
+    
+    juce::CriticalSection RenderThreadJob::consoleLock;
+}
+
+
+int ImogenOfflineRenderer::renderAll (const juce::Array<ImogenRenderJob>& jobs, int numThreads)
+{
+    std::atomic<int> numFailures { 0 };
+    
+    juce::ThreadPool pool (juce::jlimit (1, juce::jmax (1, jobs.size()), numThreads));
+    
+    for (const auto& job : jobs)
+        pool.addJob (new RenderThreadJob (*this, job, numFailures), true);
+    
+    while (pool.getNumJobs() > 0)
+        juce::Thread::sleep (bvi_JOB_POLL_MS);
+    
+    return numFailures.load();
+}
+
+#undef bvi_JOB_POLL_MS
+
+
+juce::String ImogenOfflineRenderer::render (const ImogenRenderJob& job) const
+{
+    juce::ScopedNoDenormals nodenorms;
+    
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    
+    std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (job.vocalFile));
+    
+    if (reader == nullptr)
+        return "can't read the audio file";
+    
+    const auto samplerate = reader->sampleRate;
+    
+    juce::MidiMessageSequence midi;
+    
+    if (! readMidiFile (job.midiFile, samplerate, midi))
+        return "can't read the MIDI file " + job.midiFile.getFullPathName();
+    
+    bav::ImogenEngine<float> engine;
+    prepareEngine (engine, samplerate);
+    
+    // the output is trimmed by the latency, and runs on past the end of the input for the release & reverb tails
+    const auto latency = engine.reportLatency();
+    
+    using Defaults = bav::ImogenParameterDefaults;
+    
+    const auto releaseSeconds = getParameter ("adsrOnOff", Defaults::adsrOnOff) ? double (getParameter ("adsrRelease", Defaults::adsrRelease)) : 0.005;
+    
+    const auto totalLength = reader->lengthInSamples + latency
+                           + juce::roundToInt ((releaseSeconds + engine.getTailLengthSeconds()) * samplerate);
+    
+    job.outputFile.deleteFile();
+    auto outputStream = std::make_unique<juce::FileOutputStream> (job.outputFile);
+    
+    if (outputStream->failedToOpen())
+        return "can't open the output file " + job.outputFile.getFullPathName();
+    
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    
+    if (auto* newWriter = juce::WavAudioFormat().createWriterFor (outputStream.get(), samplerate, 2, 24, {}, 0))
+    {
+        outputStream.release();  // now owned by the writer
+        writer.reset (newWriter);
+    }
+    else
+    {
+        return "can't create a WAV writer for the output file";
+    }
+    
+    const auto hostBlocksize = engine.getLatency() * bvi_INTERNAL_BLOCKS_PER_HOST_BLOCK;
+    
+    // in multi-singer mode, each of the file's channels is a singer
+    juce::AudioBuffer<float> input (juce::jlimit (1, bvie_MAX_NUM_SINGERS, int (reader->numChannels)), hostBlocksize);
+    juce::AudioBuffer<float> output (2, hostBlocksize);
+    juce::MidiBuffer midiBlock;
+    
+    int nextMidiEvent = 0;
+    
+    for (juce::int64 blockStart = 0; blockStart < totalLength; blockStart += hostBlocksize)
+    {
+        const auto numSamples = int (std::min (juce::int64 (hostBlocksize), totalLength - blockStart));
+        
+        juce::AudioBuffer<float> inBlock  (input.getArrayOfWritePointers(),  input.getNumChannels(), numSamples);
+        juce::AudioBuffer<float> outBlock (output.getArrayOfWritePointers(), 2, numSamples);
+        
+        // reading past the end of the file fills the buffer with zeroes
+        reader->read (&inBlock, 0, numSamples, blockStart, true, true);
+        
+        midiBlock.clear();
+        
+        for (; nextMidiEvent < midi.getNumEvents(); ++nextMidiEvent)
+        {
+            const auto& message = midi.getEventPointer (nextMidiEvent)->message;
+            const auto timestamp = juce::int64 (message.getTimeStamp());
+            
+            if (timestamp >= blockStart + numSamples)
+                break;
+            
+            midiBlock.addEvent (message, int (std::max (juce::int64 (0), timestamp - blockStart)));
+        }
+        
+        engine.process (inBlock, outBlock, midiBlock, false);
+        
+        const auto samplesToSkip = int (juce::jlimit (juce::int64 (0), juce::int64 (numSamples), juce::int64 (latency) - blockStart));
+        
+        if (! writer->writeFromAudioSampleBuffer (outBlock, samplesToSkip, numSamples - samplesToSkip))
+            return "error writing to the output file";
+    }
+    
+    return {};
+}
+
+#undef bvi_INTERNAL_BLOCKS_PER_HOST_BLOCK
+
+
+void ImogenOfflineRenderer::prepareEngine (bav::ImogenEngine<float>& engine, double samplerate) const
+{
+    engine.initialize (samplerate, internalBlocksize > 0 ? internalBlocksize : bvi_INITIAL_BLOCKSIZE);
+    engine.setTraceRecorder (traceRecorder);
+    engine.setNonRealtime (true);  // there's no deadline offline, so late pipelined analysis is always waited for
+    applyPreset (engine);
+    
+    if (internalBlocksize > 0)
+        engine.setUseIncrementalPitchTracking (true, internalBlocksize);
+    else if (getParameter ("incrementalPitchTracking", bav::ImogenParameterDefaults::incrementalPitchTracking))
+        engine.setUseIncrementalPitchTracking (true);
+    
+    engine.prepare (samplerate);
+    
+    jassert (internalBlocksize == 0 || engine.getLatency() == internalBlocksize);
+}
+
+#undef bvi_INITIAL_BLOCKSIZE
+
+
+// reads every track of the file into one sequence, with each event's timestamp in samples
+bool ImogenOfflineRenderer::readMidiFile (const juce::File& file, double samplerate, juce::MidiMessageSequence& sequence)
+{
+    juce::FileInputStream stream (file);
+    
+    if (! stream.openedOk())
+        return false;
+    
+    juce::MidiFile midiFile;
+    
+    if (! midiFile.readFrom (stream))
+        return false;
+    
+    midiFile.convertTimestampTicksToSeconds();
+    
+    for (int track = 0; track < midiFile.getNumTracks(); ++track)
+        sequence.addSequence (*midiFile.getTrack (track), 0.0);
+    
+    for (auto* event : sequence)
+        event->message.setTimeStamp (std::round (event->message.getTimeStamp() * samplerate));
+    
+    return true;
+}
+
+
+/*===========================================================================================================================
+ ============================================================================================================================*/
+
+float ImogenOfflineRenderer::getParameter (const juce::Identifier& paramID, float defaultValue) const
+{
+    return float (presetValues.getWithDefault (paramID, double (defaultValue)));
+}
+
+bool ImogenOfflineRenderer::getParameter (const juce::Identifier& paramID, bool defaultValue) const
+{
+    return getParameter (paramID, defaultValue ? 1.0f : 0.0f) >= 0.5f;
+}
+
+
+// any parameters the preset doesn't contain get the same defaults as a new instance of the plugin
+void ImogenOfflineRenderer::applyPreset (bav::ImogenEngine<float>& engine) const
+{
+    bav::applyImogenParameters (engine, [this] (const char* paramID, float defaultValue) { return getParameter (paramID, defaultValue); });
+}
@@ -0,0 +1,84 @@
+
+/*======================================================================================================================================================
+           _             _   _                _                _                 _               _
+          /\ \          /\_\/\_\ _           /\ \             /\ \              /\ \            /\ \     _
+          \ \ \        / / / / //\_\        /  \ \           /  \ \            /  \ \          /  \ \   /\_\
+          /\ \_\      /\ \/ \ \/ / /       / /\ \ \         / /\ \_\          / /\ \ \        / /\ \ \_/ / /
+         / /\/_/     /  \____\__/ /       / / /\ \ \       / / /\/_/         / / /\ \_\      / / /\ \___/ /
+        / / /       / /\/________/       / / /  \ \_\     / / / ______      / /_/_ \/_/     / / /  \/____/
+       / / /       / / /\/_// / /       / / /   / / /    / / / /\_____\    / /____/\       / / /    / / /
+      / / /       / / /    / / /       / / /   / / /    / / /  \/____ /   / /\____\/      / / /    / / /
+  ___/ / /__     / / /    / / /       / / /___/ / /    / / /_____/ / /   / / /______     / / /    / / /
+ /\__\/_/___\    \/_/    / / /       / / /____\/ /    / / /______\/ /   / / /_______\   / / /    / / /
+ \/_________/            \/_/        \/_________/     \/___________/    \/__________/   \/_/     \/_/
+ 
+ 
+ This file is part of the Imogen codebase.
+ 
+ @2021 by Ben Vining. All rights reserved.
+ 
+ OfflineRenderer.h: This file defines the ImogenOfflineRenderer class, which harmonizes vocal recordings from MIDI files without an audio device or a GUI.
+ 
+======================================================================================================================================================*/
+
+
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "bv_ImogenEngine/bv_ImogenEngine.h"
+
+
+// one vocal recording to be harmonized with the notes in one MIDI file
+struct ImogenRenderJob
+{
+    juce::File vocalFile, midiFile, outputFile;
+};
+
+
+/*
+    ImogenOfflineRenderer : drives an ImogenEngine directly from audio & MIDI files, as fast as the CPU allows.
+    The latency the engine adds doesn't matter offline -- it is trimmed from the start of the output file. Each file gets its own engine, so several files can be rendered at once on different threads.
+*/
+
+class ImogenOfflineRenderer
+{
+public:
+    /*
+        With internalBlocksizeToUse at 0, the engine's internal blocksize is set the same way as in the plugin: by the pitch detector's frame, or by the preset's "incrementalPitchTracking" parameter.
+        Otherwise it's internalBlocksizeToUse, and the pitch is tracked incrementally, since that's the only way the blocksize can be chosen independently of the vocal range.
+    */
+    explicit ImogenOfflineRenderer (int internalBlocksizeToUse = 0);
+    
+    // reads a preset written by ImogenAudioProcessor::savePreset(). Any parameters it doesn't contain keep their default values.
+    bool loadPreset (const juce::File& presetFile);
+    
+    // renders all the jobs, spread across up to numThreads threads. Returns the number of jobs that failed.
+    int renderAll (const juce::Array<ImogenRenderJob>& jobs, int numThreads);
+    
+    // renders one job on the calling thread. Returns an error message, or an empty string on success.
+    juce::String render (const ImogenRenderJob& job) const;
+    
+    // every engine rendered from now on adds its trace events to this recorder, which the caller starts & stops. nullptr turns tracing off.
+    void setTraceRecorder (bav::TraceRecorder* recorderToUse) noexcept { traceRecorder = recorderToUse; }
+    
+    // initializes the engine, applies the preset & prepares it, the same way that render() does
+    void prepareEngine (bav::ImogenEngine<float>& engine, double samplerate) const;
+    
+    
+private:
+    void applyPreset (bav::ImogenEngine<float>& engine) const;
+    
+    float getParameter (const juce::Identifier& paramID, float defaultValue) const;
+    bool  getParameter (const juce::Identifier& paramID, bool defaultValue) const;
+    
+    static bool readMidiFile (const juce::File& file, double samplerate, juce::MidiMessageSequence& sequence);
+    
+    const int internalBlocksize;
+    
+    juce::NamedValueSet presetValues;  // parameter ID -> value, in the parameter's own units
+    
+    bav::TraceRecorder* traceRecorder = nullptr;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ImogenOfflineRenderer)
+};
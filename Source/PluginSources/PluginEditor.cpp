@@ -28,6 +28,9 @@
 
 #define bvi_GRAPHICS_FRAMERATE_HZ 60
 
+// the load figures are drained from the processor every frame, but only redrawn this often, so that they're readable
+#define bvi_CPU_LOAD_DISPLAY_FRAMES 15
+
 
 ImogenAudioProcessorEditor::ImogenAudioProcessorEditor (ImogenAudioProcessor& p):
     AudioProcessorEditor (&p), imgnProcessor(p)
@@ -57,6 +60,13 @@ ImogenAudioProcessorEditor::~ImogenAudioProcessorEditor()
 void ImogenAudioProcessorEditor::paint (juce::Graphics& g)
 {
     g.fillAll (juce::Colours::black);
+    
+    if (cpuLoadText.isNotEmpty())
+    {
+        g.setColour (juce::Colours::lightgrey);
+        g.setFont (12.0f);
+        g.drawFittedText (cpuLoadText, getLocalBounds().removeFromBottom (20).reduced (8, 0), juce::Justification::centredLeft, 1);
+    }
 }
 
 
@@ -71,9 +81,33 @@ void ImogenAudioProcessorEditor::timerCallback()
 {
     if (imgnProcessor.hasUpdatedParamDefaults())
         updateParameterDefaults();
+    
+    updateCpuLoad();
 }
 
 
+// drains the processor's telemetry ring every frame, so that it never fills up, and refreshes the text a few times a second
+void ImogenAudioProcessorEditor::updateCpuLoad()
+{
+    cpuLoadMeter.update (imgnProcessor.getStageTelemetry(), imgnProcessor.getSampleRate());
+    
+    if (++framesSinceCpuLoadShown < bvi_CPU_LOAD_DISPLAY_FRAMES)
+        return;
+    
+    framesSinceCpuLoadShown = 0;
+    
+    const auto newText = cpuLoadMeter.getSummary();
+    
+    if (newText == cpuLoadText)
+        return;
+    
+    cpuLoadText = newText;
+    repaint();
+}
+
+#undef bvi_CPU_LOAD_DISPLAY_FRAMES
+
+
 inline void ImogenAudioProcessorEditor::newPresetSelected()
 {
     imgnProcessor.loadPreset (selectPreset.getItemText (selectPreset.getSelectedId()));
@@ -56,8 +56,14 @@ private:
     
     void updateParameterDefaults();
     
+    void updateCpuLoad();
+    
     juce::ComboBox selectPreset;
     
+    bav::StageLoadMeter cpuLoadMeter;
+    juce::String cpuLoadText;  // the per-stage load breakdown & worst block time, drawn along the bottom of the editor
+    int framesSinceCpuLoadShown = 0;
+    
     juce::Array< bav::MessageQueue::Message >  currentMessages;  // this array stores the current messages from the message FIFO
     
     bav::ImogenLookAndFeel lookAndFeel;
@@ -26,6 +26,10 @@
 #include "PluginProcessor.h"
 
 
+// how often the message thread checks for parameter changes that the audio thread has deferred to it
+#define bvi_DEFERRED_CHANGES_POLL_HZ 20
+
+
 ImogenAudioProcessor::ImogenAudioProcessor():
     AudioProcessor(makeBusProperties()),
     tree(*this, nullptr, "IMOGEN_PARAMETERS", createParameters())
@@ -43,9 +47,17 @@ ImogenAudioProcessor::ImogenAudioProcessor():
     updateParameterDefaults();
     
     if (isUsingDoublePrecision())
-        initialize (doubleEngine);
+    {
+        doubleEngine = std::make_unique<bav::ImogenEngine<double>>();
+        initialize (*doubleEngine);
+    }
     else
-        initialize (floatEngine);
+    {
+        floatEngine = std::make_unique<bav::ImogenEngine<float>>();
+        initialize (*floatEngine);
+    }
+    
+    Timer::startTimerHz (bvi_DEFERRED_CHANGES_POLL_HZ);
     
 #if IMOGEN_ONLY_BUILDING_STANDALONE
     //  if running as a standalone app, denormals are disabled for the lifetime of the app (instead of scoped within the processBlock).
@@ -54,8 +66,12 @@ ImogenAudioProcessor::ImogenAudioProcessor():
 #endif
 }
 
+#undef bvi_DEFERRED_CHANGES_POLL_HZ
+
 ImogenAudioProcessor::~ImogenAudioProcessor()
 {
+    Timer::stopTimer();
+    
 #if IMOGEN_ONLY_BUILDING_STANDALONE
     juce::FloatVectorOperations::disableDenormalisedNumberSupport (denormalsWereDisabledWhenTheAppStarted);
     juce::FloatVectorOperations::enableFlushToZeroMode (denormalsWereDisabledWhenTheAppStarted);
@@ -64,8 +80,8 @@ ImogenAudioProcessor::~ImogenAudioProcessor()
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-template <typename SampleType>
-inline void ImogenAudioProcessor::initialize (bav::ImogenEngine<SampleType>& activeEngine)
+template <typename SampleType, typename HarmonySampleType>
+inline void ImogenAudioProcessor::initialize (bav::ImogenEngine<SampleType, HarmonySampleType>& activeEngine)
 {
     auto initSamplerate = getSampleRate();
     if (initSamplerate <= 0.0) initSamplerate = 44100.0;
@@ -75,6 +91,9 @@ inline void ImogenAudioProcessor::initialize (bav::ImogenEngine<SampleType>& act
     
     activeEngine.initialize (initSamplerate, initBlockSize);
     
+    activeEngine.setStageTelemetry (&stageTelemetry);
+    activeEngine.setTraceRecorder (&traceRecorder);
+    
     updateAllParameters (activeEngine);
     
     setLatencySamples (activeEngine.reportLatency());
@@ -83,10 +102,12 @@ inline void ImogenAudioProcessor::initialize (bav::ImogenEngine<SampleType>& act
 
 void ImogenAudioProcessor::prepareToPlay (const double sampleRate, const int samplesPerBlock)
 {
-    if (isUsingDoublePrecision())
-        prepareToPlayWrapped (sampleRate, doubleEngine, floatEngine);
+    if (! isUsingDoublePrecision())
+        prepareToPlayWrapped (sampleRate, floatEngine);
+    else if (mixedPrecision->get())
+        prepareToPlayWrapped (sampleRate, mixedPrecisionEngine);
     else
-        prepareToPlayWrapped (sampleRate, floatEngine,  doubleEngine);
+        prepareToPlayWrapped (sampleRate, doubleEngine);
     
     paramChanges.reserveSize (samplesPerBlock);
     
@@ -94,16 +115,55 @@ void ImogenAudioProcessor::prepareToPlay (const double sampleRate, const int sam
 }
 
 
-template <typename SampleType1, typename SampleType2>
+/*
+    The host only changes the processing precision while it isn't processing, and then calls prepareToPlay() -- so this is where the engine for the new precision is created, and swapped in for the one for the old precision.
+    The "mixedPrecision" parameter is only read here too, so changing it takes effect the next time the host prepares.
+    So is "incrementalPitchTracking", since it changes the latency that the host compensates for.
+    The new engine gets its settings from the parameters, the same as it would after loading a preset.
+    It's built & prepared before the lock is taken, so the timer & the host's queries -- which reach the engines through callOnActiveEngine() -- only wait for the swap, and never see an engine that's half built or being destroyed.
+*/
+template <typename SampleType, typename HarmonySampleType>
 inline void ImogenAudioProcessor::prepareToPlayWrapped (const double sampleRate,
-                                                        bav::ImogenEngine<SampleType1>& activeEngine,
-                                                        bav::ImogenEngine<SampleType2>& idleEngine)
+                                                        std::unique_ptr<bav::ImogenEngine<SampleType, HarmonySampleType>>& activeEngine)
 {
-    if (! idleEngine.hasBeenReleased())
-        idleEngine.releaseResources();
+    std::unique_ptr<bav::ImogenEngine<SampleType, HarmonySampleType>> newEngine;
+    
+    if (activeEngine == nullptr)
+    {
+        newEngine = std::make_unique<bav::ImogenEngine<SampleType, HarmonySampleType>>();
+        initialize (*newEngine);
+        prepareEngine (*newEngine, sampleRate);
+    }
+    
+    // the engines for the other precisions are moved out under the lock, and destroyed once it's released
+    std::unique_ptr<bav::ImogenEngine<float>>  oldFloatEngine;
+    std::unique_ptr<bav::ImogenEngine<double>> oldDoubleEngine;
+    std::unique_ptr<bav::ImogenEngine<double, float>> oldMixedPrecisionEngine;
+    
+    const juce::ScopedLock sl (engineLock);
     
+    // an engine that already exists may be in use by the timer, so it's only prepared with the lock held
+    if (newEngine == nullptr)
+    {
+        prepareEngine (*activeEngine, sampleRate);
+        newEngine = std::move (activeEngine);
+    }
+    
+    oldFloatEngine = std::move (floatEngine);
+    oldDoubleEngine = std::move (doubleEngine);
+    oldMixedPrecisionEngine = std::move (mixedPrecisionEngine);
+    
+    activeEngine = std::move (newEngine);
+}
+
+
+template <typename SampleType, typename HarmonySampleType>
+inline void ImogenAudioProcessor::prepareEngine (bav::ImogenEngine<SampleType, HarmonySampleType>& activeEngine, const double sampleRate)
+{
     updateAllParameters (activeEngine);
     
+    activeEngine.setUseIncrementalPitchTracking (incrementalPitchTracking->get());
+    
     jassert (activeEngine.getLatency() > 0);
     
     activeEngine.prepare (sampleRate);
@@ -114,20 +174,17 @@ inline void ImogenAudioProcessor::prepareToPlayWrapped (const double sampleRate,
 
 void ImogenAudioProcessor::releaseResources()
 {
-    if (! doubleEngine.hasBeenReleased())
-        doubleEngine.releaseResources();
-    
-    if (! floatEngine.hasBeenReleased())
-        floatEngine.releaseResources();
+    callOnActiveEngine ([] (auto& engine)
+                        {
+                            if (! engine.hasBeenReleased())
+                                engine.releaseResources();
+                        });
 }
 
 
 void ImogenAudioProcessor::reset()
 {
-    if (isUsingDoublePrecision())
-        doubleEngine.reset();
-    else
-        floatEngine.reset();
+    callOnActiveEngine ([] (auto& engine) { engine.reset(); });
 }
 
 
@@ -144,13 +201,16 @@ void ImogenAudioProcessor::editorPitchbend (int wheelValue)
 
 void ImogenAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    processBlockWrapped (buffer, midiMessages, floatEngine, mainBypass->get());
+    processBlockWrapped (buffer, midiMessages, floatEngine.get(), mainBypass->get());
 }
 
 
 void ImogenAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
 {
-    processBlockWrapped (buffer, midiMessages, doubleEngine, mainBypass->get());
+    if (mixedPrecisionEngine != nullptr)
+        processBlockWrapped (buffer, midiMessages, mixedPrecisionEngine.get(), mainBypass->get());
+    else
+        processBlockWrapped (buffer, midiMessages, doubleEngine.get(), mainBypass->get());
 }
 
 
@@ -159,7 +219,7 @@ void ImogenAudioProcessor::processBlockBypassed (juce::AudioBuffer<float>& buffe
     if (! mainBypass->get())
         mainBypass->setValueNotifyingHost (1.0f);
     
-    processBlockWrapped (buffer, midiMessages, floatEngine, true);
+    processBlockWrapped (buffer, midiMessages, floatEngine.get(), true);
 }
 
 
@@ -168,27 +228,39 @@ void ImogenAudioProcessor::processBlockBypassed (juce::AudioBuffer<double>& buff
     if (! mainBypass->get())
         mainBypass->setValueNotifyingHost (1.0f);
     
-    processBlockWrapped (buffer, midiMessages, doubleEngine, true);
+    if (mixedPrecisionEngine != nullptr)
+        processBlockWrapped (buffer, midiMessages, mixedPrecisionEngine.get(), true);
+    else
+        processBlockWrapped (buffer, midiMessages, doubleEngine.get(), true);
 }
 
 
 // LAYER 2 ---------------------------------------------------------------------------------
 
-template <typename SampleType>
+template <typename SampleType, typename HarmonySampleType>
 inline void ImogenAudioProcessor::processBlockWrapped (juce::AudioBuffer<SampleType>& buffer,
                                                        juce::MidiBuffer& midiMessages,
-                                                       bav::ImogenEngine<SampleType>& engine,
+                                                       bav::ImogenEngine<SampleType, HarmonySampleType>* engine,
                                                        const bool isBypassedThisCallback)
 {
-    jassert (! engine.hasBeenReleased() && engine.hasBeenInitialized());
+    // the host must call prepareToPlay() after changing the processing precision, which creates this engine
+    if (engine == nullptr)
+    {
+        jassertfalse;
+        buffer.clear();
+        return;
+    }
+    
+    jassert (! engine->hasBeenReleased() && engine->hasBeenInitialized());
     
 #if ! IMOGEN_ONLY_BUILDING_STANDALONE
     juce::ScopedNoDenormals nodenorms;
 #endif
     
-    updateAllParameters (engine);
-    //processQueuedParameterChanges (engine);
-    processQueuedNonParamEvents (engine);
+    engine->setNonRealtime (isNonRealtime());
+    
+    processQueuedParameterChanges (*engine, buffer.getNumSamples());
+    processQueuedNonParamEvents (*engine);
 
     if (buffer.getNumSamples() == 0 || buffer.getNumChannels() == 0)
         return;
@@ -196,7 +268,7 @@ inline void ImogenAudioProcessor::processBlockWrapped (juce::AudioBuffer<SampleT
     juce::AudioBuffer<SampleType> inBus  = getBusBuffer (buffer, true, getBusesLayout().getMainInputChannelSet() == juce::AudioChannelSet::disabled());
     juce::AudioBuffer<SampleType> outBus = getBusBuffer (buffer, false, 0);
     
-    engine.process (inBus, outBus, midiMessages, isBypassedThisCallback);
+    engine->process (inBus, outBus, midiMessages, isBypassedThisCallback);
 }
 
 
@@ -208,10 +280,13 @@ inline void ImogenAudioProcessor::processBlockWrapped (juce::AudioBuffer<SampleT
 
 double ImogenAudioProcessor::getTailLengthSeconds() const
 {
+    double reverbTail = 0.0;
+    callOnActiveEngine ([&reverbTail] (const auto& engine) { reverbTail = engine.getTailLengthSeconds(); });
+    
     if (adsrToggle->get())
-        return double(adsrRelease->get()); // ADSR release time in seconds
+        return double(adsrRelease->get()) + reverbTail; // ADSR release time in seconds
     
-    return 0.005;  // "quick kill" time in seconds -- must be the same as the ms value defined in the macro in bv_Harmonizer.cpp !!
+    return 0.005 + reverbTail;  // "quick kill" time in seconds -- must be the same as the ms value defined in the macro in bv_Harmonizer.cpp !!
 }
 
 
@@ -220,6 +295,7 @@ inline juce::AudioProcessor::BusesProperties ImogenAudioProcessor::makeBusProper
     auto stereo = juce::AudioChannelSet::stereo();
     auto mono   = juce::AudioChannelSet::mono();
 
+    // the main input can have up to one channel per singer (see the "numSingers" parameter)
     return BusesProperties().withInput ("Input",  stereo, true)
                             .withInput ("Sidechain", mono, false)
                             .withOutput("Output", stereo, true);
@@ -233,6 +309,9 @@ bool ImogenAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) c
     if (layouts.getMainInputChannelSet() == disabled && layouts.getChannelSet(true, 1) == disabled)
         return false;
     
+    if (layouts.getMainInputChannels() > bvie_MAX_NUM_SINGERS)
+        return false;
+    
     return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
 }
 
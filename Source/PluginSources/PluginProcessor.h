@@ -32,14 +32,13 @@
 #endif
 
 
-#define bvie_MAX_POSSIBLE_NUM_VOICES 20
-
 
 class ImogenAudioProcessorEditor; // forward declaration...
 
 ///////////
 
-class ImogenAudioProcessor    : public juce::AudioProcessor
+class ImogenAudioProcessor    : public juce::AudioProcessor,
+                                private juce::Timer
 {
     using Parameter      = bav::Parameter;
     using FloatParameter = bav::FloatParameter;
@@ -52,6 +51,19 @@ class ImogenAudioProcessor    : public juce::AudioProcessor
     
     using ParameterMessenger = bav::ParameterMessenger;
     
+    // for settings that restructure the engine -- changing its latency or how it processes -- which are applied from the message thread, so hosts mustn't automate them
+    struct NonAutomatableBoolParameter  :   BoolParameter
+    {
+        using BoolParameter::BoolParameter;
+        bool isAutomatable() const override { return false; }
+    };
+    
+    struct NonAutomatableIntParameter  :   IntParameter
+    {
+        using IntParameter::IntParameter;
+        bool isAutomatable() const override { return false; }
+    };
+    
     
 public:
     ImogenAudioProcessor();
@@ -117,9 +129,16 @@ public:
         reverbDecayID,
         reverbDuckID,
         reverbLoCutID,
-        reverbHiCutID
+        reverbHiCutID,
+        pipelinedAnalysisID,
+        multithreadedRenderingID,
+        numSingersID,
+        mixedPrecisionID,
+        incrementalPitchTrackingID
     };
-#define IMGN_NUM_PARAMS reverbHiCutID + 1
+#define IMGN_NUM_PARAMS incrementalPitchTrackingID + 1
+    
+    static_assert (IMGN_NUM_PARAMS <= 64, "Each parameter needs its own bit in the dirty parameter mask");
     
     // IDs for events from the editor that are not parameters
     enum eventID
@@ -185,47 +204,69 @@ public:
     
     bool supportsDoublePrecisionProcessing() const override { return true; }
     
+    // true if the host is processing in double precision and the "mixedPrecision" parameter was on when it last prepared: the harmonizer -- pitch detection, grains & voices -- then runs in float,
+    // converting at its input & output, while the mix, reverb & limiter stay in double.
+    bool isUsingMixedPrecision() const
+    {
+        const juce::ScopedLock sl (engineLock);
+        return mixedPrecisionEngine != nullptr;
+    }
+    
     void editorPitchbend (int wheelValue);
     
+    // the active engine pushes each internal block's per-stage CPU timings into this ring. Only one reader at a time, e.g. the editor's timer.
+    bav::StageTelemetry& getStageTelemetry() noexcept { return stageTelemetry; }
+    
+    // records every block's timings, the parameter changes, automation & latency changes to a Chrome trace (or, for a .csv file, CSV) until stopped. Call these from the message thread.
+    bool startTraceRecording (const juce::File& file) { return traceRecorder.start (file); }
+    void stopTraceRecording() { traceRecorder.stop(); }
+    bool isRecordingTrace() const noexcept { return traceRecorder.isRecording(); }
+    
     
     // this queue is SPSC; this is only for events flowing from the editor into the processor
     bav::MessageQueue nonParamEvents;
     
     
 private:
-    template <typename SampleType>
-    void initialize (bav::ImogenEngine<SampleType>& activeEngine);
+    template <typename SampleType, typename HarmonySampleType>
+    void initialize (bav::ImogenEngine<SampleType, HarmonySampleType>& activeEngine);
     
     juce::AudioProcessor::BusesProperties makeBusProperties() const;
     
-    template <typename SampleType1, typename SampleType2>
+    template <typename SampleType, typename HarmonySampleType>
     void prepareToPlayWrapped (const double sampleRate,
-                               bav::ImogenEngine<SampleType1>& activeEngine,
-                               bav::ImogenEngine<SampleType2>& idleEngine);
+                               std::unique_ptr<bav::ImogenEngine<SampleType, HarmonySampleType>>& activeEngine);
+    
+    template <typename SampleType, typename HarmonySampleType>
+    void prepareEngine (bav::ImogenEngine<SampleType, HarmonySampleType>& activeEngine, const double sampleRate);
     
     
-    template <typename SampleType>
+    template <typename SampleType, typename HarmonySampleType>
     inline void processBlockWrapped (juce::AudioBuffer<SampleType>& buffer,
                                      juce::MidiBuffer& midiMessages,
-                                     bav::ImogenEngine<SampleType>& engine,
+                                     bav::ImogenEngine<SampleType, HarmonySampleType>* engine,
                                      const bool isBypassedThisCallback);
     
-    template<typename SampleType>
-    void updateAllParameters (bav::ImogenEngine<SampleType>& activeEngine);
+    template<typename SampleType, typename HarmonySampleType>
+    void updateAllParameters (bav::ImogenEngine<SampleType, HarmonySampleType>& activeEngine);
     
-    template<typename SampleType>
-    void processQueuedParameterChanges (bav::ImogenEngine<SampleType>& activeEngine);
+    template<typename SampleType, typename HarmonySampleType>
+    void processQueuedParameterChanges (bav::ImogenEngine<SampleType, HarmonySampleType>& activeEngine, const int numSamples);
     
-    template<typename SampleType>
-    void processQueuedNonParamEvents (bav::ImogenEngine<SampleType>& activeEngine);
+    void timerCallback() override;
+    
+    static constexpr juce::uint64 parameterBit (const parameterID paramID) noexcept { return juce::uint64(1) << paramID; }
+    
+    template<typename SampleType, typename HarmonySampleType>
+    void processQueuedNonParamEvents (bav::ImogenEngine<SampleType, HarmonySampleType>& activeEngine);
     
     void updateVocalRangeType (int newRangeType);
     
-    void updateNumVoices (const int newNumVoices);
+    void updatePipelinedAnalysis (bool shouldUsePipeline);
     
-    template<typename SampleType>
-    void updateCompressor (bav::ImogenEngine<SampleType>& activeEngine,
-                           bool compressorIsOn, float knobValue);
+    void updateMultithreadedRendering (bool shouldUseMultithreading);
+    
+    void updateNumSingers();
     
     juce::AudioProcessorValueTreeState::ParameterLayout createParameters();
     void initializeParameterPointers();
@@ -235,29 +276,63 @@ private:
     
     bav::MessageQueue paramChanges;
     
-    template<typename SampleType>
-    bool updatePluginInternalState (juce::XmlElement& newState, bav::ImogenEngine<SampleType>& activeEngine);
+    // one bit per parameterID. The ParameterMessengers' messages only mark which parameters have changed; the values are read from the parameters when the changes are applied
+    std::atomic<juce::uint64> dirtyParameters { 0 };
+    
+    // changes that have to be made on the message thread (the vocal range & pipelined analysis, which change the latency, multithreaded rendering, which may start threads, & the number of singers, which allocates) are handed over from the audio thread through this mask
+    std::atomic<juce::uint64> pendingStructuralChanges { 0 };
+    
+    bool updatePluginInternalState (juce::XmlElement& newState);
     
     
     inline bool isMidiLatched() const
     {
-        if (isUsingDoublePrecision())
-            return doubleEngine.isMidiLatched();
+        bool isLatched = false;
+        callOnActiveEngine ([&isLatched] (const auto& engine) { isLatched = engine.isMidiLatched(); });
+        return isLatched;
+    }
+    
+    // calls the function with the engine that currently exists. Until prepareToPlay() has created the engine for a new precision, this is still the old one.
+    // This holds engineLock, so never call it from the audio thread.
+    template<typename Function>
+    void callOnActiveEngine (Function&& function)
+    {
+        const juce::ScopedLock sl (engineLock);
+        
+        if (floatEngine != nullptr)                 function (*floatEngine);
+        else if (doubleEngine != nullptr)           function (*doubleEngine);
+        else if (mixedPrecisionEngine != nullptr)   function (*mixedPrecisionEngine);
+    }
+    
+    template<typename Function>
+    void callOnActiveEngine (Function&& function) const
+    {
+        const juce::ScopedLock sl (engineLock);
         
-        return floatEngine.isMidiLatched();
+        if (floatEngine != nullptr)                 function (std::as_const (*floatEngine));
+        else if (doubleEngine != nullptr)           function (std::as_const (*doubleEngine));
+        else if (mixedPrecisionEngine != nullptr)   function (std::as_const (*mixedPrecisionEngine));
     }
     
-    // one engine of each type. The idle one isn't destroyed, but takes up few resources.
-    bav::ImogenEngine<float>  floatEngine;
-    bav::ImogenEngine<double> doubleEngine;
+    // declared before the engines, which push into it, so that it outlives them
+    bav::StageTelemetry stageTelemetry;
+    bav::TraceRecorder traceRecorder;
+    
+    // only one of these exists at a time: the one for the current processing precision. The others are destroyed in prepareToPlay(), which creates the right one if it doesn't exist yet.
+    // prepareToPlay() swaps them with engineLock held, and every other thread but the audio thread reaches them through callOnActiveEngine(), which holds it too.
+    // The host never calls processBlock() during prepareToPlay(), so the audio thread uses them without locking.
+    mutable juce::CriticalSection engineLock;
+    std::unique_ptr<bav::ImogenEngine<float>>  floatEngine;
+    std::unique_ptr<bav::ImogenEngine<double>> doubleEngine;
+    std::unique_ptr<bav::ImogenEngine<double, float>> mixedPrecisionEngine;
     
     juce::Array< bav::MessageQueue::Message >  currentMessages;  // this array stores the current messages from the message FIFO
     
     juce::AudioProcessorValueTreeState tree;
     
     // pointers to all the parameter objects
-    BoolParamPtr  mainBypass, leadBypass, harmonyBypass, adsrToggle, pedalPitchIsOn, descantIsOn, voiceStealing, limiterToggle, noiseGateToggle, compressorToggle, aftertouchGainToggle, deEsserToggle, reverbToggle;
-    IntParamPtr   vocalRangeType, dryPan, dryWet, stereoWidth, lowestPanned, velocitySens, pitchBendRange, pedalPitchThresh, pedalPitchInterval, descantThresh, descantInterval, concertPitchHz, reverbDryWet, numVoices, inputSource;
+    BoolParamPtr  mainBypass, leadBypass, harmonyBypass, adsrToggle, pedalPitchIsOn, descantIsOn, voiceStealing, limiterToggle, noiseGateToggle, compressorToggle, aftertouchGainToggle, deEsserToggle, reverbToggle, pipelinedAnalysis, multithreadedRendering, mixedPrecision, incrementalPitchTracking;
+    IntParamPtr   vocalRangeType, dryPan, dryWet, stereoWidth, lowestPanned, velocitySens, pitchBendRange, pedalPitchThresh, pedalPitchInterval, descantThresh, descantInterval, concertPitchHz, reverbDryWet, numVoices, inputSource, numSingers;
     FloatParamPtr adsrAttack, adsrDecay, adsrSustain, adsrRelease, noiseGateThreshold, inputGain, outputGain, compressorAmount, deEsserThresh, deEsserAmount, reverbDecay, reverbDuck, reverbLoCut, reverbHiCut;
     
     std::atomic<bool> parameterDefaultsAreDirty;
@@ -57,10 +57,7 @@ void ImogenAudioProcessor::setStateInformation (const void* data, int sizeInByte
 {
     auto xmlElement (getXmlFromBinary (data, sizeInBytes));
     
-    if (isUsingDoublePrecision())
-        updatePluginInternalState (*xmlElement, doubleEngine);
-    else
-        updatePluginInternalState (*xmlElement, floatEngine);
+    updatePluginInternalState (*xmlElement);
 }
 
 bool ImogenAudioProcessor::loadPreset (juce::String presetName)
@@ -74,15 +71,12 @@ bool ImogenAudioProcessor::loadPreset (juce::String presetName)
     
     auto xmlElement = juce::parseXML (presetToLoad);
     
-    if (isUsingDoublePrecision())
-        return updatePluginInternalState (*xmlElement, doubleEngine);
-    
-    return updatePluginInternalState (*xmlElement, floatEngine);
+    return updatePluginInternalState (*xmlElement);
 }
 
 
-template<typename SampleType>
-inline bool ImogenAudioProcessor::updatePluginInternalState (juce::XmlElement& newState, bav::ImogenEngine<SampleType>& activeEngine)
+// if the engine for the current precision hasn't been created yet, it picks up the new state from the parameters when it is
+bool ImogenAudioProcessor::updatePluginInternalState (juce::XmlElement& newState)
 {
     if (! newState.hasTagName (tree.state.getType()))
         return false;
@@ -91,7 +85,7 @@ inline bool ImogenAudioProcessor::updatePluginInternalState (juce::XmlElement& n
     
     tree.replaceState (juce::ValueTree::fromXml (newState));
     
-    updateAllParameters (activeEngine);
+    callOnActiveEngine ([this] (auto& engine) { updateAllParameters (engine); });
     
     updateParameterDefaults();
     
@@ -158,38 +152,46 @@ void ImogenAudioProcessor::changeProgramName (int index, const juce::String& new
 // updates the vocal input range type. This controls the pitch detection Hz range, and, thus, the latency of the pitch detector and the latency of the entire plugin. The lower the min possible Hz for the pitch detector, the higher the plugin's latency.
 void ImogenAudioProcessor::updateVocalRangeType (int newRangeType)
 {
-    jassert (newRangeType >= 0 && newRangeType <= 3);
+    suspendProcessing (true);
     
-    int minHz, maxHz;
+    callOnActiveEngine ([this, newRangeType] (auto& engine)
+                        {
+                            bav::applyVocalRangeType (engine, newRangeType);
+                            setLatencySamples (engine.reportLatency());
+                        });
     
-    switch (newRangeType)
-    {
-        default:
-            minHz = bav::math::midiToFreq (57);
-            maxHz = bav::math::midiToFreq (88);
-        case (1):
-            minHz = bav::math::midiToFreq (50);
-            maxHz = bav::math::midiToFreq (81);
-        case (2):
-            minHz = bav::math::midiToFreq (43);
-            maxHz = bav::math::midiToFreq (76);
-        case (3):
-            minHz = bav::math::midiToFreq (36);
-            maxHz = bav::math::midiToFreq (67);
-    }
+    suspendProcessing (false);
+}
+
+
+// runs the harmonizer's pitch detection a block ahead on its own thread. This adds a block of latency, so like the vocal range, it's applied with processing suspended.
+void ImogenAudioProcessor::updatePipelinedAnalysis (bool shouldUsePipeline)
+{
+    suspendProcessing (true);
     
+    callOnActiveEngine ([this, shouldUsePipeline] (auto& engine)
+                        {
+                            engine.setUsePipelinedAnalysis (shouldUsePipeline);
+                            setLatencySamples (engine.reportLatency());
+                        });
+    
+    suspendProcessing (false);
+}
+
+
+// renders the voices in parallel on the shared render pool. This doesn't change the output or the latency, but the pool's threads are started the first time it's enabled, so it's applied from the message thread.
+void ImogenAudioProcessor::updateMultithreadedRendering (bool shouldUseMultithreading)
+{
+    callOnActiveEngine ([shouldUseMultithreading] (auto& engine) { engine.setUseMultithreadedRendering (shouldUseMultithreading); });
+}
+
+
+// each of the first numSingers input channels is harmonized separately. Any new singers start out with default settings, so all the parameters are re-applied with processing suspended.
+void ImogenAudioProcessor::updateNumSingers()
+{
     suspendProcessing (true);
     
-    if (isUsingDoublePrecision())
-    {
-        doubleEngine.updatePitchDetectionHzRange (minHz, maxHz);
-        setLatencySamples (doubleEngine.reportLatency());
-    }
-    else
-    {
-        floatEngine.updatePitchDetectionHzRange (minHz, maxHz);
-        setLatencySamples (floatEngine.reportLatency());
-    }
+    callOnActiveEngine ([this] (auto& engine) { updateAllParameters (engine); });
     
     suspendProcessing (false);
 }
@@ -207,40 +209,22 @@ juce::String ImogenAudioProcessor::getCurrentVocalRange() const
 }
 
 
-// converts the "compressor-knob" value to threshold and ratio control values and passes these to the ImogenEngine
-template<typename SampleType>
-void ImogenAudioProcessor::updateCompressor (bav::ImogenEngine<SampleType>& activeEngine,
-                                             bool compressorIsOn, float knobValue)
+// applies the changes to the vocal range, pipelined analysis, multithreaded rendering & number of singers that the audio thread has deferred, none of which are safe to apply from processBlock()
+void ImogenAudioProcessor::timerCallback()
 {
-    jassert (knobValue >= 0.0f && knobValue <= 1.0f);
+    const auto changes = pendingStructuralChanges.exchange (0, std::memory_order_acq_rel);
     
-    activeEngine.updateCompressor (juce::jmap (knobValue, 0.0f, -60.0f),  // threshold (dB)
-                                   juce::jmap (knobValue, 1.0f, 10.0f),  // ratio
-                                   compressorIsOn);
-}
-
-
-// update the number of concurrently running instances of the harmony algorithm
-void ImogenAudioProcessor::updateNumVoices (const int newNumVoices)
-{
-    if (isUsingDoublePrecision())
-    {
-        if (doubleEngine.getCurrentNumVoices() == newNumVoices)
-            return;
-        
-        suspendProcessing (true);
-        doubleEngine.updateNumVoices (newNumVoices);
-    }
-    else
-    {
-        if (floatEngine.getCurrentNumVoices() == newNumVoices)
-            return;
-        
-        suspendProcessing (true);
-        floatEngine.updateNumVoices (newNumVoices);
-    }
+    if ((changes & parameterBit (vocalRangeTypeID)) != 0)
+        updateVocalRangeType (vocalRangeType->get());
     
-    suspendProcessing (false);
+    if ((changes & parameterBit (pipelinedAnalysisID)) != 0)
+        updatePipelinedAnalysis (pipelinedAnalysis->get());
+    
+    if ((changes & parameterBit (multithreadedRenderingID)) != 0)
+        updateMultithreadedRendering (multithreadedRendering->get());
+    
+    if ((changes & parameterBit (numSingersID)) != 0)
+        updateNumSingers();
 }
 
 
@@ -253,145 +237,129 @@ void ImogenAudioProcessor::updateNumVoices (const int newNumVoices)
 */
 
 
-// refreshes all parameter values, without consulting the FIFO message queue.
-template<typename SampleType>
-void ImogenAudioProcessor::updateAllParameters (bav::ImogenEngine<SampleType>& activeEngine)
+// refreshes all parameter values, without consulting the FIFO message queue. The offline renderer applies its presets with the same function, so the two always agree.
+// this changes the engine's structure & latency without suspending processing itself, so call it before the engine is prepared, or while processing is suspended.
+template<typename SampleType, typename HarmonySampleType>
+void ImogenAudioProcessor::updateAllParameters (bav::ImogenEngine<SampleType, HarmonySampleType>& activeEngine)
 {
-    updateVocalRangeType (vocalRangeType->get());
-    updateNumVoices (numVoices->get());
+    // every parameter exists, so the defaults are never needed
+    bav::applyImogenParameters (activeEngine, [this] (const char* paramID, float) { return tree.getRawParameterValue (paramID)->load(); });
     
-    activeEngine.updateBypassStates (leadBypass->get(), harmonyBypass->get());
-
-    activeEngine.updateInputGain (juce::Decibels::decibelsToGain (inputGain->get()));
-    activeEngine.updateOutputGain (juce::Decibels::decibelsToGain (outputGain->get()));
-    activeEngine.updateDryVoxPan (dryPan->get());
-    activeEngine.updateDryWet (dryWet->get());
-    activeEngine.updateAdsr (adsrAttack->get(), adsrDecay->get(), adsrSustain->get(), adsrRelease->get(), adsrToggle->get());
-    activeEngine.updateStereoWidth (stereoWidth->get(), lowestPanned->get());
-    activeEngine.updateMidiVelocitySensitivity (velocitySens->get());
-    activeEngine.updatePitchbendRange (pitchBendRange->get());
-    activeEngine.updatePedalPitch (pedalPitchIsOn->get(), pedalPitchThresh->get(), pedalPitchInterval->get());
-    activeEngine.updateDescant (descantIsOn->get(), descantThresh->get(), descantInterval->get());
-    activeEngine.updateConcertPitch (concertPitchHz->get());
-    activeEngine.updateNoteStealing (voiceStealing->get());
-    activeEngine.updateAftertouchGainOnOff (aftertouchGainToggle->get());
-    activeEngine.setModulatorSource (inputSource->get());
-    activeEngine.updateLimiter (limiterToggle->get());
-    activeEngine.updateNoiseGate (noiseGateThreshold->get(), noiseGateToggle->get());
-    activeEngine.updateDeEsser (deEsserAmount->get(), deEsserThresh->get(), deEsserToggle->get());
-
-    updateCompressor (activeEngine, compressorToggle->get(), compressorAmount->get());
-
-    activeEngine.updateReverb (reverbDryWet->get(), reverbDecay->get(), reverbDuck->get(),
-                               reverbLoCut->get(), reverbHiCut->get(), reverbToggle->get());
+    setLatencySamples (activeEngine.reportLatency());
 }
 
 
-// reads all available messages from the FIFO queue, and processes the most recent of each type.
-template<typename SampleType>
-void ImogenAudioProcessor::processQueuedParameterChanges (bav::ImogenEngine<SampleType>& activeEngine)
+// reads all available messages from the FIFO queue, and applies each changed parameter -- or group of related parameters -- once, using its current value.
+// when nothing has changed since the last block, this costs one queue read & one atomic exchange. numSamples is the length of the host block about to be processed.
+template<typename SampleType, typename HarmonySampleType>
+void ImogenAudioProcessor::processQueuedParameterChanges (bav::ImogenEngine<SampleType, HarmonySampleType>& activeEngine, const int numSamples)
 {
     paramChanges.getReadyMessages (currentMessages, true);
     
-    bool adsr = false;
-    float adsrA = adsrAttack->get(), adsrD = adsrDecay->get(), adsrS = adsrSustain->get(), adsrR = adsrRelease->get();
-    bool adsrT = adsrToggle->get();
+    juce::uint64 changedFromQueue = 0;
     
-    bool reverb = false;
-    int rDryWet = reverbDryWet->get();
-    float rDecay = reverbDecay->get(), rDuck = reverbDuck->get(), rLoCut = reverbLoCut->get(), rHiCut = reverbHiCut->get();
-    bool rToggle = reverbToggle->get();
+    for (const auto msg : currentMessages)
+        if (msg.isValid() && msg.type() >= 0 && msg.type() < IMGN_NUM_PARAMS)
+            changedFromQueue |= parameterBit (parameterID (msg.type()));
     
-    // converts a message's raw normalized value to its actual float value using the normalisable range of the selected parameter p
-#define _FLOAT_MSG getParameterPntr(parameterID(type))->denormalize (value)
+    if (changedFromQueue != 0)
+        dirtyParameters.fetch_or (changedFromQueue, std::memory_order_acq_rel);
     
-    // converts a message's raw normalized value to its actual integer value using the normalisable range of the selected parameter p
-#define _INT_MSG juce::roundToInt (_FLOAT_MSG)
+    const auto dirty = dirtyParameters.exchange (0, std::memory_order_acq_rel);
     
-    // converts a message's raw normalized value to its actual boolean true/false value
-#define _BOOL_MSG value >= 0.5f
+    if (dirty == 0)
+        return;
     
-    for (const auto msg : currentMessages)
-    {
-        if (! msg.isValid())
-            continue;
-        
-        const float value = msg.value();
-        
-        jassert (value >= 0.0f && value <= 1.0f);
-        
-        const int type = msg.type();
-        
-        switch (type)
-        {
-            default:             continue;
-            case (mainBypassID): continue;
-            case (leadBypassID):     activeEngine.updateBypassStates (_BOOL_MSG, harmonyBypass->get());
-            case (harmonyBypassID):  activeEngine.updateBypassStates (leadBypass->get(), _BOOL_MSG);
-            case (inputSourceID):    activeEngine.setModulatorSource (_INT_MSG);
-            case (numVoicesID):      updateNumVoices (_INT_MSG);
-            case (dryPanID):         activeEngine.updateDryVoxPan (_INT_MSG);
-            case (dryWetID):         activeEngine.updateDryWet (_INT_MSG);
-            case (stereoWidthID):    activeEngine.updateStereoWidth (_INT_MSG, lowestPanned->get());
-            case (lowestPannedID):   activeEngine.updateStereoWidth (stereoWidth->get(), _INT_MSG);
-            case (velocitySensID):   activeEngine.updateMidiVelocitySensitivity (_INT_MSG);
-            case (pitchBendRangeID): activeEngine.updatePitchbendRange (_INT_MSG);
-            case (concertPitchHzID):        activeEngine.updateConcertPitch (_INT_MSG);
-            case (voiceStealingID):         activeEngine.updateNoteStealing (_BOOL_MSG);
-            case (inputGainID):             activeEngine.updateInputGain (juce::Decibels::decibelsToGain (_FLOAT_MSG));
-            case (outputGainID):            activeEngine.updateOutputGain (juce::Decibels::decibelsToGain (_FLOAT_MSG));
-            case (limiterToggleID):         activeEngine.updateLimiter (_BOOL_MSG);
-            case (noiseGateToggleID):       activeEngine.updateNoiseGate (noiseGateThreshold->get(), _BOOL_MSG);
-            case (noiseGateThresholdID):    activeEngine.updateNoiseGate (_FLOAT_MSG, noiseGateToggle->get());
-            case (compressorToggleID):      updateCompressor (activeEngine, _BOOL_MSG, compressorAmount->get());
-            case (compressorAmountID):      updateCompressor (activeEngine, compressorToggle->get(), _FLOAT_MSG);
-            case (vocalRangeTypeID):        updateVocalRangeType (_INT_MSG);
-            case (aftertouchGainToggleID):  activeEngine.updateAftertouchGainOnOff (_BOOL_MSG);
-                
-            case (pedalPitchIsOnID):     activeEngine.updatePedalPitch (_BOOL_MSG, pedalPitchThresh->get(), pedalPitchInterval->get());
-            case (pedalPitchThreshID):   activeEngine.updatePedalPitch (pedalPitchIsOn->get(), _INT_MSG, pedalPitchInterval->get());
-            case (pedalPitchIntervalID): activeEngine.updatePedalPitch (pedalPitchIsOn->get(), pedalPitchThresh->get(), _INT_MSG);
-                
-            case (descantIsOnID):     activeEngine.updateDescant (_BOOL_MSG, descantThresh->get(), descantInterval->get());
-            case (descantThreshID):   activeEngine.updateDescant (descantIsOn->get(), _INT_MSG, descantInterval->get());
-            case (descantIntervalID): activeEngine.updateDescant (descantIsOn->get(), descantThresh->get(), _INT_MSG);
-                
-            case (deEsserToggleID):   activeEngine.updateDeEsser (deEsserAmount->get(), deEsserThresh->get(), _BOOL_MSG);
-            case (deEsserThreshID):   activeEngine.updateDeEsser (deEsserAmount->get(), _FLOAT_MSG, deEsserToggle->get());
-            case (deEsserAmountID):   activeEngine.updateDeEsser (_FLOAT_MSG, deEsserThresh->get(), deEsserToggle->get());
-                
-            case (reverbToggleID): rToggle = _BOOL_MSG;   reverb = true;
-            case (reverbDryWetID): rDryWet = _INT_MSG;    reverb = true;
-            case (reverbDecayID):  rDecay  = _FLOAT_MSG;  reverb = true;
-            case (reverbDuckID):   rDuck   = _FLOAT_MSG;  reverb = true;
-            case (reverbLoCutID):  rLoCut  = _FLOAT_MSG;  reverb = true;
-            case (reverbHiCutID):  rHiCut  = _FLOAT_MSG;  reverb = true;
-                
-            case (adsrAttackID):  adsrA = _FLOAT_MSG;     adsr = true;
-            case (adsrDecayID):   adsrD = _FLOAT_MSG;     adsr = true;
-            case (adsrSustainID): adsrS = _FLOAT_MSG;     adsr = true;
-            case (adsrReleaseID): adsrR = _FLOAT_MSG;     adsr = true;
-            case (adsrToggleID):  adsrT = _BOOL_MSG;      adsr = true;
-        }
-    }
+    if (traceRecorder.isRecording())
+        for (int param = 0; param < IMGN_NUM_PARAMS; ++param)
+            if ((dirty & parameterBit (parameterID (param))) != 0)
+                traceRecorder.addInstant ("Parameter", param, getNormalizedCurrentParameterValue (parameterID (param)));
+    
+    auto changed = [dirty] (const juce::uint64 mask) { return (dirty & mask) != 0; };
+    
+    // these are left to the message thread (see timerCallback()). Mixed precision & incremental pitch tracking are only read when the host next prepares (see prepareToPlay())
+    const auto structuralChanges = dirty & (parameterBit (vocalRangeTypeID) | parameterBit (pipelinedAnalysisID) | parameterBit (multithreadedRenderingID) | parameterBit (numSingersID));
+    
+    if (structuralChanges != 0)
+        pendingStructuralChanges.fetch_or (structuralChanges, std::memory_order_acq_rel);
+    
+    if (changed (parameterBit (numVoicesID)))
+        activeEngine.updateNumVoices (numVoices->get());
+    
+    if (changed (parameterBit (leadBypassID) | parameterBit (harmonyBypassID)))
+        activeEngine.updateBypassStates (leadBypass->get(), harmonyBypass->get());
+    
+    if (changed (parameterBit (inputSourceID)))
+        activeEngine.setModulatorSource (inputSource->get());
     
-    if (adsr)
-        activeEngine.updateAdsr (adsrA, adsrD, adsrS, adsrR, adsrT);
+    // JUCE doesn't tell us where in the host block a parameter changed, so these ramp from their previous values to their new ones across the whole host block.
+    // The engine places each step of the ramp on its own sample of its internal blocks, instead of jumping at the start of the next internal block.
+    using Engine = bav::ImogenEngine<SampleType, HarmonySampleType>;
     
-    if (reverb)
-        activeEngine.updateReverb (rDryWet, rDecay, rDuck, rLoCut, rHiCut, rToggle);
+    if (changed (parameterBit (inputGainID)))
+        activeEngine.queueAutomationRamp (Engine::automatedInputGain, juce::Decibels::decibelsToGain (inputGain->get()), numSamples);
+    
+    if (changed (parameterBit (outputGainID)))
+        activeEngine.queueAutomationRamp (Engine::automatedOutputGain, juce::Decibels::decibelsToGain (outputGain->get()), numSamples);
+    
+    if (changed (parameterBit (dryPanID)))
+        activeEngine.queueAutomationRamp (Engine::automatedDryPan, float (dryPan->get()), numSamples);
+    
+    if (changed (parameterBit (dryWetID)))
+        activeEngine.queueAutomationRamp (Engine::automatedDryWet, float (dryWet->get()), numSamples);
+    
+    if (changed (parameterBit (adsrAttackID) | parameterBit (adsrDecayID) | parameterBit (adsrSustainID) | parameterBit (adsrReleaseID) | parameterBit (adsrToggleID)))
+        activeEngine.updateAdsr (adsrAttack->get(), adsrDecay->get(), adsrSustain->get(), adsrRelease->get(), adsrToggle->get());
+    
+    if (changed (parameterBit (stereoWidthID) | parameterBit (lowestPannedID)))
+        activeEngine.updateStereoWidth (stereoWidth->get(), lowestPanned->get());
+    
+    if (changed (parameterBit (velocitySensID)))
+        activeEngine.updateMidiVelocitySensitivity (velocitySens->get());
+    
+    if (changed (parameterBit (pitchBendRangeID)))
+        activeEngine.updatePitchbendRange (pitchBendRange->get());
+    
+    if (changed (parameterBit (pedalPitchIsOnID) | parameterBit (pedalPitchThreshID) | parameterBit (pedalPitchIntervalID)))
+        activeEngine.updatePedalPitch (pedalPitchIsOn->get(), pedalPitchThresh->get(), pedalPitchInterval->get());
+    
+    if (changed (parameterBit (descantIsOnID) | parameterBit (descantThreshID) | parameterBit (descantIntervalID)))
+        activeEngine.updateDescant (descantIsOn->get(), descantThresh->get(), descantInterval->get());
+    
+    if (changed (parameterBit (concertPitchHzID)))
+        activeEngine.updateConcertPitch (concertPitchHz->get());
+    
+    if (changed (parameterBit (voiceStealingID)))
+        activeEngine.updateNoteStealing (voiceStealing->get());
+    
+    if (changed (parameterBit (aftertouchGainToggleID)))
+        activeEngine.updateAftertouchGainOnOff (aftertouchGainToggle->get());
+    
+    if (changed (parameterBit (limiterToggleID)))
+        activeEngine.updateLimiter (limiterToggle->get());
+    
+    if (changed (parameterBit (noiseGateToggleID) | parameterBit (noiseGateThresholdID)))
+        activeEngine.updateNoiseGate (noiseGateThreshold->get(), noiseGateToggle->get());
+    
+    if (changed (parameterBit (compressorToggleID) | parameterBit (compressorAmountID)))
+        bav::applyCompressorAmount (activeEngine, compressorToggle->get(), compressorAmount->get());
+    
+    if (changed (parameterBit (deEsserToggleID) | parameterBit (deEsserThreshID) | parameterBit (deEsserAmountID)))
+        activeEngine.updateDeEsser (deEsserAmount->get(), deEsserThresh->get(), deEsserToggle->get());
+    
+    if (changed (parameterBit (reverbToggleID) | parameterBit (reverbDryWetID) | parameterBit (reverbDecayID)
+                 | parameterBit (reverbDuckID) | parameterBit (reverbLoCutID) | parameterBit (reverbHiCutID)))
+        activeEngine.updateReverb (reverbDryWet->get(), reverbDecay->get(), reverbDuck->get(),
+                                   reverbLoCut->get(), reverbHiCut->get(), reverbToggle->get());
 }
 ///function template instantiations...
-template void ImogenAudioProcessor::processQueuedParameterChanges (bav::ImogenEngine<float>& activeEngine);
-template void ImogenAudioProcessor::processQueuedParameterChanges (bav::ImogenEngine<double>& activeEngine);
+template void ImogenAudioProcessor::processQueuedParameterChanges (bav::ImogenEngine<float>& activeEngine, const int numSamples);
+template void ImogenAudioProcessor::processQueuedParameterChanges (bav::ImogenEngine<double>& activeEngine, const int numSamples);
+template void ImogenAudioProcessor::processQueuedParameterChanges (bav::ImogenEngine<double, float>& activeEngine, const int numSamples);
 
-#undef _FLOAT_MSG
-#undef _INT_MSG
-#undef _BOOL_MSG
 
-
-template<typename SampleType>
-void ImogenAudioProcessor::processQueuedNonParamEvents (bav::ImogenEngine<SampleType>& activeEngine)
+template<typename SampleType, typename HarmonySampleType>
+void ImogenAudioProcessor::processQueuedNonParamEvents (bav::ImogenEngine<SampleType, HarmonySampleType>& activeEngine)
 {
     nonParamEvents.getReadyMessages (currentMessages, true);
     
@@ -407,15 +375,16 @@ void ImogenAudioProcessor::processQueuedNonParamEvents (bav::ImogenEngine<Sample
         switch (msg.type())
         {
             default: continue;
-            case (killAllMidi): activeEngine.killAllMidi();  // any message of this type triggers this, regardless of its value
-            case (midiLatch):   activeEngine.updateMidiLatch (value >= 0.5f);
-            case (pitchBendFromEditor): activeEngine.recieveExternalPitchbend (juce::roundToInt (pitchbendNormalizedRange.convertFrom0to1 (value)));
+            case (killAllMidi): activeEngine.killAllMidi();  break;  // any message of this type triggers this, regardless of its value
+            case (midiLatch):   activeEngine.updateMidiLatch (value >= 0.5f);  break;
+            case (pitchBendFromEditor): activeEngine.recieveExternalPitchbend (juce::roundToInt (pitchbendNormalizedRange.convertFrom0to1 (value)));  break;
         }
     }
 }
 ///function template instantiations...
 template void ImogenAudioProcessor::processQueuedNonParamEvents (bav::ImogenEngine<float>& activeEngine);
 template void ImogenAudioProcessor::processQueuedNonParamEvents (bav::ImogenEngine<double>& activeEngine);
+template void ImogenAudioProcessor::processQueuedNonParamEvents (bav::ImogenEngine<double, float>& activeEngine);
 
 
 /*===========================================================================================================================
@@ -501,53 +470,60 @@ juce::AudioProcessorValueTreeState::ParameterLayout ImogenAudioProcessor::create
 {
     std::vector<std::unique_ptr<juce::RangedAudioParameter>> params;
     
+    using Defaults = bav::ImogenParameterDefaults;
+    
     juce::NormalisableRange<float> gainRange (-60.0f, 0.0f, 0.01f);
     juce::NormalisableRange<float> zeroToOneRange (0.0f, 1.0f, 0.01f);
     juce::NormalisableRange<float> msRange (0.001f, 1.0f, 0.001f);
     juce::NormalisableRange<float> hzRange (40.0f, 10000.0f, 1.0f);
     
-    params.emplace_back (std::make_unique<BoolParameter>  ("mainBypass", "Bypass", false));
-    params.emplace_back (std::make_unique<BoolParameter>  ("leadBypass", "Lead bypass", false));
-    params.emplace_back (std::make_unique<BoolParameter>  ("harmonyBypass", "Harmony bypass", false));
-    params.emplace_back (std::make_unique<IntParameter>   ("numVoices", "Number of voices", 1, 20, 12));
-    params.emplace_back (std::make_unique<IntParameter>   ("inputSource", "Input source", 1, 3, 1));
-    params.emplace_back (std::make_unique<IntParameter>   ("dryPan", "Dry vox pan", 0, 127, 64));
-    params.emplace_back (std::make_unique<FloatParameter> ("adsrAttack", "ADSR Attack", msRange, 0.35f));
-    params.emplace_back (std::make_unique<FloatParameter> ("adsrDecay", "ADSR Decay", msRange, 0.06f));
-    params.emplace_back (std::make_unique<FloatParameter> ("adsrSustain", "ADSR Sustain", zeroToOneRange, 0.8f));
-    params.emplace_back (std::make_unique<FloatParameter> ("adsrRelease", "ADSR Release", msRange, 0.1f));
-    params.emplace_back (std::make_unique<BoolParameter>  ("adsrOnOff", "ADSR on/off", true));
-    params.emplace_back (std::make_unique<IntParameter>   ("stereoWidth", "Stereo Width", 0, 100, 100));
-    params.emplace_back (std::make_unique<IntParameter>   ("lowestPan", "Lowest panned midiPitch", 0, 127, 0));
-    params.emplace_back (std::make_unique<IntParameter>   ("midiVelocitySens", "MIDI Velocity Sensitivity", 0, 100, 100));
-    params.emplace_back (std::make_unique<IntParameter>   ("PitchBendRange", "Pitch bend range (st)", 0, 12, 2));
-    params.emplace_back (std::make_unique<IntParameter>   ("concertPitch", "Concert pitch (Hz)", 392, 494, 440));
-    params.emplace_back (std::make_unique<BoolParameter>  ("voiceStealing", "Voice stealing", false));
-    params.emplace_back (std::make_unique<BoolParameter>  ("aftertouchGainToggle", "Aftertouch gain on/off", true));
-    params.emplace_back (std::make_unique<BoolParameter>  ("pedalPitchToggle", "Pedal pitch on/off", false));
-    params.emplace_back (std::make_unique<IntParameter>   ("pedalPitchThresh", "Pedal pitch upper threshold", 0, 127, 0));
-    params.emplace_back (std::make_unique<IntParameter>   ("pedalPitchInterval", "Pedal pitch interval", 1, 12, 12));
-    params.emplace_back (std::make_unique<BoolParameter>  ("descantToggle", "Descant on/off", false));
-    params.emplace_back (std::make_unique<IntParameter>   ("descantThresh", "Descant lower threshold", 0, 127, 127));
-    params.emplace_back (std::make_unique<IntParameter>   ("descantInterval", "Descant interval", 1, 12, 12));
-    params.emplace_back (std::make_unique<IntParameter>   ("masterDryWet", "% wet", 0, 100, 100));
-    params.emplace_back (std::make_unique<FloatParameter> ("inputGain", "Input gain",   gainRange, 0.0f));
-    params.emplace_back (std::make_unique<FloatParameter> ("outputGain", "Output gain", gainRange, -4.0f));
-    params.emplace_back (std::make_unique<BoolParameter>  ("limiterIsOn", "Limiter on/off", true));
-    params.emplace_back (std::make_unique<BoolParameter>  ("noiseGateIsOn", "Noise gate toggle", true));
-    params.emplace_back (std::make_unique<FloatParameter> ("noiseGateThresh", "Noise gate threshold", gainRange, -20.0f));
-    params.emplace_back (std::make_unique<BoolParameter>  ("deEsserIsOn", "De-esser toggle", true));
-    params.emplace_back (std::make_unique<FloatParameter> ("deEsserThresh", "De-esser thresh", gainRange, -6.0f));
-    params.emplace_back (std::make_unique<FloatParameter> ("deEsserAmount", "De-esser amount", zeroToOneRange, 0.5f));
-    params.emplace_back (std::make_unique<BoolParameter>  ("compressorToggle", "Compressor on/off", false));
-    params.emplace_back (std::make_unique<FloatParameter> ("compressorAmount", "Compressor amount", zeroToOneRange, 0.35f));
-    params.emplace_back (std::make_unique<BoolParameter>  ("reverbIsOn", "Reverb toggle", false));
-    params.emplace_back (std::make_unique<IntParameter>   ("reverbDryWet", "Reverb dry/wet", 0, 100, 35));
-    params.emplace_back (std::make_unique<FloatParameter> ("reverbDecay", "Reverb decay", zeroToOneRange, 0.6f));
-    params.emplace_back (std::make_unique<FloatParameter> ("reverbDuck", "Duck amount", zeroToOneRange, 0.3f));
-    params.emplace_back (std::make_unique<FloatParameter> ("reverbLoCut", "Reverb low cut", hzRange, 80.0f));
-    params.emplace_back (std::make_unique<FloatParameter> ("reverbHiCut", "Reverb high cut", hzRange, 5500.0f));
-    params.emplace_back (std::make_unique<IntParameter>   ("vocalRangeType", "Input vocal range", 0, 3, 0));
+    params.emplace_back (std::make_unique<BoolParameter>  ("mainBypass", "Bypass", Defaults::mainBypass));
+    params.emplace_back (std::make_unique<BoolParameter>  ("leadBypass", "Lead bypass", Defaults::leadBypass));
+    params.emplace_back (std::make_unique<BoolParameter>  ("harmonyBypass", "Harmony bypass", Defaults::harmonyBypass));
+    params.emplace_back (std::make_unique<IntParameter>   ("numVoices", "Number of voices", 1, bvie_MAX_POSSIBLE_NUM_VOICES, Defaults::numVoices));
+    params.emplace_back (std::make_unique<IntParameter>   ("inputSource", "Input source", 1, 3, Defaults::inputSource));
+    params.emplace_back (std::make_unique<IntParameter>   ("dryPan", "Dry vox pan", 0, 127, Defaults::dryPan));
+    params.emplace_back (std::make_unique<FloatParameter> ("adsrAttack", "ADSR Attack", msRange, Defaults::adsrAttack));
+    params.emplace_back (std::make_unique<FloatParameter> ("adsrDecay", "ADSR Decay", msRange, Defaults::adsrDecay));
+    params.emplace_back (std::make_unique<FloatParameter> ("adsrSustain", "ADSR Sustain", zeroToOneRange, Defaults::adsrSustain));
+    params.emplace_back (std::make_unique<FloatParameter> ("adsrRelease", "ADSR Release", msRange, Defaults::adsrRelease));
+    params.emplace_back (std::make_unique<BoolParameter>  ("adsrOnOff", "ADSR on/off", Defaults::adsrOnOff));
+    params.emplace_back (std::make_unique<IntParameter>   ("stereoWidth", "Stereo Width", 0, 100, Defaults::stereoWidth));
+    params.emplace_back (std::make_unique<IntParameter>   ("lowestPan", "Lowest panned midiPitch", 0, 127, Defaults::lowestPan));
+    params.emplace_back (std::make_unique<IntParameter>   ("midiVelocitySens", "MIDI Velocity Sensitivity", 0, 100, Defaults::midiVelocitySens));
+    params.emplace_back (std::make_unique<IntParameter>   ("PitchBendRange", "Pitch bend range (st)", 0, 12, Defaults::pitchBendRange));
+    params.emplace_back (std::make_unique<IntParameter>   ("concertPitch", "Concert pitch (Hz)", 392, 494, Defaults::concertPitch));
+    params.emplace_back (std::make_unique<BoolParameter>  ("voiceStealing", "Voice stealing", Defaults::voiceStealing));
+    params.emplace_back (std::make_unique<BoolParameter>  ("aftertouchGainToggle", "Aftertouch gain on/off", Defaults::aftertouchGainToggle));
+    params.emplace_back (std::make_unique<BoolParameter>  ("pedalPitchToggle", "Pedal pitch on/off", Defaults::pedalPitchToggle));
+    params.emplace_back (std::make_unique<IntParameter>   ("pedalPitchThresh", "Pedal pitch upper threshold", 0, 127, Defaults::pedalPitchThresh));
+    params.emplace_back (std::make_unique<IntParameter>   ("pedalPitchInterval", "Pedal pitch interval", 1, 12, Defaults::pedalPitchInterval));
+    params.emplace_back (std::make_unique<BoolParameter>  ("descantToggle", "Descant on/off", Defaults::descantToggle));
+    params.emplace_back (std::make_unique<IntParameter>   ("descantThresh", "Descant lower threshold", 0, 127, Defaults::descantThresh));
+    params.emplace_back (std::make_unique<IntParameter>   ("descantInterval", "Descant interval", 1, 12, Defaults::descantInterval));
+    params.emplace_back (std::make_unique<IntParameter>   ("masterDryWet", "% wet", 0, 100, Defaults::masterDryWet));
+    params.emplace_back (std::make_unique<FloatParameter> ("inputGain", "Input gain",   gainRange, Defaults::inputGain));
+    params.emplace_back (std::make_unique<FloatParameter> ("outputGain", "Output gain", gainRange, Defaults::outputGain));
+    params.emplace_back (std::make_unique<BoolParameter>  ("limiterIsOn", "Limiter on/off", Defaults::limiterIsOn));
+    params.emplace_back (std::make_unique<BoolParameter>  ("noiseGateIsOn", "Noise gate toggle", Defaults::noiseGateIsOn));
+    params.emplace_back (std::make_unique<FloatParameter> ("noiseGateThresh", "Noise gate threshold", gainRange, Defaults::noiseGateThresh));
+    params.emplace_back (std::make_unique<BoolParameter>  ("deEsserIsOn", "De-esser toggle", Defaults::deEsserIsOn));
+    params.emplace_back (std::make_unique<FloatParameter> ("deEsserThresh", "De-esser thresh", gainRange, Defaults::deEsserThresh));
+    params.emplace_back (std::make_unique<FloatParameter> ("deEsserAmount", "De-esser amount", zeroToOneRange, Defaults::deEsserAmount));
+    params.emplace_back (std::make_unique<BoolParameter>  ("compressorToggle", "Compressor on/off", Defaults::compressorToggle));
+    params.emplace_back (std::make_unique<FloatParameter> ("compressorAmount", "Compressor amount", zeroToOneRange, Defaults::compressorAmount));
+    params.emplace_back (std::make_unique<BoolParameter>  ("reverbIsOn", "Reverb toggle", Defaults::reverbIsOn));
+    params.emplace_back (std::make_unique<IntParameter>   ("reverbDryWet", "Reverb dry/wet", 0, 100, Defaults::reverbDryWet));
+    params.emplace_back (std::make_unique<FloatParameter> ("reverbDecay", "Reverb decay", zeroToOneRange, Defaults::reverbDecay));
+    params.emplace_back (std::make_unique<FloatParameter> ("reverbDuck", "Duck amount", zeroToOneRange, Defaults::reverbDuck));
+    params.emplace_back (std::make_unique<FloatParameter> ("reverbLoCut", "Reverb low cut", hzRange, Defaults::reverbLoCut));
+    params.emplace_back (std::make_unique<FloatParameter> ("reverbHiCut", "Reverb high cut", hzRange, Defaults::reverbHiCut));
+    params.emplace_back (std::make_unique<IntParameter>   ("vocalRangeType", "Input vocal range", 0, 3, Defaults::vocalRangeType));
+    params.emplace_back (std::make_unique<NonAutomatableBoolParameter> ("pipelinedAnalysis", "Pipelined analysis", Defaults::pipelinedAnalysis));
+    params.emplace_back (std::make_unique<NonAutomatableBoolParameter> ("multithreadedRendering", "Multithreaded rendering", Defaults::multithreadedRendering));
+    params.emplace_back (std::make_unique<NonAutomatableIntParameter>  ("numSingers", "Number of singers", 1, bvie_MAX_NUM_SINGERS, Defaults::numSingers));
+    params.emplace_back (std::make_unique<NonAutomatableBoolParameter> ("mixedPrecision", "Mixed precision", Defaults::mixedPrecision));
+    params.emplace_back (std::make_unique<NonAutomatableBoolParameter> ("incrementalPitchTracking", "Low latency pitch tracking", Defaults::incrementalPitchTracking));
     
     return { params.begin(), params.end() };
 }
@@ -598,6 +574,11 @@ void ImogenAudioProcessor::initializeParameterPointers()
     reverbLoCut          = dynamic_cast<FloatParamPtr> (tree.getParameter ("reverbLoCut"));                  jassert (reverbLoCut);
     reverbHiCut          = dynamic_cast<FloatParamPtr> (tree.getParameter ("reverbHiCut"));                  jassert (reverbHiCut);
     vocalRangeType       = dynamic_cast<IntParamPtr>   (tree.getParameter ("vocalRangeType"));               jassert (vocalRangeType);
+    pipelinedAnalysis    = dynamic_cast<BoolParamPtr>  (tree.getParameter ("pipelinedAnalysis"));            jassert (pipelinedAnalysis);
+    multithreadedRendering = dynamic_cast<BoolParamPtr> (tree.getParameter ("multithreadedRendering"));      jassert (multithreadedRendering);
+    numSingers           = dynamic_cast<IntParamPtr>   (tree.getParameter ("numSingers"));                   jassert (numSingers);
+    mixedPrecision       = dynamic_cast<BoolParamPtr>  (tree.getParameter ("mixedPrecision"));               jassert (mixedPrecision);
+    incrementalPitchTracking = dynamic_cast<BoolParamPtr> (tree.getParameter ("incrementalPitchTracking"));  jassert (incrementalPitchTracking);
 }
 
 
@@ -648,6 +629,11 @@ void ImogenAudioProcessor::initializeParameterListeners()
     addParameterMessenger ("reverbDuck",            reverbDuckID);
     addParameterMessenger ("reverbLoCut",           reverbLoCutID);
     addParameterMessenger ("reverbHiCut",           reverbHiCutID);
+    addParameterMessenger ("pipelinedAnalysis",     pipelinedAnalysisID);
+    addParameterMessenger ("multithreadedRendering", multithreadedRenderingID);
+    addParameterMessenger ("numSingers",            numSingersID);
+    addParameterMessenger ("mixedPrecision",        mixedPrecisionID);
+    addParameterMessenger ("incrementalPitchTracking", incrementalPitchTrackingID);
 }
 
 
@@ -712,6 +698,11 @@ bav::Parameter* ImogenAudioProcessor::getParameterPntr (const parameterID paramI
         case (numVoicesID):             return numVoices;
         case (inputSourceID):           return inputSource;
         case (vocalRangeTypeID):        return vocalRangeType;
+        case (pipelinedAnalysisID):     return pipelinedAnalysis;
+        case (multithreadedRenderingID): return multithreadedRendering;
+        case (numSingersID):            return numSingers;
+        case (mixedPrecisionID):        return mixedPrecision;
+        case (incrementalPitchTrackingID): return incrementalPitchTracking;
         default:                        return nullptr;
     }
 }
@@ -0,0 +1,79 @@
+
+#include "catch2/catch.hpp"
+
+#include "bv_Harmonizer/bv_Harmonizer.h"
+
+
+// fills the buffer with a harmonically rich, slightly noisy waveform of the given period, roughly like a sung vowel
+template<typename SampleType>
+static void fillWithVoicedSignal (juce::AudioBuffer<SampleType>& buffer, int period)
+{
+    juce::Random rand (period);
+    
+    auto* writing = buffer.getWritePointer (0);
+    
+    for (int s = 0; s < buffer.getNumSamples(); ++s)
+    {
+        const auto phase = juce::MathConstants<double>::twoPi * s / period;
+        
+        writing[s] = SampleType (0.6 * std::sin (phase)
+                               + 0.3 * std::sin (2.0 * phase + 0.4)
+                               + 0.15 * std::sin (3.0 * phase + 1.1)
+                               + 0.05 * (rand.nextDouble() - 0.5));
+    }
+}
+
+
+// a hard-clipped version of the voiced signal. Runs of samples share the clipping level, and the weights are symmetric about the predicted peak,
+// so the weighted frames are full of exact ties without being flat
+template<typename SampleType>
+static void fillWithClippedSignal (juce::AudioBuffer<SampleType>& buffer, int period)
+{
+    fillWithVoicedSignal (buffer, period);
+    
+    auto* writing = buffer.getWritePointer (0);
+    
+    for (int s = 0; s < buffer.getNumSamples(); ++s)
+        writing[s] = juce::jlimit (SampleType(-0.25), SampleType(0.25), writing[s]);
+}
+
+
+TEST_CASE ("Single-pass peak search chooses the same grains as the iterative search", "[GrainExtractor]")
+{
+    constexpr int numSamples = 4096;
+    
+    juce::AudioBuffer<float> signal (1, numSamples);
+    
+    bav::GrainExtractor<float> singlePass, iterative;
+    singlePass.prepare (numSamples);
+    iterative.prepare (numSamples);
+    iterative.setUseSinglePassPeakSearch (false);
+    
+    juce::Array<int> expected, actual;
+    
+    for (int period : { 64, 150, 300, 550, 900, 1200 })
+    {
+        CAPTURE (period);
+        
+        fillWithVoicedSignal (signal, period);
+        
+        iterative.getGrainOnsetIndices (expected, signal, period);
+        singlePass.getGrainOnsetIndices (actual, signal, period);
+        
+        REQUIRE (expected == actual);
+        
+        fillWithClippedSignal (signal, period);  // many tied weighted samples, so this exercises the tie-breaking order
+        
+        iterative.getGrainOnsetIndices (expected, signal, period);
+        singlePass.getGrainOnsetIndices (actual, signal, period);
+        
+        REQUIRE (expected == actual);
+        
+        signal.clear();  // digital silence takes the flat frame shortcut, which both searches share
+        
+        iterative.getGrainOnsetIndices (expected, signal, period);
+        singlePass.getGrainOnsetIndices (actual, signal, period);
+        
+        REQUIRE (expected == actual);
+    }
+}
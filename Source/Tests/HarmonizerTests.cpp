@@ -4,20 +4,400 @@
 #include "bv_Harmonizer/bv_Harmonizer.h"
 
 
+// with this range the pitch detector's frame fits inside the 512-sample test blocks at 44.1 kHz, so every block gets a real pitch estimate
+constexpr int testMinHz = 200;
+constexpr int testMaxHz = 2400;
+
+
 TEST_CASE("Harmonizer MIDI is working correctly", "[Harmonizer][MIDI]")
 {
-    bav::Harmonizer testHarmonizer;
-    
-    for (int i = 0; i < 12; ++i)
-        harmonizer.addVoice (new HarmonizerVoice<SampleType>(&harmonizer));
+    bav::Harmonizer<float> testHarmonizer;
     
-    testHarmonizer.setCurrentPlaybackSampleRate (44100.0);
+    testHarmonizer.initialize (12, 44100.0, 512);
     testHarmonizer.prepare (512);
     
+    juce::Array<int> activeNotes;
+    
     SECTION("Turning on a single note")
     {
+        testHarmonizer.playChord ({ 60 }, 1.0f, false);
+        
+        testHarmonizer.reportActiveNotes (activeNotes);
+        REQUIRE (activeNotes.size() == 1);
+        REQUIRE (activeNotes.getFirst() == 60);
+        
         testHarmonizer.allNotesOff (false);
         
+        testHarmonizer.reportActiveNotes (activeNotes);
+        REQUIRE (activeNotes.isEmpty());
+    }
+}
+
+
+
+TEST_CASE ("Block rendering matches per-sample rendering", "[Harmonizer][HarmonizerVoice]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    
+    bav::Harmonizer<float> perSample, block;
+    
+    perSample.setUseBlockRendering (false);
+    
+    for (auto* harm : { &perSample, &block })
+    {
+        harm->initialize (12, samplerate, blocksize);
+        harm->updatePitchDetectionHzRange (testMinHz, testMaxHz);
+        harm->prepare (blocksize);
+        harm->playChord ({ 60, 64, 67, 71 }, 1.0f, false);
+    }
+    
+    juce::AudioBuffer<float> input (1, blocksize), perSampleOut (2, blocksize), blockOut (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    const auto phaseIncrement = juce::MathConstants<double>::twoPi * 440.0 / samplerate;
+    double phase = 0.0;
+    
+    for (int b = 0; b < 8; ++b)
+    {
+        for (int s = 0; s < blocksize; ++s)
+        {
+            input.setSample (0, s, static_cast<float> (std::sin (phase)));
+            phase += phaseIncrement;
+        }
+        
+        perSample.render (input, perSampleOut, midi);
+        block.render (input, blockOut, midi);
+        
+        for (int chan = 0; chan < 2; ++chan)
+            for (int s = 0; s < blocksize; ++s)
+                REQUIRE (blockOut.getSample (chan, s) == Approx (perSampleOut.getSample (chan, s)).margin (1.0e-5));
+    }
+}
+
+
+
+TEST_CASE ("Multithreaded rendering matches serial rendering", "[Harmonizer][HarmonizerVoice]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    
+    bav::Harmonizer<float> serial, multithreaded;
+    
+    multithreaded.setUseMultithreadedRendering (true);
+    
+    for (auto* harm : { &serial, &multithreaded })
+    {
+        harm->initialize (12, samplerate, blocksize);
+        harm->updatePitchDetectionHzRange (testMinHz, testMaxHz);
+        harm->prepare (blocksize);
+        harm->playChord ({ 55, 60, 64, 67, 71, 74 }, 1.0f, false);
+    }
+    
+    juce::AudioBuffer<float> input (1, blocksize), serialOut (2, blocksize), multithreadedOut (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    const auto phaseIncrement = juce::MathConstants<double>::twoPi * 440.0 / samplerate;
+    double phase = 0.0;
+    
+    for (int b = 0; b < 16; ++b)
+    {
+        for (int s = 0; s < blocksize; ++s)
+        {
+            input.setSample (0, s, static_cast<float> (std::sin (phase)));
+            phase += phaseIncrement;
+        }
+        
+        // change the chord partway through, & change notes partway through a block, so that the block is rendered in several spans
+        if (b == 8)
+            for (auto* harm : { &serial, &multithreaded })
+                harm->playChord ({ 57, 62, 65, 69 }, 1.0f, false);
+        
+        midi.clear();
+        
+        if (b == 12)
+        {
+            midi.addEvent (juce::MidiMessage::noteOff (1, 57), 200);
+            midi.addEvent (juce::MidiMessage::noteOn (1, 76, 1.0f), 200);
+        }
+        
+        auto serialMidi = midi;
+        serial.render (input, serialOut, serialMidi);
+        multithreaded.render (input, multithreadedOut, midi);
+        
+        for (int chan = 0; chan < 2; ++chan)
+            for (int s = 0; s < blocksize; ++s)
+                REQUIRE (multithreadedOut.getSample (chan, s) == serialOut.getSample (chan, s));
+    }
+}
+
+
+
+TEST_CASE ("Pipelined analysis delays the serial output by one block", "[Harmonizer]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    constexpr int numBlocks = 8;
+    
+    bav::Harmonizer<float> serial, pipelined;
+    
+    pipelined.setUsePipelinedAnalysis (true);
+    pipelined.setNonRealtime (true);  // so that a late analysis is waited for, rather than replaced
+    
+    for (auto* harm : { &serial, &pipelined })
+    {
+        harm->initialize (12, samplerate, blocksize);
+        harm->updatePitchDetectionHzRange (testMinHz, testMaxHz);
+        harm->prepare (blocksize);
+        harm->setADSRonOff (false);
+        harm->playChord ({ 60, 64, 67 }, 1.0f, false);
+    }
+    
+    REQUIRE (serial.getPipelineLatencySamples() == 0);
+    REQUIRE (pipelined.getPipelineLatencySamples() == blocksize);
+    
+    juce::AudioBuffer<float> input (1, blocksize), pipelinedOut (2, blocksize);
+    juce::AudioBuffer<float> serialOut (2, blocksize * numBlocks);
+    juce::MidiBuffer midi;
+    
+    const auto phaseIncrement = juce::MathConstants<double>::twoPi * 440.0 / samplerate;
+    double phase = 0.0;
+    
+    for (int b = 0; b < numBlocks; ++b)
+    {
+        for (int s = 0; s < blocksize; ++s)
+        {
+            input.setSample (0, s, static_cast<float> (std::sin (phase)));
+            phase += phaseIncrement;
+        }
+        
+        juce::AudioBuffer<float> serialBlock (serialOut.getArrayOfWritePointers(), 2, b * blocksize, blocksize);
+        serial.render (input, serialBlock, midi);
+        
+        pipelined.render (input, pipelinedOut, midi);
+        
+        for (int chan = 0; chan < 2; ++chan)
+        {
+            for (int s = 0; s < blocksize; ++s)
+            {
+                if (b == 0)
+                    REQUIRE (pipelinedOut.getSample (chan, s) == 0.0f);
+                else
+                    REQUIRE (pipelinedOut.getSample (chan, s) == Approx (serialOut.getSample (chan, (b - 1) * blocksize + s)).margin (1.0e-5));
+            }
+        }
+    }
+}
+
+
+
+TEST_CASE ("Pipelined analysis delays MIDI along with the audio", "[Harmonizer][MIDI]")
+{
+    constexpr int blocksize = 512;
+    
+    bav::Harmonizer<float> pipelined;
+    pipelined.setUsePipelinedAnalysis (true);
+    pipelined.initialize (12, 44100.0, blocksize);
+    pipelined.updatePitchDetectionHzRange (testMinHz, testMaxHz);
+    pipelined.prepare (blocksize);
+    
+    juce::AudioBuffer<float> input (1, blocksize), output (2, blocksize);
+    input.clear();
+    
+    juce::MidiBuffer midi;
+    juce::Array<int> activeNotes;
+    
+    // the note arrives with the first block, which has nothing to render yet
+    midi.addEvent (juce::MidiMessage::noteOn (1, 60, 1.0f), 0);
+    pipelined.render (input, output, midi);
+    
+    pipelined.reportActiveNotes (activeNotes);
+    REQUIRE (activeNotes.isEmpty());
+    
+    // ...so it starts in the next one, together with the audio it was played over
+    midi.clear();
+    pipelined.render (input, output, midi);
+    
+    pipelined.reportActiveNotes (activeNotes);
+    REQUIRE (activeNotes.size() == 1);
+    REQUIRE (activeNotes.getFirst() == 60);
+}
+
+
+
+TEST_CASE ("Incremental pitch tracking decouples the latency from the analysis window", "[Harmonizer]")
+{
+    constexpr int blocksize = 256;
+    constexpr double samplerate = 44100.0;
+    
+    bav::Harmonizer<float> harmonizer;
+    harmonizer.setUseIncrementalPitchTracking (true, blocksize, 64);
+    harmonizer.initialize (4, samplerate, blocksize);
+    harmonizer.updatePitchDetectionHzRange (80, 2400);
+    harmonizer.prepare (blocksize);
+    harmonizer.playChord ({ 60, 64, 67 }, 1.0f, false);
+    
+    // an 80 Hz period alone is longer than the internal blocksize
+    REQUIRE (harmonizer.getLatencySamples() == blocksize);
+    
+    juce::AudioBuffer<float> input (1, blocksize), output (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    // an upward glide, so the period keeps changing
+    double phase = 0.0, frequency = 196.0;
+    bool periodChangedWithinABlock = false;
+    
+    for (int b = 0; b < 160; ++b)
+    {
+        for (int s = 0; s < blocksize; ++s)
+        {
+            input.setSample (0, s, static_cast<float> (std::sin (phase)));
+            phase += juce::MathConstants<double>::twoPi * frequency / samplerate;
+            frequency *= 1.00001;
+        }
+        
+        harmonizer.render (input, output, midi);
+        
+        if (b > 20)
+        {
+            REQUIRE (harmonizer.getPeriodAt (blocksize - 1) == harmonizer.getCurrentPeriod());
+            REQUIRE (harmonizer.getCurrentPeriod() == Approx (samplerate / frequency).epsilon (0.05));
+            
+            if (harmonizer.getPeriodAt (0) != harmonizer.getPeriodAt (blocksize - 1))
+                periodChangedWithinABlock = true;
+        }
     }
     
-};
+    REQUIRE (periodChangedWithinABlock);
+}
+
+
+
+TEST_CASE ("Incremental pitch tracking centres its grains on the input's peaks", "[Harmonizer][GrainExtractor]")
+{
+    constexpr int blocksize = 256;
+    constexpr double samplerate = 44100.0;
+    constexpr double frequency = 300.0;  // a period of exactly 147 samples, so each grain is longer than a block
+    
+    bav::Harmonizer<float> harmonizer;
+    harmonizer.setUseIncrementalPitchTracking (true, blocksize, 64);
+    harmonizer.initialize (4, samplerate, blocksize);
+    harmonizer.updatePitchDetectionHzRange (80, 2400);
+    harmonizer.prepare (blocksize);
+    
+    juce::AudioBuffer<float> input (1, blocksize), output (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    auto inputAt = [] (juce::int64 sample) { return std::sin (juce::MathConstants<double>::twoPi * frequency * double(sample) / samplerate); };
+    
+    for (int b = 0; b < 60; ++b)
+    {
+        for (int s = 0; s < blocksize; ++s)
+            input.setSample (0, s, static_cast<float> (inputAt (b * blocksize + s)));
+        
+        harmonizer.render (input, output, midi);
+        
+        if (b < 20)
+            continue;
+        
+        REQUIRE (harmonizer.getCurrentPeriod() == 147);
+        
+        // the analysis ring's positions count the input's samples, so each grain's centre can be checked against the sine
+        for (int marker : { 0, blocksize / 2, blocksize - 1 })
+        {
+            const auto* grain = harmonizer.findClosestGrain (marker);
+            
+            REQUIRE (grain != nullptr);
+            REQUIRE (grain->getSize() == 2 * 147);
+            REQUIRE (std::abs (inputAt (grain->getStartSample() + grain->getSize() / 2)) > 0.9);
+        }
+    }
+}
+
+
+
+TEST_CASE ("Voices above the active ceiling are never given notes", "[Harmonizer]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    
+    bav::Harmonizer<float> harmonizer;
+    harmonizer.initialize (8, samplerate, blocksize);
+    harmonizer.updatePitchDetectionHzRange (testMinHz, testMaxHz);
+    harmonizer.prepare (blocksize);
+    
+    harmonizer.setActiveVoiceCeiling (3);
+    REQUIRE (harmonizer.getActiveVoiceCeiling() == 3);
+    
+    juce::AudioBuffer<float> input (1, blocksize), output (2, blocksize);
+    juce::MidiBuffer midi;
+    juce::Array<int> activeNotes;
+    
+    for (int s = 0; s < blocksize; ++s)
+        input.setSample (0, s, static_cast<float> (std::sin (juce::MathConstants<double>::twoPi * 440.0 * s / samplerate)));
+    
+    harmonizer.playChord ({ 55, 60, 64, 67, 71, 74 }, 1.0f, false);
+    harmonizer.render (input, output, midi);
+    
+    harmonizer.reportActiveNotes (activeNotes);
+    REQUIRE (activeNotes.size() <= 3);
+    
+    // raising the ceiling again doesn't need any new voices
+    harmonizer.setActiveVoiceCeiling (8);
+    harmonizer.playChord ({ 55, 60, 64, 67, 71, 74 }, 1.0f, false);
+    harmonizer.render (input, output, midi);
+    
+    harmonizer.reportActiveNotes (activeNotes);
+    REQUIRE (activeNotes.size() == 6);
+}
+
+
+
+namespace
+{
+    struct PoolJobCounts
+    {
+        bav::RenderThreadPool* pool;
+        std::atomic<int> counts[8];
+    };
+    
+    void countPoolJob (void* context, int jobIndex)
+    {
+        static_cast<PoolJobCounts*> (context)->counts[jobIndex].fetch_add (1);
+    }
+    
+    // each job runs a batch of its own, as an engine's singer jobs do
+    void runNestedPoolBatch (void* context, int jobIndex)
+    {
+        auto* outer = static_cast<PoolJobCounts*> (context);
+        
+        PoolJobCounts inner { outer->pool, {} };
+        outer->pool->run (8, countPoolJob, &inner);
+        
+        for (auto& count : inner.counts)
+            if (count.load() == 1)
+                outer->counts[jobIndex].fetch_add (1);
+    }
+}
+
+
+TEST_CASE ("The render pool runs nested batches, and batches from several threads at once", "[Harmonizer]")
+{
+    juce::SharedResourcePointer<bav::RenderThreadPool> pool;
+    
+    for (int rep = 0; rep < 50; ++rep)
+    {
+        PoolJobCounts first { pool.get(), {} }, second { pool.get(), {} };
+        
+        std::thread other ([&second] { second.pool->run (8, runNestedPoolBatch, &second); });
+        pool->run (8, runNestedPoolBatch, &first);
+        other.join();
+        
+        // every job ran exactly once, & so did every job of each of its nested batches
+        for (int i = 0; i < 8; ++i)
+        {
+            REQUIRE (first.counts[i].load() == 8);
+            REQUIRE (second.counts[i].load() == 8);
+        }
+    }
+}
@@ -0,0 +1,561 @@
+#include "catch2/catch.hpp"
+
+#include "bv_ImogenEngine/bv_ImogenEngine.h"
+
+
+// prepares an engine with every optional effect switched off, so that the benchmarks measure the gain & mix stages around the harmonizer
+template<typename SampleType, typename HarmonySampleType>
+static void prepareTestEngine (bav::ImogenEngine<SampleType, HarmonySampleType>& engine, double samplerate, int blocksize)
+{
+    engine.initialize (samplerate, blocksize);
+    engine.prepare (samplerate);
+    
+    engine.updateBypassStates (false, false);
+    engine.updateInputGain (1.0f);
+    engine.updateOutputGain (1.0f);
+    engine.updateDryVoxPan (64);
+    engine.updateDryWet (50);
+    engine.updateNoiseGate (-40.0f, false);
+    engine.updateDeEsser (0.5f, -20.0f, false);
+    engine.updateCompressor (-20.0f, 2.0f, false);
+    engine.updateReverb (35, 0.6f, 0.3f, 80.0f, 5500.0f, false);
+    engine.updateLimiter (false);
+    engine.playChord ({ 60, 64, 67 }, 1.0f, false);
+}
+
+
+TEST_CASE ("An automation ramp steps from the last queued value to the new one across the block", "[ImogenEngine]")
+{
+    constexpr int blocksize = 512;
+    constexpr int minSubBlock = 64;
+    constexpr double samplerate = 44100.0;
+    
+    using Engine = bav::ImogenEngine<float>;
+    
+    // one engine is handed the ramp, and the other the events it should be made of
+    Engine ramped, stepped;
+    
+    for (auto* engine : { &ramped, &stepped })
+    {
+        prepareTestEngine (*engine, samplerate, blocksize);
+        engine->setMinimumAutomationSubBlock (minSubBlock);
+    }
+    
+    juce::AudioBuffer<float> input (2, blocksize), rampedOut (2, blocksize), steppedOut (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    for (int s = 0; s < blocksize; ++s)
+        for (int chan = 0; chan < 2; ++chan)
+            input.setSample (chan, s, static_cast<float> (0.5 * std::sin (juce::MathConstants<double>::twoPi * 220.0 * s / samplerate)));
+    
+    for (int b = 0; b < 8; ++b)
+    {
+        if (b == 0)
+        {
+            // the first value has nothing to ramp from
+            ramped.queueAutomationRamp (Engine::automatedOutputGain, 1.0f, blocksize);
+            stepped.queueAutomationEvent ({ 0, Engine::automatedOutputGain, 1.0f });
+        }
+        else if (b == 4)
+        {
+            ramped.queueAutomationRamp (Engine::automatedOutputGain, 0.25f, blocksize);
+            
+            constexpr int numSteps = blocksize / minSubBlock;
+            
+            for (int step = 1; step <= numSteps; ++step)
+                stepped.queueAutomationEvent ({ (step - 1) * minSubBlock, Engine::automatedOutputGain, 1.0f - 0.75f * float(step) / float(numSteps) });
+        }
+        
+        ramped.process (input, rampedOut, midi, false);
+        stepped.process (input, steppedOut, midi, false);
+        
+        for (int chan = 0; chan < 2; ++chan)
+            for (int s = 0; s < blocksize; ++s)
+                REQUIRE (rampedOut.getSample (chan, s) == Approx (steppedOut.getSample (chan, s)).margin (1.0e-6));
+    }
+}
+
+
+
+TEST_CASE ("A value set off the audio thread replaces any queued events, and starts the next ramp", "[ImogenEngine]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    
+    using Engine = bav::ImogenEngine<float>;
+    
+    Engine set, queued;
+    
+    for (auto* engine : { &set, &queued })
+        prepareTestEngine (*engine, samplerate, blocksize);
+    
+    juce::AudioBuffer<float> input (2, blocksize), setOut (2, blocksize), queuedOut (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    for (int s = 0; s < blocksize; ++s)
+        for (int chan = 0; chan < 2; ++chan)
+            input.setSample (chan, s, static_cast<float> (0.5 * std::sin (juce::MathConstants<double>::twoPi * 220.0 * s / samplerate)));
+    
+    for (int b = 0; b < 8; ++b)
+    {
+        if (b == 0)
+        {
+            set.queueAutomationEvent ({ blocksize / 2, Engine::automatedOutputGain, 0.1f });
+            set.setAutomatedParameter (Engine::automatedOutputGain, 1.0f);
+            
+            queued.queueAutomationEvent ({ 0, Engine::automatedOutputGain, 1.0f });
+        }
+        else if (b == 4)
+        {
+            for (auto* engine : { &set, &queued })
+                engine->queueAutomationRamp (Engine::automatedOutputGain, 0.25f, blocksize);
+        }
+        
+        set.process (input, setOut, midi, false);
+        queued.process (input, queuedOut, midi, false);
+        
+        for (int chan = 0; chan < 2; ++chan)
+            for (int s = 0; s < blocksize; ++s)
+                REQUIRE (setOut.getSample (chan, s) == Approx (queuedOut.getSample (chan, s)).margin (1.0e-6));
+    }
+}
+
+
+
+TEST_CASE ("The shared dynamics detector follows each stage's gain curve", "[ImogenEngine]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    
+    juce::AudioBuffer<float> signal (1, blocksize);
+    
+    // fills the buffer with a sine of the given frequency & amplitude, runs it through the dynamics a few times to settle the envelopes, and returns the peak of the last block
+    auto getSettledPeak = [&] (bav::VocalDynamics<float>& dynamics, double frequency, float amplitude)
+    {
+        double phase = 0.0;
+        
+        for (int b = 0; b < 64; ++b)
+        {
+            for (int s = 0; s < blocksize; ++s)
+            {
+                signal.setSample (0, s, amplitude * static_cast<float> (std::sin (phase)));
+                phase += juce::MathConstants<double>::twoPi * frequency / samplerate;
+            }
+            
+            dynamics.process (signal.getWritePointer (0), blocksize);
+        }
+        
+        return signal.getMagnitude (0, 0, blocksize);
+    };
+    
+    bav::VocalDynamics<float> dynamics;
+    dynamics.prepare (samplerate, blocksize);
+    
+    SECTION ("Compressor")
+    {
+        // 0.5 is about -6 dB, so 14 dB above the threshold comes out 3.5 dB above it
+        dynamics.setCompressor (-20.0f, 4.0f, true);
+        REQUIRE (getSettledPeak (dynamics, 440.0, 0.5f) == Approx (juce::Decibels::decibelsToGain (-16.5f)).epsilon (0.1));
+    }
+    
+    SECTION ("Noise gate")
+    {
+        dynamics.setGate (-40.0f, true);
+        REQUIRE (getSettledPeak (dynamics, 440.0, 0.5f) == Approx (0.5f).epsilon (0.01));
+        REQUIRE (getSettledPeak (dynamics, 440.0, 0.001f) < 1.0e-5f);
+    }
+    
+    SECTION ("De-esser")
+    {
+        dynamics.setDeEsser (1.0f, -30.0f, true);
+        REQUIRE (getSettledPeak (dynamics, 200.0, 0.5f) == Approx (0.5f).epsilon (0.01));
+        REQUIRE (getSettledPeak (dynamics, 9000.0, 0.5f) < 0.4f);
+    }
+}
+
+
+
+TEST_CASE ("The FDN reverb's tail decays, and it sleeps once the tail is gone", "[ImogenEngine]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    
+    bav::FDNReverb<double> reverb;
+    reverb.prepare (samplerate);
+    reverb.setDryWet (100);
+    reverb.setDecay (0.3f);
+    
+    juce::AudioBuffer<double> buffer (2, blocksize);
+    buffer.clear();
+    buffer.setSample (0, 0, 1.0);
+    buffer.setSample (1, 0, 1.0);
+    
+    reverb.process (buffer);
+    REQUIRE (! reverb.isAsleep());
+    
+    double lastEnergy = std::numeric_limits<double>::max();
+    int numBlocks = 0;
+    
+    // about 6 seconds -- far longer than the tail at this decay setting
+    for (; numBlocks < 500 && ! reverb.isAsleep(); ++numBlocks)
+    {
+        buffer.clear();
+        reverb.process (buffer);
+        
+        // measured over a few blocks at a time, as the tail fluctuates from one block to the next
+        if (numBlocks % 16 == 15)
+        {
+            const auto energy = buffer.getRMSLevel (0, 0, blocksize) + buffer.getRMSLevel (1, 0, blocksize);
+            REQUIRE (energy < lastEnergy);
+            lastEnergy = energy;
+        }
+    }
+    
+    REQUIRE (reverb.isAsleep());
+    REQUIRE (numBlocks < 500);
+    
+    SECTION ("With the wet level at zero, the input passes through untouched")
+    {
+        reverb.setDryWet (0);
+        reverb.reset();
+        
+        for (int s = 0; s < blocksize; ++s)
+        {
+            buffer.setSample (0, s, std::sin (s * 0.1));
+            buffer.setSample (1, s, std::cos (s * 0.1));
+        }
+        
+        reverb.process (buffer);
+        
+        REQUIRE (reverb.isAsleep());
+        
+        for (int s = 0; s < blocksize; ++s)
+        {
+            REQUIRE (buffer.getSample (0, s) == std::sin (s * 0.1));
+            REQUIRE (buffer.getSample (1, s) == std::cos (s * 0.1));
+        }
+    }
+}
+
+
+
+TEST_CASE ("A silent engine with no notes sounding goes idle, and wakes up again", "[ImogenEngine]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    
+    bav::ImogenEngine<float> engine;
+    prepareTestEngine (engine, samplerate, blocksize);
+    engine.updateReverb (35, 0.3f, 0.3f, 80.0f, 5500.0f, true);
+    engine.killAllMidi();
+    
+    juce::AudioBuffer<float> input (2, blocksize), output (2, blocksize);
+    juce::MidiBuffer midi;
+    input.clear();
+    
+    // long enough for the reverb's tail to die away
+    for (int b = 0; b < 400 && ! engine.isIdle(); ++b)
+        engine.process (input, output, midi, false);
+    
+    REQUIRE (engine.isIdle());
+    
+    engine.process (input, output, midi, false);
+    REQUIRE (output.getMagnitude (0, blocksize) == 0.0f);
+    
+    SECTION ("Singing wakes it up")
+    {
+        for (int s = 0; s < blocksize; ++s)
+            for (int chan = 0; chan < 2; ++chan)
+                input.setSample (chan, s, 0.5f * static_cast<float> (std::sin (juce::MathConstants<double>::twoPi * 220.0 * s / samplerate)));
+        
+        engine.process (input, output, midi, false);
+        REQUIRE (! engine.isIdle());
+    }
+    
+    SECTION ("A note wakes it up")
+    {
+        engine.playChord ({ 60 }, 1.0f, false);
+        engine.process (input, output, midi, false);
+        REQUIRE (! engine.isIdle());
+    }
+}
+
+
+
+TEST_CASE ("Mixed precision output stays close to double precision", "[ImogenEngine]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    
+    bav::ImogenEngine<double> doubleEngine;
+    bav::ImogenEngine<double, float> mixedEngine;
+    
+    prepareTestEngine (doubleEngine, samplerate, blocksize);
+    prepareTestEngine (mixedEngine, samplerate, blocksize);
+    
+    juce::AudioBuffer<double> input (2, blocksize), doubleOut (2, blocksize), mixedOut (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    const auto phaseIncrement = juce::MathConstants<double>::twoPi * 220.0 / samplerate;
+    double phase = 0.0;
+    
+    for (int b = 0; b < 32; ++b)
+    {
+        for (int s = 0; s < blocksize; ++s)
+        {
+            for (int chan = 0; chan < 2; ++chan)
+                input.setSample (chan, s, 0.5 * std::sin (phase));
+            
+            phase += phaseIncrement;
+        }
+        
+        doubleEngine.process (input, doubleOut, midi, false);
+        mixedEngine.process (input, mixedOut, midi, false);
+        
+        for (int chan = 0; chan < 2; ++chan)
+            for (int s = 0; s < blocksize; ++s)
+                REQUIRE (mixedOut.getSample (chan, s) == Approx (doubleOut.getSample (chan, s)).margin (1.0e-3));
+    }
+}
+
+
+
+TEST_CASE ("The harmonizer follows the selected input channel", "[ImogenEngine]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    
+    // the same voice, sung into the left channel, the right channel & both channels, with the input source set to match
+    bav::ImogenEngine<float> leftChannel, rightChannel, mixed, silent;
+    
+    for (auto* engine : { &leftChannel, &rightChannel, &mixed, &silent })
+        prepareTestEngine (*engine, samplerate, blocksize);
+    
+    rightChannel.setModulatorSource (2);
+    mixed.setModulatorSource (3);
+    
+    juce::AudioBuffer<float> leftInput (2, blocksize), rightInput (2, blocksize), bothInput (2, blocksize), silentInput (2, blocksize);
+    juce::AudioBuffer<float> leftOut (2, blocksize), rightOut (2, blocksize), mixedOut (2, blocksize), silentOut (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    leftInput.clear();
+    rightInput.clear();
+    silentInput.clear();
+    
+    const auto phaseIncrement = juce::MathConstants<double>::twoPi * 220.0 / samplerate;
+    double phase = 0.0;
+    bool heardHarmonies = false;
+    
+    for (int b = 0; b < 32; ++b)
+    {
+        for (int s = 0; s < blocksize; ++s)
+        {
+            const auto sample = static_cast<float> (0.5 * std::sin (phase));
+            leftInput.setSample (0, s, sample);
+            rightInput.setSample (1, s, sample);
+            bothInput.setSample (0, s, sample);
+            bothInput.setSample (1, s, sample);
+            phase += phaseIncrement;
+        }
+        
+        leftChannel.process (leftInput, leftOut, midi, false);
+        rightChannel.process (rightInput, rightOut, midi, false);
+        mixed.process (bothInput, mixedOut, midi, false);
+        silent.process (silentInput, silentOut, midi, false);
+        
+        for (int chan = 0; chan < 2; ++chan)
+        {
+            for (int s = 0; s < blocksize; ++s)
+            {
+                REQUIRE (rightOut.getSample (chan, s) == Approx (leftOut.getSample (chan, s)).margin (1.0e-5));
+                REQUIRE (mixedOut.getSample (chan, s) == Approx (leftOut.getSample (chan, s)).margin (1.0e-5));
+            }
+            
+            // with nothing sung, there's nothing to harmonize
+            REQUIRE (silentOut.getMagnitude (chan, 0, blocksize) < 1.0e-5f);
+        }
+        
+        if (leftOut.getMagnitude (0, blocksize) > 0.01f)
+            heardHarmonies = true;
+    }
+    
+    REQUIRE (heardHarmonies);
+}
+
+
+
+TEST_CASE ("Each singer is harmonized from its own input channel", "[ImogenEngine]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    
+    // the same voice, sung into the first channel of one engine and into the second channel of the other
+    bav::ImogenEngine<float> firstChannel, secondChannel;
+    
+    for (auto* engine : { &firstChannel, &secondChannel })
+    {
+        engine->setNumSingers (2);
+        prepareTestEngine (*engine, samplerate, blocksize);
+        
+        REQUIRE (engine->getNumSingers() == 2);
+    }
+    
+    bav::ImogenEngine<float> singleSinger;
+    prepareTestEngine (singleSinger, samplerate, blocksize);
+    
+    REQUIRE (firstChannel.reportLatency() == singleSinger.reportLatency());
+    
+    juce::AudioBuffer<float> firstInput (2, blocksize), secondInput (2, blocksize), firstOut (2, blocksize), secondOut (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    firstInput.clear();
+    secondInput.clear();
+    
+    const auto phaseIncrement = juce::MathConstants<double>::twoPi * 220.0 / samplerate;
+    double phase = 0.0;
+    bool heardHarmonies = false;
+    
+    for (int b = 0; b < 32; ++b)
+    {
+        for (int s = 0; s < blocksize; ++s)
+        {
+            const auto sample = static_cast<float> (0.5 * std::sin (phase));
+            firstInput.setSample (0, s, sample);
+            secondInput.setSample (1, s, sample);
+            phase += phaseIncrement;
+        }
+        
+        firstChannel.process (firstInput, firstOut, midi, false);
+        secondChannel.process (secondInput, secondOut, midi, false);
+        
+        for (int chan = 0; chan < 2; ++chan)
+            for (int s = 0; s < blocksize; ++s)
+                REQUIRE (secondOut.getSample (chan, s) == Approx (firstOut.getSample (chan, s)).margin (1.0e-5));
+        
+        if (firstOut.getMagnitude (0, blocksize) > 0.01f)
+            heardHarmonies = true;
+    }
+    
+    REQUIRE (heardHarmonies);
+}
+
+
+
+TEST_CASE ("Each internal block's stage timings reach the telemetry ring", "[ImogenEngine]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    constexpr int numBlocks = 8;
+    
+    bav::StageTelemetry telemetry;
+    
+    bav::ImogenEngine<float> engine;
+    prepareTestEngine (engine, samplerate, blocksize);
+    engine.setStageTelemetry (&telemetry);
+    
+    juce::AudioBuffer<float> input (2, blocksize), output (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    for (int b = 0; b < numBlocks; ++b)
+        engine.process (input, output, midi, false);
+    
+    int numRecords = 0;
+    
+    telemetry.readAll ([&numRecords] (const bav::StageTimings& block)
+                       {
+                           ++numRecords;
+                           REQUIRE (block.numSamples == blocksize);
+                           
+#if BV_HARMONIZER_STAGE_TIMING
+                           juce::uint64 stagesTotal = 0;
+                           
+                           for (int stage = 0; stage < bav::wholeBlockStage; ++stage)
+                               stagesTotal += block[static_cast<bav::RenderStage> (stage)];
+                           
+                           REQUIRE (block[bav::voiceRenderingStage] > 0);
+                           REQUIRE (block[bav::wholeBlockStage] >= stagesTotal);  // with one singer, every stage runs inside the block's own time
+#endif
+                       });
+    
+    REQUIRE (numRecords > 0);
+    REQUIRE (numRecords <= numBlocks);
+    
+    // everything was drained
+    telemetry.readAll ([&numRecords] (const bav::StageTimings&) { ++numRecords; });
+    REQUIRE (numRecords <= numBlocks);
+}
+
+
+
+TEST_CASE ("A recorded trace holds every block, with its stages & voices nested inside it", "[ImogenEngine]")
+{
+    constexpr int blocksize = 512;
+    constexpr double samplerate = 44100.0;
+    constexpr int numBlocks = 8;
+    
+    const auto traceFile = juce::File::createTempFile ("json");
+    
+    bav::TraceRecorder recorder;
+    
+    bav::ImogenEngine<float> engine;
+    prepareTestEngine (engine, samplerate, blocksize);
+    engine.setTraceRecorder (&recorder);
+    
+    juce::AudioBuffer<float> input (2, blocksize), output (2, blocksize);
+    juce::MidiBuffer midi;
+    
+    for (int s = 0; s < blocksize; ++s)
+        for (int chan = 0; chan < 2; ++chan)
+            input.setSample (chan, s, static_cast<float> (0.5 * std::sin (juce::MathConstants<double>::twoPi * 220.0 * s / samplerate)));
+    
+    REQUIRE (recorder.start (traceFile));
+    
+    for (int b = 0; b < numBlocks; ++b)
+    {
+        engine.queueAutomationEvent ({ blocksize / 2, bav::ImogenEngine<float>::automatedOutputGain, 0.5f });
+        engine.process (input, output, midi, false);
+    }
+    
+    recorder.stop();
+    
+    const auto trace = juce::JSON::parse (traceFile);
+    const auto* events = trace["traceEvents"].getArray();
+    
+    REQUIRE (events != nullptr);
+    
+    int numBlockEvents = 0, numVoiceEvents = 0, numAutomationEvents = 0;
+    
+    for (const auto& event : *events)
+    {
+        const auto name = event["name"].toString();
+        
+        if (name == "Block")
+        {
+            ++numBlockEvents;
+            REQUIRE (event["ph"].toString() == "X");
+            REQUIRE (static_cast<int> (event["args"]["index"]) == blocksize);
+        }
+        else if (name == "Voice")
+        {
+            ++numVoiceEvents;
+        }
+        else if (name == "Automation")
+        {
+            ++numAutomationEvents;
+        }
+        
+        REQUIRE (name != "Dropped events");
+    }
+    
+    REQUIRE (numBlockEvents > 0);
+    REQUIRE (numBlockEvents <= numBlocks);
+    REQUIRE (numVoiceEvents >= numBlockEvents);  // the chord has three notes
+    REQUIRE (numAutomationEvents > 0);
+    
+    // nothing is recorded once the recorder has stopped
+    const auto sizeWhenStopped = traceFile.getSize();
+    engine.process (input, output, midi, false);
+    REQUIRE (traceFile.getSize() == sizeWhenStopped);
+    
+    traceFile.deleteFile();
+}
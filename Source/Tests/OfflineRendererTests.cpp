@@ -0,0 +1,81 @@
+
+#include "catch2/catch.hpp"
+
+#include "Source/OfflineRenderer/OfflineRenderer.h"
+
+
+TEST_CASE ("The offline renderer keeps the requested internal blocksize", "[OfflineRenderer]")
+{
+    constexpr double samplerate = 44100.0;
+    constexpr int numSamples = 22050;
+    
+    const auto vocalFile = juce::File::createTempFile ("wav");
+    const auto midiFile  = juce::File::createTempFile ("mid");
+    
+    // half a second of a sung A3...
+    {
+        juce::AudioBuffer<float> vocal (1, numSamples);
+        
+        for (int s = 0; s < numSamples; ++s)
+            vocal.setSample (0, s, static_cast<float> (0.5 * std::sin (juce::MathConstants<double>::twoPi * 220.0 * s / samplerate)));
+        
+        auto stream = std::make_unique<juce::FileOutputStream> (vocalFile);
+        std::unique_ptr<juce::AudioFormatWriter> writer (juce::WavAudioFormat().createWriterFor (stream.get(), samplerate, 1, 24, {}, 0));
+        
+        REQUIRE (writer != nullptr);
+        stream.release();  // now owned by the writer
+        
+        REQUIRE (writer->writeFromAudioSampleBuffer (vocal, 0, numSamples));
+    }
+    
+    // ...harmonized with one note that lasts a quarter of a second, at the default 120 bpm
+    {
+        juce::MidiMessageSequence track;
+        track.addEvent (juce::MidiMessage::noteOn (1, 64, 1.0f), 0.0);
+        track.addEvent (juce::MidiMessage::noteOff (1, 64), 480.0);
+        
+        juce::MidiFile midi;
+        midi.setTicksPerQuarterNote (960);
+        midi.addTrack (track);
+        
+        juce::FileOutputStream stream (midiFile);
+        REQUIRE (midi.writeTo (stream));
+    }
+    
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    
+    juce::Array<juce::int64> outputLengths;
+    
+    for (int blocksize : { 512, 1024 })
+    {
+        ImogenOfflineRenderer renderer (blocksize);
+        
+        bav::ImogenEngine<float> engine;
+        renderer.prepareEngine (engine, samplerate);
+        
+        REQUIRE (engine.getLatency() == blocksize);
+        REQUIRE (engine.reportLatency() == blocksize);
+        
+        const auto outputFile = juce::File::createTempFile ("wav");
+        
+        REQUIRE (renderer.render ({ vocalFile, midiFile, outputFile }).isEmpty());
+        
+        {
+            std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (outputFile));
+            
+            REQUIRE (reader != nullptr);
+            REQUIRE (reader->lengthInSamples > numSamples);  // the release tail runs on past the end of the input
+            
+            outputLengths.add (reader->lengthInSamples);
+        }
+        
+        outputFile.deleteFile();
+    }
+    
+    // the latency is trimmed from the start of the output, so however long it is, the output is the same length
+    REQUIRE (outputLengths.getFirst() == outputLengths.getLast());
+    
+    vocalFile.deleteFile();
+    midiFile.deleteFile();
+}
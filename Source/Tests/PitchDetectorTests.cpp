@@ -0,0 +1,180 @@
+
+#include "catch2/catch.hpp"
+
+#include "bv_Harmonizer/bv_Harmonizer.h"
+
+
+// fills the buffer with a steady tone with a few harmonics
+static void fillWithHarmonicTone (juce::AudioBuffer<float>& buffer, double frequency, double samplerate)
+{
+    const auto phaseIncrement = juce::MathConstants<double>::twoPi * frequency / samplerate;
+    
+    for (int s = 0; s < buffer.getNumSamples(); ++s)
+    {
+        const auto phase = phaseIncrement * s;
+        buffer.setSample (0, s, static_cast<float> (0.6 * std::sin (phase) + 0.3 * std::sin (2.0 * phase) + 0.1 * std::sin (3.0 * phase)));
+    }
+}
+
+
+// the MIDI note ranges of the processor's soprano, alto, tenor & bass vocal range presets
+static const std::vector<std::pair<int, int>> vocalRangeNotes { { 57, 88 }, { 50, 81 }, { 43, 76 }, { 36, 67 } };
+
+
+TEST_CASE ("FFT pitch detector finds the pitch of a harmonic tone", "[PitchDetector]")
+{
+    constexpr double samplerate = 44100.0;
+    
+    bav::FFTPitchDetector<float> detector;
+    detector.setHzRange (80, 2400);
+    detector.setSamplerate (samplerate);
+    detector.setConfidenceThresh (0.15f);
+    
+    juce::AudioBuffer<float> frame (1, detector.getLatencySamples());
+    
+    for (double frequency : { 82.4, 110.0, 196.0, 261.6, 440.0, 880.0, 1760.0 })
+    {
+        fillWithHarmonicTone (frame, frequency, samplerate);
+        REQUIRE (detector.detectPitch (frame) == Approx (frequency).epsilon (0.01));
+    }
+    
+    SECTION ("Silence is unpitched")
+    {
+        frame.clear();
+        REQUIRE (detector.detectPitch (frame) == 0.0f);
+    }
+    
+    SECTION ("Noise is unpitched")
+    {
+        juce::Random random (42);
+        
+        for (int s = 0; s < frame.getNumSamples(); ++s)
+            frame.setSample (0, s, random.nextFloat() * 2.0f - 1.0f);
+        
+        REQUIRE (detector.detectPitch (frame) == 0.0f);
+    }
+}
+
+
+TEST_CASE ("FFT pitch detector decimates at high samplerates", "[PitchDetector]")
+{
+    for (double samplerate : { 96000.0, 192000.0 })
+    {
+        bav::FFTPitchDetector<float> detector;
+        detector.setHzRange (80, 2400);
+        detector.setSamplerate (samplerate);
+        
+        REQUIRE (detector.getDecimationFactor() > 1);
+        
+        juce::AudioBuffer<float> frame (1, detector.getLatencySamples());
+        
+        for (double frequency : { 82.4, 110.0, 261.6, 440.0, 1760.0 })
+        {
+            fillWithHarmonicTone (frame, frequency, samplerate);
+            REQUIRE (detector.detectPitch (frame) == Approx (frequency).epsilon (0.01));
+        }
+        
+        detector.setAllowDecimation (false);
+        REQUIRE (detector.getDecimationFactor() == 1);
+    }
+    
+    bav::FFTPitchDetector<float> detector;
+    detector.setHzRange (80, 2400);
+    detector.setSamplerate (44100.0);
+    
+    REQUIRE (detector.getDecimationFactor() == 1);
+}
+
+
+TEST_CASE ("Sliding pitch tracker estimates every hop", "[PitchDetector]")
+{
+    constexpr double samplerate = 44100.0;
+    constexpr int hopSize = 64;
+    
+    juce::AudioBuffer<float> input (1, juce::roundToInt (samplerate));
+    fillWithHarmonicTone (input, 220.0, samplerate);
+    
+    // the estimates land on the same samples, with the same values, however the input is split up
+    for (int blocksize : { 64, 300, 1024 })
+    {
+        bav::SlidingPitchTracker<float> tracker;
+        tracker.setHzRange (80, 2400);
+        tracker.setSamplerate (samplerate);
+        tracker.setHopSize (hopSize);
+        
+        juce::Array<bav::SlidingPitchTracker<float>::Estimate> estimates;
+        estimates.ensureStorageAllocated (blocksize / hopSize + 1);
+        
+        int numEstimates = 0;
+        
+        for (int start = 0; start + blocksize <= input.getNumSamples(); start += blocksize)
+        {
+            tracker.process (input.getReadPointer (0, start), blocksize, estimates);
+            
+            for (const auto& estimate : estimates)
+            {
+                ++numEstimates;
+                REQUIRE ((start + estimate.sampleOffset) % hopSize == 0);
+                
+                // once the window is full of the tone, every estimate should be right
+                if (start + estimate.sampleOffset > 2 * tracker.getPeriodRange().getEnd())
+                    REQUIRE (estimate.frequency == Approx (220.0).epsilon (0.01));
+            }
+        }
+        
+        REQUIRE (numEstimates == (input.getNumSamples() / blocksize) * blocksize / hopSize);
+    }
+    
+    SECTION ("Silence is unpitched")
+    {
+        bav::SlidingPitchTracker<float> tracker;
+        tracker.setSamplerate (samplerate);
+        
+        juce::Array<bav::SlidingPitchTracker<float>::Estimate> estimates;
+        
+        tracker.process (input.getReadPointer (0), input.getNumSamples(), estimates);
+        REQUIRE (tracker.getLatestFrequency() > 0.0f);
+        
+        input.clear();
+        tracker.process (input.getReadPointer (0), input.getNumSamples(), estimates);
+        REQUIRE (tracker.getLatestFrequency() == 0.0f);
+    }
+}
+
+
+TEST_CASE ("Sliding pitch tracker follows a change of pitch at high samplerates", "[PitchDetector]")
+{
+    constexpr double samplerate = 192000.0;
+    constexpr int blocksize = 512;
+    
+    bav::SlidingPitchTracker<float> tracker;
+    tracker.setHzRange (80, 2400);
+    tracker.setSamplerate (samplerate);
+    
+    REQUIRE (tracker.getDecimationFactor() > 1);
+    
+    juce::AudioBuffer<float> block (1, blocksize);
+    juce::Array<bav::SlidingPitchTracker<float>::Estimate> estimates;
+    estimates.ensureStorageAllocated (blocksize / tracker.getHopSize() + 1);
+    
+    const auto samplesPerNote = juce::roundToInt (samplerate * 0.25);
+    double phase = 0.0;
+    
+    for (double frequency : { 196.0, 293.7 })
+    {
+        const auto phaseIncrement = juce::MathConstants<double>::twoPi * frequency / samplerate;
+        
+        for (int start = 0; start < samplesPerNote; start += blocksize)
+        {
+            for (int s = 0; s < blocksize; ++s)
+            {
+                block.setSample (0, s, static_cast<float> (0.6 * std::sin (phase) + 0.3 * std::sin (2.0 * phase)));
+                phase += phaseIncrement;
+            }
+            
+            tracker.process (block.getReadPointer (0), blocksize, estimates);
+        }
+        
+        REQUIRE (tracker.getLatestFrequency() == Approx (frequency).epsilon (0.01));
+    }
+}
@@ -0,0 +1,58 @@
+#include "catch2/catch.hpp"
+
+#include "bv_Harmonizer/bv_Harmonizer.h"
+
+
+TEST_CASE ("Leased window tables are built straight away, shared between leases, and kept until the last lease is released", "[WindowTableCache]")
+{
+    using Cache = bav::WindowTableCache<float>;
+    
+    Cache cache;
+    
+    Cache::Lease first  (cache, Cache::hannWindows);
+    Cache::Lease second (cache, Cache::hannWindows);
+    
+    first.setLengths ({ 100, 200 });
+    
+    const auto* table = first.get (150);
+    
+    REQUIRE (table != nullptr);
+    REQUIRE (first.get (99)  == nullptr);
+    REQUIRE (first.get (200) == nullptr);
+    
+    // a Hann window of length n starts & ends at 0, and is symmetric about its middle
+    REQUIRE (table[0]   == Approx (0.0f).margin (1.0e-6));
+    REQUIRE (table[149] == Approx (0.0f).margin (1.0e-6));
+    
+    for (int i = 0; i < 150; ++i)
+        REQUIRE (table[i] == Approx (table[149 - i]).margin (1.0e-6));
+    
+    second.setLengths ({ 150, 300 });
+    
+    REQUIRE (second.get (150) == table);  // the table that's already there is shared, not rebuilt
+    REQUIRE (second.get (250) != nullptr);
+    
+    first.setLengths ({});
+    
+    REQUIRE (first.get (150) == nullptr);
+    REQUIRE (second.get (150) == table);  // still leased by the second lease
+    REQUIRE (second.get (120) == nullptr);
+    
+    // moving a range keeps the tables that are in both the old & new ranges
+    const auto* longTable = second.get (250);
+    
+    second.setLengths ({ 200, 400 });
+    
+    REQUIRE (second.get (250) == longTable);
+    REQUIRE (second.get (350) != nullptr);
+    REQUIRE (second.get (150) == nullptr);
+    
+    Cache::Lease weights (cache, Cache::distanceWeights);
+    weights.setLengths ({ 10, 11 });
+    
+    const auto* weightTable = weights.get (10);
+    
+    REQUIRE (weightTable != nullptr);
+    REQUIRE (weightTable[0]  == Approx (1.0f));
+    REQUIRE (weightTable[10] == Approx (0.5f));
+}
@@ -10,6 +10,11 @@
  
  [Harmonizer]
  [HarmonizerVoice]
+ [GrainExtractor]
+ [WindowTableCache]
+ [PitchDetector]
+ [ImogenEngine]
+ [OfflineRenderer]
 
  [MIDI]
  